@@ -0,0 +1,157 @@
+/*
+ * Copyright (c) 2022- Gerber Lóránt Viktor
+ * Author: Gerber Lóránt Viktor <glorantv@student.elte.hu>
+ *
+ * This file is part of s4pkg.
+ *
+ * s4pkg is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <s4pkg/internal/export.h>
+#include <s4pkg/lib/bytebuffer.h>
+#include <s4pkg/lib/string.h>
+#include <s4pkg/object.h>
+
+#include <cinttypes>
+#include <functional>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+
+namespace s4pkg {
+
+enum ResourceCacheKind : uint32_t { CACHED_RECORD = 0, CACHED_PIXELS };
+
+/**
+ * @brief Identifies cached data: who it belongs to (see
+ * ResourceCache::newOwnerId()), which of their resources, and what it is
+ */
+struct S4PKG_EXPORT ResourceCacheKey {
+    uint64_t m_owner;
+    uint64_t m_id;
+    ResourceCacheKind m_kind;
+
+    bool operator==(const ResourceCacheKey& other) const {
+        return m_owner == other.m_owner && m_id == other.m_id &&
+               m_kind == other.m_kind;
+    }
+};
+
+struct ResourceCacheKeyHash {
+    size_t operator()(const ResourceCacheKey& key) const {
+        return std::hash<uint64_t>()((key.m_owner * 0x9e3779b97f4a7c15) ^
+                                     (key.m_id << 1) ^ key.m_kind);
+    }
+};
+
+/**
+ * @brief Keeps decompressed records and decoded pixels in memory, up to a byte
+ * budget, evicting the least recently used first. Cached data is handed out
+ * as shared pointers, and an entry is pinned (never evicted) while any pointer
+ * to it is alive, so data in use stays valid and is counted in the budget.
+ * When pinned data alone exceeds the budget, the cache holds nothing else.
+ *
+ * Packages opened with a cache (see openPackage()) read records, and decode
+ * images, through it.
+ * All methods are thread-safe.
+ */
+class S4PKG_EXPORT ResourceCache : public Object {
+   private:
+    typedef struct cache_entry_t {
+        ResourceCacheKey m_key;
+        std::shared_ptr<const lib::ByteBuffer> m_data;
+    } cache_entry_t;
+
+    mutable std::mutex m_mutex;
+    size_t m_byteBudget;
+    size_t m_usedBytes;
+
+    // Most recently used first
+    std::list<cache_entry_t> m_entries;
+    std::unordered_map<ResourceCacheKey,
+                       std::list<cache_entry_t>::iterator,
+                       ResourceCacheKeyHash>
+        m_index;
+
+    uint64_t m_hitCount;
+    uint64_t m_missCount;
+    uint64_t m_evictionCount;
+
+    void evictLocked();
+
+   public:
+    explicit ResourceCache(size_t byteBudget = 256 * 1024 * 1024);
+
+    /**
+     * @return an owner id never returned before, for keys of a new package or
+     * resource
+     */
+    static uint64_t newOwnerId();
+
+    /**
+     * @brief Looks up data, and marks it as used
+     * @return nullptr on a miss
+     */
+    std::shared_ptr<const lib::ByteBuffer> find(const ResourceCacheKey& key);
+
+    /**
+     * @brief Caches data, evicting other entries to make room. If the key is
+     * already cached, the cached data is kept and returned.
+     */
+    std::shared_ptr<const lib::ByteBuffer> insert(const ResourceCacheKey& key,
+                                                  lib::ByteBuffer data);
+
+    /**
+     * @brief Looks up data, and loads and caches it on a miss. The cache isn't
+     * locked while loading, so concurrent misses may load the same data.
+     * @throws whatever load throws
+     */
+    std::shared_ptr<const lib::ByteBuffer> getOrLoad(
+        const ResourceCacheKey& key,
+        const std::function<lib::ByteBuffer()>& load);
+
+    void erase(const ResourceCacheKey& key);
+
+    /**
+     * @brief Forgets everything cached for an owner, when it goes away
+     */
+    void eraseOwner(uint64_t owner);
+
+    /**
+     * @brief Changes the budget, evicting entries if it shrinks
+     */
+    void setByteBudget(size_t byteBudget);
+
+    const size_t getByteBudget() const;
+    const size_t getUsedBytes() const;
+
+    /**
+     * @brief Bytes of the entries in use, which can't be evicted
+     */
+    const size_t getPinnedBytes() const;
+    const size_t getEntryCount() const;
+
+    const uint64_t getHitCount() const;
+    const uint64_t getMissCount() const;
+    const uint64_t getEvictionCount() const;
+
+    // Object interface
+   public:
+    const lib::String toString() const override;
+};
+
+}  // namespace s4pkg
@@ -0,0 +1,134 @@
+/*
+ * Copyright (c) 2022- Gerber Lóránt Viktor
+ * Author: Gerber Lóránt Viktor <glorantv@student.elte.hu>
+ *
+ * This file is part of s4pkg.
+ *
+ * s4pkg is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <s4pkg/internal/export.h>
+#include <s4pkg/lib/bytebuffer.h>
+#include <s4pkg/lib/string.h>
+#include <s4pkg/object.h>
+
+#include <cinttypes>
+#include <optional>
+#include <string>
+
+namespace s4pkg {
+
+enum DecodedFormat : uint32_t { DECODED_RGBA = 0, DECODED_DXT1, DECODED_DXT5 };
+
+/**
+ * @brief A decoded image, as pixels or as compressed blocks
+ */
+struct S4PKG_EXPORT DecodedImage {
+    uint32_t m_width;
+    uint32_t m_height;
+    DecodedFormat m_format;
+    lib::ByteBuffer m_data;
+};
+
+/**
+ * @brief A cache of decoded images shared by every process of the host that
+ * opens it by the same name, so an image decoded by one process is reused by
+ * the others. Images are keyed by the hash of the record they were decoded
+ * from (see hashRecord()), so the same content is shared whatever package or
+ * key it came from.
+ *
+ * The cache is a named POSIX shared memory object holding a hash table and
+ * the image bytes, which are evicted least recently used first to stay within
+ * the byte budget. Lookups take no locks: a lookup racing with an eviction is
+ * detected, and reported as a miss. Inserts are serialised by a process-shared
+ * mutex, which survives the death of the process holding it.
+ *
+ * Shared memory is only used on Linux; elsewhere the cache is always empty.
+ */
+class S4PKG_EXPORT SharedDecodeCache : public Object {
+   private:
+    std::string m_name;
+    void* m_region;
+    size_t m_regionSize;
+
+    bool insertLocked(uint64_t key, const DecodedImage& image);
+
+   public:
+    /**
+     * @brief Opens the cache with this name, creating it if no process has
+     * yet. The budget and entry count only apply when creating it, whoever
+     * created it first decides.
+     * @param name: the name of the shared memory object
+     * @param byteBudget: bytes of images kept at most
+     * @param maxEntries: images kept at most
+     * @throws PackageException, if the shared memory can't be mapped, or holds
+     * something else
+     */
+    explicit SharedDecodeCache(const lib::String& name,
+                               size_t byteBudget = 256 * 1024 * 1024,
+                               uint32_t maxEntries = 16384);
+    ~SharedDecodeCache();
+
+    SharedDecodeCache(const SharedDecodeCache&) = delete;
+    SharedDecodeCache& operator=(const SharedDecodeCache&) = delete;
+
+    /**
+     * @brief Deletes the cache with this name. Processes which have it open
+     * keep using it, and the memory is freed when the last one closes it.
+     * @return false if there was no such cache
+     */
+    static bool remove(const lib::String& name);
+
+    /**
+     * @brief The key of the image decoded from a record: the hash of the
+     * record bytes, as stored or decompressed, as long as it's always the same
+     */
+    static uint64_t hashRecord(const lib::ByteBuffer& record);
+
+    /**
+     * @return false where shared memory isn't supported, and the cache is
+     * always empty
+     */
+    const bool isShared() const { return m_region != nullptr; }
+
+    /**
+     * @brief Copies an image out of the cache, and marks it as used
+     */
+    const std::optional<DecodedImage> find(uint64_t recordHash) const;
+
+    /**
+     * @brief Adds an image, evicting the least recently used ones if needed.
+     * Nothing happens if the image is already cached.
+     * @return false if the image is larger than the whole cache
+     */
+    bool insert(uint64_t recordHash, const DecodedImage& image);
+
+    const size_t getByteBudget() const;
+    const size_t getUsedBytes() const;
+    const uint32_t getEntryCount() const;
+
+    /**
+     * @brief Counted across every process using the cache
+     */
+    const uint64_t getHitCount() const;
+    const uint64_t getMissCount() const;
+
+    // Object interface
+   public:
+    const lib::String toString() const override;
+};
+
+}  // namespace s4pkg
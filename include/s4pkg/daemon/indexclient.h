@@ -0,0 +1,139 @@
+/*
+ * Copyright (c) 2022- Gerber Lóránt Viktor
+ * Author: Gerber Lóránt Viktor <glorantv@student.elte.hu>
+ *
+ * This file is part of s4pkg.
+ *
+ * s4pkg is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <s4pkg/daemon/indexprotocol.h>
+#include <s4pkg/internal/export.h>
+#include <s4pkg/lib/bytebuffer.h>
+#include <s4pkg/lib/string.h>
+#include <s4pkg/object.h>
+#include <s4pkg/package/enums.h>
+#include <s4pkg/package/indexentry.h>
+#include <s4pkg/package/resourcekey.h>
+
+#include <optional>
+#include <string>
+#include <vector>
+
+namespace s4pkg {
+
+/**
+ * @brief A copy of a resource in a package served by s4pkgd
+ */
+struct S4PKG_EXPORT IndexLocation {
+    uint32_t m_packageId;
+    uint32_t m_entry;
+    lib::String m_path;
+    uint32_t m_size;
+    uint32_t m_sizeDecompressed;
+    CompressionType m_compressionType;
+};
+
+struct S4PKG_EXPORT IndexLookupResult {
+    std::vector<IndexLocation> m_locations; /**< In load order */
+    size_t m_winner; /**< The copy the game uses, in m_locations */
+};
+
+struct S4PKG_EXPORT IndexPackageInfo {
+    uint32_t m_packageId;
+    lib::String m_path;
+    uint32_t m_resourceCount;
+    uint64_t m_fileSize;
+};
+
+struct S4PKG_EXPORT IndexRecord {
+    CompressionType m_compressionType; /**< UNCOMPRESSED if decompressed */
+    uint32_t m_sizeDecompressed;
+    lib::ByteBuffer m_data;
+};
+
+struct S4PKG_EXPORT IndexThumbnail {
+    uint32_t m_width;
+    uint32_t m_height;
+    lib::ByteBuffer m_pixelData; /**< RGBA, 4 bytes per pixel */
+};
+
+/**
+ * @brief A connection to s4pkgd, answering from the catalogue the daemon keeps
+ * in memory instead of scanning the library. Requests are blocking, and a
+ * client must only be used by one thread at a time.
+ */
+class S4PKG_EXPORT IndexClient : public Object {
+   private:
+    std::string m_socketPath;
+    int m_descriptor;
+
+    // Sends a request, and receives the payload of its response
+    IndexStatus request(IndexRequestType type,
+                        const std::string& payload,
+                        lib::ByteBuffer& response);
+
+   public:
+    /**
+     * @brief Connects to the daemon
+     * @throws PackageException, if nothing is listening at the socket
+     */
+    explicit IndexClient(const lib::String& socketPath);
+    ~IndexClient();
+
+    IndexClient(const IndexClient&) = delete;
+    IndexClient& operator=(const IndexClient&) = delete;
+
+    /**
+     * @brief Finds every copy of a resource
+     * @return no locations if the resource isn't in the library
+     * @throws PackageException, if the connection or the daemon fails
+     */
+    const IndexLookupResult lookup(const ResourceKey& key);
+
+    /**
+     * @return every package of the library, in load order
+     */
+    const std::vector<IndexPackageInfo> listPackages();
+
+    /**
+     * @return the index of a package, empty if there's no such package
+     */
+    const std::vector<IndexEntry> listResources(uint32_t packageId);
+
+    /**
+     * @brief Reads the copy of a resource the game would use. The daemon
+     * sends the record as stored in the package file.
+     * @param decompress: decompress the record here, or return it as stored
+     * @return nothing if the resource isn't in the library
+     */
+    const std::optional<IndexRecord> extract(const ResourceKey& key,
+                                             bool decompress = true);
+
+    /**
+     * @brief Decodes the image resource the game would use, from the cache
+     * of the daemon if it was decoded before
+     * @return nothing if the resource isn't in the library
+     * @throws PackageException, if the resource isn't an image
+     */
+    const std::optional<IndexThumbnail> thumbnail(const ResourceKey& key);
+
+    // Object interface
+   public:
+    const lib::String toString() const override;
+};
+
+}  // namespace s4pkg
@@ -0,0 +1,59 @@
+/*
+ * Copyright (c) 2022- Gerber Lóránt Viktor
+ * Author: Gerber Lóránt Viktor <glorantv@student.elte.hu>
+ *
+ * This file is part of s4pkg.
+ *
+ * s4pkg is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <cinttypes>
+
+namespace s4pkg {
+
+// The protocol spoken over the socket of s4pkgd, see IndexServer. Every
+// request is a type byte and a 32-bit payload size followed by the payload,
+// every response a status byte and a 64-bit payload size followed by the
+// payload. Integers are little-endian, strings are prefixed by their 32-bit
+// length, and keys are 4 32-bit integers: type, group, instanceEx, instance.
+// A connection can carry any number of requests, answered in order.
+
+enum IndexRequestType : uint8_t {
+    INDEX_LOOKUP = 1,          /**< Key -> every copy of the resource */
+    INDEX_LIST_PACKAGES = 2,   /**< Nothing -> every package */
+    INDEX_LIST_RESOURCES = 3,  /**< Package id -> the index of the package */
+    INDEX_EXTRACT = 4,         /**< Key -> stored bytes of the winning copy */
+    INDEX_THUMBNAIL = 5        /**< Key -> decoded RGBA pixels of the winner */
+};
+
+/**
+ * @brief The payload of INDEX_BAD_REQUEST and INDEX_FAILED responses is an
+ * error message
+ */
+enum IndexStatus : uint8_t {
+    INDEX_OK = 0,
+    INDEX_NOT_FOUND = 1,
+    INDEX_BAD_REQUEST = 2,
+    INDEX_FAILED = 3
+};
+
+/**
+ * @brief Requests with a larger payload are rejected, and the connection is
+ * closed
+ */
+static constexpr uint32_t g_indexMaxRequestSize = 4096;
+
+}  // namespace s4pkg
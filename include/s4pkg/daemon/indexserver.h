@@ -0,0 +1,137 @@
+/*
+ * Copyright (c) 2022- Gerber Lóránt Viktor
+ * Author: Gerber Lóránt Viktor <glorantv@student.elte.hu>
+ *
+ * This file is part of s4pkg.
+ *
+ * s4pkg is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <s4pkg/daemon/indexprotocol.h>
+#include <s4pkg/internal/export.h>
+#include <s4pkg/lib/bytebuffer.h>
+#include <s4pkg/lib/string.h>
+#include <s4pkg/library/librarywatcher.h>
+#include <s4pkg/library/packagelibrary.h>
+#include <s4pkg/object.h>
+#include <s4pkg/package/ipackage.h>
+
+#include <atomic>
+#include <list>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace s4pkg {
+
+/**
+ * @brief The server behind s4pkgd: keeps the catalogue of a library, and the
+ * images decoded from it, in memory, and answers requests over a Unix domain
+ * socket (see indexprotocol.h and IndexClient). Record bytes are sent straight
+ * from the package files with sendfile() where available.
+ *
+ * Everything happens on the thread calling run(): requests are answered one at
+ * a time, and the library is kept up to date with a LibraryWatcher between
+ * them. Only stop() may be called from other threads.
+ */
+class S4PKG_EXPORT IndexServer : public Object {
+   private:
+    typedef struct cached_thumbnail_t {
+        uint64_t m_location;  // Package id and entry
+        uint32_t m_width;
+        uint32_t m_height;
+        lib::ByteBuffer m_pixelData;
+    } cached_thumbnail_t;
+
+    PackageLibrary& m_library;
+    LibraryWatcher m_watcher;
+    std::string m_socketPath;
+    int m_listenDescriptor;
+    std::vector<int> m_clients;
+    std::atomic<bool> m_stopping;
+
+    // Least recently used thumbnails last
+    std::list<cached_thumbnail_t> m_thumbnails;
+    std::unordered_map<uint64_t, std::list<cached_thumbnail_t>::iterator>
+        m_thumbnailIndex;
+    size_t m_thumbnailCacheSize;
+    size_t m_thumbnailCacheUsed;
+
+    // Packages thumbnails were decoded from, each holding its file open. Least
+    // recently used last, only a few are kept.
+    typedef std::pair<uint32_t, std::shared_ptr<IPackage>> open_package_t;
+    std::list<open_package_t> m_openPackages;
+    std::unordered_map<uint32_t, std::list<open_package_t>::iterator>
+        m_openPackageIndex;
+    size_t m_requestCount;
+
+    void forgetPackage(uint32_t packageId);
+    void closePackage(uint32_t packageId);
+
+    // Opens a package of the library, or reuses it if it's still open
+    std::shared_ptr<IPackage> openLibraryPackage(uint32_t packageId);
+
+    // Answers one request, returns false if the client is gone
+    bool serve(int client);
+
+    void sendResponse(int client,
+                      IndexStatus status,
+                      const std::string& payload);
+
+    void lookup(int client, const ResourceKey& key);
+    void listPackages(int client);
+    void listResources(int client, uint32_t packageId);
+    void extract(int client, const ResourceKey& key);
+    void thumbnail(int client, const ResourceKey& key);
+
+   public:
+    /**
+     * @brief Starts watching and scans the library, and starts listening at
+     * the socket. Clients can connect as soon as this returns.
+     * @param library: the library to serve, it must outlive the server
+     * @param thumbnailCacheSize: bytes of decoded pixels to keep in memory
+     * @throws PackageException, if the socket can't be created
+     */
+    IndexServer(PackageLibrary& library,
+                const lib::String& socketPath,
+                size_t thumbnailCacheSize = 64 * 1024 * 1024);
+    ~IndexServer();
+
+    IndexServer(const IndexServer&) = delete;
+    IndexServer& operator=(const IndexServer&) = delete;
+
+    /**
+     * @brief Serves clients until stop() is called. SIGPIPE is ignored from
+     * then on, so clients that disconnect only fail their own requests.
+     */
+    void run();
+
+    /**
+     * @brief Makes run() return within a poll interval. Safe to call from any
+     * thread, and from signal handlers.
+     */
+    void stop() { m_stopping = true; }
+
+    const size_t getRequestCount() const { return m_requestCount; }
+    const size_t getThumbnailCacheUsed() const { return m_thumbnailCacheUsed; }
+
+    // Object interface
+   public:
+    const lib::String toString() const override;
+};
+
+}  // namespace s4pkg
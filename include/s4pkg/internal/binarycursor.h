@@ -0,0 +1,176 @@
+/*
+ * Copyright (c) 2022- Gerber Lóránt Viktor
+ * Author: Gerber Lóránt Viktor <glorantv@student.elte.hu>
+ *
+ * This file is part of s4pkg.
+ *
+ * s4pkg is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#pragma once
+
+#include <s4pkg/internal/export.h>
+
+#include <cinttypes>
+#include <cstring>
+#include <type_traits>
+
+namespace s4pkg::internal {
+
+[[noreturn]] S4PKG_EXPORT void throwCursorOutOfBounds(uint64_t position,
+                                                      uint64_t size,
+                                                      uint64_t available);
+
+/**
+ * @brief Reads little-endian values from a span of memory, which has to
+ * outlive the cursor. Bounds are checked once per call, so a struct read with
+ * a single read() of all its fields is one check and a few loads, instead of a
+ * virtual call per byte through an std::istream.
+ */
+class BinaryCursor {
+   private:
+    const uint8_t* m_data;
+    uint64_t m_size;
+    uint64_t m_position = 0;
+
+    template <typename T>
+    static T load(const uint8_t* bytes) {
+        static_assert(std::is_integral_v<T> || std::is_enum_v<T>,
+                      "Only integers can be read");
+
+        std::make_unsigned_t<
+            std::conditional_t<std::is_enum_v<T>, uint32_t, T>>
+            value = 0;
+        static_assert(sizeof(value) == sizeof(T), "Unsupported enum size");
+
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+        for (size_t i = 0; i < sizeof(T); i++) {
+            value |= (decltype(value))bytes[i] << (i * 8);
+        }
+#else
+        memcpy(&value, bytes, sizeof(T));
+#endif
+
+        return (T)value;
+    }
+
+   public:
+    BinaryCursor(const uint8_t* data, uint64_t size)
+        : m_data(data), m_size(size) {}
+
+    uint64_t size() const { return m_size; }
+    uint64_t position() const { return m_position; }
+    uint64_t remaining() const { return m_size - m_position; }
+    const uint8_t* data() const { return m_data; }
+
+    /**
+     * @throws PackageException, if there aren't size bytes left
+     */
+    void require(uint64_t size) const {
+        if (size > m_size - m_position) {
+            throwCursorOutOfBounds(m_position, size, m_size - m_position);
+        }
+    }
+
+    /**
+     * @throws PackageException, if position is past the end
+     */
+    void seek(uint64_t position) {
+        if (position > m_size) {
+            throwCursorOutOfBounds(0, position, m_size);
+        }
+
+        m_position = position;
+    }
+
+    void skip(uint64_t size) {
+        require(size);
+        m_position += size;
+    }
+
+    template <typename T>
+    T readLE() {
+        require(sizeof(T));
+
+        T value = load<T>(m_data + m_position);
+        m_position += sizeof(T);
+
+        return value;
+    }
+
+    /**
+     * @brief Reads consecutive values, with a single bounds check for all of
+     * them, e.g. read(header.m_width, header.m_height)
+     */
+    template <typename... T>
+    void read(T&... values) {
+        require((sizeof(T) + ...));
+
+        const uint8_t* bytes = m_data + m_position;
+        ((values = load<T>(bytes), bytes += sizeof(T)), ...);
+
+        m_position += (sizeof(T) + ...);
+    }
+
+    template <typename T>
+    void readArray(T* values, uint64_t count) {
+        if (count > (m_size - m_position) / sizeof(T)) {
+            throwCursorOutOfBounds(m_position, count * sizeof(T),
+                                   m_size - m_position);
+        }
+
+        const uint8_t* bytes = m_data + m_position;
+        for (uint64_t i = 0; i < count; i++) {
+            values[i] = load<T>(bytes + i * sizeof(T));
+        }
+
+        m_position += count * sizeof(T);
+    }
+
+    void readBytes(uint8_t* buffer, uint64_t size) {
+        require(size);
+
+        if (size > 0) {
+            memcpy(buffer, m_data + m_position, size);
+        }
+
+        m_position += size;
+    }
+
+    /**
+     * @brief A cursor over size bytes at offset, from the start of this one
+     * @throws PackageException, if the span doesn't fit
+     */
+    BinaryCursor subspan(uint64_t offset, uint64_t size) const {
+        if (offset > m_size || size > m_size - offset) {
+            throwCursorOutOfBounds(offset, size,
+                                   offset > m_size ? 0 : m_size - offset);
+        }
+
+        return BinaryCursor(m_data + offset, size);
+    }
+
+    /**
+     * @brief A cursor over the next size bytes, which are skipped in this one
+     */
+    BinaryCursor take(uint64_t size) {
+        BinaryCursor span = subspan(m_position, size);
+        m_position += size;
+
+        return span;
+    }
+};
+
+}  // namespace s4pkg::internal
@@ -0,0 +1,68 @@
+/*
+ * Copyright (c) 2022- Gerber Lóránt Viktor
+ * Author: Gerber Lóránt Viktor <glorantv@student.elte.hu>
+ *
+ * This file is part of s4pkg.
+ *
+ * s4pkg is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <s4pkg/internal/soaindex.h>
+#include <s4pkg/package/resourcekey.h>
+
+#include <cinttypes>
+#include <vector>
+
+namespace s4pkg::internal::bloomfilter {
+
+/**
+ * @brief 512 bits, aligned so that a block is exactly one cache line
+ */
+typedef struct alignas(64) bloom_block_t {
+    uint64_t m_words[8];
+} bloom_block_t;
+
+/**
+ * @brief A blocked Bloom filter over resource keys. Every key maps to a single
+ * 64-byte block (one cache line), and all of its bits are set within that
+ * block, so a query touches exactly one cache line. False positives are
+ * possible, false negatives are not.
+ */
+typedef struct bloom_filter_t {
+    std::vector<bloom_block_t> m_blocks;
+    uint32_t m_blockCount;
+} bloom_filter_t;
+
+/**
+ * @brief Creates an empty filter sized for the given number of keys, at
+ * roughly 12 bits per key (around 0.5% false positives)
+ */
+bloom_filter_t create(size_t expectedKeys);
+
+/**
+ * @brief Creates a filter containing every key of an index
+ */
+bloom_filter_t build(const soaindex::soa_index_t&);
+
+void insert(bloom_filter_t&, const ResourceKey& key);
+
+/**
+ * @brief Checks whether the key might have been inserted into the filter
+ * @return false if the key was definitely not inserted
+ */
+bool mayContain(const bloom_filter_t&, const ResourceKey& key);
+
+}  // namespace s4pkg::internal::bloomfilter
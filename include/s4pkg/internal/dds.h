@@ -25,7 +25,10 @@
 #include <string>
 #include <vector>
 
+#include <s4pkg/internal/binarycursor.h>
 #include <s4pkg/internal/export.h>
+#include <s4pkg/internal/layout.h>
+#include <s4pkg/io/bytesource.h>
 #include <s4pkg/lib/bytebuffer.h>
 
 #ifndef MAKE_FOURCC
@@ -87,6 +90,17 @@ typedef struct dds_pixelformat_t {
     uint32_t m_aBitMask;
 } dds_pixelformat_t;
 
+S4PKG_LAYOUT(dds_pixelformat_t,
+             32,
+             S4PKG_FIELD(m_size),
+             S4PKG_FIELD(m_flags),
+             S4PKG_FIELD(m_fourCC),
+             S4PKG_FIELD(m_rgbBitCount),
+             S4PKG_FIELD(m_rBitMask),
+             S4PKG_FIELD(m_gBitMask),
+             S4PKG_FIELD(m_bBitMask),
+             S4PKG_FIELD(m_aBitMask));
+
 typedef enum dds_header_flags_t {
     DDSD_CAPS = 0x1,
     DDSD_HEIGHT = 0x2,
@@ -121,10 +135,39 @@ typedef struct dds_header_t {
     uint32_t m_reserved2;
 } dds_header_t;
 
-std::string pixelFormatToString(const dds_pixelformat_t&);
+S4PKG_LAYOUT(dds_header_t,
+             124,
+             S4PKG_FIELD(m_size),
+             S4PKG_FIELD(m_flags),
+             S4PKG_FIELD(m_height),
+             S4PKG_FIELD(m_width),
+             S4PKG_FIELD(m_pitchOrLinearSize),
+             S4PKG_FIELD(m_depth),
+             S4PKG_FIELD(m_mipMapCount),
+             S4PKG_FIELD(m_reserved),
+             S4PKG_FIELD(m_pixelFormat),
+             S4PKG_FIELD(m_caps),
+             S4PKG_FIELD(m_caps2),
+             S4PKG_FIELD(m_caps3),
+             S4PKG_FIELD(m_caps4),
+             S4PKG_FIELD(m_reserved2));
+
+S4PKG_EXPORT std::string pixelFormatToString(const dds_pixelformat_t&);
 std::string headerToString(const dds_header_t&);
 
+// The std::istream overloads read through a StreamByteSource
+
+dds_pixelformat_t readPixelFormat(BinaryCursor&);
+dds_pixelformat_t readPixelFormat(ByteSource&);
 dds_pixelformat_t readPixelFormat(std::istream&);
+
+/**
+ * @brief Reads the header following the magic bytes. The bounds of a cursor
+ * are checked once for the whole header, other sources are read at once.
+ * @throws PackageException, if there aren't enough bytes left
+ */
+S4PKG_EXPORT dds_header_t readHeader(BinaryCursor&);
+S4PKG_EXPORT dds_header_t readHeader(ByteSource&);
 dds_header_t readHeader(std::istream&);
 
 typedef struct dds_file_t {
@@ -137,6 +180,7 @@ typedef struct dds_file_t {
  * @brief Read a DDS file.
  * @return whether the reading was successful or not
  */
+bool readFile(ByteSource&, dds_file_t&);
 bool readFile(std::istream&, dds_file_t&);
 
 S4PKG_EXPORT lib::ByteBuffer writeFile(const dds_file_t&);
@@ -0,0 +1,132 @@
+/*
+ * Copyright (c) 2022- Gerber Lóránt Viktor
+ * Author: Gerber Lóránt Viktor <glorantv@student.elte.hu>
+ *
+ * This file is part of s4pkg.
+ *
+ * s4pkg is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#pragma once
+
+#include <s4pkg/internal/export.h>
+
+#include <cinttypes>
+
+// DST is DXT with the parts of every block stored in separate planes, one
+// after the other, which compresses better. A DXT5 block is 2 bytes of alpha
+// endpoints, 6 bytes of alpha indices, 4 bytes of colour endpoints and 4 bytes
+// of colour indices. DST5 stores the alpha endpoints of every block first,
+// then the colour endpoints, the alpha indices, and the colour indices. DXT1
+// blocks only have the colour half, which DST1 splits into two planes the
+// same way.
+
+namespace s4pkg::internal::dst {
+
+/**
+ * @brief Implementations of the shuffles, which all give the same result
+ */
+typedef enum dst_kernel_t {
+    SCALAR_KERNEL,
+    SSE2_KERNEL, /**< DST1 only, DST5 falls back to SCALAR_KERNEL */
+    SSSE3_KERNEL
+} dst_kernel_t;
+
+/**
+ * @return whether the kernel was compiled in, and the CPU supports it
+ */
+S4PKG_EXPORT bool isKernelSupported(dst_kernel_t kernel);
+
+/**
+ * @return the fastest kernel supported, picked once at runtime
+ */
+S4PKG_EXPORT dst_kernel_t bestKernel();
+
+/**
+ * @brief Where the planes of DST5 blocks start. They don't have to be next to
+ * each other, the blocks of RLE images are stored like this as well.
+ */
+template <typename T>
+struct dst5_view_t {
+    T* m_alphaEndpoints; /**< 2 bytes per block */
+    T* m_colourEndpoints; /**< 4 bytes per block */
+    T* m_alphaIndices; /**< 6 bytes per block */
+    T* m_colourIndices; /**< 4 bytes per block */
+
+    dst5_view_t(T* alphaEndpoints,
+                T* colourEndpoints,
+                T* alphaIndices,
+                T* colourIndices)
+        : m_alphaEndpoints(alphaEndpoints),
+          m_colourEndpoints(colourEndpoints),
+          m_alphaIndices(alphaIndices),
+          m_colourIndices(colourIndices) {}
+
+    /**
+     * @brief The planes of blockCount blocks of DST5 data
+     */
+    dst5_view_t(T* planes, uint64_t blockCount)
+        : dst5_view_t(planes,
+                      planes + blockCount * 2,
+                      planes + blockCount * 6,
+                      planes + blockCount * 12) {}
+};
+
+/**
+ * @brief Gathers DXT5 blocks from DST5 planes
+ * @param planes: 16 * blockCount bytes of DST5 data
+ * @param blocks: room for blockCount DXT5 blocks, mustn't overlap planes
+ * @param kernel: an unsupported one falls back to SCALAR_KERNEL
+ */
+S4PKG_EXPORT void unshuffleDst5(const dst5_view_t<const uint8_t>& planes,
+                                uint8_t* blocks,
+                                uint64_t blockCount,
+                                dst_kernel_t kernel = bestKernel());
+
+S4PKG_EXPORT void unshuffleDst5(const uint8_t* planes,
+                                uint8_t* blocks,
+                                uint64_t blockCount,
+                                dst_kernel_t kernel = bestKernel());
+
+/**
+ * @brief Scatters DXT5 blocks into DST5 planes, see unshuffleDst5()
+ */
+S4PKG_EXPORT void shuffleDst5(const uint8_t* blocks,
+                              const dst5_view_t<uint8_t>& planes,
+                              uint64_t blockCount,
+                              dst_kernel_t kernel = bestKernel());
+
+S4PKG_EXPORT void shuffleDst5(const uint8_t* blocks,
+                              uint8_t* planes,
+                              uint64_t blockCount,
+                              dst_kernel_t kernel = bestKernel());
+
+/**
+ * @brief Gathers DXT1 blocks from DST1 planes, see unshuffleDst5()
+ */
+S4PKG_EXPORT void unshuffleDst1(const uint8_t* planes,
+                                uint8_t* blocks,
+                                uint64_t blockCount,
+                                dst_kernel_t kernel = bestKernel());
+
+/**
+ * @brief Scatters DXT1 blocks into DST1 planes, see unshuffleDst5()
+ */
+S4PKG_EXPORT void shuffleDst1(const uint8_t* blocks,
+                              uint8_t* planes,
+                              uint64_t blockCount,
+                              dst_kernel_t kernel = bestKernel());
+
+}  // namespace s4pkg::internal::dst
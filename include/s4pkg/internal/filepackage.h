@@ -0,0 +1,132 @@
+/*
+ * Copyright (c) 2022- Gerber Lóránt Viktor
+ * Author: Gerber Lóránt Viktor <glorantv@student.elte.hu>
+ *
+ * This file is part of s4pkg.
+ *
+ * s4pkg is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <s4pkg/cache/resourcecache.h>
+#include <s4pkg/internal/bloomfilter.h>
+#include <s4pkg/internal/keyindex.h>
+#include <s4pkg/internal/soaindex.h>
+#include <s4pkg/internal/types.h>
+#include <s4pkg/io/bytesource.h>
+#include <s4pkg/package/ipackage.h>
+
+#include <memory>
+#include <mutex>
+#include <string>
+
+namespace s4pkg::internal {
+
+/**
+ * @brief A package implementation which only reads the header and index of a
+ * package file when constructed. Resources are read from the file when they
+ * are asked for, and aren't kept, except by getResources(). With a cache, the
+ * decompressed records are kept in it, so reading a resource again skips the
+ * file. The file is only open while the shared filepool keeps it, so any
+ * number of packages can be open. Records are only read from the file the
+ * index came from: if it was replaced on disk, and the pool has closed it,
+ * reading fails instead of reading the new file.
+ */
+class FilePackage : public s4pkg::IPackage {
+   private:
+    std::string m_path;
+    // Of the file the index was read from, records are only read from it
+    FileIdentity m_identity;
+
+    package_header_t m_packageHeader{};
+    flags_t m_flags{};
+
+    uint32_t m_constantTypeId = 0;
+    uint32_t m_constantGroupId = 0;
+    uint32_t m_constantInstanceIdEx = 0;
+
+    index_t m_index{};
+    soaindex::soa_index_t m_soaIndex{};
+    bloomfilter::bloom_filter_t m_keyFilter{};
+    std::vector<bool> m_deleted;
+
+    mutable std::once_flag m_keyIndexBuilt;
+    mutable keyindex::key_index_t m_keyIndex{};
+
+    std::shared_ptr<ResourceCache> m_cache;
+    uint64_t m_cacheOwner;
+
+    mutable std::once_flag m_resourcesLoaded;
+    mutable std::vector<std::shared_ptr<IResource>> m_resources;
+
+    const keyindex::key_index_t& getKeyIndex() const;
+
+   public:
+    explicit FilePackage(const std::string& path,
+                         const std::shared_ptr<ResourceCache>& cache = nullptr);
+    ~FilePackage();
+
+    // s4pkg::IPackage interface
+   public:
+    /**
+     * @brief Hides every resource with the same key as resource. The file
+     * isn't modified.
+     */
+    bool deleteResource(const std::shared_ptr<const IResource>) override;
+
+    bool isValid() const override { return true; }
+
+    const PackageVersion getFileVersion() const override;
+    const PackageVersion getUserVersion() const override;
+    const int32_t getCreationTime() const override;
+    const int32_t getModifiedTime() const override;
+    const PackageHeader getPackageHeader() const override;
+    const PackageFlags getPackageFlags() const override;
+    const std::vector<IndexEntry> getPackageIndex() const override;
+    const IndexView getIndexView() const override;
+
+    /**
+     * @brief Reads every resource of the package the first time it is called
+     */
+    const std::vector<std::shared_ptr<IResource>>& getResources()
+        const override;
+    std::shared_ptr<IResource> getResource(uint32_t position) const override;
+
+    const std::vector<uint32_t> findEntries(
+        const std::vector<ResourceType>& types,
+        std::optional<uint32_t> group) const override;
+    const int64_t findEntry(const ResourceKey& key) const override;
+    const std::vector<int64_t> findMany(
+        const std::vector<ResourceKey>& keys) const override;
+    const bool mayContain(const ResourceKey& key) const override;
+
+    const uint32_t getConstantGroup() const override {
+        return this->m_constantGroupId;
+    }
+
+    const uint32_t getConstantType() const override {
+        return this->m_constantTypeId;
+    }
+
+    const uint32_t getConstantInstanceEx() const override {
+        return this->m_constantInstanceIdEx;
+    }
+
+    // s4pkg::Object interface
+   public:
+    const lib::String toString() const override;
+};
+
+}  // namespace s4pkg::internal
@@ -0,0 +1,57 @@
+/*
+ * Copyright (c) 2022- Gerber Lóránt Viktor
+ * Author: Gerber Lóránt Viktor <glorantv@student.elte.hu>
+ *
+ * This file is part of s4pkg.
+ *
+ * s4pkg is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <s4pkg/io/bytesource.h>
+
+#include <cinttypes>
+#include <memory>
+#include <string>
+
+namespace s4pkg::internal::filepool {
+
+/**
+ * @brief The most files the pool keeps open. A file evicted while it's being
+ * read is closed when the reads finish.
+ */
+constexpr size_t g_maxOpenFiles = 256;
+
+/**
+ * @brief Opens a file for reading, or reuses it if the pool still has it open.
+ * Files are shared by every caller with the same path and identity, and closed
+ * in least recently used order, so packages can be kept for many more files
+ * than there are descriptors. Files are never closed for a caller, only
+ * evicted.
+ * @param identity: of the file the caller parsed, see
+ * FileByteSource::getIdentity(). A file replaced on disk since then is never
+ * mistaken for it.
+ * @throws PackageException, if the file can't be opened, or isn't the one
+ * with the identity anymore
+ */
+std::shared_ptr<const FileByteSource> acquire(const std::string& path,
+                                              const FileIdentity& identity);
+
+/**
+ * @return the number of files the pool has open
+ */
+size_t size();
+
+}  // namespace s4pkg::internal::filepool
@@ -21,10 +21,12 @@
 #pragma once
 
 #include <s4pkg/internal/export.h>
+#include <s4pkg/internal/types.h>
 #include <s4pkg/package/enums.h>
 #include <s4pkg/resources/iresourcefactory.h>
 
 #include <map>
+#include <memory>
 
 namespace s4pkg::internal::globals {
 
@@ -35,4 +37,16 @@ extern const std::map<s4pkg::ResourceType,
 extern S4PKG_EXPORT const s4pkg::IResourceFactory* getResourceFactoryFor(
     s4pkg::ResourceType);
 
+/**
+ * @brief Parses the decompressed data of a record with the factory registered
+ * for its type
+ * @throws PackageException, if the factory fails, or returns nothing
+ */
+std::shared_ptr<s4pkg::IResource> createResource(
+    const index_entry_t&,
+    const std::shared_ptr<const lib::ByteBuffer>& data);
+
+std::shared_ptr<s4pkg::IResource> createResource(const index_entry_t&,
+                                                 lib::ByteBuffer data);
+
 };  // namespace s4pkg::internal::globals
@@ -0,0 +1,50 @@
+/*
+ * Copyright (c) 2022- Gerber Lóránt Viktor
+ * Author: Gerber Lóránt Viktor <glorantv@student.elte.hu>
+ *
+ * This file is part of s4pkg.
+ *
+ * s4pkg is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <cinttypes>
+#include <cstddef>
+
+namespace s4pkg::internal::hash {
+
+/**
+ * @brief Hashes a block of memory with XXH64. Used for comparing the content of
+ * resources, it is not a cryptographic hash.
+ * @param data: the bytes to hash
+ * @param size: the number of bytes
+ * @param seed: changes the result, so unrelated kinds of data can be kept apart
+ * @return the 64-bit hash
+ */
+uint64_t hash64(const uint8_t* data, size_t size, uint64_t seed = 0);
+
+/**
+ * @brief Hashes a block of memory, built for throughput on large buffers.
+ * 32-byte stripes are accumulated into four 64-bit lanes using 32x32->64 bit
+ * multiplications, two lanes per SSE2 instruction, and the lanes are scrambled
+ * every kilobyte. The result is the same with or without SSE2, but differs
+ * from hash64().
+ * @param data: the bytes to hash
+ * @param size: the number of bytes
+ * @return the 64-bit hash
+ */
+uint64_t hashWide(const uint8_t* data, size_t size);
+
+}  // namespace s4pkg::internal::hash
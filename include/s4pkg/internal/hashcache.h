@@ -0,0 +1,64 @@
+/*
+ * Copyright (c) 2022- Gerber Lóránt Viktor
+ * Author: Gerber Lóránt Viktor <glorantv@student.elte.hu>
+ *
+ * This file is part of s4pkg.
+ *
+ * s4pkg is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <cinttypes>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace s4pkg::internal::hashcache {
+
+/**
+ * @brief Hashes of the records of a package file, valid as long as the size
+ * and modification time of the file don't change
+ */
+typedef struct package_hashes_t {
+    uint64_t m_fileSize;
+    int64_t m_modifiedTime;
+
+    std::vector<uint64_t> m_storedHashes; /**< Stored bytes, by entry */
+    std::unordered_map<uint32_t, uint64_t>
+        m_contentHashes; /**< Decompressed content, for the entries which
+                            needed it */
+} package_hashes_t;
+
+/**
+ * @brief Hashes of every package of a library, keyed by package path
+ */
+typedef std::unordered_map<std::string, package_hashes_t> hash_cache_t;
+
+/**
+ * @brief Loads a cache written by write()
+ * @param value: receives the cache, left empty if the file doesn't exist, is
+ * corrupt, or was written by another version
+ * @return true if the cache was loaded
+ */
+bool read(const std::string& path, hash_cache_t& value);
+
+/**
+ * @brief Saves a cache. The file is written next to path first, and then
+ * renamed over it, so an interrupted write never leaves a corrupt cache.
+ * @throws PackageException, if the file can't be written
+ */
+void write(const std::string& path, const hash_cache_t& value);
+
+}  // namespace s4pkg::internal::hashcache
@@ -22,6 +22,7 @@
 
 #include <s4pkg/internal/export.h>
 #include <s4pkg/internal/image.h>
+#include <s4pkg/internal/mipmap.h>
 #include <s4pkg/lib/bytebuffer.h>
 
 #include <memory>
@@ -48,6 +49,24 @@ enum ImageFormat {
     RLES,
 };
 
+/**
+ * @brief How much time DXT compression may take. FAST fits block colours
+ * along their range, BALANCED with a single cluster fit, and BEST with an
+ * iterative cluster fit, which is the slowest but closest to the original.
+ */
+typedef enum encode_quality_t { FAST, BALANCED, BEST } encode_quality_t;
+
+/**
+ * @brief Options of encoding, only used by the DXT based formats
+ */
+typedef struct encode_options_t {
+    encode_quality_t m_quality = BEST;
+    bool m_perceptual = true; /**< Weigh colour errors by how visible they
+                                 are, instead of uniformly */
+    unsigned int m_threadCount = 0; /**< 0 for one per hardware thread */
+    mipmap::mip_filter_t m_mipFilter = mipmap::BOX_FILTER;
+} encode_options_t;
+
 /**
  * @brief Decodes an image into RGBA pixels
  * @param data: raw data
@@ -57,12 +76,56 @@ enum ImageFormat {
 S4PKG_EXPORT std::shared_ptr<Image> decode(const lib::ByteBuffer& data,
                                            ImageFormat format);
 
+/**
+ * @brief Reads the size of an image from its header, without decoding it
+ * @param data: raw data
+ * @param format: the format of the image
+ * @return whether the header could be read, width and height are only set if
+ * it could
+ */
+S4PKG_EXPORT bool probe(const lib::ByteBuffer& data,
+                        ImageFormat format,
+                        uint32_t& width,
+                        uint32_t& height);
+
 /**
  * @brief Encodes an RGBA image into raw bytes
  * @param image: the image to encode
  * @param format: the format to encode to
+ * @param options: quality of the encoding, the default is the best quality
  * @return the encoded bytes (empty on failure)
  */
-S4PKG_EXPORT lib::ByteBuffer encode(const Image& image, ImageFormat format);
+S4PKG_EXPORT lib::ByteBuffer encode(const Image& image,
+                                    ImageFormat format,
+                                    const encode_options_t& options = {});
+
+/**
+ * @brief Converts an image between DST and DXT (DST5 and DXT5, or DST1 and
+ * DXT1) by reordering its blocks, without decoding it. The pixels are kept
+ * exactly, and only the four character code of the header changes.
+ * @param data: raw data in the from format
+ * @return the converted bytes, or a copy of data if the formats are the same
+ * (empty if the pair isn't supported, or data isn't in the from format)
+ */
+S4PKG_EXPORT lib::ByteBuffer transcode(const lib::ByteBuffer& data,
+                                       ImageFormat from,
+                                       ImageFormat to);
+
+/**
+ * @brief Compresses RGBA pixels into DXT blocks, without a DDS header. The
+ * image is split into strips of block rows, which are compressed on threads
+ * started for the call. Every thread gets at least 1024 blocks, so small
+ * images are compressed on the calling thread alone. The output is the same
+ * whatever the number of threads.
+ * @param format: DXT1, DXT3 or DXT5
+ * @param options: with a thread count of 1, the image is compressed in one go
+ * @return the compressed blocks (empty for other formats)
+ */
+S4PKG_EXPORT lib::ByteBuffer compressBlocks(
+    const uint8_t* pixels,
+    uint32_t width,
+    uint32_t height,
+    ImageFormat format,
+    const encode_options_t& options = {});
 
 };  // namespace s4pkg::internal::imagecoder
@@ -20,11 +20,17 @@
 
 #pragma once
 
+#include <s4pkg/internal/bloomfilter.h>
+#include <s4pkg/internal/keyindex.h>
+#include <s4pkg/internal/soaindex.h>
 #include <s4pkg/internal/types.h>
+#include <s4pkg/io/bytesource.h>
 #include <s4pkg/package/ipackage.h>
 
 #include <s4pkg/packageexception.h>
 
+#include <mutex>
+
 namespace s4pkg::internal {
 
 /**
@@ -36,18 +42,29 @@ class InMemoryPackage : public s4pkg::IPackage {
     package_header_t m_packageHeader{};
     flags_t m_flags{};
 
-    uint32_t m_constantTypeId;
-    uint32_t m_constantGroupId;
-    uint32_t m_constantInstanceIdEx;
+    uint32_t m_constantTypeId = 0;
+    uint32_t m_constantGroupId = 0;
+    uint32_t m_constantInstanceIdEx = 0;
 
     index_t m_index{};
+    soaindex::soa_index_t m_soaIndex{};
+    bloomfilter::bloom_filter_t m_keyFilter{};
+
+    // Built the first time a key is looked up
+    mutable std::once_flag m_keyIndexBuilt;
+    mutable keyindex::key_index_t m_keyIndex{};
     records_t m_records{};
 
     bool m_valid = false;
 
     std::vector<std::shared_ptr<IResource>> m_resources;
+    std::vector<std::shared_ptr<IResource>> m_entryResources;  // By position
+
+    const keyindex::key_index_t& getKeyIndex() const;
+    void read(ByteSource&);
 
    public:
+    InMemoryPackage(ByteSource&);
     InMemoryPackage(std::istream&);
 
     // s4pkg::IPackage interface
@@ -63,7 +80,18 @@ class InMemoryPackage : public s4pkg::IPackage {
     const PackageHeader getPackageHeader() const override;
     const PackageFlags getPackageFlags() const override;
     const std::vector<IndexEntry> getPackageIndex() const override;
-    const std::vector<std::shared_ptr<IResource>> getResources() const override;
+    const IndexView getIndexView() const override;
+    const std::vector<std::shared_ptr<IResource>>& getResources()
+        const override;
+    std::shared_ptr<IResource> getResource(uint32_t position) const override;
+
+    const std::vector<uint32_t> findEntries(
+        const std::vector<ResourceType>& types,
+        std::optional<uint32_t> group) const override;
+    const int64_t findEntry(const ResourceKey& key) const override;
+    const std::vector<int64_t> findMany(
+        const std::vector<ResourceKey>& keys) const override;
+    const bool mayContain(const ResourceKey& key) const override;
 
     const uint32_t getConstantGroup() const override {
         return this->m_constantGroupId;
@@ -0,0 +1,67 @@
+/*
+ * Copyright (c) 2022- Gerber Lóránt Viktor
+ * Author: Gerber Lóránt Viktor <glorantv@student.elte.hu>
+ *
+ * This file is part of s4pkg.
+ *
+ * s4pkg is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <s4pkg/internal/soaindex.h>
+#include <s4pkg/package/resourcekey.h>
+
+#include <cinttypes>
+#include <vector>
+
+namespace s4pkg::internal::keyindex {
+
+/**
+ * @brief The keys of a package index in ascending order, along with the
+ * position each key has in the original index. Entries sharing a key are kept
+ * in index order.
+ */
+typedef struct key_index_t {
+    std::vector<ResourceKey> m_keys;
+    std::vector<uint32_t> m_positions;
+} key_index_t;
+
+/**
+ * @brief Sorts the keys of an index
+ */
+key_index_t build(const soaindex::soa_index_t&);
+
+/**
+ * @brief Looks up a single key with a binary search
+ * @return the position of the first entry with this key in the original index,
+ * or -1 if there is none
+ */
+int64_t find(const key_index_t&, const ResourceKey& key);
+
+/**
+ * @brief Looks up many keys in one pass. When the keys are sorted this is a
+ * merge-join, where each key is found by galloping forward from where the
+ * previous one was found; unsorted keys are sorted first.
+ * @param keys: the keys to look up
+ * @param count: the number of keys
+ * @param positions: receives the result of find() for every key, in the order
+ * of keys, must have room for count elements
+ */
+void findMany(const key_index_t&,
+              const ResourceKey* keys,
+              size_t count,
+              int64_t* positions);
+
+}  // namespace s4pkg::internal::keyindex
@@ -0,0 +1,249 @@
+/*
+ * Copyright (c) 2022- Gerber Lóránt Viktor
+ * Author: Gerber Lóránt Viktor <glorantv@student.elte.hu>
+ *
+ * This file is part of s4pkg.
+ *
+ * s4pkg is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#pragma once
+
+#include <s4pkg/internal/binarycursor.h>
+
+#include <cinttypes>
+#include <cstddef>
+#include <cstring>
+#include <type_traits>
+
+// Describes how a struct is laid out in a file, so its reader and writer are
+// generated from the same declaration, next to the struct:
+//
+//     S4PKG_LAYOUT(version_t, 8, S4PKG_FIELD(m_major), S4PKG_FIELD(m_minor));
+//
+// Fields are listed in file order, and are stored little-endian without any
+// padding. Integers, enums, arrays of them, and structs with a layout of their
+// own are supported. The size of the layout is checked against the size given
+// at compile time. When the fields are stored exactly like the struct is laid
+// out in memory, on a little-endian host, reading and writing it is a single
+// memcpy.
+
+#define S4PKG_LAYOUT(name, expectedSize, ...)                               \
+    struct name##_layout {                                                  \
+        typedef name struct_t;                                              \
+        typedef s4pkg::internal::layout::struct_layout_t<name, __VA_ARGS__> \
+            type;                                                           \
+    };                                                                      \
+    name##_layout layoutOf(const name*);                                    \
+    static_assert(name##_layout::type::size == (expectedSize),             \
+                  "Layout of " #name " doesn't match its size in the file")
+
+#define S4PKG_FIELD(member)                                  \
+    s4pkg::internal::layout::field_t<&struct_t::member,      \
+                                     offsetof(struct_t, member)>
+
+namespace s4pkg::internal::layout {
+
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+static constexpr bool g_littleEndian = false;
+#else
+static constexpr bool g_littleEndian = true;
+#endif
+
+template <typename T>
+struct member_traits;
+
+template <typename Class, typename T>
+struct member_traits<T Class::*> {
+    typedef Class class_t;
+    typedef T type;
+};
+
+/**
+ * @brief The layout declared for T with S4PKG_LAYOUT, found by argument
+ * dependent lookup in the namespace of T
+ */
+template <typename T>
+using layout_t =
+    typename decltype(layoutOf(std::declval<const T*>()))::type;
+
+template <typename T>
+constexpr uint64_t encodedSize() {
+    if constexpr (std::is_array_v<T>) {
+        return std::extent_v<T> * encodedSize<std::remove_extent_t<T>>();
+    } else if constexpr (std::is_integral_v<T> || std::is_enum_v<T>) {
+        return sizeof(T);
+    } else {
+        return layout_t<T>::size;
+    }
+}
+
+/**
+ * @brief Whether T is stored in the file the same way as in memory
+ */
+template <typename T>
+constexpr bool isNative() {
+    if constexpr (std::is_array_v<T>) {
+        return isNative<std::remove_extent_t<T>>();
+    } else if constexpr (std::is_integral_v<T> || std::is_enum_v<T>) {
+        return g_littleEndian;
+    } else {
+        return layout_t<T>::native;
+    }
+}
+
+template <typename T>
+void load(const uint8_t*& bytes, T& value) {
+    if constexpr (std::is_array_v<T>) {
+        for (auto& element : value) {
+            load(bytes, element);
+        }
+    } else if constexpr (std::is_integral_v<T> || std::is_enum_v<T>) {
+        std::make_unsigned_t<
+            std::conditional_t<std::is_enum_v<T>, uint32_t, T>>
+            bits = 0;
+        static_assert(sizeof(bits) == sizeof(T), "Unsupported enum size");
+
+        if constexpr (g_littleEndian) {
+            memcpy(&bits, bytes, sizeof(T));
+        } else {
+            for (size_t i = 0; i < sizeof(T); i++) {
+                bits |= (decltype(bits))bytes[i] << (i * 8);
+            }
+        }
+
+        value = (T)bits;
+        bytes += sizeof(T);
+    } else {
+        layout_t<T>::load(bytes, value);
+    }
+}
+
+template <typename T>
+void store(uint8_t*& bytes, const T& value) {
+    if constexpr (std::is_array_v<T>) {
+        for (const auto& element : value) {
+            store(bytes, element);
+        }
+    } else if constexpr (std::is_integral_v<T> || std::is_enum_v<T>) {
+        std::make_unsigned_t<
+            std::conditional_t<std::is_enum_v<T>, uint32_t, T>>
+            bits = (decltype(bits))value;
+
+        if constexpr (g_littleEndian) {
+            memcpy(bytes, &bits, sizeof(T));
+        } else {
+            for (size_t i = 0; i < sizeof(T); i++) {
+                bytes[i] = (uint8_t)(bits >> (i * 8));
+            }
+        }
+
+        bytes += sizeof(T);
+    } else {
+        layout_t<T>::store(bytes, value);
+    }
+}
+
+/**
+ * @brief A member of a struct, at offset in memory
+ */
+template <auto Member, size_t Offset>
+struct field_t {
+    typedef typename member_traits<decltype(Member)>::class_t class_t;
+    typedef typename member_traits<decltype(Member)>::type type;
+
+    static constexpr size_t offset = Offset;
+    static constexpr uint64_t size = encodedSize<type>();
+    static constexpr bool native = isNative<type>();
+
+    static void load(const uint8_t*& bytes, class_t& value) {
+        layout::load(bytes, value.*Member);
+    }
+
+    static void store(uint8_t*& bytes, const class_t& value) {
+        layout::store(bytes, value.*Member);
+    }
+};
+
+template <typename Struct, typename... Fields>
+struct struct_layout_t {
+    static constexpr uint64_t size = (Fields::size + ...);
+
+    /**
+     * @brief Whether every field is stored where it is in memory, with nothing
+     * in between
+     */
+    static constexpr bool contiguous() {
+        const size_t offsets[] = {Fields::offset...};
+        const uint64_t sizes[] = {Fields::size...};
+
+        uint64_t position = 0;
+        for (size_t i = 0; i < sizeof...(Fields); i++) {
+            if (offsets[i] != position) {
+                return false;
+            }
+
+            position += sizes[i];
+        }
+
+        return position == sizeof(Struct);
+    }
+
+    static constexpr bool native = std::is_trivially_copyable_v<Struct> &&
+                                   (Fields::native && ...) && contiguous();
+
+    static void load(const uint8_t*& bytes, Struct& value) {
+        if constexpr (native) {
+            memcpy(&value, bytes, size);
+            bytes += size;
+        } else {
+            (Fields::load(bytes, value), ...);
+        }
+    }
+
+    static void store(uint8_t*& bytes, const Struct& value) {
+        if constexpr (native) {
+            memcpy(bytes, &value, size);
+            bytes += size;
+        } else {
+            (Fields::store(bytes, value), ...);
+        }
+    }
+};
+
+/**
+ * @brief Reads a struct with a layout from the cursor, with one bounds check
+ * @throws PackageException, if there aren't enough bytes left
+ */
+template <typename T>
+void read(BinaryCursor& cursor, T& value) {
+    cursor.require(encodedSize<T>());
+
+    const uint8_t* bytes = cursor.data() + cursor.position();
+    load(bytes, value);
+
+    cursor.skip(encodedSize<T>());
+}
+
+/**
+ * @brief Writes a struct with a layout to bytes, which has to have room for
+ * encodedSize<T>() bytes
+ */
+template <typename T>
+void write(uint8_t* bytes, const T& value) {
+    store(bytes, value);
+}
+
+}  // namespace s4pkg::internal::layout
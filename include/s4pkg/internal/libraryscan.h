@@ -0,0 +1,126 @@
+/*
+ * Copyright (c) 2022- Gerber Lóránt Viktor
+ * Author: Gerber Lóránt Viktor <glorantv@student.elte.hu>
+ *
+ * This file is part of s4pkg.
+ *
+ * s4pkg is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <s4pkg/internal/soaindex.h>
+#include <s4pkg/internal/types.h>
+
+#include <cinttypes>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace s4pkg::internal::libraryscan {
+
+/**
+ * @brief What is kept in memory about a package in a library: where it is, and
+ * its index. Records are never read while scanning.
+ */
+typedef struct library_package_t {
+    std::string m_path;
+    uint64_t m_fileSize;
+    int64_t m_modifiedTime; /**< In the units of the filesystem clock */
+
+    package_header_t m_header;
+    soaindex::soa_index_t m_index;
+} library_package_t;
+
+/**
+ * @brief Content hashes of some records of a package file, valid as long as the
+ * size and modification time of the file don't change
+ */
+typedef struct record_hashes_t {
+    uint64_t m_fileSize;
+    int64_t m_modifiedTime;
+    std::unordered_map<uint32_t, uint64_t> m_hashes; /**< Entry -> hash */
+} record_hashes_t;
+
+/**
+ * @brief Walks a directory tree, listing every directory of the same depth in
+ * parallel
+ * @param root: the directory to start from
+ * @param extension: only files with this extension are returned (compared case
+ * insensitively), every file is returned if empty
+ * @param maxDepth: how many levels of subdirectories to descend into, -1 for no
+ * limit
+ * @return paths of the matching files, sorted
+ */
+std::vector<std::string> findFiles(const std::string& root,
+                                   const std::string& extension,
+                                   int32_t maxDepth);
+
+/**
+ * @brief Checks the extension of a path, ignoring ASCII case
+ * @param extension: the extension with the leading dot, every path matches if
+ * empty
+ */
+bool hasExtension(const std::string& path, const std::string& extension);
+
+/**
+ * @brief Number of directories between root and the directory containing
+ * path, the same depth findFiles() uses
+ * @return the depth, or -1 if path isn't under root
+ */
+int32_t depthBelow(const std::string& root, const std::string& path);
+
+/**
+ * @brief Reads the size and modification time of a file
+ * @return false if the file doesn't exist or can't be accessed
+ */
+bool statFile(const std::string& path,
+              uint64_t& fileSize,
+              int64_t& modifiedTime);
+
+/**
+ * @brief Reads the header and index of a package file
+ * @param path: the file to read
+ * @param value: receives the package, m_path is set to path
+ * @param errorMessage: set if the file is a package but couldn't be read
+ * @return true if the package was read, false if it isn't a package (it
+ * doesn't start with the DBPF identifier) or it failed to read
+ */
+bool readPackage(const std::string& path,
+                 library_package_t& value,
+                 std::string& errorMessage);
+
+/**
+ * @brief Hashes some records of a package file with hash::hashWide(). The
+ * records are read in the order they are stored in, through a single stream.
+ * @param path: the package file
+ * @param entries: index entries of the records to hash
+ * @param decompress: if set, the decompressed content is hashed, otherwise the
+ * bytes as they are stored. Records which can't be decompressed (deleted, or
+ * using an unsupported compression) are always hashed as they are stored.
+ * @param hashes: receives the hash of every entry, in the same order
+ * @throws PackageException, if the file can't be opened or is truncated
+ */
+void hashRecords(const std::string& path,
+                 const std::vector<index_entry_t>& entries,
+                 bool decompress,
+                 std::vector<uint64_t>& hashes);
+
+/**
+ * @brief Compares paths the way packages are ordered when loading them:
+ * alphabetically, ignoring ASCII case
+ */
+bool loadsBefore(const std::string& a, const std::string& b);
+
+}  // namespace s4pkg::internal::libraryscan
@@ -43,16 +43,25 @@ struct membuf : std::streambuf {
         off_type off,
         std::ios_base::seekdir dir,
         std::ios_base::openmode which = std::ios_base::in) override {
+        // Offsets are 64-bit, and anything outside the buffer fails the seek
+        // instead of moving the read pointer out of it
+        int64_t base = 0;
         if (dir == std::ios_base::cur) {
-            gbump((int)off);
+            base = gptr() - eback();
         } else if (dir == std::ios_base::end) {
-            setg((char*)m_begin, (char*)m_begin + m_size + off,
-                 (char*)m_begin + m_size);
-        } else if (dir == std::ios_base::beg) {
-            setg((char*)m_begin, (char*)m_begin + off, (char*)m_begin + m_size);
+            base = (int64_t)m_size;
         }
 
-        return gptr() - eback();
+        int64_t position = base + (int64_t)off;
+        if ((which & std::ios_base::in) == 0 || position < 0 ||
+            position > (int64_t)m_size) {
+            return pos_type(off_type(-1));
+        }
+
+        setg((char*)m_begin, (char*)m_begin + position,
+             (char*)m_begin + m_size);
+
+        return pos_type(off_type(position));
     }
 
     virtual pos_type seekpos(std::streampos pos,
@@ -0,0 +1,96 @@
+/*
+ * Copyright (c) 2022- Gerber Lóránt Viktor
+ * Author: Gerber Lóránt Viktor <glorantv@student.elte.hu>
+ *
+ * This file is part of s4pkg.
+ *
+ * s4pkg is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#pragma once
+
+#include <s4pkg/internal/export.h>
+#include <s4pkg/lib/bytebuffer.h>
+
+#include <cinttypes>
+#include <vector>
+
+namespace s4pkg::internal::mipmap {
+
+/**
+ * @brief How the levels of a mip chain are made. BOX_FILTER averages every
+ * 2x2 pixels of the previous level, RESAMPLE_FILTER resizes the full image to
+ * every level with stb_image_resize, which is slower, and is what textures
+ * were encoded with before.
+ */
+typedef enum mip_filter_t { BOX_FILTER, RESAMPLE_FILTER } mip_filter_t;
+
+/**
+ * @brief Implementations of the box filter, which all give the same result
+ */
+typedef enum mip_kernel_t {
+    SCALAR_KERNEL,
+    SSE2_KERNEL,
+    AVX2_KERNEL
+} mip_kernel_t;
+
+typedef struct mip_level_t {
+    uint32_t m_width;
+    uint32_t m_height;
+    lib::ByteBuffer m_pixels; /**< RGBA */
+} mip_level_t;
+
+/**
+ * @return whether the kernel was compiled in, and the CPU supports it
+ */
+S4PKG_EXPORT bool isKernelSupported(mip_kernel_t kernel);
+
+/**
+ * @return the fastest kernel supported, picked once at runtime
+ */
+S4PKG_EXPORT mip_kernel_t bestKernel();
+
+/**
+ * @brief Halves an RGBA image with a 2x2 box filter, rounding to the nearest
+ * value. An odd last row or column is dropped, a side of 1 pixel stays 1.
+ * @param output: room for max(1, width / 2) * max(1, height / 2) pixels
+ * @param kernel: the implementation to use, an unsupported one falls back to
+ * SCALAR_KERNEL
+ */
+S4PKG_EXPORT void downsample(const uint8_t* pixels,
+                             uint32_t width,
+                             uint32_t height,
+                             uint8_t* output,
+                             mip_kernel_t kernel);
+
+/**
+ * @brief Halves an RGBA image with the best kernel, see the other overload
+ */
+S4PKG_EXPORT void downsample(const uint8_t* pixels,
+                             uint32_t width,
+                             uint32_t height,
+                             uint8_t* output);
+
+/**
+ * @brief Makes every level of the mip chain below an RGBA image, down to 1x1.
+ * With BOX_FILTER, each level is made from the one before it.
+ */
+S4PKG_EXPORT std::vector<mip_level_t> generate(
+    const uint8_t* pixels,
+    uint32_t width,
+    uint32_t height,
+    mip_filter_t filter = BOX_FILTER);
+
+}  // namespace s4pkg::internal::mipmap
@@ -0,0 +1,49 @@
+/*
+ * Copyright (c) 2022- Gerber Lóránt Viktor
+ * Author: Gerber Lóránt Viktor <glorantv@student.elte.hu>
+ *
+ * This file is part of s4pkg.
+ *
+ * s4pkg is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <cstddef>
+#include <functional>
+
+namespace s4pkg::internal::parallel {
+
+/**
+ * @brief Number of threads used by forEach() when none is given, which is the
+ * number of hardware threads (at least 1)
+ */
+unsigned int defaultThreadCount();
+
+/**
+ * @brief Calls task once for every index in [0, count), spread over a number of
+ * worker threads. The calling thread takes part in the work, and the function
+ * returns when every task has finished. Tasks are handed out one at a time, so
+ * uneven task sizes are balanced automatically.
+ * @param count: the number of tasks
+ * @param task: the function to call with the index of each task
+ * @param threadCount: the maximum number of threads to use, 0 for
+ * defaultThreadCount()
+ * @throws the first exception thrown by a task, after every thread stopped
+ */
+void forEach(size_t count,
+             const std::function<void(size_t)>& task,
+             unsigned int threadCount = 0);
+
+}  // namespace s4pkg::internal::parallel
@@ -0,0 +1,94 @@
+/*
+ * Copyright (c) 2022- Gerber Lóránt Viktor
+ * Author: Gerber Lóránt Viktor <glorantv@student.elte.hu>
+ *
+ * This file is part of s4pkg.
+ *
+ * s4pkg is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <s4pkg/internal/types.h>
+
+#include <cinttypes>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace s4pkg::internal::recordstore {
+
+/**
+ * @brief Where the stored bytes of a record are in a pack file
+ */
+typedef struct pack_location_t {
+    uint64_t m_offset; /**< Of the bytes, after the entry header */
+    uint32_t m_size;
+} pack_location_t;
+
+/**
+ * @brief A package without its records: the table of the package as it was
+ * read, and for every index entry the hash of the bytes it pointed to
+ */
+typedef struct package_manifest_t {
+    package_table_t m_table;
+    std::vector<uint64_t> m_hashes;
+} package_manifest_t;
+
+/**
+ * @brief Lists every record of a pack file. A pack file is a header followed by
+ * records, each prefixed by its hash and size. A truncated record at the end,
+ * left by an interrupted append, is cut off the file.
+ * @param value: receives the records, keyed by hash
+ * @return the size of the pack file, without the truncated record
+ * @throws PackageException, if the file isn't a pack file
+ */
+uint64_t scanPack(const std::string& path,
+                  std::unordered_map<uint64_t, pack_location_t>& value);
+
+/**
+ * @brief Appends a record to a pack file, writing its header first if the file
+ * is empty
+ * @param packSize: the size of the pack file, updated after the append
+ * @return where the bytes of the record were written
+ * @throws PackageException, if the file can't be written
+ */
+pack_location_t appendRecord(std::ostream&,
+                             uint64_t& packSize,
+                             uint64_t hash,
+                             const lib::ByteBuffer& value);
+
+/**
+ * @brief Reads the stored bytes of a record from a pack file
+ * @param value: replaced by a buffer of the size of the record
+ * @throws PackageException, if there aren't enough bytes left in the stream
+ */
+void readRecord(std::istream&,
+                const pack_location_t& location,
+                lib::ByteBuffer& value);
+
+/**
+ * @brief Loads a manifest written by writeManifest()
+ * @throws PackageException, if the file can't be read or is corrupt
+ */
+void readManifest(const std::string& path, package_manifest_t& value);
+
+/**
+ * @brief Saves a manifest. The file is written next to path first, and then
+ * renamed over it, so an interrupted write never leaves a corrupt manifest.
+ * @throws PackageException, if the file can't be written
+ */
+void writeManifest(const std::string& path, const package_manifest_t& value);
+
+}  // namespace s4pkg::internal::recordstore
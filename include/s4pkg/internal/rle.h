@@ -25,8 +25,11 @@
 #include <string>
 #include <vector>
 
+#include <s4pkg/internal/binarycursor.h>
 #include <s4pkg/internal/dds.h>
 #include <s4pkg/internal/export.h>
+#include <s4pkg/internal/layout.h>
+#include <s4pkg/io/bytesource.h>
 
 // TODO: Should only be exported when actively developing, users should not need
 // to rely on these functions
@@ -67,13 +70,72 @@ typedef struct rle_header_t {
     uint32_t m_streamSize;
 } rle_header_t;
 
+// Only the fixed part at the start, the mipmap headers depend on the format
+S4PKG_LAYOUT(rle_header_t,
+             16,
+             S4PKG_FIELD(m_fourCC),
+             S4PKG_FIELD(m_rleVersion),
+             S4PKG_FIELD(m_width),
+             S4PKG_FIELD(m_height),
+             S4PKG_FIELD(m_mipCount),
+             S4PKG_FIELD(m_unknown0));
+
 typedef struct rle_file_t {
     rle_header_t m_rleHeader;
-    std::vector<uint8_t> m_rleData;
     dds::dds_file_t m_ddsFile;
 } rle_file_t;
 
+// The std::istream overloads read through a StreamByteSource
+
+/**
+ * @brief Reads the header at the start of the bytes. The size of the stream,
+ * which the header records, is the size of the cursor or the source.
+ */
+S4PKG_EXPORT rle_header_t readHeader(BinaryCursor&);
+rle_header_t readHeader(ByteSource&);
 rle_header_t readHeader(std::istream&);
+
+/**
+ * @brief Decodes the image in the bytes of the cursor. The blocks are written
+ * straight into the surfaces of the DDS file, without copying the stream.
+ * @throws PackageException, if the header or the blocks are corrupt
+ */
+S4PKG_EXPORT rle_file_t readFile(BinaryCursor&);
+S4PKG_EXPORT rle_file_t readFile(ByteSource&);
 S4PKG_EXPORT rle_file_t readFile(std::istream&);
 
+/**
+ * @brief How the alpha of a DXT5 block decodes, which decides how the block
+ * is stored in RLE images
+ */
+typedef enum block_class_t {
+    MIXED_BLOCK,
+    TRANSPARENT_BLOCK, /**< Every pixel has an alpha of 0 */
+    OPAQUE_BLOCK, /**< Every pixel has an alpha of 255 */
+} block_class_t;
+
+/**
+ * @brief Classifies DXT5 blocks by their alpha. Values interpolated between
+ * different endpoints are always taken as mixed, as decoders round them
+ * differently.
+ * @param classes: receives a block_class_t for every block
+ */
+S4PKG_EXPORT void classifyBlocks(const uint8_t* blocks,
+                                 uint64_t blockCount,
+                                 uint8_t* classes);
+
+/**
+ * @brief Encodes the surfaces of a DXT5 image. Transparent blocks are stored
+ * as a command only, and so are the alpha halves of opaque blocks in RLE2.
+ * @param specularMask: a DXT5 image with the same surfaces, whose blocks are
+ * stored as the specular mask of the non-transparent blocks of RLES images.
+ * Without it, RLES images have no specular mask.
+ * @throws PackageException, if the image doesn't fit in an RLE image, or the
+ * specular mask doesn't match it
+ */
+S4PKG_EXPORT lib::ByteBuffer writeFile(
+    const dds::dds_file_t& ddsFile,
+    rle_version_t version,
+    const dds::dds_file_t* specularMask = nullptr);
+
 };  // namespace s4pkg::internal::rle
@@ -0,0 +1,99 @@
+/*
+ * Copyright (c) 2022- Gerber Lóránt Viktor
+ * Author: Gerber Lóránt Viktor <glorantv@student.elte.hu>
+ *
+ * This file is part of s4pkg.
+ *
+ * s4pkg is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <s4pkg/internal/types.h>
+
+#include <cinttypes>
+#include <vector>
+
+namespace s4pkg::internal::soaindex {
+
+/**
+ * @brief Structure-of-arrays copy of a package index. Every field of
+ * index_entry_t lives in its own contiguous array, so scans over a single
+ * column (type, group, ...) only touch the memory they actually need. Constant
+ * values from the package flags are already applied here.
+ */
+typedef struct soa_index_t {
+    std::vector<uint32_t> m_types;
+    std::vector<uint32_t> m_groups;
+    std::vector<uint32_t> m_instanceExs;
+    std::vector<uint32_t> m_instances;
+    std::vector<uint32_t> m_positions;
+    std::vector<uint32_t> m_sizes;
+    std::vector<uint32_t> m_sizesDecompressed;
+    std::vector<uint16_t> m_compressionTypes;
+    std::vector<uint16_t> m_committed;
+    std::vector<uint8_t> m_extendedCompressionTypes;
+
+    size_t size() const { return m_types.size(); }
+} soa_index_t;
+
+/**
+ * @brief A predicate for filter(). An entry matches if its type is one of
+ * m_types (or m_types is empty), and, if m_matchGroup is set, its group equals
+ * m_group.
+ */
+typedef struct soa_filter_t {
+    std::vector<uint32_t> m_types;
+    bool m_matchGroup;
+    uint32_t m_group;
+} soa_filter_t;
+
+/**
+ * @brief Builds the structure-of-arrays layout from a parsed index
+ * @param flags: the flags of the package, to know which constants to apply
+ * @param constantType: type used for every entry if flags.m_constantType is set
+ * @param constantGroup: group used for every entry if flags.m_constantGroup is
+ * set
+ * @param constantInstanceEx: instanceEx used for every entry if
+ * flags.m_constantInstanceEx is set
+ * @return the new index
+ */
+soa_index_t build(const index_t&,
+                  const flags_t& flags,
+                  uint32_t constantType,
+                  uint32_t constantGroup,
+                  uint32_t constantInstanceEx);
+
+/**
+ * @brief Appends every entry of from to the end of into, used for building
+ * merged indices of multiple packages. Entries are copied unchanged, so their
+ * m_positions are still offsets into their own package; the caller keeps track
+ * of which package the entries from into.size() onwards came from.
+ */
+void append(soa_index_t& into, const soa_index_t& from);
+
+/**
+ * @brief Reconstructs a single index entry in the original layout
+ * @param position: the position of the entry, must be less than size()
+ */
+index_entry_t entryAt(const soa_index_t&, uint32_t position);
+
+/**
+ * @brief Finds every entry matching the filter. Uses SSE2 when it is available
+ * on the target, a scalar loop otherwise.
+ * @return the positions of the matching entries, in ascending order
+ */
+std::vector<uint32_t> filter(const soa_index_t&, const soa_filter_t&);
+
+}  // namespace s4pkg::internal::soaindex
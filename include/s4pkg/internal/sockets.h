@@ -0,0 +1,81 @@
+/*
+ * Copyright (c) 2022- Gerber Lóránt Viktor
+ * Author: Gerber Lóránt Viktor <glorantv@student.elte.hu>
+ *
+ * This file is part of s4pkg.
+ *
+ * s4pkg is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <cinttypes>
+#include <cstddef>
+#include <string>
+
+// Blocking helpers for Unix domain sockets. Everything here throws a
+// PackageException on platforms without them.
+
+namespace s4pkg::internal::sockets {
+
+/**
+ * @brief Creates a listening socket at path, replacing a stale socket file
+ * left there by a process that is gone
+ * @return the descriptor of the socket
+ * @throws PackageException, if the socket can't be created, or another process
+ * is listening at path
+ */
+int listenAt(const std::string& path);
+
+/**
+ * @brief Connects to a listening socket
+ * @return the descriptor of the connection
+ * @throws PackageException, if nothing is listening at path
+ */
+int connectTo(const std::string& path);
+
+void closeSocket(int descriptor);
+
+/**
+ * @brief Makes receiving fail once no byte has arrived for the given time,
+ * instead of waiting for the peer forever
+ * @throws PackageException, if the option can't be set
+ */
+void setReceiveTimeout(int descriptor, uint32_t milliseconds);
+
+/**
+ * @brief Sends every byte, retrying short writes
+ * @throws PackageException, if the connection fails
+ */
+void sendAll(int descriptor, const void* buffer, size_t size);
+
+/**
+ * @brief Receives exactly size bytes
+ * @return false if the peer closed the connection before the first byte
+ * @throws PackageException, if the connection fails, is closed halfway, or
+ * times out
+ */
+bool receiveAll(int descriptor, void* buffer, size_t size);
+
+/**
+ * @brief Sends size bytes of a file starting at offset, without copying them
+ * through user space where the platform allows it
+ * @throws PackageException, if the file is shorter, or the connection fails
+ */
+void sendFileRange(int descriptor,
+                   int fileDescriptor,
+                   uint64_t offset,
+                   uint64_t size);
+
+}  // namespace s4pkg::internal::sockets
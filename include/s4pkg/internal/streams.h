@@ -20,55 +20,64 @@
 
 #pragma once
 
+#include <s4pkg/internal/binarycursor.h>
 #include <s4pkg/internal/types.h>
+#include <s4pkg/io/bytesink.h>
+#include <s4pkg/io/bytesource.h>
 
 #include <istream>
 #include <ostream>
 
 namespace s4pkg::internal::streams {
 
+// Every read function has a ByteSource overload, which is what they are
+// implemented with. Sequential reads start at the position of the source, and
+// move it past what they read. The std::istream overloads adapt the stream
+// with a StreamByteSource, so they read from, and move, the position of the
+// stream.
+
 /**
  * @brief Reads size bytes from this stream into buffer
  * @param buffer: the array to read into
  * @param size: number of bytes to read
  * @throws PackageException, if there aren't enough bytes left in the stream
  */
-void readBytes(std::istream&, uint8_t* buffer, int size);
+void readBytes(ByteSource&, uint8_t* buffer, uint64_t size);
 
 /**
  * @brief Reads a single byte from stream
  * @param value: the variable to read into
  * @throws PackageException, if there aren't enough bytes left in the stream
  */
-void readUint8(std::istream&, uint8_t& value);
+void readUint8(ByteSource&, uint8_t& value);
 
 /**
  * @brief Reads 32-bit unsigned integer from stream
  * @param value: the variable to read into
  * @throws PackageException, if there aren't enough bytes left in the stream
  */
-void readUint32(std::istream&, uint32_t& value);
+void readUint32(ByteSource&, uint32_t& value);
 
 /**
  * @brief Reads a 32-bit signed integer from stream
  * @param value: the variable to read into
  * @throws PackageException, if there aren't enough bytes left in the stream
  */
-void readInt32(std::istream&, int32_t& value);
+void readInt32(ByteSource&, int32_t& value);
 
 /**
  * @brief Reads a 64-bit unsigned integer from stream
  * @param value: the variable to read into
  * @throws PackageException, if there aren't enough bytes left in the stream
  */
-void readUint64(std::istream&, uint64_t& value);
+void readUint64(ByteSource&, uint64_t& value);
 
 /**
  * @brief Reads a 16-bit unsigned interger from stream
  * @param value: the variable to read into
  * @throws PackageException, if there aren't enough bytes left in the stream
  */
-void readUint16(std::istream&, uint16_t& value);
+void readUint16(ByteSource&, uint16_t& value);
 
 /**
  * @brief Reads [size] unsigned 32-bit integers from stream into buffer
@@ -76,29 +85,36 @@ void readUint16(std::istream&, uint16_t& value);
  * @param size: the number of integers to read
  * @throws PackageException, if there aren't enough bytes left in the stream
  */
-void readUint32Array(std::istream&, uint32_t* buffer, int size);
+void readUint32Array(ByteSource&, uint32_t* buffer, int size);
 
 /**
  * @brief Reads timestamp from stream. (1 signed 32-bit integer)
  * @param value: the variable to read into
  * @throws PackageException, if there aren't enough bytes left in the stream
  */
-void readPackageTime(std::istream&, package_time_t& value);
+void readPackageTime(ByteSource&, package_time_t& value);
 
 /**
  * @brief Reads a version number from stream. (2 unsigned 32-bit integers)
  * @param value: the variable to read into
  * @throws PackageException, if there aren't enough bytes left in the stream
  */
-void readPackageVersion(std::istream&, package_version_t& value);
+void readPackageVersion(ByteSource&, package_version_t& value);
 
 /**
  * @brief Reads the complete package header from stream. The stream should be
- * positioned at the start of the file.
+ * positioned at the start of the file. The header is read at once.
  * @param value: the struct to populate
  * @throws PackageException, if there aren't enough bytes left in the stream
  */
-void readPackageHeader(std::istream&, package_header_t& value);
+void readPackageHeader(ByteSource&, package_header_t& value);
+
+/**
+ * @brief Checks whether the stream starts with the DBPF file identifier. Reads
+ * 4 bytes, and doesn't throw, to make rejecting other files cheap.
+ * @return true if the first 4 bytes are "DBPF"
+ */
+bool hasPackageIdentifier(ByteSource&);
 
 /**
  * @brief Reads package flags (a bitfield) from stream. The stream should be
@@ -106,48 +122,146 @@ void readPackageHeader(std::istream&, package_header_t& value);
  * @param value: the struct (bitfield) to populate
  * @throws PackageException, if there aren't enough bytes left in the stream
  */
-void readPackageFlags(std::istream&, flags_t& value);
+void readPackageFlags(ByteSource&, flags_t& value);
 
 /**
  * @brief Reads a single index entry from the stream
  * @param value: the variable to read into
  * @throws PackageException, if there aren't enough bytes left in the stream
  */
-void readIndexEntry(std::istream&, const flags_t&, index_entry_t& value);
+void readIndexEntry(ByteSource&, const flags_t&, index_entry_t& value);
+
+/**
+ * @brief Reads a single index entry from memory
+ * @throws PackageException, if there aren't enough bytes left
+ */
+void readIndexEntry(BinaryCursor&, const flags_t&, index_entry_t& value);
 
 /**
  * @brief Reads the complete package index from stream. The stream should be
- * positioned after the flags.
+ * positioned after the flags. Unless the source is in memory, the bytes the
+ * index can take up are read at once, and the entries parsed from memory.
  * @param value: the variable to read into
  * @throws PackageException, if there aren't enough bytes left in the stream
  */
-void readIndex(std::istream&,
+void readIndex(ByteSource&,
                const flags_t&,
                uint32_t indexRecordCount,
                index_t& value);
 
 /**
- * @brief Reads a single record from the stream. The stream is seeked by this
- * function.
+ * @brief Reads the header, flags, constant values and index of a package, but
+ * none of its records. The stream should be positioned at the start of the
+ * file, and is seeked by this function.
+ * @param value: the struct to populate
+ * @throws PackageException, if there aren't enough bytes left in the stream
+ */
+void readPackageTable(ByteSource&, package_table_t& value);
+
+/**
+ * @brief Reads the bytes of a record as they are stored in the package, without
+ * decompressing them. Reads at the position of the record, so it is
+ * thread-safe, and leaves the position of a ByteSource alone.
+ * @param value: the buffer to read into, replaced by a buffer of the size of
+ * the record
+ * @throws PackageException, if there aren't enough bytes left in the stream
+ */
+void readRawRecord(const ByteSource&,
+                   const index_entry_t&,
+                   lib::ByteBuffer& value);
+
+/**
+ * @brief Decompresses the stored bytes of a record, according to the
+ * compression type in its index entry. Uncompressed records are copied as is.
+ * @param compressed: the bytes read by readRawRecord()
+ * @param value: the buffer to decompress into
+ * @throws PackageException, if the compression type is unsupported or the data
+ * is corrupt
+ */
+void decompressRecord(const index_entry_t&,
+                      const lib::ByteBuffer& compressed,
+                      lib::ByteBuffer& value);
+
+/**
+ * @brief Reads a single record from the stream, see readRawRecord()
  * @param value: the variable to read into
  * @throws PackageException, if there aren't enough bytes left in the stream
  */
-void readRecord(std::istream&,
+void readRecord(const ByteSource&,
                 const index_t&,
                 uint32_t index,
                 raw_record_t& value);
 
 /**
- * @brief Reads all records of this package from the stream. The stream is
- * seeked by this function.
+ * @brief Reads all records of this package from the stream, see
+ * readRawRecord()
  * @param value: the variable to read into
  * @throws PackageException, if there aren't enough bytes left in the stream
  */
+void readRecords(const ByteSource&, const index_t&, records_t& value);
+
+void readBytes(std::istream&, uint8_t* buffer, int size);
+void readUint8(std::istream&, uint8_t& value);
+void readUint32(std::istream&, uint32_t& value);
+void readInt32(std::istream&, int32_t& value);
+void readUint64(std::istream&, uint64_t& value);
+void readUint16(std::istream&, uint16_t& value);
+void readUint32Array(std::istream&, uint32_t* buffer, int size);
+void readPackageTime(std::istream&, package_time_t& value);
+void readPackageVersion(std::istream&, package_version_t& value);
+void readPackageHeader(std::istream&, package_header_t& value);
+bool hasPackageIdentifier(std::istream&);
+void readPackageFlags(std::istream&, flags_t& value);
+void readIndexEntry(std::istream&, const flags_t&, index_entry_t& value);
+void readIndex(std::istream&,
+               const flags_t&,
+               uint32_t indexRecordCount,
+               index_t& value);
+void readPackageTable(std::istream&, package_table_t& value);
+void readRawRecord(std::istream&,
+                   const index_entry_t&,
+                   lib::ByteBuffer& value);
+void readRecord(std::istream&,
+                const index_t&,
+                uint32_t index,
+                raw_record_t& value);
 void readRecords(std::istream&, const index_t&, records_t& value);
 
 // These methods behave the same as their "read" counterparts unless documented
 // otherwise, throwing a PackageException when encountering an error with the
-// stream
+// stream. The std::ostream overloads adapt the stream with a StreamByteSink.
+
+void writeBytes(ByteSink&, const uint8_t* buffer, uint64_t size);
+void writeUint8(ByteSink&, const uint8_t& value);
+void writeUint32(ByteSink&, const uint32_t& value);
+void writeInt32(ByteSink&, const int32_t& value);
+void writeUint64(ByteSink&, const uint64_t& value);
+void writeUint16(ByteSink&, const uint16_t& value);
+void writeUint32Array(ByteSink&, const uint32_t* array, int size);
+void writePackageTime(ByteSink&, const package_time_t& value);
+void writePackageVersion(ByteSink&, const package_version_t& value);
+void writePackageHeader(ByteSink&, const package_header_t& value);
+void writePackageFlags(ByteSink&, const flags_t& value);
+void writeIndexEntry(ByteSink&, const flags_t&, const index_entry_t& value);
+void writeIndex(ByteSink&, const flags_t&, const index_t& value);
+
+/**
+ * @brief Writes a record to the stream. This method modifies the index to set
+ * the position, size, and decompressedSize
+ * @param index: a modifiable index
+ * @param value: the record to write
+ */
+void writeRecord(ByteSink&,
+                 index_t&,
+                 uint32_t index,
+                 const raw_record_t& value);
+
+/**
+ * @brief Writes a record table to the stream. This method modifies the index to
+ * set the position, size and decompressedSize
+ * @param value: the record table
+ */
+void writeRecords(ByteSink&, index_t&, const records_t& value);
 
 void writeBytes(std::ostream&, const uint8_t* buffer, int size);
 void writeUint8(std::ostream&, const uint8_t& value);
@@ -162,23 +276,19 @@ void writePackageHeader(std::ostream&, const package_header_t& value);
 void writePackageFlags(std::ostream&, const flags_t& value);
 void writeIndexEntry(std::ostream&, const flags_t&, const index_entry_t& value);
 void writeIndex(std::ostream&, const flags_t&, const index_t& value);
-
-/**
- * @brief Writes a record to the stream. This method modifies the index to set
- * the position, size, and decompressedSize
- * @param index: a modifiable index
- * @param value: the record to write
- */
 void writeRecord(std::ostream&,
                  index_t&,
                  uint32_t index,
                  const raw_record_t& value);
+void writeRecords(std::ostream&, index_t&, const records_t& value);
 
 /**
- * @brief Writes a record table to the stream. This method modifies the index to
- * set the position, size and decompressedSize
- * @param value: the record table
+ * @brief Copies bytes from the current position of one stream to another, in
+ * chunks, so that large ranges are never held in memory at once
+ * @param size: number of bytes to copy
+ * @throws PackageException, if there aren't enough bytes left in the input, or
+ * the output can't be written
  */
-void writeRecords(std::ostream&, index_t&, const records_t& value);
+void copyBytes(std::istream&, std::ostream&, uint64_t size);
 
 }  // namespace s4pkg::internal::streams
@@ -24,11 +24,13 @@
 #include <memory>
 #include <vector>
 
+#include <s4pkg/internal/layout.h>
 #include <s4pkg/lib/bytebuffer.h>
 
 // The types defined here are deliberately C-style, to keep them as close to the
 // Maxis-provided .bt files as possible. These are purely to be used internally,
-// there are C++-style classes provided for everything here.
+// there are C++-style classes provided for everything here. The ones stored
+// with a fixed layout have it declared right after them, see layout.h.
 
 /**
  * @brief 32-bit signed timestamp of seconds since the UNIX epoch
@@ -40,6 +42,8 @@ typedef struct package_version_t {
     uint32_t m_minor;
 } package_version_t;
 
+S4PKG_LAYOUT(package_version_t, 8, S4PKG_FIELD(m_major), S4PKG_FIELD(m_minor));
+
 /**
  * @brief The header of package files. Unused or deprecated fields should be set
  * to 0, unless marked otherwise
@@ -61,6 +65,23 @@ typedef struct package_header_t {
     uint32_t m_unused5[6];
 } package_header_t;
 
+S4PKG_LAYOUT(package_header_t,
+             96,
+             S4PKG_FIELD(m_fileIdentifier),
+             S4PKG_FIELD(m_fileVersion),
+             S4PKG_FIELD(m_userVersion),
+             S4PKG_FIELD(m_unused1),
+             S4PKG_FIELD(m_creationTime),
+             S4PKG_FIELD(m_updatedTime),
+             S4PKG_FIELD(m_unused2),
+             S4PKG_FIELD(m_indexRecordEntryCount),
+             S4PKG_FIELD(m_indexRecordPositionLow),
+             S4PKG_FIELD(m_indexRecordSize),
+             S4PKG_FIELD(m_unused3),
+             S4PKG_FIELD(m_unused4),
+             S4PKG_FIELD(m_indexRecordPosition),
+             S4PKG_FIELD(m_unused5));
+
 typedef struct flags_t {
     uint32_t m_constantType : 1;
     uint32_t m_constantGroup : 1;
@@ -96,6 +117,20 @@ typedef struct index_t {
     std::vector<index_entry_t> m_entries;
 } index_t;
 
+/**
+ * @brief Everything needed to locate the records of a package: the header, the
+ * flags with their constant values, and the index. Not a structure in the file
+ * itself, this is what reading a package without its records results in.
+ */
+typedef struct package_table_t {
+    package_header_t m_header;
+    flags_t m_flags;
+    uint32_t m_constantType;
+    uint32_t m_constantGroup;
+    uint32_t m_constantInstanceEx;
+    index_t m_index;
+} package_table_t;
+
 typedef struct raw_record_t {
     uint32_t m_index;
     uint32_t m_size;
@@ -0,0 +1,170 @@
+/*
+ * Copyright (c) 2022- Gerber Lóránt Viktor
+ * Author: Gerber Lóránt Viktor <glorantv@student.elte.hu>
+ *
+ * This file is part of s4pkg.
+ *
+ * s4pkg is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#pragma once
+
+#include <s4pkg/internal/export.h>
+#include <s4pkg/lib/bytebuffer.h>
+#include <s4pkg/lib/string.h>
+#include <s4pkg/object.h>
+
+#include <cinttypes>
+#include <fstream>
+#include <functional>
+#include <ostream>
+#include <string>
+#include <vector>
+
+namespace s4pkg {
+
+/**
+ * @brief The counterpart of ByteSource, for writing packages and images.
+ * Writing past the end grows the sink, gaps are filled with zeroes. Sinks
+ * aren't thread-safe.
+ */
+class S4PKG_EXPORT ByteSink : public Object {
+   private:
+    uint64_t m_position = 0;
+
+   public:
+    virtual ~ByteSink() = default;
+
+    /**
+     * @brief Writes size bytes at offset, like pwrite()
+     * @throws PackageException, if writing fails
+     */
+    virtual void writeAt(uint64_t offset,
+                         const uint8_t* buffer,
+                         uint64_t size) = 0;
+
+    /**
+     * @brief Writes size bytes at the position, and moves past them
+     * @throws PackageException, if writing fails
+     */
+    virtual void write(const uint8_t* buffer, uint64_t size);
+    virtual void seek(uint64_t position);
+    virtual uint64_t tell() const;
+};
+
+/**
+ * @brief Writes a file with pwrite(), or through an std::ofstream where that
+ * isn't available. The file is truncated when the sink is created.
+ */
+class S4PKG_EXPORT FileByteSink : public ByteSink {
+   private:
+    std::string m_path;
+    int m_descriptor;  // -1 when writing through m_stream
+    std::ofstream m_stream;
+
+   public:
+    /**
+     * @throws PackageException, if the file can't be created
+     */
+    explicit FileByteSink(const std::string& path);
+    ~FileByteSink();
+
+    FileByteSink(const FileByteSink&) = delete;
+    FileByteSink& operator=(const FileByteSink&) = delete;
+
+    void writeAt(uint64_t offset,
+                 const uint8_t* buffer,
+                 uint64_t size) override;
+
+    // Object interface
+   public:
+    const lib::String toString() const override;
+};
+
+/**
+ * @brief Collects the written bytes in memory
+ */
+class S4PKG_EXPORT MemoryByteSink : public ByteSink {
+   private:
+    std::vector<uint8_t> m_data;
+
+   public:
+    void writeAt(uint64_t offset,
+                 const uint8_t* buffer,
+                 uint64_t size) override;
+
+    uint64_t getSize() const { return m_data.size(); }
+    const uint8_t* getData() const { return m_data.data(); }
+
+    /**
+     * @return a copy of everything written
+     */
+    lib::ByteBuffer getBuffer() const;
+
+    // Object interface
+   public:
+    const lib::String toString() const override;
+};
+
+typedef std::function<
+    void(uint64_t offset, const uint8_t* buffer, uint64_t size)>
+    ByteSinkCallback;
+
+/**
+ * @brief Writes through a user function, with the same contract as
+ * ByteSink::writeAt()
+ */
+class S4PKG_EXPORT CallbackByteSink : public ByteSink {
+   private:
+    ByteSinkCallback m_callback;
+
+   public:
+    explicit CallbackByteSink(ByteSinkCallback callback);
+
+    void writeAt(uint64_t offset,
+                 const uint8_t* buffer,
+                 uint64_t size) override;
+
+    // Object interface
+   public:
+    const lib::String toString() const override;
+};
+
+/**
+ * @brief Adapts an std::ostream, for the functions still taking streams. The
+ * sequential methods use the position of the stream, writes at an offset seek
+ * it.
+ */
+class S4PKG_EXPORT StreamByteSink : public ByteSink {
+   private:
+    std::ostream& m_stream;
+
+   public:
+    explicit StreamByteSink(std::ostream& stream) : m_stream(stream) {}
+
+    void writeAt(uint64_t offset,
+                 const uint8_t* buffer,
+                 uint64_t size) override;
+
+    void write(const uint8_t* buffer, uint64_t size) override;
+    void seek(uint64_t position) override;
+    uint64_t tell() const override;
+
+    // Object interface
+   public:
+    const lib::String toString() const override;
+};
+
+}  // namespace s4pkg
@@ -0,0 +1,256 @@
+/*
+ * Copyright (c) 2022- Gerber Lóránt Viktor
+ * Author: Gerber Lóránt Viktor <glorantv@student.elte.hu>
+ *
+ * This file is part of s4pkg.
+ *
+ * s4pkg is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#pragma once
+
+#include <s4pkg/internal/export.h>
+#include <s4pkg/lib/bytebuffer.h>
+#include <s4pkg/lib/string.h>
+#include <s4pkg/object.h>
+
+#include <cinttypes>
+#include <fstream>
+#include <functional>
+#include <istream>
+#include <mutex>
+#include <string>
+
+namespace s4pkg {
+
+/**
+ * @brief Random access to the bytes of a package, image, or anything else
+ * parsed by this library. Reads at an offset (readSome(), readAt()) are
+ * thread-safe in every implementation here, and don't move the position used
+ * by the sequential methods (read(), seek(), tell()), which aren't.
+ */
+class S4PKG_EXPORT ByteSource : public Object {
+   private:
+    uint64_t m_position = 0;
+
+   public:
+    virtual ~ByteSource() = default;
+
+    virtual uint64_t getSize() const = 0;
+
+    /**
+     * @brief Reads up to size bytes at offset, like pread()
+     * @return the number of bytes read, less than size only at the end
+     * @throws PackageException, if reading fails
+     */
+    virtual uint64_t readSome(uint64_t offset,
+                              uint8_t* buffer,
+                              uint64_t size) const = 0;
+
+    /**
+     * @return the bytes of the whole source, if they are in memory, otherwise
+     * nullptr
+     */
+    virtual const uint8_t* getData() const { return nullptr; }
+
+    /**
+     * @brief Reads exactly size bytes at offset
+     * @throws PackageException, if there aren't enough bytes
+     */
+    void readAt(uint64_t offset, uint8_t* buffer, uint64_t size) const;
+
+    /**
+     * @brief Reads exactly size bytes at the position, and moves past them
+     * @throws PackageException, if there aren't enough bytes
+     */
+    virtual void read(uint8_t* buffer, uint64_t size);
+    virtual void seek(uint64_t position);
+    virtual uint64_t tell() const;
+};
+
+/**
+ * @brief Tells apart the files a path referred to over time. A file replaced
+ * on disk, or rewritten in place, has another identity at the same path.
+ */
+struct S4PKG_EXPORT FileIdentity {
+    uint64_t m_device = 0;  // 0 where it isn't available
+    uint64_t m_inode = 0;
+    uint64_t m_size = 0;
+    int64_t m_modifiedTime = 0;
+
+    bool operator==(const FileIdentity& other) const {
+        return m_device == other.m_device && m_inode == other.m_inode &&
+               m_size == other.m_size && m_modifiedTime == other.m_modifiedTime;
+    }
+
+    bool operator!=(const FileIdentity& other) const {
+        return !(*this == other);
+    }
+};
+
+/**
+ * @brief Reads a file with pread(), without any locking. Where that isn't
+ * available, reads go through a locked std::ifstream.
+ */
+class S4PKG_EXPORT FileByteSource : public ByteSource {
+   private:
+    std::string m_path;
+    uint64_t m_size;
+    int m_descriptor;  // -1 when reading through m_stream
+    FileIdentity m_identity;
+
+    mutable std::mutex m_streamMutex;
+    mutable std::ifstream m_stream;
+
+   public:
+    /**
+     * @throws PackageException, if the file can't be opened
+     */
+    explicit FileByteSource(const std::string& path);
+    ~FileByteSource();
+
+    FileByteSource(const FileByteSource&) = delete;
+    FileByteSource& operator=(const FileByteSource&) = delete;
+
+    /**
+     * @brief The identity of the file that was opened, even if the path has
+     * been replaced since
+     */
+    const FileIdentity& getIdentity() const { return m_identity; }
+
+    uint64_t getSize() const override { return m_size; }
+    uint64_t readSome(uint64_t offset,
+                      uint8_t* buffer,
+                      uint64_t size) const override;
+
+    // Object interface
+   public:
+    const lib::String toString() const override;
+};
+
+/**
+ * @brief Maps a file into memory, so parsing it reads memory directly. Where
+ * mapping isn't available, the whole file is read into memory instead.
+ */
+class S4PKG_EXPORT MappedByteSource : public ByteSource {
+   private:
+    std::string m_path;
+    uint64_t m_size;
+    void* m_region;  // nullptr for empty files, or when m_buffer is used
+    lib::ByteBuffer m_buffer;
+
+   public:
+    /**
+     * @throws PackageException, if the file can't be opened or mapped
+     */
+    explicit MappedByteSource(const std::string& path);
+    ~MappedByteSource();
+
+    MappedByteSource(const MappedByteSource&) = delete;
+    MappedByteSource& operator=(const MappedByteSource&) = delete;
+
+    uint64_t getSize() const override { return m_size; }
+    uint64_t readSome(uint64_t offset,
+                      uint8_t* buffer,
+                      uint64_t size) const override;
+    const uint8_t* getData() const override;
+
+    // Object interface
+   public:
+    const lib::String toString() const override;
+};
+
+/**
+ * @brief Reads from memory, either borrowed (which has to outlive the source)
+ * or owned
+ */
+class S4PKG_EXPORT MemoryByteSource : public ByteSource {
+   private:
+    lib::ByteBuffer m_buffer;
+    const uint8_t* m_data;
+    uint64_t m_size;
+
+   public:
+    MemoryByteSource(const uint8_t* data, uint64_t size);
+    explicit MemoryByteSource(lib::ByteBuffer buffer);
+
+    uint64_t getSize() const override { return m_size; }
+    uint64_t readSome(uint64_t offset,
+                      uint8_t* buffer,
+                      uint64_t size) const override;
+    const uint8_t* getData() const override { return m_data; }
+
+    // Object interface
+   public:
+    const lib::String toString() const override;
+};
+
+typedef std::function<uint64_t(uint64_t offset, uint8_t* buffer, uint64_t size)>
+    ByteSourceCallback;
+
+/**
+ * @brief Reads through a user function, with the same contract as
+ * ByteSource::readSome(). The function has to be thread-safe, if the source is
+ * read from several threads.
+ */
+class S4PKG_EXPORT CallbackByteSource : public ByteSource {
+   private:
+    uint64_t m_size;
+    ByteSourceCallback m_callback;
+
+   public:
+    CallbackByteSource(uint64_t size, ByteSourceCallback callback);
+
+    uint64_t getSize() const override { return m_size; }
+    uint64_t readSome(uint64_t offset,
+                      uint8_t* buffer,
+                      uint64_t size) const override;
+
+    // Object interface
+   public:
+    const lib::String toString() const override;
+};
+
+/**
+ * @brief Adapts an std::istream, for the functions still taking streams. The
+ * sequential methods use the position of the stream, reads at an offset seek
+ * it, and are locked.
+ */
+class S4PKG_EXPORT StreamByteSource : public ByteSource {
+   private:
+    std::istream& m_stream;
+    mutable std::mutex m_streamMutex;
+
+   public:
+    explicit StreamByteSource(std::istream& stream) : m_stream(stream) {}
+
+    /**
+     * @brief Seeks to the end of the stream to find its size, and back
+     */
+    uint64_t getSize() const override;
+    uint64_t readSome(uint64_t offset,
+                      uint8_t* buffer,
+                      uint64_t size) const override;
+
+    void read(uint8_t* buffer, uint64_t size) override;
+    void seek(uint64_t position) override;
+    uint64_t tell() const override;
+
+    // Object interface
+   public:
+    const lib::String toString() const override;
+};
+
+}  // namespace s4pkg
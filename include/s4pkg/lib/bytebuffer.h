@@ -50,6 +50,12 @@ class S4PKG_EXPORT ByteBuffer {
     ByteBuffer(const ByteBuffer& other)
         : ByteBuffer(other.m_buffer, other.m_length) {}
 
+    ByteBuffer(ByteBuffer&& other) noexcept
+        : m_buffer(other.m_buffer), m_length(other.m_length) {
+        other.m_buffer = nullptr;
+        other.m_length = 0;
+    }
+
     ByteBuffer& operator=(const ByteBuffer& other) {
         delete[] m_buffer;
 
@@ -61,7 +67,7 @@ class S4PKG_EXPORT ByteBuffer {
         return *this;
     }
 
-    ByteBuffer& operator=(ByteBuffer&& other) {
+    ByteBuffer& operator=(ByteBuffer&& other) noexcept {
         if (this == &other) {
             return *this;
         }
@@ -0,0 +1,120 @@
+/*
+ * Copyright (c) 2022- Gerber Lóránt Viktor
+ * Author: Gerber Lóránt Viktor <glorantv@student.elte.hu>
+ *
+ * This file is part of s4pkg.
+ *
+ * s4pkg is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <s4pkg/internal/export.h>
+#include <s4pkg/internal/libraryscan.h>
+#include <s4pkg/lib/string.h>
+#include <s4pkg/library/packagelibrary.h>
+#include <s4pkg/object.h>
+#include <s4pkg/package/resourcekey.h>
+
+#include <optional>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace s4pkg {
+
+/**
+ * @brief How the copies of a resource found in more than one package relate to
+ * each other
+ */
+enum ConflictKind {
+    IDENTICAL_DUPLICATE, /**< Every copy has the same content */
+    OVERRIDE, /**< Copies differ, but at most one content comes from packages
+                 which aren't base packages */
+    CONFLICT, /**< Several non-base packages provide different content */
+    UNREADABLE /**< The copies that could be read are the same, but others
+                  couldn't be read, see ConflictDetector::getErrors() */
+};
+
+/**
+ * @brief A resource found in more than one package of a library
+ */
+struct S4PKG_EXPORT ResourceConflict {
+    ResourceKey m_key;
+    ConflictKind m_kind;
+    LibraryLocation m_winner; /**< The copy selected by the load order rule */
+    std::vector<LibraryLocation> m_locations; /**< Every copy, in load order */
+    /**
+     * @brief Same order as m_locations, empty for copies that couldn't be read
+     */
+    std::vector<std::optional<uint64_t>> m_contentHashes;
+};
+
+/**
+ * @brief Sorts the resources a library has more than once into overrides,
+ * identical duplicates and conflicts. Only the records found in more than one
+ * package are read, and their content hashes are kept between runs, so running
+ * again after the library was rescanned only reads packages which changed.
+ * Packages are hashed in parallel.
+ */
+class S4PKG_EXPORT ConflictDetector : public Object {
+   private:
+    const PackageLibrary& m_library;
+    std::vector<std::string> m_basePaths;
+
+    // Keyed by package path, so the cache outlives package ids
+    std::unordered_map<std::string, internal::libraryscan::record_hashes_t>
+        m_hashCache;
+
+    size_t m_hashedRecordCount;
+    std::vector<LibraryScanError> m_errors;
+
+    bool isBasePackage(const std::string& path) const;
+
+   public:
+    /**
+     * @param library: the library to analyse, it must outlive the detector
+     * @param basePaths: packages in one of these directories, or their
+     * subdirectories, hold base content (the game, or a framework mod) that
+     * other packages are expected to override. Paths are compared by whole
+     * components.
+     */
+    explicit ConflictDetector(const PackageLibrary& library,
+                              const std::vector<lib::String>& basePaths = {});
+
+    /**
+     * @brief Finds every resource present in more than one package of the
+     * library, hashing the records whose hash isn't cached yet
+     * @return the colliding resources, sorted by key
+     */
+    const std::vector<ResourceConflict> analyze();
+
+    /**
+     * @brief Number of records read and hashed by the last analyze() call
+     */
+    const size_t getHashedRecordCount() const { return m_hashedRecordCount; }
+
+    /**
+     * @brief Packages that couldn't be read during the last analyze() call.
+     * Their copies are reported without a content hash, and only the copies
+     * that were read decide the kind of a conflict.
+     */
+    const std::vector<LibraryScanError>& getErrors() const { return m_errors; }
+
+    // Object interface
+   public:
+    const lib::String toString() const override;
+};
+
+}  // namespace s4pkg
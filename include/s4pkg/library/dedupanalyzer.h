@@ -0,0 +1,107 @@
+/*
+ * Copyright (c) 2022- Gerber Lóránt Viktor
+ * Author: Gerber Lóránt Viktor <glorantv@student.elte.hu>
+ *
+ * This file is part of s4pkg.
+ *
+ * s4pkg is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <s4pkg/internal/export.h>
+#include <s4pkg/internal/hashcache.h>
+#include <s4pkg/lib/string.h>
+#include <s4pkg/library/packagelibrary.h>
+#include <s4pkg/object.h>
+
+#include <string>
+#include <vector>
+
+namespace s4pkg {
+
+/**
+ * @brief Records with the same content, found anywhere in a library
+ */
+struct S4PKG_EXPORT DuplicateCluster {
+    uint64_t m_contentHash; /**< Of the decompressed content */
+    uint32_t m_sizeDecompressed;
+    std::vector<LibraryLocation> m_locations; /**< In load order */
+    uint64_t m_storedBytes; /**< Size of every copy together, as stored */
+    uint64_t m_reclaimableBytes; /**< Saved by keeping the smallest copy only */
+};
+
+/**
+ * @brief Finds records stored more than once across the packages of a
+ * library, whatever their key.
+ *
+ * Every record is hashed as it is stored (compressed), which is enough to find
+ * byte-identical copies. Of the records with the same decompressed size, only
+ * one record of every way they were stored is decompressed, to hash their
+ * content. Packages are hashed in parallel, and the hashes can be kept in a
+ * cache file, so only packages which changed are read again.
+ */
+class S4PKG_EXPORT DedupAnalyzer : public Object {
+   private:
+    const PackageLibrary& m_library;
+    std::string m_cachePath;
+    internal::hashcache::hash_cache_t m_cache;
+
+    size_t m_hashedRecordCount;
+    size_t m_decompressedRecordCount;
+    std::vector<LibraryScanError> m_errors;
+
+   public:
+    /**
+     * @param library: the library to analyse, it must outlive the analyser
+     * @param cachePath: file to keep hashes in between runs, no file is used
+     * if empty. A missing or corrupt cache file is rebuilt.
+     */
+    explicit DedupAnalyzer(const PackageLibrary& library,
+                           const lib::String& cachePath = "");
+
+    /**
+     * @brief Hashes the records not hashed yet, and groups the records with
+     * the same content. Saves the cache file, if there is one.
+     * @return clusters of at least two records, the ones saving the most bytes
+     * first
+     * @throws PackageException, if the cache file can't be written
+     */
+    const std::vector<DuplicateCluster> analyze();
+
+    /**
+     * @brief Number of records read and hashed as stored by the last
+     * analyze() call
+     */
+    const size_t getHashedRecordCount() const { return m_hashedRecordCount; }
+
+    /**
+     * @brief Number of records decompressed by the last analyze() call
+     */
+    const size_t getDecompressedRecordCount() const {
+        return m_decompressedRecordCount;
+    }
+
+    /**
+     * @brief Packages that couldn't be read during the last analyze() call,
+     * they are left out of the clusters
+     */
+    const std::vector<LibraryScanError>& getErrors() const { return m_errors; }
+
+    // Object interface
+   public:
+    const lib::String toString() const override;
+};
+
+}  // namespace s4pkg
@@ -0,0 +1,104 @@
+/*
+ * Copyright (c) 2022- Gerber Lóránt Viktor
+ * Author: Gerber Lóránt Viktor <glorantv@student.elte.hu>
+ *
+ * This file is part of s4pkg.
+ *
+ * s4pkg is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <s4pkg/internal/export.h>
+#include <s4pkg/library/packagelibrary.h>
+#include <s4pkg/object.h>
+
+#include <functional>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace s4pkg {
+
+typedef std::function<void(const LibraryChange&)> LibraryChangeListener;
+
+/**
+ * @brief Keeps a PackageLibrary up to date with its directory tree. On Linux,
+ * every directory of the tree is watched with inotify, and only the files the
+ * kernel reports are read again, so an update costs O(changed files). Where
+ * inotify isn't available (or runs out of watches), every file is stat'ed
+ * instead, see PackageLibrary::refresh().
+ *
+ * The watcher does nothing in the background, changes are applied and
+ * listeners are called from poll(), on the calling thread.
+ */
+class S4PKG_EXPORT LibraryWatcher : public Object {
+   private:
+    PackageLibrary& m_library;
+    int m_inotifyDescriptor;  // -1 when polling
+
+    typedef struct watched_directory_t {
+        std::string m_path;
+        int32_t m_depth;
+    } watched_directory_t;
+
+    std::unordered_map<int, watched_directory_t> m_watches;
+    std::vector<LibraryChangeListener> m_listeners;
+
+    void watchTree(const std::string& directory, int32_t depth);
+    void unwatchTree(const std::string& directory);
+    void fallBackToPolling();
+    void readEvents(int32_t timeoutMilliseconds,
+                    std::vector<lib::String>& paths,
+                    bool& overflowed);
+
+   public:
+    /**
+     * @brief Starts watching the root of the library. Create the watcher
+     * before the library is scanned, so nothing changing during the scan is
+     * missed.
+     * @param library: the library to update, it must outlive the watcher
+     */
+    explicit LibraryWatcher(PackageLibrary& library);
+    ~LibraryWatcher();
+
+    LibraryWatcher(const LibraryWatcher&) = delete;
+    LibraryWatcher& operator=(const LibraryWatcher&) = delete;
+
+    /**
+     * @brief Registers a function to call for every change applied by poll()
+     */
+    void addListener(const LibraryChangeListener& listener);
+
+    /**
+     * @return true if changes are reported by inotify, false if the tree is
+     * polled
+     */
+    const bool isUsingInotify() const { return m_inotifyDescriptor >= 0; }
+
+    /**
+     * @brief Waits for changes, applies them to the library, and calls the
+     * listeners. When polling, waits for the whole timeout and then checks
+     * every file.
+     * @param timeoutMilliseconds: how long to wait for the first change
+     * @return the changes applied
+     */
+    const std::vector<LibraryChange> poll(int32_t timeoutMilliseconds = 0);
+
+    // Object interface
+   public:
+    const lib::String toString() const override;
+};
+
+}  // namespace s4pkg
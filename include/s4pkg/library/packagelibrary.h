@@ -0,0 +1,199 @@
+/*
+ * Copyright (c) 2022- Gerber Lóránt Viktor
+ * Author: Gerber Lóránt Viktor <glorantv@student.elte.hu>
+ *
+ * This file is part of s4pkg.
+ *
+ * s4pkg is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <s4pkg/internal/export.h>
+#include <s4pkg/internal/libraryscan.h>
+#include <s4pkg/lib/string.h>
+#include <s4pkg/object.h>
+#include <s4pkg/package/indexview.h>
+#include <s4pkg/package/resourcekey.h>
+
+#include <optional>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace s4pkg {
+
+/**
+ * @brief Decides which package wins when more than one contains the same
+ * resource. Packages are loaded in alphabetical order of their paths.
+ */
+enum LoadOrderRule { LAST_LOADED_WINS, FIRST_LOADED_WINS };
+
+/**
+ * @brief Where a resource is in a library: the package, and the position of the
+ * resource in the index of the package
+ */
+struct S4PKG_EXPORT LibraryLocation {
+    uint32_t m_packageId;
+    uint32_t m_entry;
+};
+
+/**
+ * @brief A resource found in more than one package of a library
+ */
+struct S4PKG_EXPORT LibraryOverride {
+    ResourceKey m_key;
+    LibraryLocation m_winner;
+    std::vector<LibraryLocation> m_overridden; /**< In load order */
+};
+
+/**
+ * @brief A package which couldn't be read while scanning
+ */
+struct S4PKG_EXPORT LibraryScanError {
+    lib::String m_path;
+    lib::String m_errorMessage;
+};
+
+enum LibraryChangeKind { PACKAGE_ADDED, PACKAGE_CHANGED, PACKAGE_REMOVED };
+
+/**
+ * @brief A package added to, changed in or removed from a library by an update.
+ * The id of a removed package is no longer valid.
+ */
+struct S4PKG_EXPORT LibraryChange {
+    LibraryChangeKind m_kind;
+    uint32_t m_packageId;
+    lib::String m_path;
+};
+
+/**
+ * @brief An in-memory catalogue of every package in a directory tree. Only the
+ * headers and indices of the packages are read, never their records, and the
+ * packages are read in parallel. Files not starting with the DBPF identifier
+ * are skipped. After the first scan, the library can be kept up to date by
+ * updating only the files that changed, see update() and LibraryWatcher.
+ */
+class S4PKG_EXPORT PackageLibrary : public Object {
+   private:
+    std::string m_rootPath;
+    LoadOrderRule m_loadOrderRule;
+    int32_t m_maxDepth;
+
+    // Ids of packages are positions in this vector, and never change while
+    // the package is in the library
+    std::vector<internal::libraryscan::library_package_t> m_packages;
+    std::vector<bool> m_packageValid;
+    std::unordered_map<std::string, uint32_t> m_packageIds;
+
+    std::unordered_map<ResourceKey,
+                       std::vector<LibraryLocation>,
+                       ResourceKeyHash>
+        m_locations;
+
+    std::vector<LibraryScanError> m_errors;
+
+    bool loadsBefore(uint32_t packageId, uint32_t otherPackageId) const;
+
+    void checkPackageId(uint32_t packageId) const;
+
+    void addLocations(uint32_t packageId);
+    void removeLocations(uint32_t packageId);
+    void dropPackage(uint32_t packageId);
+
+    const std::vector<LibraryChange> updateFiles(
+        std::vector<std::string> paths);
+
+   public:
+    /**
+     * @param rootPath: the directory to scan
+     * @param loadOrderRule: decides which package overrides the others
+     * @param maxDepth: how many levels of subdirectories are scanned, -1 for no
+     * limit
+     */
+    explicit PackageLibrary(const lib::String& rootPath,
+                            LoadOrderRule loadOrderRule = LAST_LOADED_WINS,
+                            int32_t maxDepth = -1);
+
+    /**
+     * @brief Forgets everything, and reads every package under the root again
+     */
+    void scan();
+
+    /**
+     * @brief Brings some paths up to date: packages that were added or changed
+     * (their size or modification time differs) are read, and packages that
+     * no longer exist are dropped. A directory updates every package under it.
+     * Ids of unchanged packages, and of changed packages, stay the same.
+     * @param paths: files or directories that may have changed
+     * @return what changed in the library
+     */
+    const std::vector<LibraryChange> update(
+        const std::vector<lib::String>& paths);
+
+    /**
+     * @brief Like update(), but checks every file under the root. Only the
+     * packages that changed are read, but every file is listed and stat'ed.
+     */
+    const std::vector<LibraryChange> refresh();
+
+    const lib::String getRootPath() const { return m_rootPath; }
+    const LoadOrderRule getLoadOrderRule() const { return m_loadOrderRule; }
+    const int32_t getMaxDepth() const { return m_maxDepth; }
+
+    /**
+     * @return the ids of every package in the library, in load order
+     */
+    const std::vector<uint32_t> getPackageIds() const;
+
+    const size_t getPackageCount() const;
+    const lib::String getPackagePath(uint32_t packageId) const;
+    const uint64_t getPackageFileSize(uint32_t packageId) const;
+
+    /**
+     * @return the modification time of the package file when it was scanned,
+     * in the units of the filesystem clock
+     */
+    const int64_t getPackageModifiedTime(uint32_t packageId) const;
+    const IndexView getPackageIndex(uint32_t packageId) const;
+
+    /**
+     * @brief Finds every copy of a resource
+     * @return the locations, in load order
+     */
+    const std::vector<LibraryLocation> find(const ResourceKey& key) const;
+
+    /**
+     * @brief Finds the copy of a resource the game would use, according to the
+     * load order rule
+     */
+    const std::optional<LibraryLocation> resolve(const ResourceKey& key) const;
+
+    /**
+     * @brief Lists every resource found in more than one package, and which
+     * copy wins
+     */
+    const std::vector<LibraryOverride> getOverrides() const;
+
+    /**
+     * @brief Packages that couldn't be read during the last scan
+     */
+    const std::vector<LibraryScanError>& getErrors() const { return m_errors; }
+
+    // Object interface
+   public:
+    const lib::String toString() const override;
+};
+
+}  // namespace s4pkg
@@ -0,0 +1,152 @@
+/*
+ * Copyright (c) 2022- Gerber Lóránt Viktor
+ * Author: Gerber Lóránt Viktor <glorantv@student.elte.hu>
+ *
+ * This file is part of s4pkg.
+ *
+ * s4pkg is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <s4pkg/internal/export.h>
+#include <s4pkg/internal/soaindex.h>
+#include <s4pkg/package/enums.h>
+#include <s4pkg/package/indexentry.h>
+#include <s4pkg/package/resourcekey.h>
+
+#include <cstddef>
+#include <iterator>
+
+namespace s4pkg {
+
+/**
+ * @brief A read-only view into the index stored by a package. Nothing is copied
+ * or allocated when creating or iterating it; entries are built on the stack
+ * when dereferenced. The view is only valid for as long as the package it was
+ * obtained from is alive.
+ */
+class S4PKG_EXPORT IndexView {
+   private:
+    const internal::soaindex::soa_index_t* m_index;
+
+   public:
+    class Iterator {
+       private:
+        const IndexView* m_view;
+        uint32_t m_position;
+
+       public:
+        using iterator_category = std::forward_iterator_tag;
+        using value_type = IndexEntry;
+        using difference_type = std::ptrdiff_t;
+        using pointer = void;
+        using reference = IndexEntry;
+
+        Iterator(const IndexView* view, uint32_t position)
+            : m_view(view), m_position(position) {}
+
+        IndexEntry operator*() const { return (*m_view)[m_position]; }
+
+        Iterator& operator++() {
+            m_position++;
+            return *this;
+        }
+
+        Iterator operator++(int) {
+            Iterator previous = *this;
+            m_position++;
+            return previous;
+        }
+
+        bool operator==(const Iterator& other) const {
+            return m_position == other.m_position;
+        }
+
+        bool operator!=(const Iterator& other) const {
+            return m_position != other.m_position;
+        }
+    };
+
+    explicit IndexView(const internal::soaindex::soa_index_t& index)
+        : m_index(&index) {}
+
+    size_t size() const { return m_index->size(); }
+    bool empty() const { return m_index->size() == 0; }
+
+    ResourceType getType(uint32_t position) const {
+        return (ResourceType)m_index->m_types[position];
+    }
+
+    uint32_t getGroup(uint32_t position) const {
+        return m_index->m_groups[position];
+    }
+
+    uint32_t getInstanceEx(uint32_t position) const {
+        return m_index->m_instanceExs[position];
+    }
+
+    uint32_t getInstance(uint32_t position) const {
+        return m_index->m_instances[position];
+    }
+
+    uint32_t getPosition(uint32_t position) const {
+        return m_index->m_positions[position];
+    }
+
+    uint32_t getSize(uint32_t position) const {
+        return m_index->m_sizes[position];
+    }
+
+    uint32_t getSizeDecompressed(uint32_t position) const {
+        return m_index->m_sizesDecompressed[position];
+    }
+
+    CompressionType getCompressionType(uint32_t position) const {
+        return (CompressionType)m_index->m_compressionTypes[position];
+    }
+
+    bool isExtendedCompressionType(uint32_t position) const {
+        return m_index->m_extendedCompressionTypes[position] != 0;
+    }
+
+    uint16_t getCommitted(uint32_t position) const {
+        return m_index->m_committed[position];
+    }
+
+    ResourceKey getKey(uint32_t position) const {
+        return ResourceKey::fromParts(m_index->m_types[position],
+                                      getGroup(position),
+                                      getInstanceEx(position),
+                                      getInstance(position));
+    }
+
+    IndexEntry operator[](uint32_t position) const {
+        return {getType(position),
+                getGroup(position),
+                getInstanceEx(position),
+                getInstance(position),
+                getPosition(position),
+                getSize(position),
+                isExtendedCompressionType(position),
+                getSizeDecompressed(position),
+                getCompressionType(position),
+                getCommitted(position)};
+    }
+
+    Iterator begin() const { return {this, 0}; }
+    Iterator end() const { return {this, (uint32_t)size()}; }
+};
+
+}  // namespace s4pkg
@@ -21,11 +21,15 @@
 #pragma once
 
 #include <s4pkg/internal/export.h>
+#include <s4pkg/io/bytesink.h>
 #include <s4pkg/object.h>
+#include <s4pkg/package/resourcekey.h>
 #include <s4pkg/package/types.h>
 #include <s4pkg/resources/iresource.h>
 
+#include <functional>
 #include <memory>
+#include <optional>
 #include <ostream>
 #include <vector>
 
@@ -36,6 +40,22 @@ namespace s4pkg {
  * @brief The main interface for package files
  */
 class S4PKG_EXPORT IPackage : public Object {
+   protected:
+    /**
+     * @brief Writes a package with the header and flags of this package, and
+     * the given resources. Resources are asked for one at a time, and only one
+     * is held while writing.
+     * @param resourceCount: the number of resources to write
+     * @param resourceAt: returns the i-th resource to write, or nullptr to
+     * skip it
+     */
+    void writeResources(
+        ByteSink& sink,
+        bool updateTime,
+        size_t resourceCount,
+        const std::function<std::shared_ptr<const IResource>(size_t)>&
+            resourceAt) const;
+
    public:
     virtual bool isValid() const = 0;
 
@@ -58,11 +78,68 @@ class S4PKG_EXPORT IPackage : public Object {
     virtual const uint32_t getConstantType() const = 0;
     virtual const uint32_t getConstantInstanceEx() const = 0;
 
+    /**
+     * @brief Copies the whole index into IndexEntry objects. Prefer
+     * getIndexView() when the index is queried often.
+     */
     virtual const std::vector<IndexEntry> getPackageIndex() const = 0;
-    virtual const std::vector<std::shared_ptr<IResource>> getResources()
+
+    /**
+     * @brief Returns a view into the index stored in this package, without
+     * copying it
+     */
+    virtual const IndexView getIndexView() const = 0;
+
+    virtual const std::vector<std::shared_ptr<IResource>>& getResources()
         const = 0;
 
+    /**
+     * @brief Returns the resource at a position of the index. Packages which
+     * don't keep their resources in memory read it when it is asked for.
+     * @return the resource, or nullptr if it was deleted
+     * @throws PackageException, if there is no such position, or the resource
+     * can't be read
+     */
+    virtual std::shared_ptr<IResource> getResource(uint32_t position) const = 0;
+
+    // Queries
+
+    /**
+     * @brief Finds every entry in the index of this package with one of the
+     * given types and (optionally) the given group
+     * @param types: the accepted types, every type is accepted if empty
+     * @param group: if set, only entries in this group are accepted
+     * @return positions of the matching entries in getPackageIndex()
+     */
+    virtual const std::vector<uint32_t> findEntries(
+        const std::vector<ResourceType>& types,
+        std::optional<uint32_t> group = std::nullopt) const = 0;
+
+    /**
+     * @brief Finds the entry with the given key
+     * @return the position of the entry in getPackageIndex(), or -1 if this
+     * package doesn't have it
+     */
+    virtual const int64_t findEntry(const ResourceKey& key) const = 0;
+
+    /**
+     * @brief Finds the entries for many keys at once. This is considerably
+     * faster than calling findEntry() for each of them, especially when the
+     * keys are sorted.
+     * @return the result of findEntry() for every key, in the order of keys
+     */
+    virtual const std::vector<int64_t> findMany(
+        const std::vector<ResourceKey>& keys) const = 0;
+
+    /**
+     * @brief Cheap membership test using a Bloom filter built while parsing the
+     * index. Use this to skip packages before calling findEntry().
+     * @return false if this package definitely doesn't contain the key
+     */
+    virtual const bool mayContain(const ResourceKey& key) const = 0;
+
     void write(std::ostream& stream, bool updateTime = false) const;
+    void write(ByteSink& sink, bool updateTime = false) const;
 };
 
 };  // namespace s4pkg
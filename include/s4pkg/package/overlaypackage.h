@@ -0,0 +1,144 @@
+/*
+ * Copyright (c) 2022- Gerber Lóránt Viktor
+ * Author: Gerber Lóránt Viktor <glorantv@student.elte.hu>
+ *
+ * This file is part of s4pkg.
+ *
+ * s4pkg is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <s4pkg/internal/bloomfilter.h>
+#include <s4pkg/internal/export.h>
+#include <s4pkg/internal/keyindex.h>
+#include <s4pkg/internal/soaindex.h>
+#include <s4pkg/package/ipackage.h>
+
+#include <memory>
+#include <mutex>
+#include <ostream>
+#include <vector>
+
+namespace s4pkg {
+
+/**
+ * @brief Decides which layer of an OverlayPackage wins when more than one has
+ * the same resource
+ */
+enum LayerPrecedence { LAST_LAYER_WINS, FIRST_LAYER_WINS };
+
+/**
+ * @brief Where a resource of an OverlayPackage comes from: the layer, and the
+ * position of the resource in the index of that layer
+ */
+struct S4PKG_EXPORT OverlaySource {
+    uint32_t m_layer;
+    uint32_t m_position;
+};
+
+/**
+ * @brief Presents many packages as a single one, without merging them. Only
+ * the indices of the layers are combined when the overlay is created;
+ * resources are taken from the winning layer when they are asked for, so
+ * layers opened with openPackage() are only read for the resources that are
+ * actually used. Nothing is written until flatten() is called.
+ *
+ * Positions in the index of the overlay are its own, entries keep the
+ * position, size and compression they have in their layer.
+ */
+class S4PKG_EXPORT OverlayPackage : public IPackage {
+   private:
+    std::vector<std::shared_ptr<IPackage>> m_layers;
+    LayerPrecedence m_precedence;
+
+    internal::soaindex::soa_index_t m_index;
+    std::vector<OverlaySource> m_sources;  // Parallel to m_index
+    internal::keyindex::key_index_t m_keyIndex;
+    internal::bloomfilter::bloom_filter_t m_keyFilter;
+
+    mutable std::once_flag m_resourcesLoaded;
+    mutable std::vector<std::shared_ptr<IResource>> m_resources;
+
+   public:
+    /**
+     * @param layers: the packages to combine, none of them can be nullptr
+     * @param precedence: which layer wins when several have the same resource
+     * @throws PackageException, if a layer is nullptr
+     */
+    explicit OverlayPackage(
+        const std::vector<std::shared_ptr<IPackage>>& layers,
+        LayerPrecedence precedence = LAST_LAYER_WINS);
+
+    const size_t getLayerCount() const { return m_layers.size(); }
+    const std::shared_ptr<IPackage> getLayer(uint32_t layer) const;
+    const LayerPrecedence getPrecedence() const { return m_precedence; }
+
+    /**
+     * @brief Finds which layer the entry at a position of the index comes from
+     */
+    const OverlaySource getSource(uint32_t position) const;
+
+    /**
+     * @brief Writes the combined package. Resources are read from their layers
+     * one at a time, so the whole overlay is never held in memory.
+     */
+    void flatten(std::ostream& stream, bool updateTime = false) const;
+
+    // s4pkg::IPackage interface
+   public:
+    /**
+     * @brief Hides the resource with the same key as resource from the
+     * overlay. The layers aren't modified.
+     */
+    bool deleteResource(const std::shared_ptr<const IResource>) override;
+
+    bool isValid() const override;
+
+    const PackageVersion getFileVersion() const override;
+    const PackageVersion getUserVersion() const override;
+    const int32_t getCreationTime() const override;
+    const int32_t getModifiedTime() const override;
+    const PackageHeader getPackageHeader() const override;
+    const PackageFlags getPackageFlags() const override;
+    const std::vector<IndexEntry> getPackageIndex() const override;
+    const IndexView getIndexView() const override;
+
+    /**
+     * @brief Reads every winning resource the first time it is called. Prefer
+     * getResource() for large overlays.
+     */
+    const std::vector<std::shared_ptr<IResource>>& getResources()
+        const override;
+    std::shared_ptr<IResource> getResource(uint32_t position) const override;
+
+    const std::vector<uint32_t> findEntries(
+        const std::vector<ResourceType>& types,
+        std::optional<uint32_t> group) const override;
+    const int64_t findEntry(const ResourceKey& key) const override;
+    const std::vector<int64_t> findMany(
+        const std::vector<ResourceKey>& keys) const override;
+    const bool mayContain(const ResourceKey& key) const override;
+
+    // Resources from different layers can't share constant values
+    const uint32_t getConstantGroup() const override { return 0; }
+    const uint32_t getConstantType() const override { return 0; }
+    const uint32_t getConstantInstanceEx() const override { return 0; }
+
+    // s4pkg::Object interface
+   public:
+    const lib::String toString() const override;
+};
+
+}  // namespace s4pkg
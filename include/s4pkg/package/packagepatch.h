@@ -0,0 +1,74 @@
+/*
+ * Copyright (c) 2022- Gerber Lóránt Viktor
+ * Author: Gerber Lóránt Viktor <glorantv@student.elte.hu>
+ *
+ * This file is part of s4pkg.
+ *
+ * s4pkg is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <s4pkg/internal/export.h>
+
+#include <cinttypes>
+#include <istream>
+#include <ostream>
+
+namespace s4pkg {
+
+/**
+ * @brief What changed between two versions of a package, by resource key
+ */
+struct S4PKG_EXPORT PackageDiffResult {
+    uint32_t m_addedCount;
+    uint32_t m_removedCount;
+    uint32_t m_changedCount;
+    uint32_t m_unchangedCount;
+    uint64_t m_patchSize; /**< Bytes written to the patch */
+};
+
+/**
+ * @brief Writes a patch turning one version of a package into another. Records
+ * of the new version found in the old one (by the hash of their stored bytes,
+ * whatever their key) are referred to by their position in the old file; only
+ * new records, and the header and index of the new version, are stored in the
+ * patch. Both streams are seeked by this function.
+ * @param oldPackage: the version the patch will be applied to
+ * @param newPackage: the version the patch produces
+ * @param patch: the stream to write the patch to, written sequentially
+ * @throws PackageException, if either package can't be read
+ */
+S4PKG_EXPORT const PackageDiffResult diffPackages(std::istream& oldPackage,
+                                                  std::istream& newPackage,
+                                                  std::ostream& patch);
+
+/**
+ * @brief Rebuilds the new version of a package from the old one and a patch
+ * written by diffPackages(). The result is byte-identical to the new version
+ * the patch was made from. Unchanged records are copied across without being
+ * held in memory or decompressed.
+ * @param oldPackage: the version the patch was made against, seeked by this
+ * function
+ * @param patch: the patch, read sequentially
+ * @param newPackage: the stream to write the new version to, written
+ * sequentially
+ * @throws PackageException, if the patch is corrupt, or was made against a
+ * different package
+ */
+S4PKG_EXPORT void applyPatch(std::istream& oldPackage,
+                             std::istream& patch,
+                             std::ostream& newPackage);
+
+}  // namespace s4pkg
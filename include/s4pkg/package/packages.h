@@ -20,11 +20,15 @@
 
 #pragma once
 
+#include <s4pkg/cache/resourcecache.h>
 #include <s4pkg/internal/export.h>
+#include <s4pkg/io/bytesource.h>
 #include <s4pkg/lib/string.h>
 #include <s4pkg/package/ipackage.h>
 
 #include <istream>
+#include <memory>
+#include <vector>
 
 namespace s4pkg {
 
@@ -45,4 +49,46 @@ struct S4PKG_EXPORT PackageLoadResult {
  */
 S4PKG_EXPORT const PackageLoadResult loadPackage(std::istream& stream);
 
+/**
+ * @brief Loads a package from a source, and stores it in memory. It is safe to
+ * destroy the source after this method returns.
+ * @param source: the source to read from, from its start
+ * @return A struct with either the package object, or an error message
+ */
+S4PKG_EXPORT const PackageLoadResult loadPackage(ByteSource& source);
+
+/**
+ * @brief Opens a package file, reading only its header and index. Resources are
+ * read from the file when they are asked for, so the file has to stay in place
+ * while the package is used.
+ * @param path: the package file
+ * @param cache: keeps the decompressed records read from the package, shared
+ * by every package opened with it. Nothing is kept if nullptr.
+ * @return A struct with either the package object, or an error message
+ */
+S4PKG_EXPORT const PackageLoadResult openPackage(
+    const lib::String& path,
+    const std::shared_ptr<ResourceCache>& cache = nullptr);
+
+/**
+ * @brief A package containing a looked up resource, and the position of the
+ * resource in its index
+ */
+struct S4PKG_EXPORT PackageLookupResult {
+    std::shared_ptr<IPackage> m_package;
+    int64_t m_position;
+};
+
+/**
+ * @brief Finds every package containing the resource with the given key. The
+ * Bloom filter of each package is consulted first, so packages not containing
+ * the key are usually rejected without touching their index.
+ * @param packages: the packages to search, in order
+ * @param key: the key of the resource
+ * @return the packages containing the resource, in the order they were given
+ */
+S4PKG_EXPORT const std::vector<PackageLookupResult> findInPackages(
+    const std::vector<std::shared_ptr<IPackage>>& packages,
+    const ResourceKey& key);
+
 }  // namespace s4pkg
@@ -0,0 +1,86 @@
+/*
+ * Copyright (c) 2022- Gerber Lóránt Viktor
+ * Author: Gerber Lóránt Viktor <glorantv@student.elte.hu>
+ *
+ * This file is part of s4pkg.
+ *
+ * s4pkg is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <s4pkg/package/enums.h>
+
+#include <cinttypes>
+#include <cstddef>
+#include <tuple>
+
+namespace s4pkg {
+
+/**
+ * @brief The 128-bit type-group-instance key identifying a resource. The 64-bit
+ * instance is made up of the instanceEx (high 32 bits) and the instance (low
+ * 32 bits) fields of the index. This is deliberately a plain struct instead of
+ * an Object, so arrays of keys stay tightly packed.
+ */
+struct ResourceKey {
+    uint32_t m_type;
+    uint32_t m_group;
+    uint64_t m_instance;
+
+    static ResourceKey fromParts(uint32_t type,
+                                 uint32_t group,
+                                 uint32_t instanceEx,
+                                 uint32_t instance) {
+        return {type, group, (uint64_t)instanceEx << 32 | instance};
+    }
+
+    ResourceType getType() const { return (ResourceType)m_type; }
+    uint32_t getInstanceEx() const { return (uint32_t)(m_instance >> 32); }
+    uint32_t getInstance() const { return (uint32_t)m_instance; }
+
+    bool operator==(const ResourceKey& other) const {
+        return m_type == other.m_type && m_group == other.m_group &&
+               m_instance == other.m_instance;
+    }
+
+    bool operator!=(const ResourceKey& other) const {
+        return !(*this == other);
+    }
+
+    bool operator<(const ResourceKey& other) const {
+        return std::tie(m_type, m_group, m_instance) <
+               std::tie(other.m_type, other.m_group, other.m_instance);
+    }
+};
+
+/**
+ * @brief Hash for using ResourceKey in unordered containers
+ */
+struct ResourceKeyHash {
+    size_t operator()(const ResourceKey& key) const {
+        // Mix all 128 bits, the instance alone is usually unique enough but
+        // the type and group shouldn't be ignored
+        uint64_t hash = key.m_instance;
+        hash ^= ((uint64_t)key.m_type << 32 | key.m_group) +
+                0x9E3779B97F4A7C15ULL + (hash << 6) + (hash >> 2);
+        hash ^= hash >> 33;
+        hash *= 0xFF51AFD7ED558CCDULL;
+        hash ^= hash >> 33;
+
+        return (size_t)hash;
+    }
+};
+
+}  // namespace s4pkg
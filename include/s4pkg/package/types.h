@@ -24,4 +24,5 @@
 #include <s4pkg/package/flags.h>
 #include <s4pkg/package/header.h>
 #include <s4pkg/package/indexentry.h>
+#include <s4pkg/package/indexview.h>
 #include <s4pkg/package/version.h>
@@ -23,6 +23,8 @@
 #include <s4pkg/internal/export.h>
 #include <s4pkg/resources/iresource.h>
 
+#include <memory>
+
 namespace s4pkg::resources {
 
 /**
@@ -30,7 +32,7 @@ namespace s4pkg::resources {
  */
 class S4PKG_EXPORT FallbackResource : public IResource {
    private:
-    lib::ByteBuffer m_data{};
+    std::shared_ptr<const lib::ByteBuffer> m_data;
 
    public:
     FallbackResource(uint32_t type,
@@ -38,10 +40,20 @@ class S4PKG_EXPORT FallbackResource : public IResource {
                      uint32_t instance,
                      uint32_t group,
                      const lib::ByteBuffer& data)
+        : FallbackResource(type, instanceEx, instance, group,
+                           std::make_shared<const lib::ByteBuffer>(data)) {}
+
+    FallbackResource(uint32_t type,
+                     uint32_t instanceEx,
+                     uint32_t instance,
+                     uint32_t group,
+                     const std::shared_ptr<const lib::ByteBuffer>& data)
         : IResource(instanceEx, instance, group, (ResourceType)type),
           m_data(data) {}
 
-    void setData(const lib::ByteBuffer& data) { this->m_data = data; }
+    void setData(const lib::ByteBuffer& data) {
+        this->m_data = std::make_shared<const lib::ByteBuffer>(data);
+    }
 
     // IResource interface
    public:
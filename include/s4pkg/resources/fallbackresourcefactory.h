@@ -32,11 +32,12 @@ namespace s4pkg::factories {
 class S4PKG_EXPORT FallbackResourceFactory : public IResourceFactory {
     // IResourceFactory interface
    public:
-    std::shared_ptr<IResource> create(uint32_t type,
-                                      uint32_t instanceEx,
-                                      uint32_t instance,
-                                      uint32_t group,
-                                      const lib::ByteBuffer&) const override;
+    std::shared_ptr<IResource> create(
+        uint32_t type,
+        uint32_t instanceEx,
+        uint32_t instance,
+        uint32_t group,
+        const std::shared_ptr<const lib::ByteBuffer>&) const override;
 
     // Object interface
    public:
@@ -20,6 +20,7 @@
 
 #pragma once
 
+#include <s4pkg/cache/resourcecache.h>
 #include <s4pkg/internal/export.h>
 #include <s4pkg/internal/image.h>
 #include <s4pkg/internal/imagecoder.h>
@@ -27,59 +28,100 @@
 #include <s4pkg/resources/iresource.h>
 
 #include <memory>
+#include <mutex>
 
 namespace s4pkg::resources {
 
+/**
+ * @brief An image, kept encoded as it was read until its pixels are needed.
+ * The size comes from the header of the image, so listing images doesn't
+ * decode them, and an image that was never modified is written back as the
+ * bytes it was read from.
+ */
 class S4PKG_EXPORT IImageResource : public IResource {
    private:
-    std::shared_ptr<internal::Image> m_image;
     internal::imagecoder::ImageFormat m_format;
+    std::shared_ptr<const lib::ByteBuffer> m_data;
+    uint32_t m_width;
+    uint32_t m_height;
+
+    // Whether the size came from the header, if not, it is taken from the
+    // decoded image
+    bool m_probed;
+    bool m_modified;
+
+    internal::imagecoder::encode_options_t m_encodeOptions;
+
+    // Decoded on the first access
+    mutable std::mutex m_imageMutex;
+    mutable bool m_decoded;
+    mutable std::shared_ptr<internal::Image> m_image;
+
+    // With a cache, the pixels of the unmodified image are kept there instead
+    // of in m_image
+    std::shared_ptr<ResourceCache> m_pixelCache;
+    ResourceCacheKey m_pixelCacheKey{};
+
+    std::shared_ptr<internal::Image> getImage() const;
 
    public:
     IImageResource(uint32_t instanceEx,
                    uint32_t instance,
                    uint32_t group,
                    ResourceType resourceType)
-        : IResource(instanceEx, instance, group, resourceType) {}
-
-    uint32_t getWidth() const {
-        if (m_image) {
-            return m_image->getWidth();
-        } else {
-            return 0;
-        }
-    }
+        : IResource(instanceEx, instance, group, resourceType),
+          m_format(internal::imagecoder::UNKNOWN),
+          m_data(std::make_shared<const lib::ByteBuffer>()),
+          m_width(0),
+          m_height(0),
+          m_probed(false),
+          m_modified(false),
+          m_decoded(false) {}
 
-    uint32_t getHeight() const {
-        if (m_image) {
-            return m_image->getHeight();
-        } else {
-            return 0;
-        }
-    }
+    uint32_t getWidth() const;
+    uint32_t getHeight() const;
 
-    const lib::ByteBuffer getPixelData() const {
-        if (m_image) {
-            return m_image->getPixelData();
-        } else {
-            return {};
-        }
-    }
+    /**
+     * @brief The RGBA pixels of the image, decoding it if this is the first
+     * time they are needed
+     */
+    const lib::ByteBuffer getPixelData() const;
 
     const internal::imagecoder::ImageFormat getFormat() const {
         return this->m_format;
     }
 
-    void setImage(uint32_t width, uint32_t height, lib::ByteBuffer pixelData) {
-        m_image = std::make_shared<internal::Image>(width, height, pixelData);
+    /**
+     * @brief Whether the pixels were decoded already (or set with setImage())
+     */
+    bool isDecoded() const;
+
+    void setImage(uint32_t width, uint32_t height, lib::ByteBuffer pixelData);
+
+    /**
+     * @brief Sets how a modified image is encoded by write(), e.g. a fast
+     * preset for previews. Unmodified images are written as they were read.
+     */
+    void setEncodeOptions(
+        const internal::imagecoder::encode_options_t& options) {
+        m_encodeOptions = options;
     }
 
+    const internal::imagecoder::encode_options_t& getEncodeOptions() const {
+        return m_encodeOptions;
+    }
+
+    /**
+     * @brief Decodes the pixels through a cache, under key, instead of keeping
+     * them in the resource. Only used while the image isn't modified, and its
+     * size is known from its header.
+     */
+    void setPixelCache(const std::shared_ptr<ResourceCache>& cache,
+                       const ResourceCacheKey& key);
+
    protected:
     void setDataWithFormat(internal::imagecoder::ImageFormat format,
-                           const lib::ByteBuffer& data) {
-        this->m_format = format;
-        this->m_image = internal::imagecoder::decode(data, format);
-    }
+                           const std::shared_ptr<const lib::ByteBuffer>& data);
 
     // IResource interface
    public:
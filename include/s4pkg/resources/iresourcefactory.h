@@ -32,19 +32,25 @@ namespace s4pkg {
 
 class S4PKG_EXPORT IResourceFactory : public Object {
    public:
+    /**
+     * @brief Parses a resource from its decompressed data. The resource keeps
+     * the data it is given instead of copying it, so cached data stays pinned
+     * in its cache while the resource is alive.
+     */
     virtual std::shared_ptr<IResource> create(
         uint32_t type, /**< This is purely for fallback, to not break resources
                           not understood (or cared about) by this tool */
         uint32_t instanceEx,
         uint32_t instance,
         uint32_t group,
-        const lib::ByteBuffer&) const = 0;
+        const std::shared_ptr<const lib::ByteBuffer>&) const = 0;
 
     std::shared_ptr<IResource> createBlank(uint32_t type,
                                            uint32_t instanceEx,
                                            uint32_t instance,
                                            uint32_t group) {
-        return this->create(type, instanceEx, instance, group, {});
+        return this->create(type, instanceEx, instance, group,
+                            std::make_shared<const lib::ByteBuffer>());
     }
 };
 
@@ -20,9 +20,9 @@
 
 #pragma once
 
+#include <s4pkg/internal/binarycursor.h>
 #include <s4pkg/internal/dds.h>
 #include <s4pkg/internal/export.h>
-#include <s4pkg/internal/membuf.h>
 #include <s4pkg/resources/imageresource.h>
 
 #include <istream>
@@ -38,24 +38,31 @@ class S4PKG_EXPORT DSTResource : public IImageResource {
                 uint32_t instance,
                 uint32_t group,
                 const lib::ByteBuffer& data)
+        : DSTResource(originalType, instanceEx, instance, group,
+                      std::make_shared<const lib::ByteBuffer>(data)) {}
+
+    DSTResource(s4pkg::ResourceType originalType,
+                uint32_t instanceEx,
+                uint32_t instance,
+                uint32_t group,
+                const std::shared_ptr<const lib::ByteBuffer>& data)
         : IImageResource(instanceEx, instance, group, originalType) {
         // Provide a way to make an empty image
-        if (data.size() < sizeof(internal::dds::dds_header_t)) {
+        if (data->size() < sizeof(internal::dds::dds_header_t)) {
             setDataWithFormat(internal::imagecoder::DST5, data);
             return;
         }
 
-        // Read in the DDS file from memory
-        internal::membuf memoryBuffer(data.data(), data.size());
-        std::istream stream(&memoryBuffer);
+        // Read in the DDS header from memory
+        internal::BinaryCursor cursor(data->data(), data->size());
 
         // Skip past the magic bytes, we just want to guess here, if the format
         // we guess here is incorrect the proper error-checking in the image
         // coder will catch it
-        stream.seekg(4);
+        cursor.skip(4);
 
         internal::dds::dds_header_t ddsHeader =
-            internal::dds::readHeader(stream);
+            internal::dds::readHeader(cursor);
 
         auto imageFormat = internal::imagecoder::UNKNOWN;
 
@@ -20,8 +20,8 @@
 
 #pragma once
 
+#include <s4pkg/internal/binarycursor.h>
 #include <s4pkg/internal/export.h>
-#include <s4pkg/internal/membuf.h>
 #include <s4pkg/internal/rle.h>
 #include <s4pkg/resources/imageresource.h>
 
@@ -34,19 +34,26 @@ class S4PKG_EXPORT RLEResource : public IImageResource {
                 uint32_t instance,
                 uint32_t group,
                 const lib::ByteBuffer& data)
+        : RLEResource(originalType, instanceEx, instance, group,
+                      std::make_shared<const lib::ByteBuffer>(data)) {}
+
+    RLEResource(s4pkg::ResourceType originalType,
+                uint32_t instanceEx,
+                uint32_t instance,
+                uint32_t group,
+                const std::shared_ptr<const lib::ByteBuffer>& data)
         : IImageResource(instanceEx, instance, group, originalType) {
         // Provide a way to make an empty image
-        if (data.size() < sizeof(internal::rle::rle_header_t)) {
+        if (data->size() < sizeof(internal::rle::rle_header_t)) {
             setDataWithFormat(internal::imagecoder::RLE2, data);
             return;
         }
 
-        // Read in the RLE file from memory
-        internal::membuf memoryBuffer(data.data(), data.size());
-        std::istream stream(&memoryBuffer);
+        // Read in the RLE header from memory
+        internal::BinaryCursor cursor(data->data(), data->size());
 
         internal::rle::rle_header_t rleHeader =
-            internal::rle::readHeader(stream);
+            internal::rle::readHeader(cursor);
 
         auto imageFormat = internal::imagecoder::UNKNOWN;
 
@@ -32,6 +32,14 @@ class S4PKG_EXPORT ThumbnailResource : public IImageResource {
                       uint32_t instance,
                       uint32_t group,
                       const lib::ByteBuffer& data)
+        : ThumbnailResource(originalType, instanceEx, instance, group,
+                            std::make_shared<const lib::ByteBuffer>(data)) {}
+
+    ThumbnailResource(s4pkg::ResourceType originalType,
+                      uint32_t instanceEx,
+                      uint32_t instance,
+                      uint32_t group,
+                      const std::shared_ptr<const lib::ByteBuffer>& data)
         : IImageResource(instanceEx, instance, group, originalType) {
         setDataWithFormat(internal::imagecoder::ImageFormat::JFIF_WITH_ALPHA,
                           data);
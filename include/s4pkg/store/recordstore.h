@@ -0,0 +1,117 @@
+/*
+ * Copyright (c) 2022- Gerber Lóránt Viktor
+ * Author: Gerber Lóránt Viktor <glorantv@student.elte.hu>
+ *
+ * This file is part of s4pkg.
+ *
+ * s4pkg is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <s4pkg/internal/export.h>
+#include <s4pkg/internal/recordstore.h>
+#include <s4pkg/lib/string.h>
+#include <s4pkg/object.h>
+
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace s4pkg {
+
+/**
+ * @brief What adding a package to a record store took
+ */
+struct S4PKG_EXPORT RecordStoreAddResult {
+    uint32_t m_recordCount;
+    uint32_t m_newRecordCount; /**< Records not in the store before */
+    uint64_t m_newBytes;       /**< Bytes appended to the pack file */
+};
+
+/**
+ * @brief A content-addressed store of packages. Records are kept once, keyed by
+ * the hash of their stored bytes, in an append-only pack file. A package is
+ * kept as a manifest: its header and index, with a record hash in place of
+ * every record position. Disk usage grows with the unique records only.
+ *
+ * Checking out a package writes a regular package file, copying the stored
+ * bytes of its records verbatim: nothing is decompressed or compressed again.
+ *
+ * The store lives in a directory, with the pack file in "records.pack" and the
+ * manifests in "manifests". A store must only be used by one object at a time.
+ */
+class S4PKG_EXPORT RecordStore : public Object {
+   private:
+    std::string m_rootPath;
+    std::unordered_map<uint64_t, internal::recordstore::pack_location_t>
+        m_records;
+    uint64_t m_packSize;
+
+    std::string getPackPath() const;
+    std::string getManifestPath(const std::string& name) const;
+
+   public:
+    /**
+     * @brief Opens the store in a directory, creating it if needed. Only the
+     * record headers of the pack file are read.
+     * @throws PackageException, if the directory can't be created, or the pack
+     * file is corrupt
+     */
+    explicit RecordStore(const lib::String& rootPath);
+
+    /**
+     * @brief Stores a package file under a name, replacing the package stored
+     * under that name before. Only the records not in the store yet are
+     * appended to the pack file.
+     * @param name: a file name, without directories
+     * @throws PackageException, if the package can't be read, or the store
+     * can't be written
+     */
+    const RecordStoreAddResult addPackage(const lib::String& name,
+                                          const lib::String& packagePath);
+
+    /**
+     * @brief Writes a stored package to a package file. Records shared by more
+     * than one entry of the package are written once.
+     * @throws PackageException, if there's no package with that name, or the
+     * file can't be written
+     */
+    void checkout(const lib::String& name,
+                  const lib::String& outputPath) const;
+
+    /**
+     * @brief Forgets a stored package. Its records stay in the pack file, as
+     * other packages may use them.
+     * @return false if there was no package with that name
+     */
+    bool removePackage(const lib::String& name);
+
+    bool hasPackage(const lib::String& name) const;
+
+    /**
+     * @return the names of the stored packages, in alphabetical order
+     */
+    const std::vector<lib::String> getPackageNames() const;
+
+    const lib::String getRootPath() const { return m_rootPath; }
+    const size_t getRecordCount() const { return m_records.size(); }
+    const uint64_t getPackSize() const { return m_packSize; }
+
+    // Object interface
+   public:
+    const lib::String toString() const override;
+};
+
+}  // namespace s4pkg
@@ -0,0 +1,197 @@
+/*
+ * Copyright (c) 2022- Gerber Lóránt Viktor
+ * Author: Gerber Lóránt Viktor <glorantv@student.elte.hu>
+ *
+ * This file is part of s4pkg.
+ *
+ * s4pkg is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <s4pkg/cache/resourcecache.h>
+
+#include <atomic>
+
+#include <fmt/core.h>
+
+namespace s4pkg {
+
+ResourceCache::ResourceCache(size_t byteBudget)
+    : m_byteBudget(byteBudget),
+      m_usedBytes(0),
+      m_hitCount(0),
+      m_missCount(0),
+      m_evictionCount(0) {}
+
+uint64_t ResourceCache::newOwnerId() {
+    static std::atomic<uint64_t> nextOwnerId{1};
+    return nextOwnerId++;
+}
+
+void ResourceCache::evictLocked() {
+    auto it = m_entries.end();
+
+    while (m_usedBytes > m_byteBudget && it != m_entries.begin()) {
+        it--;
+
+        // Someone else holds a pointer to it
+        if (it->m_data.use_count() > 1) {
+            continue;
+        }
+
+        m_usedBytes -= it->m_data->size();
+        m_index.erase(it->m_key);
+        it = m_entries.erase(it);
+        m_evictionCount++;
+    }
+}
+
+std::shared_ptr<const lib::ByteBuffer> ResourceCache::find(
+    const ResourceCacheKey& key) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+
+    auto found = m_index.find(key);
+    if (found == m_index.end()) {
+        m_missCount++;
+        return nullptr;
+    }
+
+    m_entries.splice(m_entries.begin(), m_entries, found->second);
+    m_hitCount++;
+
+    return found->second->m_data;
+}
+
+std::shared_ptr<const lib::ByteBuffer> ResourceCache::insert(
+    const ResourceCacheKey& key,
+    lib::ByteBuffer data) {
+    auto value = std::make_shared<const lib::ByteBuffer>(std::move(data));
+
+    std::lock_guard<std::mutex> lock(m_mutex);
+
+    auto found = m_index.find(key);
+    if (found != m_index.end()) {
+        m_entries.splice(m_entries.begin(), m_entries, found->second);
+        return found->second->m_data;
+    }
+
+    m_entries.push_front({key, value});
+    m_index[key] = m_entries.begin();
+    m_usedBytes += value->size();
+
+    // The new entry is pinned by value, so it survives this
+    this->evictLocked();
+
+    return value;
+}
+
+std::shared_ptr<const lib::ByteBuffer> ResourceCache::getOrLoad(
+    const ResourceCacheKey& key,
+    const std::function<lib::ByteBuffer()>& load) {
+    std::shared_ptr<const lib::ByteBuffer> cached = this->find(key);
+    if (cached != nullptr) {
+        return cached;
+    }
+
+    return this->insert(key, load());
+}
+
+void ResourceCache::erase(const ResourceCacheKey& key) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+
+    auto found = m_index.find(key);
+    if (found == m_index.end()) {
+        return;
+    }
+
+    m_usedBytes -= found->second->m_data->size();
+    m_entries.erase(found->second);
+    m_index.erase(found);
+}
+
+void ResourceCache::eraseOwner(uint64_t owner) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+
+    for (auto it = m_entries.begin(); it != m_entries.end();) {
+        if (it->m_key.m_owner != owner) {
+            it++;
+            continue;
+        }
+
+        m_usedBytes -= it->m_data->size();
+        m_index.erase(it->m_key);
+        it = m_entries.erase(it);
+    }
+}
+
+void ResourceCache::setByteBudget(size_t byteBudget) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+
+    m_byteBudget = byteBudget;
+    this->evictLocked();
+}
+
+const size_t ResourceCache::getByteBudget() const {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_byteBudget;
+}
+
+const size_t ResourceCache::getUsedBytes() const {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_usedBytes;
+}
+
+const size_t ResourceCache::getPinnedBytes() const {
+    std::lock_guard<std::mutex> lock(m_mutex);
+
+    size_t pinnedBytes = 0;
+    for (const cache_entry_t& entry : m_entries) {
+        if (entry.m_data.use_count() > 1) {
+            pinnedBytes += entry.m_data->size();
+        }
+    }
+
+    return pinnedBytes;
+}
+
+const size_t ResourceCache::getEntryCount() const {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_entries.size();
+}
+
+const uint64_t ResourceCache::getHitCount() const {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_hitCount;
+}
+
+const uint64_t ResourceCache::getMissCount() const {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_missCount;
+}
+
+const uint64_t ResourceCache::getEvictionCount() const {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_evictionCount;
+}
+
+const lib::String ResourceCache::toString() const {
+    std::lock_guard<std::mutex> lock(m_mutex);
+
+    return fmt::format(
+        "ResourceCache [ byteBudget={}, usedBytes={}, entryCount={}, hits={}, "
+        "misses={}, evictions={} ]",
+        m_byteBudget, m_usedBytes, m_entries.size(), m_hitCount, m_missCount,
+        m_evictionCount);
+}
+
+}  // namespace s4pkg
@@ -0,0 +1,647 @@
+/*
+ * Copyright (c) 2022- Gerber Lóránt Viktor
+ * Author: Gerber Lóránt Viktor <glorantv@student.elte.hu>
+ *
+ * This file is part of s4pkg.
+ *
+ * s4pkg is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <s4pkg/cache/shareddecodecache.h>
+
+#include <s4pkg/internal/hash.h>
+#include <s4pkg/packageexception.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstring>
+#include <thread>
+#include <vector>
+
+#include <fmt/core.h>
+
+#if defined(__linux__)
+#define S4PKG_SHAREDDECODECACHE_SHM
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace s4pkg {
+
+namespace {
+
+// Keys 0 and 1 mark empty and evicted slots, these two record hashes are
+// moved to the other end of the range
+constexpr uint64_t g_emptyKey = 0;
+constexpr uint64_t g_evictedKey = 1;
+
+constexpr uint64_t g_magic = 0x3143444853344b50;  // "PK4SHDC1"
+
+uint64_t keyOf(uint64_t recordHash) {
+    return recordHash < 2 ? ~recordHash : recordHash;
+}
+
+// Every field is atomic, since other processes read them without locking.
+// The version of a slot is odd while it is being changed, a reader copying an
+// image checks that it didn't change meanwhile.
+typedef struct shared_slot_t {
+    std::atomic<uint64_t> m_key;
+    std::atomic<uint32_t> m_version;
+    std::atomic<uint32_t> m_format;
+    std::atomic<uint64_t> m_lastUsed;
+    std::atomic<uint64_t> m_offset;
+    std::atomic<uint32_t> m_size;
+    std::atomic<uint32_t> m_width;
+    std::atomic<uint32_t> m_height;
+} shared_slot_t;
+
+static_assert(std::atomic<uint64_t>::is_always_lock_free,
+              "Atomics in shared memory have to be lock-free");
+
+#ifdef S4PKG_SHAREDDECODECACHE_SHM
+typedef struct shared_header_t {
+    std::atomic<uint64_t> m_magic;  // Set last, once the rest is ready
+    uint64_t m_byteBudget;
+    uint32_t m_capacity;
+    pthread_mutex_t m_mutex;
+
+    std::atomic<uint64_t> m_clock;
+    std::atomic<uint64_t> m_hits;
+    std::atomic<uint64_t> m_misses;
+    std::atomic<uint64_t> m_usedBytes;
+    std::atomic<uint32_t> m_entryCount;
+    std::atomic<uint32_t> m_evictedCount;
+} shared_header_t;
+#else
+typedef struct shared_header_t {
+} shared_header_t;
+#endif
+
+constexpr size_t alignUp(size_t value) {
+    return (value + 63) & ~(size_t)63;
+}
+
+size_t regionSize(uint64_t byteBudget, uint32_t capacity) {
+    return alignUp(sizeof(shared_header_t)) +
+           alignUp(capacity * sizeof(shared_slot_t)) + byteBudget;
+}
+
+#ifdef S4PKG_SHAREDDECODECACHE_SHM
+shared_header_t* headerOf(void* region) {
+    return (shared_header_t*)region;
+}
+
+shared_slot_t* slotsOf(void* region) {
+    return (shared_slot_t*)((uint8_t*)region +
+                            alignUp(sizeof(shared_header_t)));
+}
+
+uint8_t* arenaOf(void* region) {
+    shared_header_t* header = headerOf(region);
+    return (uint8_t*)slotsOf(region) +
+           alignUp(header->m_capacity * sizeof(shared_slot_t));
+}
+
+std::string shmName(const std::string& name) {
+    return name.rfind('/', 0) == 0 ? name : "/" + name;
+}
+
+// Writer side of the version protocol, only called with the mutex held
+template <typename F>
+void changeSlot(shared_slot_t& slot, F change) {
+    uint32_t version = slot.m_version.load(std::memory_order_relaxed);
+    slot.m_version.store(version + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+
+    change();
+
+    slot.m_version.store(version + 2, std::memory_order_release);
+}
+
+// Releases the mutex when leaving scope
+class SharedLock {
+   private:
+    shared_header_t* m_header;
+
+   public:
+    explicit SharedLock(shared_header_t* header) : m_header(header) {
+        if (pthread_mutex_lock(&m_header->m_mutex) == EOWNERDEAD) {
+            pthread_mutex_consistent(&m_header->m_mutex);
+            this->repair();
+        }
+    }
+
+    ~SharedLock() { pthread_mutex_unlock(&m_header->m_mutex); }
+
+    // A process died while changing the cache: slots left half-written are
+    // dropped, and the counters recomputed
+    void repair() {
+        shared_slot_t* slots = slotsOf(m_header);
+        uint64_t usedBytes = 0;
+        uint32_t entryCount = 0;
+        uint32_t evictedCount = 0;
+
+        for (uint32_t i = 0; i < m_header->m_capacity; i++) {
+            shared_slot_t& slot = slots[i];
+            uint32_t version = slot.m_version.load(std::memory_order_relaxed);
+
+            if ((version & 1) != 0) {
+                slot.m_key.store(g_evictedKey, std::memory_order_relaxed);
+                slot.m_version.store(version + 1, std::memory_order_release);
+            }
+
+            uint64_t key = slot.m_key.load(std::memory_order_relaxed);
+            if (key == g_evictedKey) {
+                evictedCount++;
+            } else if (key != g_emptyKey) {
+                entryCount++;
+                usedBytes += slot.m_size.load(std::memory_order_relaxed);
+            }
+        }
+
+        m_header->m_usedBytes = usedBytes;
+        m_header->m_entryCount = entryCount;
+        m_header->m_evictedCount = evictedCount;
+    }
+};
+
+// Finds the slot holding a key, or nullptr
+shared_slot_t* findSlot(void* region, uint64_t key) {
+    shared_header_t* header = headerOf(region);
+    shared_slot_t* slots = slotsOf(region);
+
+    for (uint32_t probe = 0; probe < header->m_capacity; probe++) {
+        shared_slot_t& slot = slots[(key + probe) % header->m_capacity];
+        uint64_t slotKey = slot.m_key.load(std::memory_order_acquire);
+
+        if (slotKey == g_emptyKey) {
+            return nullptr;
+        }
+
+        if (slotKey == key) {
+            return &slot;
+        }
+    }
+
+    return nullptr;
+}
+
+void evictSlot(shared_header_t* header, shared_slot_t& slot) {
+    uint32_t size = slot.m_size.load(std::memory_order_relaxed);
+
+    changeSlot(slot, [&slot]() {
+        slot.m_key.store(g_evictedKey, std::memory_order_relaxed);
+    });
+
+    header->m_usedBytes -= size;
+    header->m_entryCount--;
+    header->m_evictedCount++;
+}
+
+bool evictLeastRecentlyUsed(void* region) {
+    shared_header_t* header = headerOf(region);
+    shared_slot_t* slots = slotsOf(region);
+
+    shared_slot_t* oldest = nullptr;
+    uint64_t oldestUse = UINT64_MAX;
+
+    for (uint32_t i = 0; i < header->m_capacity; i++) {
+        uint64_t key = slots[i].m_key.load(std::memory_order_relaxed);
+        uint64_t lastUsed = slots[i].m_lastUsed.load(std::memory_order_relaxed);
+
+        if (key != g_emptyKey && key != g_evictedKey && lastUsed < oldestUse) {
+            oldest = &slots[i];
+            oldestUse = lastUsed;
+        }
+    }
+
+    if (oldest == nullptr) {
+        return false;
+    }
+
+    evictSlot(header, *oldest);
+    return true;
+}
+
+// Finds the first free range of the arena large enough for size bytes
+bool findFreeRange(void* region, uint32_t size, uint64_t& offset) {
+    shared_header_t* header = headerOf(region);
+    shared_slot_t* slots = slotsOf(region);
+
+    std::vector<std::pair<uint64_t, uint64_t>> used;
+    for (uint32_t i = 0; i < header->m_capacity; i++) {
+        uint64_t key = slots[i].m_key.load(std::memory_order_relaxed);
+
+        if (key != g_emptyKey && key != g_evictedKey) {
+            used.emplace_back(slots[i].m_offset.load(std::memory_order_relaxed),
+                              slots[i].m_size.load(std::memory_order_relaxed));
+        }
+    }
+
+    std::sort(used.begin(), used.end());
+
+    uint64_t cursor = 0;
+    for (const auto& [start, length] : used) {
+        if (start >= cursor && start - cursor >= size) {
+            break;
+        }
+
+        cursor = std::max(cursor, start + length);
+    }
+
+    if (header->m_byteBudget - std::min(cursor, header->m_byteBudget) < size) {
+        return false;
+    }
+
+    offset = cursor;
+    return true;
+}
+
+// Evicted slots make probing longer, once there are too many every entry is
+// inserted again. Lookups meanwhile may miss.
+void rebuildTable(void* region) {
+    shared_header_t* header = headerOf(region);
+    shared_slot_t* slots = slotsOf(region);
+
+    typedef struct entry_t {
+        uint64_t m_key;
+        uint32_t m_format;
+        uint64_t m_lastUsed;
+        uint64_t m_offset;
+        uint32_t m_size;
+        uint32_t m_width;
+        uint32_t m_height;
+    } entry_t;
+
+    std::vector<entry_t> entries;
+
+    for (uint32_t i = 0; i < header->m_capacity; i++) {
+        shared_slot_t& slot = slots[i];
+        uint64_t key = slot.m_key.load(std::memory_order_relaxed);
+
+        if (key != g_emptyKey && key != g_evictedKey) {
+            entries.push_back({key, slot.m_format, slot.m_lastUsed,
+                               slot.m_offset, slot.m_size, slot.m_width,
+                               slot.m_height});
+        }
+
+        if (key != g_emptyKey) {
+            changeSlot(slot, [&slot]() {
+                slot.m_key.store(g_emptyKey, std::memory_order_relaxed);
+            });
+        }
+    }
+
+    for (const entry_t& entry : entries) {
+        for (uint32_t probe = 0; probe < header->m_capacity; probe++) {
+            shared_slot_t& slot =
+                slots[(entry.m_key + probe) % header->m_capacity];
+
+            if (slot.m_key.load(std::memory_order_relaxed) != g_emptyKey) {
+                continue;
+            }
+
+            changeSlot(slot, [&slot, &entry]() {
+                slot.m_format.store(entry.m_format, std::memory_order_relaxed);
+                slot.m_lastUsed.store(entry.m_lastUsed,
+                                      std::memory_order_relaxed);
+                slot.m_offset.store(entry.m_offset, std::memory_order_relaxed);
+                slot.m_size.store(entry.m_size, std::memory_order_relaxed);
+                slot.m_width.store(entry.m_width, std::memory_order_relaxed);
+                slot.m_height.store(entry.m_height, std::memory_order_relaxed);
+                slot.m_key.store(entry.m_key, std::memory_order_relaxed);
+            });
+
+            break;
+        }
+    }
+
+    header->m_evictedCount = 0;
+}
+#endif
+
+}  // namespace
+
+SharedDecodeCache::SharedDecodeCache(const lib::String& name,
+                                     size_t byteBudget,
+                                     uint32_t maxEntries)
+    : m_name(name.c_str()), m_region(nullptr), m_regionSize(0) {
+#ifdef S4PKG_SHAREDDECODECACHE_SHM
+    std::string objectName = shmName(m_name);
+    maxEntries = std::max<uint32_t>(maxEntries, 1);
+
+    int descriptor = shm_open(objectName.c_str(), O_RDWR | O_CREAT | O_EXCL,
+                              S_IRUSR | S_IWUSR);
+    bool creating = descriptor >= 0;
+
+    if (!creating && errno == EEXIST) {
+        descriptor = shm_open(objectName.c_str(), O_RDWR, 0);
+    }
+
+    if (descriptor < 0) {
+        throw PackageException(fmt::format(
+            "Failed to open shared cache {}: {}", m_name, strerror(errno)));
+    }
+
+    if (creating) {
+        m_regionSize = regionSize(byteBudget, maxEntries);
+
+        if (ftruncate(descriptor, (off_t)m_regionSize) != 0) {
+            close(descriptor);
+            shm_unlink(objectName.c_str());
+            throw PackageException(
+                fmt::format("Failed to size shared cache {}", m_name));
+        }
+    } else {
+        // The creator may still be sizing it
+        struct stat status {};
+        for (int attempt = 0; attempt < 100; attempt++) {
+            if (fstat(descriptor, &status) == 0 &&
+                (size_t)status.st_size >= sizeof(shared_header_t)) {
+                break;
+            }
+
+            std::this_thread::sleep_for(std::chrono::milliseconds(10));
+        }
+
+        m_regionSize = (size_t)status.st_size;
+    }
+
+    if (m_regionSize < sizeof(shared_header_t)) {
+        close(descriptor);
+        throw PackageException(
+            fmt::format("Shared cache {} was never set up", m_name));
+    }
+
+    m_region = mmap(nullptr, m_regionSize, PROT_READ | PROT_WRITE, MAP_SHARED,
+                    descriptor, 0);
+    close(descriptor);
+
+    if (m_region == MAP_FAILED) {
+        m_region = nullptr;
+        throw PackageException(
+            fmt::format("Failed to map shared cache {}", m_name));
+    }
+
+    shared_header_t* header = headerOf(m_region);
+
+    if (creating) {
+        // The region is zero-filled, which is a valid state for the atomics
+        header->m_byteBudget = byteBudget;
+        header->m_capacity = maxEntries;
+
+        pthread_mutexattr_t attributes;
+        pthread_mutexattr_init(&attributes);
+        pthread_mutexattr_setpshared(&attributes, PTHREAD_PROCESS_SHARED);
+        pthread_mutexattr_setrobust(&attributes, PTHREAD_MUTEX_ROBUST);
+        pthread_mutex_init(&header->m_mutex, &attributes);
+        pthread_mutexattr_destroy(&attributes);
+
+        header->m_magic.store(g_magic, std::memory_order_release);
+        return;
+    }
+
+    for (int attempt = 0; attempt < 100; attempt++) {
+        if (header->m_magic.load(std::memory_order_acquire) == g_magic) {
+            break;
+        }
+
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    }
+
+    if (header->m_magic.load(std::memory_order_acquire) != g_magic ||
+        regionSize(header->m_byteBudget, header->m_capacity) != m_regionSize) {
+        munmap(m_region, m_regionSize);
+        m_region = nullptr;
+
+        throw PackageException(
+            fmt::format("{} isn't a shared decode cache", m_name));
+    }
+#endif
+}
+
+SharedDecodeCache::~SharedDecodeCache() {
+#ifdef S4PKG_SHAREDDECODECACHE_SHM
+    if (m_region != nullptr) {
+        munmap(m_region, m_regionSize);
+    }
+#endif
+}
+
+bool SharedDecodeCache::remove(const lib::String& name) {
+#ifdef S4PKG_SHAREDDECODECACHE_SHM
+    return shm_unlink(shmName(name.c_str()).c_str()) == 0;
+#else
+    return false;
+#endif
+}
+
+uint64_t SharedDecodeCache::hashRecord(const lib::ByteBuffer& record) {
+    return internal::hash::hashWide(record.data(), record.size());
+}
+
+const std::optional<DecodedImage> SharedDecodeCache::find(
+    uint64_t recordHash) const {
+#ifdef S4PKG_SHAREDDECODECACHE_SHM
+    if (m_region == nullptr) {
+        return std::nullopt;
+    }
+
+    shared_header_t* header = headerOf(m_region);
+    shared_slot_t* slot = findSlot(m_region, keyOf(recordHash));
+
+    if (slot != nullptr) {
+        uint32_t version = slot->m_version.load(std::memory_order_acquire);
+
+        uint64_t offset = slot->m_offset.load(std::memory_order_relaxed);
+        uint32_t size = slot->m_size.load(std::memory_order_relaxed);
+
+        if ((version & 1) == 0 && offset + size <= header->m_byteBudget) {
+            DecodedImage image{
+                slot->m_width.load(std::memory_order_relaxed),
+                slot->m_height.load(std::memory_order_relaxed),
+                (DecodedFormat)slot->m_format.load(std::memory_order_relaxed),
+                lib::ByteBuffer(size)};
+
+            memcpy(image.m_data.data(), arenaOf(m_region) + offset, size);
+            std::atomic_thread_fence(std::memory_order_acquire);
+
+            if (slot->m_version.load(std::memory_order_relaxed) == version &&
+                slot->m_key.load(std::memory_order_relaxed) ==
+                    keyOf(recordHash)) {
+                slot->m_lastUsed.store(header->m_clock.fetch_add(1) + 1,
+                                       std::memory_order_relaxed);
+                header->m_hits++;
+
+                return image;
+            }
+        }
+    }
+
+    header->m_misses++;
+#endif
+
+    return std::nullopt;
+}
+
+bool SharedDecodeCache::insert(uint64_t recordHash,
+                               const DecodedImage& image) {
+#ifdef S4PKG_SHAREDDECODECACHE_SHM
+    if (m_region == nullptr) {
+        return false;
+    }
+
+    SharedLock lock(headerOf(m_region));
+    return this->insertLocked(keyOf(recordHash), image);
+#else
+    return false;
+#endif
+}
+
+bool SharedDecodeCache::insertLocked(uint64_t key, const DecodedImage& image) {
+#ifdef S4PKG_SHAREDDECODECACHE_SHM
+    shared_header_t* header = headerOf(m_region);
+    uint32_t size = (uint32_t)image.m_data.size();
+
+    if (findSlot(m_region, key) != nullptr) {
+        return true;
+    }
+
+    if (size > header->m_byteBudget) {
+        return false;
+    }
+
+    // Keep a quarter of the table empty, so probing stays short. A full table
+    // is evicted down to 5/8, so an eighth of it can be inserted before
+    // evicting again.
+    if (header->m_entryCount >= header->m_capacity * 3 / 4) {
+        while (header->m_entryCount > header->m_capacity * 5 / 8 &&
+               evictLeastRecentlyUsed(m_region)) {
+        }
+    }
+
+    // Evicted slots only make probing longer, so they are cleared out once
+    // they fill an eighth of the table, not on every insert
+    if (header->m_evictedCount > header->m_capacity / 8) {
+        rebuildTable(m_region);
+    }
+
+    uint64_t offset = 0;
+    while (!findFreeRange(m_region, size, offset)) {
+        if (!evictLeastRecentlyUsed(m_region)) {
+            return false;
+        }
+    }
+
+    // Nothing refers to the range yet, lookups can't see it being written
+    memcpy(arenaOf(m_region) + offset, image.m_data.data(), size);
+
+    shared_slot_t* slots = slotsOf(m_region);
+    for (uint32_t probe = 0; probe < header->m_capacity; probe++) {
+        shared_slot_t& slot = slots[(key + probe) % header->m_capacity];
+        uint64_t slotKey = slot.m_key.load(std::memory_order_relaxed);
+
+        if (slotKey != g_emptyKey && slotKey != g_evictedKey) {
+            continue;
+        }
+
+        uint64_t lastUsed = header->m_clock.fetch_add(1) + 1;
+
+        changeSlot(slot, [&]() {
+            slot.m_format.store(image.m_format, std::memory_order_relaxed);
+            slot.m_lastUsed.store(lastUsed, std::memory_order_relaxed);
+            slot.m_offset.store(offset, std::memory_order_relaxed);
+            slot.m_size.store(size, std::memory_order_relaxed);
+            slot.m_width.store(image.m_width, std::memory_order_relaxed);
+            slot.m_height.store(image.m_height, std::memory_order_relaxed);
+            slot.m_key.store(key, std::memory_order_relaxed);
+        });
+
+        if (slotKey == g_evictedKey) {
+            header->m_evictedCount--;
+        }
+
+        header->m_usedBytes += size;
+        header->m_entryCount++;
+        return true;
+    }
+#endif
+
+    return false;
+}
+
+const size_t SharedDecodeCache::getByteBudget() const {
+#ifdef S4PKG_SHAREDDECODECACHE_SHM
+    if (m_region != nullptr) {
+        return headerOf(m_region)->m_byteBudget;
+    }
+#endif
+
+    return 0;
+}
+
+const size_t SharedDecodeCache::getUsedBytes() const {
+#ifdef S4PKG_SHAREDDECODECACHE_SHM
+    if (m_region != nullptr) {
+        return headerOf(m_region)->m_usedBytes;
+    }
+#endif
+
+    return 0;
+}
+
+const uint32_t SharedDecodeCache::getEntryCount() const {
+#ifdef S4PKG_SHAREDDECODECACHE_SHM
+    if (m_region != nullptr) {
+        return headerOf(m_region)->m_entryCount;
+    }
+#endif
+
+    return 0;
+}
+
+const uint64_t SharedDecodeCache::getHitCount() const {
+#ifdef S4PKG_SHAREDDECODECACHE_SHM
+    if (m_region != nullptr) {
+        return headerOf(m_region)->m_hits;
+    }
+#endif
+
+    return 0;
+}
+
+const uint64_t SharedDecodeCache::getMissCount() const {
+#ifdef S4PKG_SHAREDDECODECACHE_SHM
+    if (m_region != nullptr) {
+        return headerOf(m_region)->m_misses;
+    }
+#endif
+
+    return 0;
+}
+
+const lib::String SharedDecodeCache::toString() const {
+    return fmt::format(
+        "SharedDecodeCache [ name={}, shared={}, entryCount={}, usedBytes={}, "
+        "byteBudget={}, hits={}, misses={} ]",
+        m_name, this->isShared(), this->getEntryCount(), this->getUsedBytes(),
+        this->getByteBudget(), this->getHitCount(), this->getMissCount());
+}
+
+}  // namespace s4pkg
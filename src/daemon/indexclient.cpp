@@ -0,0 +1,285 @@
+/*
+ * Copyright (c) 2022- Gerber Lóránt Viktor
+ * Author: Gerber Lóránt Viktor <glorantv@student.elte.hu>
+ *
+ * This file is part of s4pkg.
+ *
+ * s4pkg is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <s4pkg/daemon/indexclient.h>
+
+#include <s4pkg/internal/membuf.h>
+#include <s4pkg/internal/sockets.h>
+#include <s4pkg/internal/streams.h>
+#include <s4pkg/packageexception.h>
+
+#include <cstring>
+#include <sstream>
+
+#include <fmt/core.h>
+
+namespace s4pkg {
+
+namespace sockets = internal::sockets;
+namespace streams = internal::streams;
+
+static void writeKey(std::ostream& stream, const ResourceKey& key) {
+    streams::writeUint32(stream, key.m_type);
+    streams::writeUint32(stream, key.m_group);
+    streams::writeUint32(stream, key.getInstanceEx());
+    streams::writeUint32(stream, key.getInstance());
+}
+
+static std::string readString(std::istream& stream) {
+    uint32_t size;
+    streams::readUint32(stream, size);
+
+    std::string value(size, '\0');
+    stream.read(value.data(), size);
+    if (!stream.good() && size > 0) {
+        throw PackageException("Response ended inside a string");
+    }
+
+    return value;
+}
+
+IndexClient::IndexClient(const lib::String& socketPath)
+    : m_socketPath(socketPath.c_str()), m_descriptor(-1) {
+    m_descriptor = sockets::connectTo(m_socketPath);
+}
+
+IndexClient::~IndexClient() {
+    sockets::closeSocket(m_descriptor);
+}
+
+IndexStatus IndexClient::request(IndexRequestType type,
+                                 const std::string& payload,
+                                 lib::ByteBuffer& response) {
+    std::ostringstream stream;
+    streams::writeUint8(stream, type);
+    streams::writeUint32(stream, (uint32_t)payload.size());
+    stream.write(payload.data(), payload.size());
+
+    std::string message = stream.str();
+    sockets::sendAll(m_descriptor, message.data(), message.size());
+
+    uint8_t header[9];
+    if (!sockets::receiveAll(m_descriptor, header, sizeof(header))) {
+        throw PackageException("The daemon closed the connection");
+    }
+
+    uint8_t status;
+    uint64_t size;
+    {
+        internal::membuf buffer(header, sizeof(header));
+        std::istream headerStream(&buffer);
+        streams::readUint8(headerStream, status);
+        streams::readUint64(headerStream, size);
+    }
+
+    response = lib::ByteBuffer(size);
+    if (size > 0 && !sockets::receiveAll(m_descriptor, response.data(), size)) {
+        throw PackageException("The daemon closed the connection");
+    }
+
+    if (status == INDEX_BAD_REQUEST || status == INDEX_FAILED) {
+        throw PackageException(fmt::format(
+            "Request failed: {}",
+            std::string((const char*)response.data(), response.size())));
+    }
+
+    return (IndexStatus)status;
+}
+
+const IndexLookupResult IndexClient::lookup(const ResourceKey& key) {
+    std::ostringstream payload;
+    writeKey(payload, key);
+
+    lib::ByteBuffer response;
+    IndexLookupResult result{{}, 0};
+
+    if (this->request(INDEX_LOOKUP, payload.str(), response) != INDEX_OK) {
+        return result;
+    }
+
+    internal::membuf buffer(response.data(), response.size());
+    std::istream stream(&buffer);
+
+    uint32_t count;
+    uint32_t winner;
+    streams::readUint32(stream, count);
+    streams::readUint32(stream, winner);
+    result.m_winner = winner;
+
+    for (uint32_t i = 0; i < count; i++) {
+        uint32_t packageId;
+        uint32_t entry;
+        uint32_t size;
+        uint32_t sizeDecompressed;
+        uint16_t compressionType;
+
+        streams::readUint32(stream, packageId);
+        streams::readUint32(stream, entry);
+        streams::readUint32(stream, size);
+        streams::readUint32(stream, sizeDecompressed);
+        streams::readUint16(stream, compressionType);
+
+        IndexLocation location{packageId,
+                               entry,
+                               readString(stream),
+                               size,
+                               sizeDecompressed,
+                               (CompressionType)compressionType};
+
+        result.m_locations.push_back(location);
+    }
+
+    return result;
+}
+
+const std::vector<IndexPackageInfo> IndexClient::listPackages() {
+    lib::ByteBuffer response;
+    this->request(INDEX_LIST_PACKAGES, "", response);
+
+    internal::membuf buffer(response.data(), response.size());
+    std::istream stream(&buffer);
+
+    uint32_t count;
+    streams::readUint32(stream, count);
+
+    std::vector<IndexPackageInfo> packages;
+    for (uint32_t i = 0; i < count; i++) {
+        uint32_t packageId;
+        uint32_t resourceCount;
+        uint64_t fileSize;
+
+        streams::readUint32(stream, packageId);
+        std::string path = readString(stream);
+        streams::readUint32(stream, resourceCount);
+        streams::readUint64(stream, fileSize);
+
+        IndexPackageInfo package{packageId, path, resourceCount, fileSize};
+        packages.push_back(package);
+    }
+
+    return packages;
+}
+
+const std::vector<IndexEntry> IndexClient::listResources(uint32_t packageId) {
+    std::ostringstream payload;
+    streams::writeUint32(payload, packageId);
+
+    lib::ByteBuffer response;
+    std::vector<IndexEntry> entries;
+
+    if (this->request(INDEX_LIST_RESOURCES, payload.str(), response) !=
+        INDEX_OK) {
+        return entries;
+    }
+
+    internal::membuf buffer(response.data(), response.size());
+    std::istream stream(&buffer);
+
+    uint32_t count;
+    streams::readUint32(stream, count);
+
+    for (uint32_t i = 0; i < count; i++) {
+        uint32_t fields[6];
+        uint8_t isExtendedCompressionType;
+        uint32_t sizeDecompressed;
+        uint16_t compressionType;
+        uint16_t committed;
+
+        streams::readUint32Array(stream, fields, 6);
+        streams::readUint8(stream, isExtendedCompressionType);
+        streams::readUint32(stream, sizeDecompressed);
+        streams::readUint16(stream, compressionType);
+        streams::readUint16(stream, committed);
+
+        entries.emplace_back((ResourceType)fields[0], fields[1], fields[2],
+                             fields[3], fields[4], fields[5],
+                             isExtendedCompressionType != 0, sizeDecompressed,
+                             (CompressionType)compressionType, committed);
+    }
+
+    return entries;
+}
+
+const std::optional<IndexRecord> IndexClient::extract(const ResourceKey& key,
+                                                      bool decompress) {
+    std::ostringstream payload;
+    writeKey(payload, key);
+
+    lib::ByteBuffer response;
+    if (this->request(INDEX_EXTRACT, payload.str(), response) != INDEX_OK) {
+        return std::nullopt;
+    }
+
+    internal::membuf buffer(response.data(), response.size());
+    std::istream stream(&buffer);
+
+    uint16_t compressionType;
+    uint32_t sizeDecompressed;
+    streams::readUint16(stream, compressionType);
+    streams::readUint32(stream, sizeDecompressed);
+
+    IndexRecord record{(CompressionType)compressionType, sizeDecompressed,
+                       lib::ByteBuffer(response.size() - 6)};
+    memcpy(record.m_data.data(), response.data() + 6, record.m_data.size());
+
+    if (decompress && compressionType != CompressionType::UNCOMPRESSED) {
+        index_entry_t entry{};
+        entry.m_size = (uint32_t)record.m_data.size();
+        entry.m_sizeDecompressed = sizeDecompressed;
+        entry.m_compressionType = compressionType;
+
+        lib::ByteBuffer content;
+        streams::decompressRecord(entry, record.m_data, content);
+
+        record.m_data = std::move(content);
+        record.m_compressionType = CompressionType::UNCOMPRESSED;
+    }
+
+    return record;
+}
+
+const std::optional<IndexThumbnail> IndexClient::thumbnail(
+    const ResourceKey& key) {
+    std::ostringstream payload;
+    writeKey(payload, key);
+
+    lib::ByteBuffer response;
+    if (this->request(INDEX_THUMBNAIL, payload.str(), response) != INDEX_OK) {
+        return std::nullopt;
+    }
+
+    internal::membuf buffer(response.data(), response.size());
+    std::istream stream(&buffer);
+
+    IndexThumbnail thumbnail{0, 0, lib::ByteBuffer(response.size() - 8)};
+    streams::readUint32(stream, thumbnail.m_width);
+    streams::readUint32(stream, thumbnail.m_height);
+    memcpy(thumbnail.m_pixelData.data(), response.data() + 8,
+           thumbnail.m_pixelData.size());
+
+    return thumbnail;
+}
+
+const lib::String IndexClient::toString() const {
+    return fmt::format("IndexClient [ socketPath={}, connected={} ]",
+                       m_socketPath, m_descriptor >= 0);
+}
+
+}  // namespace s4pkg
@@ -0,0 +1,509 @@
+/*
+ * Copyright (c) 2022- Gerber Lóránt Viktor
+ * Author: Gerber Lóránt Viktor <glorantv@student.elte.hu>
+ *
+ * This file is part of s4pkg.
+ *
+ * s4pkg is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <s4pkg/daemon/indexserver.h>
+
+#include <s4pkg/internal/membuf.h>
+#include <s4pkg/internal/sockets.h>
+#include <s4pkg/internal/streams.h>
+#include <s4pkg/package/packages.h>
+#include <s4pkg/packageexception.h>
+#include <s4pkg/resources/imageresource.h>
+
+#include <algorithm>
+#include <exception>
+#include <sstream>
+
+#include <fmt/core.h>
+
+#if defined(__unix__) || defined(__APPLE__)
+#define S4PKG_INDEXSERVER_POSIX
+#include <fcntl.h>
+#include <poll.h>
+#include <signal.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace s4pkg {
+
+namespace sockets = internal::sockets;
+namespace streams = internal::streams;
+
+static constexpr int g_pollIntervalMilliseconds = 100;
+
+// Requests are read with blocking reads once their first byte is there, a
+// client that stops in the middle of one may only hold up the others this long
+static constexpr uint32_t g_receiveTimeoutMilliseconds = 2000;
+
+// Every open package holds a file descriptor
+static constexpr size_t g_maxOpenPackages = 32;
+
+static void writeString(std::ostream& stream, const std::string& value) {
+    streams::writeUint32(stream, (uint32_t)value.size());
+    streams::writeBytes(stream, (const uint8_t*)value.data(),
+                        (int)value.size());
+}
+
+static void readKey(std::istream& stream, ResourceKey& key) {
+    uint32_t parts[4];
+    streams::readUint32Array(stream, parts, 4);
+
+    key = ResourceKey::fromParts(parts[0], parts[1], parts[2], parts[3]);
+}
+
+static uint64_t locationOf(uint32_t packageId, uint32_t entry) {
+    return (uint64_t)packageId << 32 | entry;
+}
+
+IndexServer::IndexServer(PackageLibrary& library,
+                         const lib::String& socketPath,
+                         size_t thumbnailCacheSize)
+    : m_library(library),
+      m_watcher(library),
+      m_socketPath(socketPath.c_str()),
+      m_listenDescriptor(-1),
+      m_stopping(false),
+      m_thumbnailCacheSize(thumbnailCacheSize),
+      m_thumbnailCacheUsed(0),
+      m_requestCount(0) {
+    m_library.scan();
+
+    // Ids of changed packages stay the same, but what was read from them
+    // before is stale
+    m_watcher.addListener([this](const LibraryChange& change) {
+        this->forgetPackage(change.m_packageId);
+    });
+
+    m_listenDescriptor = sockets::listenAt(m_socketPath);
+}
+
+IndexServer::~IndexServer() {
+    for (int client : m_clients) {
+        sockets::closeSocket(client);
+    }
+
+    if (m_listenDescriptor >= 0) {
+        sockets::closeSocket(m_listenDescriptor);
+
+#ifdef S4PKG_INDEXSERVER_POSIX
+        unlink(m_socketPath.c_str());
+#endif
+    }
+}
+
+void IndexServer::run() {
+#ifdef S4PKG_INDEXSERVER_POSIX
+    // sendfile() has no MSG_NOSIGNAL, so a client disconnecting in the middle
+    // of a record would kill the process, instead of failing the send
+    signal(SIGPIPE, SIG_IGN);
+
+    while (!m_stopping) {
+        std::vector<pollfd> descriptors;
+        descriptors.push_back({m_listenDescriptor, POLLIN, 0});
+        for (int client : m_clients) {
+            descriptors.push_back({client, POLLIN, 0});
+        }
+
+        int ready = ::poll(descriptors.data(), descriptors.size(),
+                           g_pollIntervalMilliseconds);
+
+        if (ready > 0) {
+            // Clients are served before new ones are accepted, so the
+            // descriptors line up with m_clients
+            std::vector<int> clients;
+
+            for (size_t i = 1; i < descriptors.size(); i++) {
+                int client = descriptors[i].fd;
+
+                if (descriptors[i].revents == 0 || this->serve(client)) {
+                    clients.push_back(client);
+                } else {
+                    sockets::closeSocket(client);
+                }
+            }
+
+            m_clients = std::move(clients);
+
+            if ((descriptors[0].revents & POLLIN) != 0) {
+                int client = accept(m_listenDescriptor, nullptr, nullptr);
+                if (client >= 0) {
+                    fcntl(client, F_SETFD, FD_CLOEXEC);
+
+                    try {
+                        sockets::setReceiveTimeout(
+                            client, g_receiveTimeoutMilliseconds);
+                        m_clients.push_back(client);
+                    } catch (PackageException) {
+                        sockets::closeSocket(client);
+                    }
+                }
+            }
+        }
+
+        m_watcher.poll(0);
+    }
+#endif
+}
+
+void IndexServer::forgetPackage(uint32_t packageId) {
+    this->closePackage(packageId);
+
+    for (auto it = m_thumbnails.begin(); it != m_thumbnails.end();) {
+        if ((uint32_t)(it->m_location >> 32) != packageId) {
+            it++;
+            continue;
+        }
+
+        m_thumbnailCacheUsed -= it->m_pixelData.size();
+        m_thumbnailIndex.erase(it->m_location);
+        it = m_thumbnails.erase(it);
+    }
+}
+
+void IndexServer::closePackage(uint32_t packageId) {
+    auto found = m_openPackageIndex.find(packageId);
+    if (found != m_openPackageIndex.end()) {
+        m_openPackages.erase(found->second);
+        m_openPackageIndex.erase(found);
+    }
+}
+
+std::shared_ptr<IPackage> IndexServer::openLibraryPackage(uint32_t packageId) {
+    auto found = m_openPackageIndex.find(packageId);
+    if (found != m_openPackageIndex.end()) {
+        m_openPackages.splice(m_openPackages.begin(), m_openPackages,
+                              found->second);
+        return found->second->second;
+    }
+
+    PackageLoadResult result =
+        openPackage(m_library.getPackagePath(packageId));
+
+    if (result.m_package == nullptr) {
+        throw PackageException(result.m_errorMessage.c_str());
+    }
+
+    m_openPackages.emplace_front(packageId, result.m_package);
+    m_openPackageIndex[packageId] = m_openPackages.begin();
+
+    while (m_openPackages.size() > g_maxOpenPackages) {
+        m_openPackageIndex.erase(m_openPackages.back().first);
+        m_openPackages.pop_back();
+    }
+
+    return result.m_package;
+}
+
+bool IndexServer::serve(int client) {
+    try {
+        uint8_t header[5];
+        if (!sockets::receiveAll(client, header, sizeof(header))) {
+            return false;
+        }
+
+        uint8_t type;
+        uint32_t size;
+        {
+            internal::membuf buffer(header, sizeof(header));
+            std::istream stream(&buffer);
+            streams::readUint8(stream, type);
+            streams::readUint32(stream, size);
+        }
+
+        if (size > g_indexMaxRequestSize) {
+            this->sendResponse(client, INDEX_BAD_REQUEST, "Request too large");
+            return false;
+        }
+
+        lib::ByteBuffer payload(size);
+        if (size > 0 && !sockets::receiveAll(client, payload.data(), size)) {
+            return false;
+        }
+
+        m_requestCount++;
+
+        internal::membuf buffer(payload.data(), payload.size());
+        std::istream stream(&buffer);
+
+        ResourceKey key{};
+        uint32_t packageId = 0;
+
+        try {
+            if (type == INDEX_LOOKUP || type == INDEX_EXTRACT ||
+                type == INDEX_THUMBNAIL) {
+                readKey(stream, key);
+            } else if (type == INDEX_LIST_RESOURCES) {
+                streams::readUint32(stream, packageId);
+            }
+        } catch (PackageException) {
+            this->sendResponse(client, INDEX_BAD_REQUEST, "Payload too short");
+            return true;
+        }
+
+        switch (type) {
+            case INDEX_LOOKUP:
+                this->lookup(client, key);
+                break;
+            case INDEX_LIST_PACKAGES:
+                this->listPackages(client);
+                break;
+            case INDEX_LIST_RESOURCES:
+                this->listResources(client, packageId);
+                break;
+            case INDEX_EXTRACT:
+                this->extract(client, key);
+                break;
+            case INDEX_THUMBNAIL:
+                this->thumbnail(client, key);
+                break;
+            default:
+                this->sendResponse(client, INDEX_BAD_REQUEST,
+                                   fmt::format("Unknown request {}", type));
+                break;
+        }
+    } catch (PackageException) {
+        return false;  // The connection failed, or is out of sync
+    } catch (const std::exception&) {
+        // Out of memory while decoding, for example. Only this client is
+        // dropped, the others are still served.
+        return false;
+    }
+
+    return true;
+}
+
+void IndexServer::sendResponse(int client,
+                               IndexStatus status,
+                               const std::string& payload) {
+    std::ostringstream stream;
+    streams::writeUint8(stream, status);
+    streams::writeUint64(stream, payload.size());
+    stream.write(payload.data(), payload.size());
+
+    std::string response = stream.str();
+    sockets::sendAll(client, response.data(), response.size());
+}
+
+void IndexServer::lookup(int client, const ResourceKey& key) {
+    std::vector<LibraryLocation> locations = m_library.find(key);
+    std::optional<LibraryLocation> winner = m_library.resolve(key);
+
+    if (locations.empty() || !winner.has_value()) {
+        this->sendResponse(client, INDEX_NOT_FOUND, "");
+        return;
+    }
+
+    std::ostringstream stream;
+    streams::writeUint32(stream, (uint32_t)locations.size());
+
+    uint32_t winnerIndex = 0;
+    for (uint32_t i = 0; i < locations.size(); i++) {
+        if (locations[i].m_packageId == winner->m_packageId &&
+            locations[i].m_entry == winner->m_entry) {
+            winnerIndex = i;
+        }
+    }
+
+    streams::writeUint32(stream, winnerIndex);
+
+    for (const LibraryLocation& location : locations) {
+        IndexView index = m_library.getPackageIndex(location.m_packageId);
+
+        streams::writeUint32(stream, location.m_packageId);
+        streams::writeUint32(stream, location.m_entry);
+        streams::writeUint32(stream, index.getSize(location.m_entry));
+        streams::writeUint32(stream,
+                             index.getSizeDecompressed(location.m_entry));
+        streams::writeUint16(stream,
+                             index.getCompressionType(location.m_entry));
+        writeString(stream,
+                    m_library.getPackagePath(location.m_packageId).c_str());
+    }
+
+    this->sendResponse(client, INDEX_OK, stream.str());
+}
+
+void IndexServer::listPackages(int client) {
+    std::vector<uint32_t> packageIds = m_library.getPackageIds();
+
+    std::ostringstream stream;
+    streams::writeUint32(stream, (uint32_t)packageIds.size());
+
+    for (uint32_t packageId : packageIds) {
+        streams::writeUint32(stream, packageId);
+        writeString(stream, m_library.getPackagePath(packageId).c_str());
+        streams::writeUint32(
+            stream, (uint32_t)m_library.getPackageIndex(packageId).size());
+        streams::writeUint64(stream, m_library.getPackageFileSize(packageId));
+    }
+
+    this->sendResponse(client, INDEX_OK, stream.str());
+}
+
+void IndexServer::listResources(int client, uint32_t packageId) {
+    std::vector<uint32_t> packageIds = m_library.getPackageIds();
+    if (std::find(packageIds.begin(), packageIds.end(), packageId) ==
+        packageIds.end()) {
+        this->sendResponse(client, INDEX_NOT_FOUND, "");
+        return;
+    }
+
+    IndexView index = m_library.getPackageIndex(packageId);
+
+    std::ostringstream stream;
+    streams::writeUint32(stream, (uint32_t)index.size());
+
+    for (const IndexEntry& entry : index) {
+        streams::writeUint32(stream, entry.m_type);
+        streams::writeUint32(stream, entry.m_group);
+        streams::writeUint32(stream, entry.m_instanceEx);
+        streams::writeUint32(stream, entry.m_instance);
+        streams::writeUint32(stream, entry.m_position);
+        streams::writeUint32(stream, entry.m_size);
+        streams::writeUint8(stream, entry.m_isExtendedCompressionType);
+        streams::writeUint32(stream, entry.m_sizeDecompressed);
+        streams::writeUint16(stream, entry.m_compressionType);
+        streams::writeUint16(stream, entry.m_committed);
+    }
+
+    this->sendResponse(client, INDEX_OK, stream.str());
+}
+
+void IndexServer::extract(int client, const ResourceKey& key) {
+#ifdef S4PKG_INDEXSERVER_POSIX
+    std::optional<LibraryLocation> location = m_library.resolve(key);
+    if (!location.has_value()) {
+        this->sendResponse(client, INDEX_NOT_FOUND, "");
+        return;
+    }
+
+    IndexView index = m_library.getPackageIndex(location->m_packageId);
+    uint64_t position = index.getPosition(location->m_entry);
+    uint64_t size = index.getSize(location->m_entry);
+
+    std::string path = m_library.getPackagePath(location->m_packageId).c_str();
+
+    int file = open(path.c_str(), O_RDONLY);
+    struct stat status {};
+
+    if (file < 0 || fstat(file, &status) != 0 ||
+        position + size > (uint64_t)status.st_size) {
+        if (file >= 0) {
+            close(file);
+        }
+
+        this->sendResponse(client, INDEX_FAILED,
+                           fmt::format("Failed to read record from {}", path));
+        return;
+    }
+
+    // The record is sent after this header straight from the file
+    std::ostringstream stream;
+    streams::writeUint8(stream, INDEX_OK);
+    streams::writeUint64(stream, 6 + size);
+    streams::writeUint16(stream, index.getCompressionType(location->m_entry));
+    streams::writeUint32(stream, index.getSizeDecompressed(location->m_entry));
+
+    std::string header = stream.str();
+
+    try {
+        sockets::sendAll(client, header.data(), header.size());
+        sockets::sendFileRange(client, file, position, size);
+    } catch (PackageException e) {
+        close(file);
+        throw e;
+    }
+
+    close(file);
+#endif
+}
+
+void IndexServer::thumbnail(int client, const ResourceKey& key) {
+    std::optional<LibraryLocation> location = m_library.resolve(key);
+    if (!location.has_value()) {
+        this->sendResponse(client, INDEX_NOT_FOUND, "");
+        return;
+    }
+
+    uint64_t cacheKey = locationOf(location->m_packageId, location->m_entry);
+    auto cached = m_thumbnailIndex.find(cacheKey);
+
+    if (cached == m_thumbnailIndex.end()) {
+        cached_thumbnail_t thumbnail{cacheKey, 0, 0, {}};
+
+        try {
+            std::shared_ptr<IPackage> package =
+                this->openLibraryPackage(location->m_packageId);
+
+            std::shared_ptr<IResource> resource =
+                package->getResource(location->m_entry);
+            auto image =
+                std::dynamic_pointer_cast<resources::IImageResource>(resource);
+
+            if (image == nullptr) {
+                throw PackageException("Resource isn't an image");
+            }
+
+            thumbnail.m_width = image->getWidth();
+            thumbnail.m_height = image->getHeight();
+            thumbnail.m_pixelData = image->getPixelData();
+        } catch (PackageException e) {
+            this->closePackage(location->m_packageId);
+            this->sendResponse(client, INDEX_FAILED, e.what());
+            return;
+        }
+
+        m_thumbnails.push_front(std::move(thumbnail));
+        m_thumbnailCacheUsed += m_thumbnails.front().m_pixelData.size();
+        cached = m_thumbnailIndex.emplace(cacheKey, m_thumbnails.begin()).first;
+    } else {
+        m_thumbnails.splice(m_thumbnails.begin(), m_thumbnails,
+                            cached->second);
+    }
+
+    std::ostringstream stream;
+    const cached_thumbnail_t& thumbnail = *cached->second;
+    streams::writeUint32(stream, thumbnail.m_width);
+    streams::writeUint32(stream, thumbnail.m_height);
+    streams::writeBytes(stream, thumbnail.m_pixelData.data(),
+                        (int)thumbnail.m_pixelData.size());
+
+    this->sendResponse(client, INDEX_OK, stream.str());
+
+    // Evicting after sending keeps an image larger than the whole cache usable
+    while (m_thumbnailCacheUsed > m_thumbnailCacheSize &&
+           !m_thumbnails.empty()) {
+        m_thumbnailCacheUsed -= m_thumbnails.back().m_pixelData.size();
+        m_thumbnailIndex.erase(m_thumbnails.back().m_location);
+        m_thumbnails.pop_back();
+    }
+}
+
+const lib::String IndexServer::toString() const {
+    return fmt::format(
+        "IndexServer [ socketPath={}, clients={}, requestCount={}, "
+        "cachedThumbnails={}, thumbnailCacheUsed={} ]",
+        m_socketPath, m_clients.size(), m_requestCount, m_thumbnails.size(),
+        m_thumbnailCacheUsed);
+}
+
+}  // namespace s4pkg
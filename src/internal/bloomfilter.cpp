@@ -0,0 +1,108 @@
+/*
+ * Copyright (c) 2022- Gerber Lóránt Viktor
+ * Author: Gerber Lóránt Viktor <glorantv@student.elte.hu>
+ *
+ * This file is part of s4pkg.
+ *
+ * s4pkg is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <s4pkg/internal/bloomfilter.h>
+
+namespace s4pkg::internal::bloomfilter {
+
+// Number of bits set per key, each selected by 9 bits of the hash
+static constexpr int g_bitsPerKey = 6;
+
+static_assert(sizeof(bloom_block_t) == 64, "A block must be one cache line");
+
+// Finaliser from MurmurHash3
+static uint64_t mix(uint64_t hash) {
+    hash ^= hash >> 33;
+    hash *= 0xFF51AFD7ED558CCDULL;
+    hash ^= hash >> 33;
+    hash *= 0xC4CEB9FE1A85EC53ULL;
+    hash ^= hash >> 33;
+
+    return hash;
+}
+
+static uint64_t hashKey(const ResourceKey& key) {
+    return mix(key.m_instance ^
+               mix((uint64_t)key.m_type << 32 | key.m_group));
+}
+
+// Bits within the block are chosen by a second hash, so they are independent
+// of the choice of block
+static uint64_t bitsFor(uint64_t hash) {
+    return mix(hash ^ 0x9E3779B97F4A7C15ULL);
+}
+
+static uint32_t blockFor(const bloom_filter_t& filter, uint64_t hash) {
+    // Maps the high 32 bits of the hash onto [0, blockCount) without a modulo
+    return (uint32_t)(((hash >> 32) * filter.m_blockCount) >> 32);
+}
+
+bloom_filter_t create(size_t expectedKeys) {
+    uint32_t blockCount =
+        (uint32_t)((expectedKeys * 12 + 511) / 512);  // ~12 bits per key
+
+    if (blockCount == 0) {
+        blockCount = 1;
+    }
+
+    return {std::vector<bloom_block_t>(blockCount, bloom_block_t{}),
+            blockCount};
+}
+
+bloom_filter_t build(const soaindex::soa_index_t& index) {
+    bloom_filter_t filter = create(index.size());
+
+    for (uint32_t i = 0; i < index.size(); i++) {
+        insert(filter, ResourceKey::fromParts(index.m_types[i],
+                                              index.m_groups[i],
+                                              index.m_instanceExs[i],
+                                              index.m_instances[i]));
+    }
+
+    return filter;
+}
+
+void insert(bloom_filter_t& filter, const ResourceKey& key) {
+    uint64_t hash = hashKey(key);
+    uint64_t* block = filter.m_blocks[blockFor(filter, hash)].m_words;
+
+    uint64_t bits = bitsFor(hash);
+    for (int i = 0; i < g_bitsPerKey; i++) {
+        uint32_t bit = (bits >> (i * 9)) & 511;
+        block[bit >> 6] |= 1ULL << (bit & 63);
+    }
+}
+
+bool mayContain(const bloom_filter_t& filter, const ResourceKey& key) {
+    uint64_t hash = hashKey(key);
+    const uint64_t* block = filter.m_blocks[blockFor(filter, hash)].m_words;
+
+    uint64_t bits = bitsFor(hash);
+    for (int i = 0; i < g_bitsPerKey; i++) {
+        uint32_t bit = (bits >> (i * 9)) & 511;
+        if ((block[bit >> 6] & (1ULL << (bit & 63))) == 0) {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+}  // namespace s4pkg::internal::bloomfilter
@@ -27,7 +27,8 @@
 #include <fmt/printf.h>
 #include <fmt/ranges.h>
 
-#include <s4pkg/internal/membuf.h>
+#include <s4pkg/internal/binarycursor.h>
+#include <s4pkg/internal/layout.h>
 #include <s4pkg/internal/streams.h>
 #include <s4pkg/packageexception.h>
 
@@ -133,45 +134,38 @@ std::string headerToString(const dds_header_t& header) {
         header.m_caps4);
 }
 
-dds_pixelformat_t readPixelFormat(std::istream& stream) {
+dds_pixelformat_t readPixelFormat(BinaryCursor& cursor) {
     dds_pixelformat_t pixelFormat{};
-
-    streams::readUint32(stream, pixelFormat.m_size);
-    streams::readUint32(stream, pixelFormat.m_flags);
-    streams::readUint32(stream, pixelFormat.m_fourCC);
-    streams::readUint32(stream, pixelFormat.m_rgbBitCount);
-    streams::readUint32(stream, pixelFormat.m_rBitMask);
-    streams::readUint32(stream, pixelFormat.m_gBitMask);
-    streams::readUint32(stream, pixelFormat.m_bBitMask);
-    streams::readUint32(stream, pixelFormat.m_aBitMask);
+    layout::read(cursor, pixelFormat);
 
     return pixelFormat;
 }
 
-dds_header_t readHeader(std::istream& stream) {
-    dds_header_t header{};
-
-    streams::readUint32(stream, header.m_size);
-    streams::readUint32(stream, header.m_flags);
-    streams::readUint32(stream, header.m_height);
-    streams::readUint32(stream, header.m_width);
-    streams::readUint32(stream, header.m_pitchOrLinearSize);
-    streams::readUint32(stream, header.m_depth);
-    streams::readUint32(stream, header.m_mipMapCount);
-    streams::readUint32Array(stream, header.m_reserved, 11);
+dds_pixelformat_t readPixelFormat(ByteSource& source) {
+    uint8_t buffer[layout::encodedSize<dds_pixelformat_t>()];
+    streams::readBytes(source, buffer, sizeof(buffer));
 
-    header.m_pixelFormat = readPixelFormat(stream);
+    BinaryCursor cursor(buffer, sizeof(buffer));
+    return readPixelFormat(cursor);
+}
 
-    streams::readUint32(stream, header.m_caps);
-    streams::readUint32(stream, header.m_caps2);
-    streams::readUint32(stream, header.m_caps3);
-    streams::readUint32(stream, header.m_caps4);
-    streams::readUint32(stream, header.m_reserved2);
+dds_header_t readHeader(BinaryCursor& cursor) {
+    dds_header_t header{};
+    layout::read(cursor, header);
 
     return header;
 }
 
-void readCompressedImageData(std::istream& stream, dds_file_t& file) {
+dds_header_t readHeader(ByteSource& source) {
+    // One read for the whole header, the fields are parsed from memory
+    uint8_t buffer[layout::encodedSize<dds_header_t>()];
+    streams::readBytes(source, buffer, sizeof(buffer));
+
+    BinaryCursor cursor(buffer, sizeof(buffer));
+    return readHeader(cursor);
+}
+
+void readCompressedImageData(ByteSource& source, dds_file_t& file) {
     uint32_t width = file.m_header.m_width;
     uint32_t height = file.m_header.m_height;
 
@@ -189,14 +183,14 @@ void readCompressedImageData(std::istream& stream, dds_file_t& file) {
     try {
         file.m_mainImage =
             lib::ByteBuffer(DDS_IMAGE_SIZE(width, height, blockSize));
-        streams::readBytes(stream, file.m_mainImage.data(),
-                           (int)file.m_mainImage.size());
+        streams::readBytes(source, file.m_mainImage.data(),
+                           file.m_mainImage.size());
     } catch (PackageException e) {
         throw PackageException(
             fmt::format("Reading DDS main image (compressed) (requested size: "
                         "{}, position: "
                         "{}, block size: {}, header: {}): {}",
-                        file.m_mainImage.size(), stream.tellg(), blockSize,
+                        file.m_mainImage.size(), source.tell(), blockSize,
                         headerToString(file.m_header), e.what()));
     }
 
@@ -213,13 +207,13 @@ void readCompressedImageData(std::istream& stream, dds_file_t& file) {
         height = std::max<uint32_t>(1, height);
 
         lib::ByteBuffer mipmap(DDS_IMAGE_SIZE(width, height, blockSize));
-        streams::readBytes(stream, mipmap.data(), (int)mipmap.size());
+        streams::readBytes(source, mipmap.data(), mipmap.size());
 
         file.m_mipmaps[i] = mipmap;
     }
 }
 
-void readUncompressedImageData(std::istream& stream, dds_file_t& file) {
+void readUncompressedImageData(ByteSource& source, dds_file_t& file) {
     uint32_t width = file.m_header.m_width;
     uint32_t height = file.m_header.m_height;
 
@@ -228,14 +222,14 @@ void readUncompressedImageData(std::istream& stream, dds_file_t& file) {
     // Read in the main image
     try {
         file.m_mainImage = lib::ByteBuffer(width * height * bytesPerPixel);
-        streams::readBytes(stream, file.m_mainImage.data(),
-                           (int)file.m_mainImage.size());
+        streams::readBytes(source, file.m_mainImage.data(),
+                           file.m_mainImage.size());
     } catch (PackageException e) {
         throw PackageException(fmt::format(
             "Reading DDS main image (uncompressed) (requested size: "
             "{}, position: "
             "{}, bpp: {}, header: {}): {}",
-            file.m_mainImage.size(), stream.tellg(), bytesPerPixel,
+            file.m_mainImage.size(), source.tell(), bytesPerPixel,
             headerToString(file.m_header), e.what()));
     }
 
@@ -252,17 +246,17 @@ void readUncompressedImageData(std::istream& stream, dds_file_t& file) {
         height = std::max<uint32_t>(1, height);
 
         lib::ByteBuffer mipmap(width * height * bytesPerPixel);
-        streams::readBytes(stream, mipmap.data(), (int)mipmap.size());
+        streams::readBytes(source, mipmap.data(), mipmap.size());
 
         file.m_mipmaps[i] = mipmap;
     }
 }
 
-bool readFile(std::istream& stream, dds_file_t& file) {
+bool readFile(ByteSource& source, dds_file_t& file) {
     uint8_t magicBytes[4];
     uint8_t expectedMagic[] = {'D', 'D', 'S', ' '};
 
-    streams::readBytes(stream, magicBytes, 4);
+    streams::readBytes(source, magicBytes, 4);
 
     // Verify that this actually is a DDS file
     for (int i = 0; i < 4; i++) {
@@ -272,7 +266,7 @@ bool readFile(std::istream& stream, dds_file_t& file) {
     }
 
     try {
-        file.m_header = readHeader(stream);
+        file.m_header = readHeader(source);
     } catch (PackageException e) {
         throw PackageException(fmt::format("Reading DDS header: {}", e.what()));
     }
@@ -289,10 +283,10 @@ bool readFile(std::istream& stream, dds_file_t& file) {
 
     if ((file.m_header.m_pixelFormat.m_flags & DDPF_FOURCC) !=
         0) {  // Compressed image
-        readCompressedImageData(stream, file);
+        readCompressedImageData(source, file);
     } else if ((file.m_header.m_pixelFormat.m_flags & DDPF_RGB) !=
                0) {  // Uncompressed image
-        readUncompressedImageData(stream, file);
+        readUncompressedImageData(source, file);
     } else {
         throw PackageException(
             fmt::format("Unrecognised DDS file! {}", fileToString(file)));
@@ -301,6 +295,21 @@ bool readFile(std::istream& stream, dds_file_t& file) {
     return true;
 }
 
+dds_pixelformat_t readPixelFormat(std::istream& stream) {
+    StreamByteSource source(stream);
+    return readPixelFormat(source);
+}
+
+dds_header_t readHeader(std::istream& stream) {
+    StreamByteSource source(stream);
+    return readHeader(source);
+}
+
+bool readFile(std::istream& stream, dds_file_t& file) {
+    StreamByteSource source(stream);
+    return readFile(source, file);
+}
+
 // We're going for functionality over looks here
 lib::ByteBuffer writeFile(const dds_file_t& file) {
     uint8_t magicBytes[] = {'D', 'D', 'S', ' '};
@@ -310,41 +319,17 @@ lib::ByteBuffer writeFile(const dds_file_t& file) {
         imageDataSize += (uint32_t)mipmap.size();
     }
 
-    uint32_t totalFileSize =
-        sizeof(magicBytes) + sizeof(dds_header_t) + imageDataSize;
+    uint32_t totalFileSize = sizeof(magicBytes) +
+                             layout::encodedSize<dds_header_t>() +
+                             imageDataSize;
 
     lib::ByteBuffer output(totalFileSize);
 
     uint32_t c = 0;
     COPY_BYTES(magicBytes, output, 0, 4, c);
-    COPY_UINT32(file.m_header.m_size, output, c);
-    COPY_UINT32(file.m_header.m_flags, output, c);
-    COPY_UINT32(file.m_header.m_height, output, c);
-    COPY_UINT32(file.m_header.m_width, output, c);
-    COPY_UINT32(file.m_header.m_pitchOrLinearSize, output, c);
-    COPY_UINT32(file.m_header.m_depth, output, c);
-    COPY_UINT32(file.m_header.m_mipMapCount, output, c);
-
-    for (int i = 0; i < 11; i++) {
-        COPY_UINT32(file.m_header.m_reserved[i], output, c);
-    }
-
-    {
-        COPY_UINT32(file.m_header.m_pixelFormat.m_size, output, c);
-        COPY_UINT32(file.m_header.m_pixelFormat.m_flags, output, c);
-        COPY_UINT32(file.m_header.m_pixelFormat.m_fourCC, output, c);
-        COPY_UINT32(file.m_header.m_pixelFormat.m_rgbBitCount, output, c);
-        COPY_UINT32(file.m_header.m_pixelFormat.m_rBitMask, output, c);
-        COPY_UINT32(file.m_header.m_pixelFormat.m_gBitMask, output, c);
-        COPY_UINT32(file.m_header.m_pixelFormat.m_bBitMask, output, c);
-        COPY_UINT32(file.m_header.m_pixelFormat.m_aBitMask, output, c);
-    }
 
-    COPY_UINT32(file.m_header.m_caps, output, c);
-    COPY_UINT32(file.m_header.m_caps2, output, c);
-    COPY_UINT32(file.m_header.m_caps3, output, c);
-    COPY_UINT32(file.m_header.m_caps4, output, c);
-    COPY_UINT32(file.m_header.m_reserved2, output, c);
+    layout::write(output.data() + c, file.m_header);
+    c += layout::encodedSize<dds_header_t>();
 
     COPY_BYTES(file.m_mainImage, output, 0, file.m_mainImage.size(), c);
 
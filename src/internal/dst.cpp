@@ -0,0 +1,379 @@
+/*
+ * Copyright (c) 2022- Gerber Lóránt Viktor
+ * Author: Gerber Lóránt Viktor <glorantv@student.elte.hu>
+ *
+ * This file is part of s4pkg.
+ *
+ * s4pkg is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#include <s4pkg/internal/dst.h>
+
+#include <cstring>
+
+#if defined(__SSE2__) || defined(_M_X64) || \
+    (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define S4PKG_DST_SSE2
+#include <emmintrin.h>
+#endif
+
+// SSSE3 is compiled for the functions that need it, and only used when the
+// CPU supports it
+#if defined(S4PKG_DST_SSE2) && (defined(__GNUC__) || defined(__clang__)) && \
+    (defined(__x86_64__) || defined(__i386__))
+#define S4PKG_DST_SSSE3
+#include <tmmintrin.h>
+#endif
+
+namespace s4pkg::internal::dst {
+
+// The scalar kernels do the blocks from first on, the others do as many
+// blocks as they can at once, and leave the rest to the scalar ones
+
+static void unshuffleDst5Scalar(const dst5_view_t<const uint8_t>& view,
+                                uint8_t* blocks,
+                                uint64_t first,
+                                uint64_t blockCount) {
+    for (uint64_t i = first; i < blockCount; i++) {
+        uint8_t* block = blocks + i * 16;
+
+        memcpy(block, view.m_alphaEndpoints + i * 2, 2);
+        memcpy(block + 2, view.m_alphaIndices + i * 6, 6);
+        memcpy(block + 8, view.m_colourEndpoints + i * 4, 4);
+        memcpy(block + 12, view.m_colourIndices + i * 4, 4);
+    }
+}
+
+static void shuffleDst5Scalar(const uint8_t* blocks,
+                              const dst5_view_t<uint8_t>& view,
+                              uint64_t first,
+                              uint64_t blockCount) {
+    for (uint64_t i = first; i < blockCount; i++) {
+        const uint8_t* block = blocks + i * 16;
+
+        memcpy(view.m_alphaEndpoints + i * 2, block, 2);
+        memcpy(view.m_alphaIndices + i * 6, block + 2, 6);
+        memcpy(view.m_colourEndpoints + i * 4, block + 8, 4);
+        memcpy(view.m_colourIndices + i * 4, block + 12, 4);
+    }
+}
+
+static void unshuffleDst1Scalar(const uint8_t* planes,
+                                uint8_t* blocks,
+                                uint64_t first,
+                                uint64_t blockCount) {
+    const uint8_t* endpoints = planes;
+    const uint8_t* indices = planes + blockCount * 4;
+
+    for (uint64_t i = first; i < blockCount; i++) {
+        memcpy(blocks + i * 8, endpoints + i * 4, 4);
+        memcpy(blocks + i * 8 + 4, indices + i * 4, 4);
+    }
+}
+
+static void shuffleDst1Scalar(const uint8_t* blocks,
+                              uint8_t* planes,
+                              uint64_t first,
+                              uint64_t blockCount) {
+    uint8_t* endpoints = planes;
+    uint8_t* indices = planes + blockCount * 4;
+
+    for (uint64_t i = first; i < blockCount; i++) {
+        memcpy(endpoints + i * 4, blocks + i * 8, 4);
+        memcpy(indices + i * 4, blocks + i * 8 + 4, 4);
+    }
+}
+
+#ifdef S4PKG_DST_SSE2
+// DXT1 blocks are pairs of 32-bit words, so the planes are interleaved and
+// split with 32-bit unpacks and shuffles, 4 blocks at a time
+static void unshuffleDst1Sse2(const uint8_t* planes,
+                              uint8_t* blocks,
+                              uint64_t blockCount) {
+    const uint8_t* endpoints = planes;
+    const uint8_t* indices = planes + blockCount * 4;
+
+    uint64_t i = 0;
+    for (; i + 4 <= blockCount; i += 4) {
+        __m128i e = _mm_loadu_si128((const __m128i*)(endpoints + i * 4));
+        __m128i c = _mm_loadu_si128((const __m128i*)(indices + i * 4));
+
+        _mm_storeu_si128((__m128i*)(blocks + i * 8), _mm_unpacklo_epi32(e, c));
+        _mm_storeu_si128((__m128i*)(blocks + i * 8 + 16),
+                         _mm_unpackhi_epi32(e, c));
+    }
+
+    unshuffleDst1Scalar(planes, blocks, i, blockCount);
+}
+
+static void shuffleDst1Sse2(const uint8_t* blocks,
+                            uint8_t* planes,
+                            uint64_t blockCount) {
+    uint8_t* endpoints = planes;
+    uint8_t* indices = planes + blockCount * 4;
+
+    uint64_t i = 0;
+    for (; i + 4 <= blockCount; i += 4) {
+        __m128i first = _mm_loadu_si128((const __m128i*)(blocks + i * 8));
+        __m128i second =
+            _mm_loadu_si128((const __m128i*)(blocks + i * 8 + 16));
+
+        // Endpoints in the low half, indices in the high half
+        first = _mm_shuffle_epi32(first, _MM_SHUFFLE(3, 1, 2, 0));
+        second = _mm_shuffle_epi32(second, _MM_SHUFFLE(3, 1, 2, 0));
+
+        _mm_storeu_si128((__m128i*)(endpoints + i * 4),
+                         _mm_unpacklo_epi64(first, second));
+        _mm_storeu_si128((__m128i*)(indices + i * 4),
+                         _mm_unpackhi_epi64(first, second));
+    }
+
+    shuffleDst1Scalar(blocks, planes, i, blockCount);
+}
+#endif
+
+#ifdef S4PKG_DST_SSSE3
+// 8 blocks at a time. Every register holds the alpha or colour halves of two
+// blocks. The colour halves are handled like DXT1 blocks, the alpha halves are
+// put together from (or taken apart into) the 2 and 6 byte planes with byte
+// shuffles. The alpha index loads and stores of a group run 4 bytes past it,
+// so the last group is always left to the scalar kernel.
+
+__attribute__((target("ssse3"))) static void unshuffleDst5Ssse3(
+    const dst5_view_t<const uint8_t>& view,
+    uint8_t* blocks,
+    uint64_t blockCount) {
+
+    // Endpoints of blocks 2k and 2k + 1 from the 16 bytes of 8 blocks
+    const __m128i endpointMasks[4] = {
+        _mm_setr_epi8(0, 1, -1, -1, -1, -1, -1, -1, 2, 3, -1, -1, -1, -1, -1,
+                      -1),
+        _mm_setr_epi8(4, 5, -1, -1, -1, -1, -1, -1, 6, 7, -1, -1, -1, -1, -1,
+                      -1),
+        _mm_setr_epi8(8, 9, -1, -1, -1, -1, -1, -1, 10, 11, -1, -1, -1, -1, -1,
+                      -1),
+        _mm_setr_epi8(12, 13, -1, -1, -1, -1, -1, -1, 14, 15, -1, -1, -1, -1,
+                      -1, -1)};
+
+    // Indices of two blocks, from the 12 bytes they take up
+    const __m128i indexMask =
+        _mm_setr_epi8(-1, -1, 0, 1, 2, 3, 4, 5, -1, -1, 6, 7, 8, 9, 10, 11);
+
+    uint64_t i = 0;
+    for (; i + 8 < blockCount; i += 8) {
+        __m128i alphaEndpoints =
+            _mm_loadu_si128((const __m128i*)(view.m_alphaEndpoints + i * 2));
+
+        __m128i colourEndpoints0 =
+            _mm_loadu_si128((const __m128i*)(view.m_colourEndpoints + i * 4));
+        __m128i colourEndpoints1 = _mm_loadu_si128(
+            (const __m128i*)(view.m_colourEndpoints + i * 4 + 16));
+        __m128i colourIndices0 =
+            _mm_loadu_si128((const __m128i*)(view.m_colourIndices + i * 4));
+        __m128i colourIndices1 = _mm_loadu_si128(
+            (const __m128i*)(view.m_colourIndices + i * 4 + 16));
+
+        const __m128i colours[4] = {
+            _mm_unpacklo_epi32(colourEndpoints0, colourIndices0),
+            _mm_unpackhi_epi32(colourEndpoints0, colourIndices0),
+            _mm_unpacklo_epi32(colourEndpoints1, colourIndices1),
+            _mm_unpackhi_epi32(colourEndpoints1, colourIndices1)};
+
+        uint8_t* output = blocks + i * 16;
+
+        for (int k = 0; k < 4; k++) {
+            __m128i alphaIndices = _mm_loadu_si128(
+                (const __m128i*)(view.m_alphaIndices + i * 6 + k * 12));
+
+            __m128i alpha = _mm_or_si128(
+                _mm_shuffle_epi8(alphaEndpoints, endpointMasks[k]),
+                _mm_shuffle_epi8(alphaIndices, indexMask));
+
+            _mm_storeu_si128((__m128i*)(output + k * 32),
+                             _mm_unpacklo_epi64(alpha, colours[k]));
+            _mm_storeu_si128((__m128i*)(output + k * 32 + 16),
+                             _mm_unpackhi_epi64(alpha, colours[k]));
+        }
+    }
+
+    unshuffleDst5Scalar(view, blocks, i, blockCount);
+}
+
+__attribute__((target("ssse3"))) static void shuffleDst5Ssse3(
+    const uint8_t* blocks,
+    const dst5_view_t<uint8_t>& view,
+    uint64_t blockCount) {
+
+    // The reverse of the masks of unshuffleDst5Ssse3()
+    const __m128i endpointMasks[4] = {
+        _mm_setr_epi8(0, 1, 8, 9, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+                      -1),
+        _mm_setr_epi8(-1, -1, -1, -1, 0, 1, 8, 9, -1, -1, -1, -1, -1, -1, -1,
+                      -1),
+        _mm_setr_epi8(-1, -1, -1, -1, -1, -1, -1, -1, 0, 1, 8, 9, -1, -1, -1,
+                      -1),
+        _mm_setr_epi8(-1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, 0, 1, 8,
+                      9)};
+
+    const __m128i indexMask =
+        _mm_setr_epi8(2, 3, 4, 5, 6, 7, 10, 11, 12, 13, 14, 15, -1, -1, -1, -1);
+
+    uint64_t i = 0;
+    for (; i + 8 < blockCount; i += 8) {
+        const uint8_t* input = blocks + i * 16;
+
+        __m128i alphaEndpoints = _mm_setzero_si128();
+        __m128i colours[4];
+
+        // Every store of indices overwrites the 4 bytes the previous one wrote
+        // past its own
+        for (int k = 0; k < 4; k++) {
+            __m128i first = _mm_loadu_si128((const __m128i*)(input + k * 32));
+            __m128i second =
+                _mm_loadu_si128((const __m128i*)(input + k * 32 + 16));
+
+            __m128i alpha = _mm_unpacklo_epi64(first, second);
+            colours[k] = _mm_shuffle_epi32(_mm_unpackhi_epi64(first, second),
+                                           _MM_SHUFFLE(3, 1, 2, 0));
+
+            alphaEndpoints = _mm_or_si128(
+                alphaEndpoints, _mm_shuffle_epi8(alpha, endpointMasks[k]));
+
+            _mm_storeu_si128(
+                (__m128i*)(view.m_alphaIndices + i * 6 + k * 12),
+                _mm_shuffle_epi8(alpha, indexMask));
+        }
+
+        _mm_storeu_si128((__m128i*)(view.m_alphaEndpoints + i * 2),
+                         alphaEndpoints);
+
+        _mm_storeu_si128((__m128i*)(view.m_colourEndpoints + i * 4),
+                         _mm_unpacklo_epi64(colours[0], colours[1]));
+        _mm_storeu_si128((__m128i*)(view.m_colourEndpoints + i * 4 + 16),
+                         _mm_unpacklo_epi64(colours[2], colours[3]));
+        _mm_storeu_si128((__m128i*)(view.m_colourIndices + i * 4),
+                         _mm_unpackhi_epi64(colours[0], colours[1]));
+        _mm_storeu_si128((__m128i*)(view.m_colourIndices + i * 4 + 16),
+                         _mm_unpackhi_epi64(colours[2], colours[3]));
+    }
+
+    shuffleDst5Scalar(blocks, view, i, blockCount);
+}
+#endif
+
+bool isKernelSupported(dst_kernel_t kernel) {
+    switch (kernel) {
+        case SCALAR_KERNEL:
+            return true;
+        case SSE2_KERNEL:
+#ifdef S4PKG_DST_SSE2
+            return true;
+#else
+            return false;
+#endif
+        case SSSE3_KERNEL:
+#ifdef S4PKG_DST_SSSE3
+            return __builtin_cpu_supports("ssse3");
+#else
+            return false;
+#endif
+    }
+
+    return false;
+}
+
+dst_kernel_t bestKernel() {
+    static const dst_kernel_t kernel = isKernelSupported(SSSE3_KERNEL)
+                                           ? SSSE3_KERNEL
+                                       : isKernelSupported(SSE2_KERNEL)
+                                           ? SSE2_KERNEL
+                                           : SCALAR_KERNEL;
+
+    return kernel;
+}
+
+void unshuffleDst5(const dst5_view_t<const uint8_t>& planes,
+                   uint8_t* blocks,
+                   uint64_t blockCount,
+                   dst_kernel_t kernel) {
+#ifdef S4PKG_DST_SSSE3
+    if (kernel == SSSE3_KERNEL && isKernelSupported(kernel)) {
+        unshuffleDst5Ssse3(planes, blocks, blockCount);
+        return;
+    }
+#endif
+
+    unshuffleDst5Scalar(planes, blocks, 0, blockCount);
+}
+
+void unshuffleDst5(const uint8_t* planes,
+                   uint8_t* blocks,
+                   uint64_t blockCount,
+                   dst_kernel_t kernel) {
+    unshuffleDst5(dst5_view_t<const uint8_t>(planes, blockCount), blocks,
+                  blockCount, kernel);
+}
+
+void shuffleDst5(const uint8_t* blocks,
+                 const dst5_view_t<uint8_t>& planes,
+                 uint64_t blockCount,
+                 dst_kernel_t kernel) {
+#ifdef S4PKG_DST_SSSE3
+    if (kernel == SSSE3_KERNEL && isKernelSupported(kernel)) {
+        shuffleDst5Ssse3(blocks, planes, blockCount);
+        return;
+    }
+#endif
+
+    shuffleDst5Scalar(blocks, planes, 0, blockCount);
+}
+
+void shuffleDst5(const uint8_t* blocks,
+                 uint8_t* planes,
+                 uint64_t blockCount,
+                 dst_kernel_t kernel) {
+    shuffleDst5(blocks, dst5_view_t<uint8_t>(planes, blockCount), blockCount,
+                kernel);
+}
+
+void unshuffleDst1(const uint8_t* planes,
+                   uint8_t* blocks,
+                   uint64_t blockCount,
+                   dst_kernel_t kernel) {
+#ifdef S4PKG_DST_SSE2
+    if (kernel != SCALAR_KERNEL && isKernelSupported(kernel)) {
+        unshuffleDst1Sse2(planes, blocks, blockCount);
+        return;
+    }
+#endif
+
+    unshuffleDst1Scalar(planes, blocks, 0, blockCount);
+}
+
+void shuffleDst1(const uint8_t* blocks,
+                 uint8_t* planes,
+                 uint64_t blockCount,
+                 dst_kernel_t kernel) {
+#ifdef S4PKG_DST_SSE2
+    if (kernel != SCALAR_KERNEL && isKernelSupported(kernel)) {
+        shuffleDst1Sse2(blocks, planes, blockCount);
+        return;
+    }
+#endif
+
+    shuffleDst1Scalar(blocks, planes, 0, blockCount);
+}
+
+}  // namespace s4pkg::internal::dst
@@ -0,0 +1,117 @@
+/*
+ * Copyright (c) 2022- Gerber Lóránt Viktor
+ * Author: Gerber Lóránt Viktor <glorantv@student.elte.hu>
+ *
+ * This file is part of s4pkg.
+ *
+ * s4pkg is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <s4pkg/internal/filepool.h>
+
+#include <s4pkg/packageexception.h>
+
+#include <list>
+#include <mutex>
+#include <unordered_map>
+#include <utility>
+
+#include <fmt/core.h>
+
+namespace s4pkg::internal::filepool {
+
+typedef struct file_key_t {
+    std::string m_path;
+    FileIdentity m_identity;
+
+    bool operator==(const file_key_t& other) const {
+        return m_path == other.m_path && m_identity == other.m_identity;
+    }
+} file_key_t;
+
+struct FileKeyHash {
+    size_t operator()(const file_key_t& key) const {
+        return std::hash<std::string>()(key.m_path) ^
+               (std::hash<uint64_t>()(key.m_identity.m_inode) << 1) ^
+               std::hash<int64_t>()(key.m_identity.m_modifiedTime);
+    }
+};
+
+typedef std::pair<file_key_t, std::shared_ptr<const FileByteSource>>
+    open_file_t;
+
+static std::mutex g_mutex;
+// Least recently used last
+static std::list<open_file_t> g_files;
+static std::unordered_map<file_key_t,
+                          std::list<open_file_t>::iterator,
+                          FileKeyHash>
+    g_index;
+
+static std::shared_ptr<const FileByteSource> findLocked(
+    const file_key_t& key) {
+    auto found = g_index.find(key);
+    if (found == g_index.end()) {
+        return nullptr;
+    }
+
+    g_files.splice(g_files.begin(), g_files, found->second);
+    return found->second->second;
+}
+
+std::shared_ptr<const FileByteSource> acquire(const std::string& path,
+                                              const FileIdentity& identity) {
+    file_key_t key{path, identity};
+
+    {
+        std::lock_guard<std::mutex> lock(g_mutex);
+
+        std::shared_ptr<const FileByteSource> source = findLocked(key);
+        if (source != nullptr) {
+            return source;
+        }
+    }
+
+    // Opened outside the lock, so a slow open doesn't hold up other reads
+    auto source = std::make_shared<const FileByteSource>(path);
+    if (source->getIdentity() != identity) {
+        throw PackageException(
+            fmt::format("File {} was replaced since it was opened", path));
+    }
+
+    std::lock_guard<std::mutex> lock(g_mutex);
+
+    // Another thread may have opened it meanwhile
+    std::shared_ptr<const FileByteSource> opened = findLocked(key);
+    if (opened != nullptr) {
+        return opened;
+    }
+
+    g_files.emplace_front(key, source);
+    g_index[key] = g_files.begin();
+
+    while (g_files.size() > g_maxOpenFiles) {
+        g_index.erase(g_files.back().first);
+        g_files.pop_back();
+    }
+
+    return source;
+}
+
+size_t size() {
+    std::lock_guard<std::mutex> lock(g_mutex);
+    return g_files.size();
+}
+
+}  // namespace s4pkg::internal::filepool
@@ -19,11 +19,14 @@
  */
 
 #include <s4pkg/internal/globals.h>
+#include <s4pkg/packageexception.h>
 #include <s4pkg/resources/fallbackresourcefactory.h>
 #include <s4pkg/resources/ts4/dstresourcefactory.h>
 #include <s4pkg/resources/ts4/rleresourcefactory.h>
 #include <s4pkg/resources/ts4/thumbnailresourcefactory.h>
 
+#include <fmt/core.h>
+
 namespace s4pkg::internal::globals {
 
 #define MAKE_FACTORY(t) std::make_shared<t>()
@@ -55,4 +58,43 @@ const s4pkg::IResourceFactory* getResourceFactoryFor(s4pkg::ResourceType type) {
         return getResourceFactoryFor(s4pkg::ResourceType::UNKNOWN);
     }
 }
+
+std::shared_ptr<s4pkg::IResource> createResource(
+    const index_entry_t& entry,
+    const std::shared_ptr<const lib::ByteBuffer>& data) {
+    const IResourceFactory* resourceFactory =
+        getResourceFactoryFor((ResourceType)entry.m_type);
+
+    if (resourceFactory == nullptr) {
+        throw PackageException(
+            fmt::format("Unknown resource {:#x}, and for some reason no "
+                        "fallback factory was returned.",
+                        entry.m_type));
+    }
+
+    try {
+        std::shared_ptr<IResource> parsedResource = resourceFactory->create(
+            entry.m_type, entry.m_instanceEx, entry.m_instance, entry.m_group,
+            data);
+
+        if (parsedResource == nullptr) {
+            throw PackageException(
+                fmt::format("Resource of type {:#x} returned no parsed "
+                            "implementation.",
+                            entry.m_type));
+        }
+
+        return parsedResource;
+    } catch (PackageException e) {
+        throw PackageException(
+            fmt::format("Exception while reading resource {:#x} ({}): {}",
+                        entry.m_type, resourceFactory->toString(), e.what()));
+    }
+}
+
+std::shared_ptr<s4pkg::IResource> createResource(const index_entry_t& entry,
+                                                 lib::ByteBuffer data) {
+    return createResource(
+        entry, std::make_shared<const lib::ByteBuffer>(std::move(data)));
+}
 };  // namespace s4pkg::internal::globals
@@ -0,0 +1,221 @@
+/*
+ * Copyright (c) 2022- Gerber Lóránt Viktor
+ * Author: Gerber Lóránt Viktor <glorantv@student.elte.hu>
+ *
+ * This file is part of s4pkg.
+ *
+ * s4pkg is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <s4pkg/internal/hash.h>
+
+#include <algorithm>
+#include <cstring>
+
+#if defined(__SSE2__) || defined(_M_X64) || \
+    (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define S4PKG_HASH_SSE2
+#include <emmintrin.h>
+#endif
+
+namespace s4pkg::internal::hash {
+
+static constexpr uint64_t g_prime1 = 0x9E3779B185EBCA87ULL;
+static constexpr uint64_t g_prime2 = 0xC2B2AE3D27D4EB4FULL;
+static constexpr uint64_t g_prime3 = 0x165667B19E3779F9ULL;
+static constexpr uint64_t g_prime4 = 0x85EBCA77C2B2AE63ULL;
+static constexpr uint64_t g_prime5 = 0x27D4EB2F165667C5ULL;
+
+// Mixed into the data of every stripe, one per lane
+alignas(16) static constexpr uint64_t g_stripeKeys[4] = {
+    0xBE4BA423396CFEB8ULL, 0x1CAD21F72C81017CULL, 0xDB979083E96DD4DEULL,
+    0x1F67B3B7A4A44072ULL};
+
+static constexpr size_t g_stripeSize = 32;
+static constexpr size_t g_stripesPerBlock = 32;  // Scrambled every kilobyte
+
+static inline uint64_t rotateLeft(uint64_t value, int bits) {
+    return (value << bits) | (value >> (64 - bits));
+}
+
+// Packages are little-endian, and so is every platform we build for, so the
+// bytes are loaded as they are
+static inline uint64_t load64(const uint8_t* data) {
+    uint64_t value;
+    memcpy(&value, data, 8);
+    return value;
+}
+
+static inline uint32_t load32(const uint8_t* data) {
+    uint32_t value;
+    memcpy(&value, data, 4);
+    return value;
+}
+
+static inline uint64_t accumulate(uint64_t accumulator, uint64_t input) {
+    accumulator += input * g_prime2;
+    accumulator = rotateLeft(accumulator, 31);
+    return accumulator * g_prime1;
+}
+
+static inline uint64_t mergeAccumulator(uint64_t accumulator,
+                                        uint64_t value) {
+    accumulator ^= accumulate(0, value);
+    return accumulator * g_prime1 + g_prime4;
+}
+
+uint64_t hash64(const uint8_t* data, size_t size, uint64_t seed) {
+    const uint8_t* end = data + size;
+    uint64_t hash;
+
+    if (size >= 32) {
+        // Four independent lanes, so the multiplications can overlap
+        uint64_t v1 = seed + g_prime1 + g_prime2;
+        uint64_t v2 = seed + g_prime2;
+        uint64_t v3 = seed;
+        uint64_t v4 = seed - g_prime1;
+
+        const uint8_t* limit = end - 32;
+        do {
+            v1 = accumulate(v1, load64(data));
+            v2 = accumulate(v2, load64(data + 8));
+            v3 = accumulate(v3, load64(data + 16));
+            v4 = accumulate(v4, load64(data + 24));
+            data += 32;
+        } while (data <= limit);
+
+        hash = rotateLeft(v1, 1) + rotateLeft(v2, 7) + rotateLeft(v3, 12) +
+               rotateLeft(v4, 18);
+        hash = mergeAccumulator(hash, v1);
+        hash = mergeAccumulator(hash, v2);
+        hash = mergeAccumulator(hash, v3);
+        hash = mergeAccumulator(hash, v4);
+    } else {
+        hash = seed + g_prime5;
+    }
+
+    hash += (uint64_t)size;
+
+    while (data + 8 <= end) {
+        hash ^= accumulate(0, load64(data));
+        hash = rotateLeft(hash, 27) * g_prime1 + g_prime4;
+        data += 8;
+    }
+
+    if (data + 4 <= end) {
+        hash ^= (uint64_t)load32(data) * g_prime1;
+        hash = rotateLeft(hash, 23) * g_prime2 + g_prime3;
+        data += 4;
+    }
+
+    while (data < end) {
+        hash ^= (uint64_t)*data * g_prime5;
+        hash = rotateLeft(hash, 11) * g_prime1;
+        data++;
+    }
+
+    hash ^= hash >> 33;
+    hash *= g_prime2;
+    hash ^= hash >> 29;
+    hash *= g_prime3;
+    hash ^= hash >> 32;
+
+    return hash;
+}
+
+// Every lane gets the product of the two halves of its keyed data, and the
+// plain data of its neighbour
+static void accumulateStripes(uint64_t* accumulators,
+                              const uint8_t* data,
+                              size_t stripeCount) {
+#ifdef S4PKG_HASH_SSE2
+    __m128i accumulator0 = _mm_loadu_si128((const __m128i*)accumulators);
+    __m128i accumulator1 = _mm_loadu_si128((const __m128i*)(accumulators + 2));
+    const __m128i key0 = _mm_load_si128((const __m128i*)g_stripeKeys);
+    const __m128i key1 = _mm_load_si128((const __m128i*)(g_stripeKeys + 2));
+
+    for (size_t i = 0; i < stripeCount; i++, data += g_stripeSize) {
+        __m128i data0 = _mm_loadu_si128((const __m128i*)data);
+        __m128i data1 = _mm_loadu_si128((const __m128i*)(data + 16));
+
+        __m128i keyed0 = _mm_xor_si128(data0, key0);
+        __m128i keyed1 = _mm_xor_si128(data1, key1);
+
+        // _mm_mul_epu32 multiplies the low halves of each lane, so the high
+        // halves are shuffled down first
+        __m128i product0 = _mm_mul_epu32(
+            keyed0, _mm_shuffle_epi32(keyed0, _MM_SHUFFLE(0, 3, 0, 1)));
+        __m128i product1 = _mm_mul_epu32(
+            keyed1, _mm_shuffle_epi32(keyed1, _MM_SHUFFLE(0, 3, 0, 1)));
+
+        __m128i swapped0 = _mm_shuffle_epi32(data0, _MM_SHUFFLE(1, 0, 3, 2));
+        __m128i swapped1 = _mm_shuffle_epi32(data1, _MM_SHUFFLE(1, 0, 3, 2));
+
+        accumulator0 =
+            _mm_add_epi64(accumulator0, _mm_add_epi64(product0, swapped0));
+        accumulator1 =
+            _mm_add_epi64(accumulator1, _mm_add_epi64(product1, swapped1));
+    }
+
+    _mm_storeu_si128((__m128i*)accumulators, accumulator0);
+    _mm_storeu_si128((__m128i*)(accumulators + 2), accumulator1);
+#else
+    for (size_t i = 0; i < stripeCount; i++, data += g_stripeSize) {
+        for (int lane = 0; lane < 4; lane++) {
+            uint64_t value = load64(data + lane * 8);
+            uint64_t keyed = value ^ g_stripeKeys[lane];
+
+            accumulators[lane] += (keyed & 0xFFFFFFFFULL) * (keyed >> 32);
+            accumulators[lane ^ 1] += value;
+        }
+    }
+#endif
+}
+
+static void scramble(uint64_t* accumulators) {
+    for (int lane = 0; lane < 4; lane++) {
+        uint64_t value = accumulators[lane];
+        value ^= value >> 47;
+        value ^= g_stripeKeys[lane];
+        accumulators[lane] = value * g_prime1;
+    }
+}
+
+uint64_t hashWide(const uint8_t* data, size_t size) {
+    uint64_t accumulators[4] = {g_prime3, g_prime1, g_prime2, g_prime4};
+
+    size_t stripeCount = size / g_stripeSize;
+    for (size_t done = 0; done < stripeCount;) {
+        size_t count = std::min(g_stripesPerBlock, stripeCount - done);
+
+        accumulateStripes(accumulators, data, count);
+        data += count * g_stripeSize;
+        done += count;
+
+        if (count == g_stripesPerBlock) {
+            scramble(accumulators);
+        }
+    }
+
+    uint64_t hash = (uint64_t)size * g_prime1;
+    for (int lane = 0; lane < 4; lane++) {
+        hash ^= accumulate(0, accumulators[lane]);
+        hash = rotateLeft(hash, 27) * g_prime1 + g_prime4;
+    }
+
+    // The last partial stripe, and the final avalanche
+    return hash64(data, size % g_stripeSize, hash);
+}
+
+}  // namespace s4pkg::internal::hash
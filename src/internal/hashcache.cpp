@@ -0,0 +1,177 @@
+/*
+ * Copyright (c) 2022- Gerber Lóránt Viktor
+ * Author: Gerber Lóránt Viktor <glorantv@student.elte.hu>
+ *
+ * This file is part of s4pkg.
+ *
+ * s4pkg is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <s4pkg/internal/hashcache.h>
+
+#include <s4pkg/internal/streams.h>
+#include <s4pkg/packageexception.h>
+
+#include <filesystem>
+#include <fstream>
+
+#include <fmt/core.h>
+
+namespace s4pkg::internal::hashcache {
+
+namespace fs = std::filesystem;
+
+static const uint8_t g_magic[4] = {'S', '4', 'H', 'C'};
+static constexpr uint32_t g_version = 1;
+
+bool read(const std::string& path, hash_cache_t& value) {
+    value.clear();
+
+    std::ifstream stream(fs::u8path(path), std::ios_base::binary);
+    if (!stream.good()) {
+        return false;
+    }
+
+    stream.seekg(0, std::ios_base::end);
+    uint64_t fileSize = (uint64_t)stream.tellg();
+    stream.seekg(0, std::ios_base::beg);
+
+    // Lengths are checked before allocating for them, a corrupt length could
+    // otherwise ask for gigabytes
+    auto fits = [&stream, fileSize](uint64_t size) {
+        return size <= fileSize - (uint64_t)stream.tellg();
+    };
+
+    try {
+        uint8_t magic[4];
+        streams::readBytes(stream, magic, 4);
+
+        uint32_t version;
+        streams::readUint32(stream, version);
+
+        if (memcmp(magic, g_magic, 4) != 0 || version != g_version) {
+            return false;
+        }
+
+        uint32_t packageCount;
+        streams::readUint32(stream, packageCount);
+
+        for (uint32_t i = 0; i < packageCount; i++) {
+            uint32_t pathLength;
+            streams::readUint32(stream, pathLength);
+
+            if (!fits(pathLength)) {
+                value.clear();
+                return false;
+            }
+
+            std::string packagePath(pathLength, '\0');
+            streams::readBytes(stream, (uint8_t*)packagePath.data(),
+                               (int)pathLength);
+
+            package_hashes_t hashes{};
+
+            uint64_t modifiedTime;
+            streams::readUint64(stream, hashes.m_fileSize);
+            streams::readUint64(stream, modifiedTime);
+            hashes.m_modifiedTime = (int64_t)modifiedTime;
+
+            uint32_t entryCount;
+            streams::readUint32(stream, entryCount);
+
+            if (!fits((uint64_t)entryCount * sizeof(uint64_t))) {
+                value.clear();
+                return false;
+            }
+
+            hashes.m_storedHashes.resize(entryCount);
+            for (uint32_t j = 0; j < entryCount; j++) {
+                streams::readUint64(stream, hashes.m_storedHashes[j]);
+            }
+
+            uint32_t contentCount;
+            streams::readUint32(stream, contentCount);
+
+            for (uint32_t j = 0; j < contentCount; j++) {
+                uint32_t entry;
+                uint64_t hash;
+                streams::readUint32(stream, entry);
+                streams::readUint64(stream, hash);
+
+                hashes.m_contentHashes[entry] = hash;
+            }
+
+            value[packagePath] = std::move(hashes);
+        }
+    } catch (PackageException) {
+        value.clear();
+        return false;
+    }
+
+    return true;
+}
+
+void write(const std::string& path, const hash_cache_t& value) {
+    fs::path target = fs::u8path(path);
+    fs::path temporary = target;
+    temporary += ".tmp";
+
+    {
+        std::ofstream stream(temporary, std::ios_base::binary);
+        if (!stream.good()) {
+            throw PackageException(
+                fmt::format("Failed to open hash cache {} for writing", path));
+        }
+
+        streams::writeBytes(stream, g_magic, 4);
+        streams::writeUint32(stream, g_version);
+        streams::writeUint32(stream, (uint32_t)value.size());
+
+        for (const auto& [packagePath, hashes] : value) {
+            streams::writeUint32(stream, (uint32_t)packagePath.size());
+            streams::writeBytes(stream, (const uint8_t*)packagePath.data(),
+                                (int)packagePath.size());
+
+            streams::writeUint64(stream, hashes.m_fileSize);
+            streams::writeUint64(stream, (uint64_t)hashes.m_modifiedTime);
+
+            streams::writeUint32(stream,
+                                 (uint32_t)hashes.m_storedHashes.size());
+            for (uint64_t hash : hashes.m_storedHashes) {
+                streams::writeUint64(stream, hash);
+            }
+
+            streams::writeUint32(stream,
+                                 (uint32_t)hashes.m_contentHashes.size());
+            for (const auto& [entry, hash] : hashes.m_contentHashes) {
+                streams::writeUint32(stream, entry);
+                streams::writeUint64(stream, hash);
+            }
+        }
+
+        if (!stream.good()) {
+            throw PackageException(
+                fmt::format("Failed to write hash cache {}", path));
+        }
+    }
+
+    std::error_code error;
+    fs::rename(temporary, target, error);
+    if (error) {
+        throw PackageException(fmt::format(
+            "Failed to replace hash cache {}: {}", path, error.message()));
+    }
+}
+
+}  // namespace s4pkg::internal::hashcache
@@ -18,19 +18,24 @@
  * along with this program.  If not, see <http://www.gnu.org/licenses/>.
  */
 
+#include <s4pkg/internal/binarycursor.h>
 #include <s4pkg/internal/dds.h>
+#include <s4pkg/internal/dst.h>
 #include <s4pkg/internal/imagecoder.h>
-#include <s4pkg/internal/membuf.h>
+#include <s4pkg/internal/layout.h>
+#include <s4pkg/internal/mipmap.h>
+#include <s4pkg/internal/parallel.h>
 #include <s4pkg/internal/rle.h>
 #include <s4pkg/internal/streams.h>
+#include <s4pkg/packageexception.h>
 
 #include <cmath>
+#include <cstring>
 #include <optional>
 #include <tuple>
 #include <unordered_map>
 
 #include <stb_image.h>
-#include <stb_image_resize.h>
 #include <stb_image_write.h>
 
 #include <jpeglib.h>
@@ -271,7 +276,6 @@ void reconstructDdsImageData(dds::dds_file_t& ddsFile,
     std::vector<lib::ByteBuffer> reconstructedMipmaps(
         std::max<int32_t>(0, ddsFile.m_header.m_mipMapCount - 1));
 
-    uint32_t mipmapCopyIdx = 0;
     uint32_t width = ddsFile.m_header.m_width;
     uint32_t height = ddsFile.m_header.m_height;
 
@@ -286,9 +290,8 @@ void reconstructDdsImageData(dds::dds_file_t& ddsFile,
     uint32_t mipmapPosition = DDS_IMAGE_SIZE(width, height, blockSize);
 
     lib::ByteBuffer reconstructedMainImage(mipmapPosition);
-    COPY_BYTES(imageData, reconstructedMainImage, 0,
-               reconstructedMainImage.size(), mipmapCopyIdx);
-    mipmapCopyIdx = 0;
+    memcpy(reconstructedMainImage.data(), imageData.data(),
+           reconstructedMainImage.size());
 
     for (int i = 0; i < reconstructedMipmaps.size(); i++) {
         width /= 2;
@@ -298,10 +301,9 @@ void reconstructDdsImageData(dds::dds_file_t& ddsFile,
         height = std::max<uint32_t>(1, height);
 
         lib::ByteBuffer mipmap(DDS_IMAGE_SIZE(width, height, blockSize));
-        COPY_BYTES(imageData, mipmap, mipmapPosition, mipmap.size(),
-                   mipmapCopyIdx);
+        memcpy(mipmap.data(), imageData.data() + mipmapPosition,
+               mipmap.size());
 
-        mipmapCopyIdx = 0;
         mipmapPosition += (uint32_t)mipmap.size();
 
         reconstructedMipmaps[i] = mipmap;
@@ -324,13 +326,14 @@ lib::ByteBuffer concatDdsImageData(const dds::dds_file_t& ddsFile) {
         dataSize += (uint32_t)mipmap.size();
     }
 
-    uint32_t copyIdx = 0;
     lib::ByteBuffer imageData(dataSize);
-    COPY_BYTES(ddsFile.m_mainImage, imageData, 0, ddsFile.m_mainImage.size(),
-               copyIdx);
+    memcpy(imageData.data(), ddsFile.m_mainImage.data(),
+           ddsFile.m_mainImage.size());
 
+    uint32_t copyIdx = (uint32_t)ddsFile.m_mainImage.size();
     for (const auto& mipmap : ddsFile.m_mipmaps) {
-        COPY_BYTES(mipmap, imageData, 0, mipmap.size(), copyIdx);
+        memcpy(imageData.data() + copyIdx, mipmap.data(), mipmap.size());
+        copyIdx += (uint32_t)mipmap.size();
     }
 
     return imageData;
@@ -338,13 +341,12 @@ lib::ByteBuffer concatDdsImageData(const dds::dds_file_t& ddsFile) {
 
 std::shared_ptr<Image> decodeDst5(const lib::ByteBuffer& data) {
     // Read in the DDS file from memory
-    membuf memoryBuffer(data.data(), data.size());
-    std::istream stream(&memoryBuffer);
+    MemoryByteSource source(data.data(), data.size());
 
     dds::dds_file_t ddsFile{};
 
     // Verify that we could read the file correctly
-    if (!dds::readFile(stream, ddsFile)) {
+    if (!dds::readFile(source, ddsFile)) {
         return nullptr;
     }
 
@@ -360,29 +362,9 @@ std::shared_ptr<Image> decodeDst5(const lib::ByteBuffer& data) {
     // Vector to hold the unshuffled block data
     lib::ByteBuffer outputImage(imageData.size());
 
-    // Block offsets for unshuffling
-    uint32_t blockOffset0 = 0;
-    uint32_t blockOffset2 = blockOffset0 + ((uint32_t)imageData.size() >> 3);
-    uint32_t blockOffset1 = blockOffset2 + ((uint32_t)imageData.size() >> 2);
-    uint32_t blockOffset3 =
-        blockOffset1 + (6 * (uint32_t)imageData.size() >> 4);
-
-    // Count of all blocks in the image
-    uint32_t blockCount = (blockOffset2 - blockOffset0) / 2;
-
-    // Unshuffle the blocks
-    uint32_t writeIdx = 0;
-    for (uint32_t i = 0; i < blockCount; i++) {
-        COPY_BYTES(imageData, outputImage, blockOffset0, 2, writeIdx);
-        COPY_BYTES(imageData, outputImage, blockOffset1, 6, writeIdx);
-        COPY_BYTES(imageData, outputImage, blockOffset2, 4, writeIdx);
-        COPY_BYTES(imageData, outputImage, blockOffset3, 4, writeIdx);
-
-        blockOffset0 += 2;
-        blockOffset1 += 6;
-        blockOffset2 += 4;
-        blockOffset3 += 4;
-    }
+    // Unshuffle the blocks, see dst.h for the layout
+    dst::unshuffleDst5(imageData.data(), outputImage.data(),
+                       imageData.size() / 16);
 
     // Reconstruct the image data in the dds_file_t structure
     reconstructDdsImageData(ddsFile, outputImage);
@@ -395,13 +377,12 @@ std::shared_ptr<Image> decodeDst5(const lib::ByteBuffer& data) {
 
 std::shared_ptr<Image> decodeDxt5(const lib::ByteBuffer& data) {
     // Read in the DDS file from memory
-    membuf memoryBuffer(data.data(), data.size());
-    std::istream stream(&memoryBuffer);
+    MemoryByteSource source(data.data(), data.size());
 
     dds::dds_file_t ddsFile{};
 
     // Verify that we could read the file correctly
-    if (!dds::readFile(stream, ddsFile)) {
+    if (!dds::readFile(source, ddsFile)) {
         return nullptr;
     }
 
@@ -416,13 +397,12 @@ std::shared_ptr<Image> decodeDxt5(const lib::ByteBuffer& data) {
 
 std::shared_ptr<Image> decodeDst1(const lib::ByteBuffer& data) {
     // Read in the DDS file from memory
-    membuf memoryBuffer(data.data(), data.size());
-    std::istream stream(&memoryBuffer);
+    MemoryByteSource source(data.data(), data.size());
 
     dds::dds_file_t ddsFile{};
 
     // Verify that we could read the file correctly
-    if (!dds::readFile(stream, ddsFile)) {
+    if (!dds::readFile(source, ddsFile)) {
         return nullptr;
     }
 
@@ -438,22 +418,9 @@ std::shared_ptr<Image> decodeDst1(const lib::ByteBuffer& data) {
     // Vector to hold the unshuffled block data
     lib::ByteBuffer outputImage(imageData.size());
 
-    // Block offsets for unshuffling
-    uint32_t blockOffset2 = 0;
-    uint32_t blockOffset3 = blockOffset2 + ((uint32_t)imageData.size() >> 1);
-
-    // Count of all blocks in the image
-    uint32_t blockCount = (blockOffset3 - blockOffset2) / 4;
-
-    // Unshuffle the blocks
-    uint32_t writeIdx = 0;
-    for (uint32_t i = 0; i < blockCount; i++) {
-        COPY_BYTES(imageData, outputImage, blockOffset2, 4, writeIdx);
-        COPY_BYTES(imageData, outputImage, blockOffset3, 4, writeIdx);
-
-        blockOffset2 += 4;
-        blockOffset3 += 4;
-    }
+    // Unshuffle the blocks, see dst.h for the layout
+    dst::unshuffleDst1(imageData.data(), outputImage.data(),
+                       imageData.size() / 8);
 
     // Reconstruct the image data in the dds_file_t structure
     reconstructDdsImageData(ddsFile, outputImage);
@@ -466,13 +433,12 @@ std::shared_ptr<Image> decodeDst1(const lib::ByteBuffer& data) {
 
 std::shared_ptr<Image> decodeDxt1(const lib::ByteBuffer& data) {
     // Read in the DDS file from memory
-    membuf memoryBuffer(data.data(), data.size());
-    std::istream stream(&memoryBuffer);
+    MemoryByteSource source(data.data(), data.size());
 
     dds::dds_file_t ddsFile{};
 
     // Verify that we could read the file correctly
-    if (!dds::readFile(stream, ddsFile)) {
+    if (!dds::readFile(source, ddsFile)) {
         return nullptr;
     }
 
@@ -487,13 +453,12 @@ std::shared_ptr<Image> decodeDxt1(const lib::ByteBuffer& data) {
 
 std::shared_ptr<Image> decodeDxt3(const lib::ByteBuffer& data) {
     // Read in the DDS file from memory
-    membuf memoryBuffer(data.data(), data.size());
-    std::istream stream(&memoryBuffer);
+    MemoryByteSource source(data.data(), data.size());
 
     dds::dds_file_t ddsFile{};
 
     // Verify that we could read the file correctly
-    if (!dds::readFile(stream, ddsFile)) {
+    if (!dds::readFile(source, ddsFile)) {
         return nullptr;
     }
 
@@ -516,13 +481,12 @@ std::shared_ptr<Image> decodeDxt3(const lib::ByteBuffer& data) {
 
 std::shared_ptr<Image> decodeUncompressedDds(const lib::ByteBuffer& data) {
     // Read in the DDS file from memory
-    membuf memoryBuffer(data.data(), data.size());
-    std::istream stream(&memoryBuffer);
+    MemoryByteSource source(data.data(), data.size());
 
     dds::dds_file_t ddsFile{};
 
     // Verify that we could read the file correctly
-    if (!dds::readFile(stream, ddsFile)) {
+    if (!dds::readFile(source, ddsFile)) {
         return nullptr;
     }
 
@@ -594,10 +558,9 @@ std::shared_ptr<Image> decodeUncompressedDds(const lib::ByteBuffer& data) {
 
 // Handles decoding for RLE2 and RLES
 std::shared_ptr<Image> decodeRle(const lib::ByteBuffer& data) {
-    membuf memoryBuffer(data.data(), data.size());
-    std::istream stream(&memoryBuffer);
+    BinaryCursor cursor(data.data(), data.size());
 
-    rle::rle_file_t rleFile = rle::readFile(stream);
+    rle::rle_file_t rleFile = rle::readFile(cursor);
 
     if (rleFile.m_rleHeader.m_fourCC == rle::fourcc_t::DXT5) {
         return decodeDxt5Internal(rleFile.m_ddsFile);
@@ -610,7 +573,10 @@ std::shared_ptr<Image> decodeRle(const lib::ByteBuffer& data) {
 
 // Encoders
 
-lib::ByteBuffer encodeJfifWithAlpha(const Image& image) {
+// Thumbnails are always written at full JPEG quality, the presets are for
+// block compression
+lib::ByteBuffer encodeJfifWithAlpha(const Image& image,
+                                    const encode_options_t&) {
     // Set up vectors for the RGB and A channels of the image
     lib::ByteBuffer rgbData(image.getWidth() * image.getHeight() * 3);
     lib::ByteBuffer alphaData(image.getWidth() * image.getHeight());
@@ -738,53 +704,194 @@ lib::ByteBuffer encodeJfifWithAlpha(const Image& image) {
 }
 
 // Pretty self-explanatory code, we generate mip-maps down to 1x1 pixels,
-// every level is half of the previous
-std::vector<Image> generateMipMaps(const Image& image) {
+// every level is half of the previous, see mipmap::generate()
+std::vector<Image> generateMipMaps(const Image& image,
+                                   mipmap::mip_filter_t filter) {
+    lib::ByteBuffer pixels = image.getPixelData();
+
     std::vector<Image> mipmaps;
+    for (const mipmap::mip_level_t& level : mipmap::generate(
+             pixels.data(), image.getWidth(), image.getHeight(), filter)) {
+        mipmaps.push_back({level.m_width, level.m_height, level.m_pixels});
+    }
 
-    uint32_t width = image.getWidth();
-    uint32_t height = image.getHeight();
+    return mipmaps;
+}
 
-    do {
-        width /= 2;
-        height /= 2;
+// Block compression. Surfaces are split into strips of block rows, and the
+// strips of every surface are compressed together by parallel::forEach(),
+// which starts its threads for every call. squish compresses each 4x4 block on
+// its own, so a strip compresses to exactly the bytes it takes up in the whole
+// surface.
+
+static constexpr uint32_t g_stripBlockRows = 4;
+
+// Fewer blocks than this per thread don't pay for starting it, so small
+// surfaces (a 128x128 image and its mips, or less) are compressed on the
+// calling thread
+static constexpr uint64_t g_blocksPerThread = 1024;
+
+// The colour fit and weighting flags of squish for the options
+int squishFlags(const encode_options_t& options) {
+    int flags = options.m_perceptual ? squish::kColourMetricPerceptual
+                                     : squish::kColourMetricUniform;
+
+    switch (options.m_quality) {
+        case FAST:
+            return flags | squish::kColourRangeFit;
+        case BALANCED:
+            return flags | squish::kColourClusterFit;
+        default:
+            return flags | squish::kColourIterativeClusterFit;
+    }
+}
 
-        width = std::max<uint32_t>(1, width);
-        height = std::max<uint32_t>(1, height);
+typedef struct surface_t {
+    const uint8_t* m_pixels;
+    uint32_t m_width;
+    uint32_t m_height;
+} surface_t;
+
+std::vector<lib::ByteBuffer> compressSurfaces(
+    const std::vector<surface_t>& surfaces,
+    int flags,
+    uint32_t blockSize,
+    unsigned int threadCount) {
+    std::vector<lib::ByteBuffer> compressed(surfaces.size());
+    for (size_t i = 0; i < surfaces.size(); i++) {
+        compressed[i] = lib::ByteBuffer(DDS_IMAGE_SIZE(
+            surfaces[i].m_width, surfaces[i].m_height, blockSize));
+    }
 
-        lib::ByteBuffer mipmapData(width * height * 4);
-        stbir_resize_uint8(image.getPixelData().data(), image.getWidth(),
-                           image.getHeight(), image.getWidth() * 4,
-                           mipmapData.data(), width, height, width * 4, 4);
+    if (threadCount == 0) {
+        threadCount = parallel::defaultThreadCount();
+    }
 
-        Image mipmap{width, height, mipmapData};
+    uint64_t blockCount = 0;
+    for (const surface_t& surface : surfaces) {
+        uint64_t columns = std::max<uint32_t>(1, (surface.m_width + 3) / 4);
+        uint64_t rows = std::max<uint32_t>(1, (surface.m_height + 3) / 4);
+        blockCount += columns * rows;
+    }
 
-        mipmaps.push_back(mipmap);
-    } while (width != 1 || height != 1);
+    threadCount = (unsigned int)std::min<uint64_t>(
+        threadCount, std::max<uint64_t>(1, blockCount / g_blocksPerThread));
 
-    return mipmaps;
+    if (threadCount == 1) {
+        for (size_t i = 0; i < surfaces.size(); i++) {
+            squish::CompressImage(surfaces[i].m_pixels, surfaces[i].m_width,
+                                  surfaces[i].m_height, compressed[i].data(),
+                                  flags);
+        }
+
+        return compressed;
+    }
+
+    typedef struct strip_t {
+        size_t m_surface;
+        uint32_t m_firstRow;
+        uint32_t m_rowCount;
+    } strip_t;
+
+    std::vector<strip_t> strips;
+    for (size_t i = 0; i < surfaces.size(); i++) {
+        uint32_t height = surfaces[i].m_height;
+        uint32_t stripRows = g_stripBlockRows * 4;
+
+        for (uint32_t row = 0; row < height; row += stripRows) {
+            strips.push_back({i, row, std::min(stripRows, height - row)});
+        }
+    }
+
+    parallel::forEach(
+        strips.size(),
+        [&](size_t i) {
+            const strip_t& strip = strips[i];
+            const surface_t& surface = surfaces[strip.m_surface];
+
+            uint32_t blocksPerRow =
+                std::max<uint32_t>(1, (surface.m_width + 3) / 4);
+            uint64_t pixelOffset =
+                (uint64_t)strip.m_firstRow * surface.m_width * 4;
+            uint64_t blockOffset =
+                (uint64_t)(strip.m_firstRow / 4) * blocksPerRow * blockSize;
+
+            squish::CompressImage(
+                surface.m_pixels + pixelOffset, surface.m_width,
+                strip.m_rowCount,
+                compressed[strip.m_surface].data() + blockOffset, flags);
+        },
+        threadCount);
+
+    return compressed;
+}
+
+// Compresses an image and its mip-maps at once, see compressSurfaces()
+void compressMipChain(const Image& image,
+                      const std::vector<Image>& rawMipmaps,
+                      int format,
+                      uint32_t blockSize,
+                      const encode_options_t& options,
+                      lib::ByteBuffer& mainImage,
+                      std::vector<lib::ByteBuffer>& mipmaps) {
+    // The pixels are copied out of the images once, and shared by the strips
+    std::vector<lib::ByteBuffer> pixels;
+    pixels.reserve(1 + rawMipmaps.size());
+    pixels.push_back(image.getPixelData());
+
+    std::vector<surface_t> surfaces{
+        {pixels[0].data(), image.getWidth(), image.getHeight()}};
+
+    for (const Image& mipmap : rawMipmaps) {
+        pixels.push_back(mipmap.getPixelData());
+        surfaces.push_back(
+            {pixels.back().data(), mipmap.getWidth(), mipmap.getHeight()});
+    }
+
+    std::vector<lib::ByteBuffer> compressed =
+        compressSurfaces(surfaces, format | squishFlags(options), blockSize,
+                         options.m_threadCount);
+
+    mainImage = compressed[0];
+    mipmaps.assign(compressed.begin() + 1, compressed.end());
+}
+
+lib::ByteBuffer compressBlocks(const uint8_t* pixels,
+                               uint32_t width,
+                               uint32_t height,
+                               ImageFormat format,
+                               const encode_options_t& options) {
+    int flags = squishFlags(options);
+    uint32_t blockSize = 16;
+
+    if (format == DXT1) {
+        flags |= squish::kDxt1;
+        blockSize = 8;
+    } else if (format == DXT3) {
+        flags |= squish::kDxt3;
+    } else if (format == DXT5) {
+        flags |= squish::kDxt5;
+    } else {
+        return {};
+    }
+
+    return compressSurfaces({{pixels, width, height}}, flags, blockSize,
+                            options.m_threadCount)[0];
 }
 
 // Encode an image as DXT5, this is again, used by multiple resources in a
 // package that are compressed or encoded differently. Mip-maps are
 // generated automatically.
-dds::dds_file_t encodeDxt5Internal(const Image& image) {
-    // Generate mip-maps and compress them
-    std::vector<Image> rawMipmaps = generateMipMaps(image);
-    std::vector<lib::ByteBuffer> mipmaps(rawMipmaps.size());
-
-    for (int i = 0; i < rawMipmaps.size(); i++) {
-        const Image& mipmapData = rawMipmaps[i];
-        lib::ByteBuffer encoded(
-            DDS_IMAGE_SIZE(mipmapData.getWidth(), mipmapData.getHeight(), 16));
-
-        squish::CompressImage(
-            mipmapData.getPixelData().data(), mipmapData.getWidth(),
-            mipmapData.getHeight(), encoded.data(),
-            squish::kDxt5 | squish::kColourIterativeClusterFit);
-
-        mipmaps[i] = encoded;
-    }
+dds::dds_file_t encodeDxt5Internal(const Image& image,
+                                   const encode_options_t& options) {
+    // Generate mip-maps, and compress them together with the main image
+    std::vector<Image> rawMipmaps =
+        generateMipMaps(image, options.m_mipFilter);
+
+    lib::ByteBuffer mainImage;
+    std::vector<lib::ByteBuffer> mipmaps;
+    compressMipChain(image, rawMipmaps, squish::kDxt5, 16, options, mainImage,
+                     mipmaps);
 
     // Set up the DDS header with correct values
 
@@ -816,38 +923,22 @@ dds::dds_file_t encodeDxt5Internal(const Image& image) {
         0                                            // m_reserved2
     };
 
-    // Compress the main image as well
-
-    lib::ByteBuffer mainImage(
-        DDS_IMAGE_SIZE(image.getWidth(), image.getHeight(), 16));
-
-    squish::CompressImage(image.getPixelData().data(), image.getWidth(),
-                          image.getHeight(), mainImage.data(),
-                          squish::kDxt5 | squish::kColourIterativeClusterFit);
-
     // Create the final DDS file
     dds::dds_file_t ddsFile{header, mainImage, mipmaps};
 
     return ddsFile;
 }
 
-dds::dds_file_t encodeDxt1Internal(const Image& image) {
-    // Generate mip-maps and compress them
-    std::vector<Image> rawMipmaps = generateMipMaps(image);
-    std::vector<lib::ByteBuffer> mipmaps(rawMipmaps.size());
-
-    for (int i = 0; i < rawMipmaps.size(); i++) {
-        const Image& mipmapData = rawMipmaps[i];
-        lib::ByteBuffer encoded(
-            DDS_IMAGE_SIZE(mipmapData.getWidth(), mipmapData.getHeight(), 8));
+dds::dds_file_t encodeDxt1Internal(const Image& image,
+                                   const encode_options_t& options) {
+    // Generate mip-maps, and compress them together with the main image
+    std::vector<Image> rawMipmaps =
+        generateMipMaps(image, options.m_mipFilter);
 
-        squish::CompressImage(
-            mipmapData.getPixelData().data(), mipmapData.getWidth(),
-            mipmapData.getHeight(), encoded.data(),
-            squish::kDxt1 | squish::kColourIterativeClusterFit);
-
-        mipmaps[i] = encoded;
-    }
+    lib::ByteBuffer mainImage;
+    std::vector<lib::ByteBuffer> mipmaps;
+    compressMipChain(image, rawMipmaps, squish::kDxt1, 8, options, mainImage,
+                     mipmaps);
 
     // Set up the DDS header with correct values
 
@@ -879,62 +970,22 @@ dds::dds_file_t encodeDxt1Internal(const Image& image) {
         0                                            // m_reserved2
     };
 
-    // Compress the main image as well
-
-    lib::ByteBuffer mainImage(
-        DDS_IMAGE_SIZE(image.getWidth(), image.getHeight(), 8));
-
-    squish::CompressImage(image.getPixelData().data(), image.getWidth(),
-                          image.getHeight(), mainImage.data(),
-                          squish::kDxt1 | squish::kColourIterativeClusterFit);
-
     // Create the final DDS file
     dds::dds_file_t ddsFile{header, mainImage, mipmaps};
 
     return ddsFile;
 }
 
-lib::ByteBuffer encodeDst5(const Image& image) {
-    dds::dds_file_t dxtFile = encodeDxt5Internal(image);
+lib::ByteBuffer encodeDst5(const Image& image,
+                           const encode_options_t& options) {
+    dds::dds_file_t dxtFile = encodeDxt5Internal(image, options);
 
     lib::ByteBuffer imageData = concatDdsImageData(dxtFile);
 
-    // Shuffle the blocks around
-    uint32_t blockCount = (uint32_t)imageData.size() / 16;
-
-    lib::ByteBuffer block0(blockCount * 2);
-    lib::ByteBuffer block1(blockCount * 6);
-    lib::ByteBuffer block2(blockCount * 4);
-    lib::ByteBuffer block3(blockCount * 4);
-
-    uint32_t c0 = 0;
-    uint32_t c1 = 0;
-    uint32_t c2 = 0;
-    uint32_t c3 = 0;
-
-    uint32_t sourceIdx = 0;
-
-    for (uint32_t i = 0; i < blockCount; i++) {
-        COPY_BYTES(imageData, block0, sourceIdx, 2, c0);
-        sourceIdx += 2;
-
-        COPY_BYTES(imageData, block1, sourceIdx, 6, c1);
-        sourceIdx += 6;
-
-        COPY_BYTES(imageData, block2, sourceIdx, 4, c2);
-        sourceIdx += 4;
-
-        COPY_BYTES(imageData, block3, sourceIdx, 4, c3);
-        sourceIdx += 4;
-    }
-
+    // Shuffle the blocks around, see dst.h for the layout
     lib::ByteBuffer shuffledData(imageData.size());
-
-    uint32_t c = 0;
-    COPY_BYTES(block0, shuffledData, 0, c0, c);
-    COPY_BYTES(block2, shuffledData, 0, c2, c);
-    COPY_BYTES(block1, shuffledData, 0, c1, c);
-    COPY_BYTES(block3, shuffledData, 0, c3, c);
+    dst::shuffleDst5(imageData.data(), shuffledData.data(),
+                     imageData.size() / 16);
 
     reconstructDdsImageData(dxtFile, shuffledData);
 
@@ -943,35 +994,16 @@ lib::ByteBuffer encodeDst5(const Image& image) {
     return dds::writeFile(dxtFile);
 }
 
-lib::ByteBuffer encodeDst1(const Image& image) {
-    dds::dds_file_t dxtFile = encodeDxt1Internal(image);
+lib::ByteBuffer encodeDst1(const Image& image,
+                           const encode_options_t& options) {
+    dds::dds_file_t dxtFile = encodeDxt1Internal(image, options);
 
     lib::ByteBuffer imageData = concatDdsImageData(dxtFile);
 
-    // Shuffle the blocks around
-    uint32_t blockCount = (uint32_t)imageData.size() / 8;
-
-    lib::ByteBuffer block0(blockCount * 4);
-    lib::ByteBuffer block1(blockCount * 4);
-
-    uint32_t c0 = 0;
-    uint32_t c1 = 0;
-
-    uint32_t sourceIdx = 0;
-
-    for (uint32_t i = 0; i < blockCount; i++) {
-        COPY_BYTES(imageData, block0, sourceIdx, 4, c0);
-        sourceIdx += 4;
-
-        COPY_BYTES(imageData, block1, sourceIdx, 4, c1);
-        sourceIdx += 4;
-    }
-
+    // Shuffle the blocks around, see dst.h for the layout
     lib::ByteBuffer shuffledData(imageData.size());
-
-    uint32_t c = 0;
-    COPY_BYTES(block0, shuffledData, 0, c0, c);
-    COPY_BYTES(block1, shuffledData, 0, c1, c);
+    dst::shuffleDst1(imageData.data(), shuffledData.data(),
+                     imageData.size() / 8);
 
     reconstructDdsImageData(dxtFile, shuffledData);
 
@@ -980,35 +1012,44 @@ lib::ByteBuffer encodeDst1(const Image& image) {
     return dds::writeFile(dxtFile);
 }
 
-lib::ByteBuffer encodeDxt5(const Image& image) {
-    dds::dds_file_t dxtFile = encodeDxt5Internal(image);
+// The blocks of RLE2 and RLES images are DXT5 blocks. The images we encode
+// have no specular mask, so neither have the RLES images.
+lib::ByteBuffer encodeRle2(const Image& image,
+                           const encode_options_t& options) {
+    return rle::writeFile(encodeDxt5Internal(image, options),
+                          rle::rle_version_t::RLE2);
+}
 
-    return dds::writeFile(dxtFile);
+lib::ByteBuffer encodeRles(const Image& image,
+                           const encode_options_t& options) {
+    return rle::writeFile(encodeDxt5Internal(image, options),
+                          rle::rle_version_t::RLES);
 }
 
-lib::ByteBuffer encodeDxt1(const Image& image) {
-    dds::dds_file_t dxtFile = encodeDxt1Internal(image);
+lib::ByteBuffer encodeDxt5(const Image& image,
+                           const encode_options_t& options) {
+    dds::dds_file_t dxtFile = encodeDxt5Internal(image, options);
 
     return dds::writeFile(dxtFile);
 }
 
-lib::ByteBuffer encodeDxt3(const Image& image) {
-    // Generate mip-maps and compress them
-    std::vector<Image> rawMipmaps = generateMipMaps(image);
-    std::vector<lib::ByteBuffer> mipmaps(rawMipmaps.size());
+lib::ByteBuffer encodeDxt1(const Image& image,
+                           const encode_options_t& options) {
+    dds::dds_file_t dxtFile = encodeDxt1Internal(image, options);
 
-    for (int i = 0; i < rawMipmaps.size(); i++) {
-        const Image& mipmapData = rawMipmaps[i];
-        lib::ByteBuffer encoded(
-            DDS_IMAGE_SIZE(mipmapData.getWidth(), mipmapData.getHeight(), 16));
+    return dds::writeFile(dxtFile);
+}
 
-        squish::CompressImage(
-            mipmapData.getPixelData().data(), mipmapData.getWidth(),
-            mipmapData.getHeight(), encoded.data(),
-            squish::kDxt3 | squish::kColourIterativeClusterFit);
+lib::ByteBuffer encodeDxt3(const Image& image,
+                           const encode_options_t& options) {
+    // Generate mip-maps, and compress them together with the main image
+    std::vector<Image> rawMipmaps =
+        generateMipMaps(image, options.m_mipFilter);
 
-        mipmaps[i] = encoded;
-    }
+    lib::ByteBuffer mainImage;
+    std::vector<lib::ByteBuffer> mipmaps;
+    compressMipChain(image, rawMipmaps, squish::kDxt3, 16, options, mainImage,
+                     mipmaps);
 
     // Set up the DDS header with correct values
 
@@ -1040,28 +1081,173 @@ lib::ByteBuffer encodeDxt3(const Image& image) {
         0                                            // m_reserved2
     };
 
-    // Compress the main image as well
-
-    lib::ByteBuffer mainImage(
-        DDS_IMAGE_SIZE(image.getWidth(), image.getHeight(), 16));
-
-    squish::CompressImage(image.getPixelData().data(), image.getWidth(),
-                          image.getHeight(), mainImage.data(),
-                          squish::kDxt3 | squish::kColourIterativeClusterFit);
-
     // Create the final DDS file
     dds::dds_file_t ddsFile{header, mainImage, mipmaps};
 
     return dds::writeFile(ddsFile);
 }
 
+// Probes, reading only as much of the header as they need
+
+bool probeJfifWithAlpha(const lib::ByteBuffer& data,
+                        uint32_t& width,
+                        uint32_t& height) {
+    int x, y, components;
+    if (stbi_info_from_memory(data.data(), (int)data.size(), &x, &y,
+                              &components) == 0) {
+        return false;
+    }
+
+    width = (uint32_t)x;
+    height = (uint32_t)y;
+    return true;
+}
+
+bool probeDds(const lib::ByteBuffer& data, uint32_t& width, uint32_t& height) {
+    try {
+        BinaryCursor cursor(data.data(), data.size());
+        cursor.skip(4);  // Magic bytes
+
+        dds::dds_header_t header = dds::readHeader(cursor);
+        width = header.m_width;
+        height = header.m_height;
+    } catch (PackageException) {
+        return false;
+    }
+
+    return true;
+}
+
+bool probeRle(const lib::ByteBuffer& data, uint32_t& width, uint32_t& height) {
+    try {
+        BinaryCursor cursor(data.data(), data.size());
+
+        rle::rle_header_t header{};
+        layout::read(cursor, header);
+        width = header.m_width;
+        height = header.m_height;
+    } catch (PackageException) {
+        return false;
+    }
+
+    return true;
+}
+
+// Transcoders
+
+// DST only reorders the parts of DXT blocks (see dst.h), so converting between
+// the two is a permutation of the block data, without decompressing anything
+
+typedef void (*permutationFunction_t)(const uint8_t*, uint8_t*, uint64_t);
+
+typedef struct transcoding_t {
+    ImageFormat m_from;
+    ImageFormat m_to;
+    uint32_t m_fromFourCC;
+    uint32_t m_toFourCC;
+    uint8_t m_blockSize;
+    permutationFunction_t m_permute;
+} transcoding_t;
+
+const transcoding_t g_transcodings[] = {
+    {DST5, DXT5, MAKE_FOURCC('D', 'S', 'T', '5'),
+     MAKE_FOURCC('D', 'X', 'T', '5'), 16,
+     [](const uint8_t* input, uint8_t* output, uint64_t blockCount) {
+         dst::unshuffleDst5(input, output, blockCount);
+     }},
+    {DXT5, DST5, MAKE_FOURCC('D', 'X', 'T', '5'),
+     MAKE_FOURCC('D', 'S', 'T', '5'), 16,
+     [](const uint8_t* input, uint8_t* output, uint64_t blockCount) {
+         dst::shuffleDst5(input, output, blockCount);
+     }},
+    {DST1, DXT1, MAKE_FOURCC('D', 'S', 'T', '1'),
+     MAKE_FOURCC('D', 'X', 'T', '1'), 8,
+     [](const uint8_t* input, uint8_t* output, uint64_t blockCount) {
+         dst::unshuffleDst1(input, output, blockCount);
+     }},
+    {DXT1, DST1, MAKE_FOURCC('D', 'X', 'T', '1'),
+     MAKE_FOURCC('D', 'S', 'T', '1'), 8,
+     [](const uint8_t* input, uint8_t* output, uint64_t blockCount) {
+         dst::shuffleDst1(input, output, blockCount);
+     }},
+};
+
+lib::ByteBuffer transcode(const lib::ByteBuffer& data,
+                          ImageFormat from,
+                          ImageFormat to) {
+    if (from == to) {
+        return data;
+    }
+
+    const transcoding_t* transcoding = nullptr;
+    for (const transcoding_t& candidate : g_transcodings) {
+        if (candidate.m_from == from && candidate.m_to == to) {
+            transcoding = &candidate;
+        }
+    }
+
+    if (transcoding == nullptr) {
+        return {};
+    }
+
+    try {
+        BinaryCursor cursor(data.data(), data.size());
+
+        uint8_t magicBytes[4];
+        cursor.readBytes(magicBytes, 4);
+        if (memcmp(magicBytes, "DDS ", 4) != 0) {
+            return {};
+        }
+
+        dds::dds_header_t header = dds::readHeader(cursor);
+        if ((header.m_pixelFormat.m_flags & dds::DDPF_FOURCC) == 0 ||
+            header.m_pixelFormat.m_fourCC != transcoding->m_fromFourCC) {
+            return {};
+        }
+
+        // The blocks of the whole mip chain, as in readCompressedImageData()
+        uint32_t width = header.m_width;
+        uint32_t height = header.m_height;
+        uint64_t imageDataSize =
+            DDS_IMAGE_SIZE(width, height, transcoding->m_blockSize);
+
+        for (int32_t i = 1; i < (int32_t)header.m_mipMapCount; i++) {
+            width = std::max<uint32_t>(1, width / 2);
+            height = std::max<uint32_t>(1, height / 2);
+
+            imageDataSize +=
+                DDS_IMAGE_SIZE(width, height, transcoding->m_blockSize);
+        }
+
+        uint64_t dataPosition = cursor.position();
+        BinaryCursor blocks = cursor.take(imageDataSize);
+
+        // Only the four character code of the header changes
+        header.m_pixelFormat.m_fourCC = transcoding->m_toFourCC;
+
+        lib::ByteBuffer output(dataPosition + imageDataSize);
+        memcpy(output.data(), magicBytes, 4);
+        layout::write(output.data() + 4, header);
+
+        transcoding->m_permute(blocks.data(), output.data() + dataPosition,
+                               imageDataSize / transcoding->m_blockSize);
+
+        return output;
+    } catch (PackageException) {
+        return {};
+    }
+}
+
 // Implementation of the s4pkg::internal::imagecoder::(decode / encode)
 // functions, which just delegate to the actual implementations defined
 // above
 
 typedef std::shared_ptr<Image> (*decoderFunction_t)(const lib::ByteBuffer&);
 
-typedef lib::ByteBuffer (*encoderFunction_t)(const Image&);
+typedef lib::ByteBuffer (*encoderFunction_t)(const Image&,
+                                           const encode_options_t&);
+
+typedef bool (*proberFunction_t)(const lib::ByteBuffer&, uint32_t&, uint32_t&);
 
 const std::unordered_map<ImageFormat, decoderFunction_t> g_decoderMapping = {
     {JFIF_WITH_ALPHA, &decodeJfifWithAlpha},
@@ -1075,6 +1261,18 @@ const std::unordered_map<ImageFormat, decoderFunction_t> g_decoderMapping = {
     {RLES, &decodeRle},
 };
 
+const std::unordered_map<ImageFormat, proberFunction_t> g_proberMapping = {
+    {JFIF_WITH_ALPHA, &probeJfifWithAlpha},
+    {DST5, &probeDds},
+    {DXT5, &probeDds},
+    {DST1, &probeDds},
+    {DXT1, &probeDds},
+    {DXT3, &probeDds},
+    {DDS_UNCOMPRESSED, &probeDds},
+    {RLE2, &probeRle},
+    {RLES, &probeRle},
+};
+
 const std::unordered_map<ImageFormat, encoderFunction_t> g_encoderMapping = {
     {JFIF_WITH_ALPHA, &encodeJfifWithAlpha},
     {DST5, &encodeDst5},
@@ -1082,9 +1280,9 @@ const std::unordered_map<ImageFormat, encoderFunction_t> g_encoderMapping = {
     {DST1, &encodeDst1},
     {DXT1, &encodeDxt1},
     {DXT3, &encodeDxt3},
+    {RLE2, &encodeRle2},
+    {RLES, &encodeRles},
     // TODO: Encoder for uncompressed DDS
-    // TODO: Encoder for RLE2
-    // TODO: Encoder for RLES
 };
 
 template <typename T>
@@ -1106,10 +1304,24 @@ std::shared_ptr<Image> decode(const lib::ByteBuffer& data, ImageFormat format) {
     return nullptr;
 }
 
-lib::ByteBuffer encode(const Image& image, ImageFormat format) {
+bool probe(const lib::ByteBuffer& data,
+           ImageFormat format,
+           uint32_t& width,
+           uint32_t& height) {
+    proberFunction_t chosenProber = tryGetFunction(g_proberMapping, format);
+    if (chosenProber != nullptr && data.size() > 0) {
+        return chosenProber(data, width, height);
+    }
+
+    return false;
+}
+
+lib::ByteBuffer encode(const Image& image,
+                       ImageFormat format,
+                       const encode_options_t& options) {
     encoderFunction_t chosenEncoder = tryGetFunction(g_encoderMapping, format);
     if (chosenEncoder != nullptr) {
-        return chosenEncoder(image);
+        return chosenEncoder(image, options);
     }
 
     return {};
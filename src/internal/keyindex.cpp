@@ -0,0 +1,122 @@
+/*
+ * Copyright (c) 2022- Gerber Lóránt Viktor
+ * Author: Gerber Lóránt Viktor <glorantv@student.elte.hu>
+ *
+ * This file is part of s4pkg.
+ *
+ * s4pkg is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <s4pkg/internal/keyindex.h>
+
+#include <algorithm>
+#include <numeric>
+
+namespace s4pkg::internal::keyindex {
+
+key_index_t build(const soaindex::soa_index_t& index) {
+    size_t count = index.size();
+
+    std::vector<ResourceKey> keys(count);
+    for (size_t i = 0; i < count; i++) {
+        keys[i] = ResourceKey::fromParts(index.m_types[i], index.m_groups[i],
+                                         index.m_instanceExs[i],
+                                         index.m_instances[i]);
+    }
+
+    std::vector<uint32_t> order(count);
+    std::iota(order.begin(), order.end(), 0);
+    std::stable_sort(order.begin(), order.end(),
+                     [&keys](uint32_t a, uint32_t b) {
+                         return keys[a] < keys[b];
+                     });
+
+    key_index_t keyIndex{};
+    keyIndex.m_keys.reserve(count);
+    keyIndex.m_positions = order;
+
+    for (uint32_t position : order) {
+        keyIndex.m_keys.push_back(keys[position]);
+    }
+
+    return keyIndex;
+}
+
+/**
+ * @brief Finds the first element not less than key, starting at from. The
+ * search range is doubled until it passes the key, then binary searched.
+ */
+static size_t gallop(const std::vector<ResourceKey>& keys,
+                     size_t from,
+                     const ResourceKey& key) {
+    size_t count = keys.size();
+    if (from >= count || !(keys[from] < key)) {
+        return from;
+    }
+
+    size_t low = from;
+    size_t step = 1;
+    while (low + step < count && keys[low + step] < key) {
+        low += step;
+        step *= 2;
+    }
+
+    size_t high = std::min(count, low + step + 1);
+
+    return std::lower_bound(keys.begin() + low + 1, keys.begin() + high, key) -
+           keys.begin();
+}
+
+int64_t find(const key_index_t& index, const ResourceKey& key) {
+    auto found =
+        std::lower_bound(index.m_keys.begin(), index.m_keys.end(), key);
+
+    if (found == index.m_keys.end() || *found != key) {
+        return -1;
+    }
+
+    return index.m_positions[found - index.m_keys.begin()];
+}
+
+void findMany(const key_index_t& index,
+              const ResourceKey* keys,
+              size_t count,
+              int64_t* positions) {
+    // Visit the keys in ascending order; in the common case they already are,
+    // and no extra work is needed
+    std::vector<size_t> order;
+    if (!std::is_sorted(keys, keys + count)) {
+        order.resize(count);
+        std::iota(order.begin(), order.end(), 0);
+        std::sort(order.begin(), order.end(), [keys](size_t a, size_t b) {
+            return keys[a] < keys[b];
+        });
+    }
+
+    size_t cursor = 0;
+    for (size_t i = 0; i < count; i++) {
+        size_t keyIdx = order.empty() ? i : order[i];
+        const ResourceKey& key = keys[keyIdx];
+
+        cursor = gallop(index.m_keys, cursor, key);
+
+        if (cursor < index.m_keys.size() && index.m_keys[cursor] == key) {
+            positions[keyIdx] = index.m_positions[cursor];
+        } else {
+            positions[keyIdx] = -1;
+        }
+    }
+}
+
+}  // namespace s4pkg::internal::keyindex
@@ -0,0 +1,249 @@
+/*
+ * Copyright (c) 2022- Gerber Lóránt Viktor
+ * Author: Gerber Lóránt Viktor <glorantv@student.elte.hu>
+ *
+ * This file is part of s4pkg.
+ *
+ * s4pkg is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <s4pkg/internal/libraryscan.h>
+
+#include <s4pkg/internal/hash.h>
+#include <s4pkg/internal/parallel.h>
+#include <s4pkg/internal/streams.h>
+#include <s4pkg/packageexception.h>
+
+#include <algorithm>
+#include <cctype>
+#include <filesystem>
+#include <fstream>
+#include <numeric>
+
+namespace s4pkg::internal::libraryscan {
+
+namespace fs = std::filesystem;
+
+static bool equalsIgnoreCase(const std::string& a, const std::string& b) {
+    return a.size() == b.size() &&
+           std::equal(a.begin(), a.end(), b.begin(), [](char x, char y) {
+               return std::tolower((unsigned char)x) ==
+                      std::tolower((unsigned char)y);
+           });
+}
+
+std::vector<std::string> findFiles(const std::string& root,
+                                   const std::string& extension,
+                                   int32_t maxDepth) {
+    std::vector<std::string> files;
+
+    std::vector<fs::path> level{fs::u8path(root)};
+    int32_t depth = 0;
+
+    while (!level.empty()) {
+        // Every directory of this level is listed by its own task, the results
+        // are merged once they are all done
+        std::vector<std::vector<fs::path>> levelDirectories(level.size());
+        std::vector<std::vector<std::string>> levelFiles(level.size());
+
+        parallel::forEach(level.size(), [&](size_t i) {
+            std::error_code error;
+            fs::directory_iterator iterator(
+                level[i], fs::directory_options::skip_permission_denied, error);
+
+            for (; !error && iterator != fs::directory_iterator();
+                 iterator.increment(error)) {
+                const fs::directory_entry& entry = *iterator;
+
+                std::error_code statError;
+                if (entry.is_symlink(statError)) {
+                    continue;  // Don't follow links, they could make loops
+                }
+
+                if (entry.is_directory(statError)) {
+                    levelDirectories[i].push_back(entry.path());
+                } else if (entry.is_regular_file(statError)) {
+                    if (hasExtension(entry.path().u8string(), extension)) {
+                        levelFiles[i].push_back(entry.path().u8string());
+                    }
+                }
+            }
+        });
+
+        std::vector<fs::path> nextLevel;
+        for (size_t i = 0; i < level.size(); i++) {
+            files.insert(files.end(), levelFiles[i].begin(),
+                         levelFiles[i].end());
+            nextLevel.insert(nextLevel.end(), levelDirectories[i].begin(),
+                             levelDirectories[i].end());
+        }
+
+        if (maxDepth >= 0 && depth >= maxDepth) {
+            break;
+        }
+
+        level = std::move(nextLevel);
+        depth++;
+    }
+
+    std::sort(files.begin(), files.end(), loadsBefore);
+    return files;
+}
+
+bool hasExtension(const std::string& path, const std::string& extension) {
+    return extension.empty() ||
+           equalsIgnoreCase(fs::u8path(path).extension().u8string(), extension);
+}
+
+int32_t depthBelow(const std::string& root, const std::string& path) {
+    fs::path relative = fs::u8path(path).lexically_normal().lexically_relative(
+        fs::u8path(root).lexically_normal());
+
+    if (relative.empty() || *relative.begin() == "..") {
+        return -1;
+    }
+
+    // The last component is the file itself
+    int32_t depth = -1;
+    for (auto it = relative.begin(); it != relative.end(); it++) {
+        if (!it->empty() && *it != ".") {
+            depth++;
+        }
+    }
+
+    return depth;
+}
+
+bool statFile(const std::string& path,
+              uint64_t& fileSize,
+              int64_t& modifiedTime) {
+    std::error_code error;
+    fs::path filePath = fs::u8path(path);
+
+    fileSize = fs::file_size(filePath, error);
+    if (error) {
+        return false;
+    }
+
+    auto writeTime = fs::last_write_time(filePath, error);
+    if (error) {
+        return false;
+    }
+
+    modifiedTime = (int64_t)writeTime.time_since_epoch().count();
+    return true;
+}
+
+bool readPackage(const std::string& path,
+                 library_package_t& value,
+                 std::string& errorMessage) {
+    value.m_path = path;
+
+    if (!statFile(path, value.m_fileSize, value.m_modifiedTime)) {
+        errorMessage = "Failed to stat file";
+        return false;
+    }
+
+    std::ifstream stream(fs::u8path(path), std::ios_base::binary);
+    if (!stream.good()) {
+        errorMessage = "Failed to open file";
+        return false;
+    }
+
+    // Reject anything that isn't a package before doing any real work
+    if (!streams::hasPackageIdentifier(stream)) {
+        return false;
+    }
+
+    stream.seekg(0);
+
+    try {
+        package_table_t table{};
+        streams::readPackageTable(stream, table);
+
+        value.m_header = table.m_header;
+        value.m_index = soaindex::build(table.m_index, table.m_flags,
+                                        table.m_constantType,
+                                        table.m_constantGroup,
+                                        table.m_constantInstanceEx);
+    } catch (PackageException e) {
+        errorMessage = e.what();
+        return false;
+    }
+
+    return true;
+}
+
+void hashRecords(const std::string& path,
+                 const std::vector<index_entry_t>& entries,
+                 bool decompress,
+                 std::vector<uint64_t>& hashes) {
+    hashes.assign(entries.size(), 0);
+
+    std::ifstream stream(fs::u8path(path), std::ios_base::binary);
+    if (!stream.good()) {
+        throw PackageException("Failed to open file");
+    }
+
+    // Reading in file order keeps the reads sequential
+    std::vector<size_t> order(entries.size());
+    std::iota(order.begin(), order.end(), 0);
+    std::sort(order.begin(), order.end(), [&entries](size_t a, size_t b) {
+        return entries[a].m_position < entries[b].m_position;
+    });
+
+    lib::ByteBuffer stored;
+    lib::ByteBuffer content;
+
+    for (size_t i : order) {
+        const index_entry_t& entry = entries[i];
+        streams::readRawRecord(stream, entry, stored);
+
+        if (!decompress ||
+            entry.m_compressionType == compression_type_t::UNCOMPRESSED) {
+            hashes[i] = hash::hashWide(stored.data(), stored.size());
+            continue;
+        }
+
+        try {
+            streams::decompressRecord(entry, stored, content);
+        } catch (PackageException) {
+            hashes[i] = hash::hashWide(stored.data(), stored.size());
+            continue;
+        }
+
+        hashes[i] = hash::hashWide(content.data(), content.size());
+    }
+}
+
+bool loadsBefore(const std::string& a, const std::string& b) {
+    auto lessIgnoreCase = [](char x, char y) {
+        return std::tolower((unsigned char)x) < std::tolower((unsigned char)y);
+    };
+
+    if (std::lexicographical_compare(a.begin(), a.end(), b.begin(), b.end(),
+                                     lessIgnoreCase)) {
+        return true;
+    }
+
+    if (std::lexicographical_compare(b.begin(), b.end(), a.begin(), a.end(),
+                                     lessIgnoreCase)) {
+        return false;
+    }
+
+    // Only differ in case, keep them in a stable order anyway
+    return a < b;
+}
+
+}  // namespace s4pkg::internal::libraryscan
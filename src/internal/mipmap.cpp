@@ -0,0 +1,291 @@
+/*
+ * Copyright (c) 2022- Gerber Lóránt Viktor
+ * Author: Gerber Lóránt Viktor <glorantv@student.elte.hu>
+ *
+ * This file is part of s4pkg.
+ *
+ * s4pkg is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#include <s4pkg/internal/mipmap.h>
+
+#include <algorithm>
+
+#include <stb_image_resize.h>
+
+#if defined(__SSE2__) || defined(_M_X64) || \
+    (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define S4PKG_MIPMAP_SSE2
+#include <emmintrin.h>
+#endif
+
+// AVX2 is compiled for the one function that needs it, and only used when the
+// CPU supports it
+#if defined(S4PKG_MIPMAP_SSE2) && (defined(__GNUC__) || defined(__clang__)) && \
+    (defined(__x86_64__) || defined(__i386__))
+#define S4PKG_MIPMAP_AVX2
+#include <immintrin.h>
+#endif
+
+namespace s4pkg::internal::mipmap {
+
+// Averages one output row from the two input rows above it, starting at output
+// pixel x. The kernels do as many pixels as they can at once, and leave the
+// rest to the scalar one.
+typedef void (*row_kernel_t)(const uint8_t* row0,
+                             const uint8_t* row1,
+                             uint8_t* output,
+                             uint32_t outputWidth,
+                             uint32_t width);
+
+static void boxRowScalar(const uint8_t* row0,
+                         const uint8_t* row1,
+                         uint8_t* output,
+                         uint32_t outputWidth,
+                         uint32_t width,
+                         uint32_t x) {
+    for (; x < outputWidth; x++) {
+        uint32_t left = std::min(x * 2, width - 1) * 4;
+        uint32_t right = std::min(x * 2 + 1, width - 1) * 4;
+
+        for (uint32_t channel = 0; channel < 4; channel++) {
+            uint32_t sum = row0[left + channel] + row0[right + channel] +
+                           row1[left + channel] + row1[right + channel];
+            output[x * 4 + channel] = (uint8_t)((sum + 2) >> 2);
+        }
+    }
+}
+
+static void boxRowScalar(const uint8_t* row0,
+                         const uint8_t* row1,
+                         uint8_t* output,
+                         uint32_t outputWidth,
+                         uint32_t width) {
+    boxRowScalar(row0, row1, output, outputWidth, width, 0);
+}
+
+#ifdef S4PKG_MIPMAP_SSE2
+static void boxRowSse2(const uint8_t* row0,
+                       const uint8_t* row1,
+                       uint8_t* output,
+                       uint32_t outputWidth,
+                       uint32_t width) {
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i two = _mm_set1_epi16(2);
+
+    // 8 input pixels of both rows make 4 output pixels. The channels are
+    // widened to 16 bits, the rows added together, and then the two pixels of
+    // every pair, which are 64 bits apart.
+    uint32_t x = 0;
+    for (; x + 4 <= outputWidth; x += 4) {
+        __m128i a0 = _mm_loadu_si128((const __m128i*)(row0 + x * 8));
+        __m128i a1 = _mm_loadu_si128((const __m128i*)(row0 + x * 8 + 16));
+        __m128i b0 = _mm_loadu_si128((const __m128i*)(row1 + x * 8));
+        __m128i b1 = _mm_loadu_si128((const __m128i*)(row1 + x * 8 + 16));
+
+        __m128i s0 = _mm_add_epi16(_mm_unpacklo_epi8(a0, zero),
+                                   _mm_unpacklo_epi8(b0, zero));
+        __m128i s1 = _mm_add_epi16(_mm_unpackhi_epi8(a0, zero),
+                                   _mm_unpackhi_epi8(b0, zero));
+        __m128i s2 = _mm_add_epi16(_mm_unpacklo_epi8(a1, zero),
+                                   _mm_unpacklo_epi8(b1, zero));
+        __m128i s3 = _mm_add_epi16(_mm_unpackhi_epi8(a1, zero),
+                                   _mm_unpackhi_epi8(b1, zero));
+
+        s0 = _mm_add_epi16(s0, _mm_srli_si128(s0, 8));
+        s1 = _mm_add_epi16(s1, _mm_srli_si128(s1, 8));
+        s2 = _mm_add_epi16(s2, _mm_srli_si128(s2, 8));
+        s3 = _mm_add_epi16(s3, _mm_srli_si128(s3, 8));
+
+        __m128i first = _mm_unpacklo_epi64(s0, s1);
+        __m128i second = _mm_unpacklo_epi64(s2, s3);
+
+        first = _mm_srli_epi16(_mm_add_epi16(first, two), 2);
+        second = _mm_srli_epi16(_mm_add_epi16(second, two), 2);
+
+        _mm_storeu_si128((__m128i*)(output + x * 4),
+                         _mm_packus_epi16(first, second));
+    }
+
+    boxRowScalar(row0, row1, output, outputWidth, width, x);
+}
+#endif
+
+#ifdef S4PKG_MIPMAP_AVX2
+__attribute__((target("avx2"))) static void boxRowAvx2(const uint8_t* row0,
+                                                       const uint8_t* row1,
+                                                       uint8_t* output,
+                                                       uint32_t outputWidth,
+                                                       uint32_t width) {
+    const __m256i zero = _mm256_setzero_si256();
+    const __m256i two = _mm256_set1_epi16(2);
+
+    // The same as the SSE2 kernel, in both 128-bit lanes at once, 16 input
+    // pixels to 8 output pixels. The lanes end up holding output pixels 0, 1,
+    // 4, 5 and 2, 3, 6, 7, which the last permutation puts in order.
+    uint32_t x = 0;
+    for (; x + 8 <= outputWidth; x += 8) {
+        __m256i a0 = _mm256_loadu_si256((const __m256i*)(row0 + x * 8));
+        __m256i a1 = _mm256_loadu_si256((const __m256i*)(row0 + x * 8 + 32));
+        __m256i b0 = _mm256_loadu_si256((const __m256i*)(row1 + x * 8));
+        __m256i b1 = _mm256_loadu_si256((const __m256i*)(row1 + x * 8 + 32));
+
+        __m256i s0 = _mm256_add_epi16(_mm256_unpacklo_epi8(a0, zero),
+                                      _mm256_unpacklo_epi8(b0, zero));
+        __m256i s1 = _mm256_add_epi16(_mm256_unpackhi_epi8(a0, zero),
+                                      _mm256_unpackhi_epi8(b0, zero));
+        __m256i s2 = _mm256_add_epi16(_mm256_unpacklo_epi8(a1, zero),
+                                      _mm256_unpacklo_epi8(b1, zero));
+        __m256i s3 = _mm256_add_epi16(_mm256_unpackhi_epi8(a1, zero),
+                                      _mm256_unpackhi_epi8(b1, zero));
+
+        s0 = _mm256_add_epi16(s0, _mm256_srli_si256(s0, 8));
+        s1 = _mm256_add_epi16(s1, _mm256_srli_si256(s1, 8));
+        s2 = _mm256_add_epi16(s2, _mm256_srli_si256(s2, 8));
+        s3 = _mm256_add_epi16(s3, _mm256_srli_si256(s3, 8));
+
+        __m256i first = _mm256_unpacklo_epi64(s0, s1);
+        __m256i second = _mm256_unpacklo_epi64(s2, s3);
+
+        first = _mm256_srli_epi16(_mm256_add_epi16(first, two), 2);
+        second = _mm256_srli_epi16(_mm256_add_epi16(second, two), 2);
+
+        __m256i packed = _mm256_packus_epi16(first, second);
+        packed = _mm256_permute4x64_epi64(packed, _MM_SHUFFLE(3, 1, 2, 0));
+
+        _mm256_storeu_si256((__m256i*)(output + x * 4), packed);
+    }
+
+    boxRowScalar(row0, row1, output, outputWidth, width, x);
+}
+#endif
+
+bool isKernelSupported(mip_kernel_t kernel) {
+    switch (kernel) {
+        case SCALAR_KERNEL:
+            return true;
+        case SSE2_KERNEL:
+#ifdef S4PKG_MIPMAP_SSE2
+            return true;
+#else
+            return false;
+#endif
+        case AVX2_KERNEL:
+#ifdef S4PKG_MIPMAP_AVX2
+            return __builtin_cpu_supports("avx2");
+#else
+            return false;
+#endif
+    }
+
+    return false;
+}
+
+mip_kernel_t bestKernel() {
+    static const mip_kernel_t kernel = isKernelSupported(AVX2_KERNEL)
+                                           ? AVX2_KERNEL
+                                       : isKernelSupported(SSE2_KERNEL)
+                                           ? SSE2_KERNEL
+                                           : SCALAR_KERNEL;
+
+    return kernel;
+}
+
+static row_kernel_t rowKernel(mip_kernel_t kernel) {
+    if (!isKernelSupported(kernel)) {
+        return &boxRowScalar;
+    }
+
+    switch (kernel) {
+#ifdef S4PKG_MIPMAP_SSE2
+        case SSE2_KERNEL:
+            return &boxRowSse2;
+#endif
+#ifdef S4PKG_MIPMAP_AVX2
+        case AVX2_KERNEL:
+            return &boxRowAvx2;
+#endif
+        default:
+            return &boxRowScalar;
+    }
+}
+
+void downsample(const uint8_t* pixels,
+                uint32_t width,
+                uint32_t height,
+                uint8_t* output,
+                mip_kernel_t kernel) {
+    uint32_t outputWidth = std::max<uint32_t>(1, width / 2);
+    uint32_t outputHeight = std::max<uint32_t>(1, height / 2);
+
+    row_kernel_t boxRow = rowKernel(kernel);
+
+    for (uint32_t y = 0; y < outputHeight; y++) {
+        const uint8_t* row0 = pixels + (uint64_t)(y * 2) * width * 4;
+        const uint8_t* row1 =
+            pixels + (uint64_t)std::min(y * 2 + 1, height - 1) * width * 4;
+
+        boxRow(row0, row1, output + (uint64_t)y * outputWidth * 4,
+               outputWidth, width);
+    }
+}
+
+void downsample(const uint8_t* pixels,
+                uint32_t width,
+                uint32_t height,
+                uint8_t* output) {
+    downsample(pixels, width, height, output, bestKernel());
+}
+
+std::vector<mip_level_t> generate(const uint8_t* pixels,
+                                  uint32_t width,
+                                  uint32_t height,
+                                  mip_filter_t filter) {
+    std::vector<mip_level_t> levels;
+    levels.reserve(32);  // Halving a 32-bit size takes at most 32 levels
+
+    const uint32_t fullWidth = width;
+    const uint32_t fullHeight = height;
+
+    const uint8_t* previous = pixels;
+    uint32_t previousWidth = width;
+    uint32_t previousHeight = height;
+
+    do {
+        width = std::max<uint32_t>(1, width / 2);
+        height = std::max<uint32_t>(1, height / 2);
+
+        lib::ByteBuffer levelPixels((uint64_t)width * height * 4);
+
+        if (filter == BOX_FILTER) {
+            downsample(previous, previousWidth, previousHeight,
+                       levelPixels.data());
+        } else {
+            stbir_resize_uint8(pixels, fullWidth, fullHeight, fullWidth * 4,
+                               levelPixels.data(), width, height, width * 4,
+                               4);
+        }
+
+        levels.push_back({width, height, levelPixels});
+
+        previous = levels.back().m_pixels.data();
+        previousWidth = width;
+        previousHeight = height;
+    } while (width != 1 || height != 1);
+
+    return levels;
+}
+
+}  // namespace s4pkg::internal::mipmap
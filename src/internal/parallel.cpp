@@ -0,0 +1,102 @@
+/*
+ * Copyright (c) 2022- Gerber Lóránt Viktor
+ * Author: Gerber Lóránt Viktor <glorantv@student.elte.hu>
+ *
+ * This file is part of s4pkg.
+ *
+ * s4pkg is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <s4pkg/internal/parallel.h>
+
+#include <algorithm>
+#include <atomic>
+#include <exception>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace s4pkg::internal::parallel {
+
+unsigned int defaultThreadCount() {
+    return std::max(1u, std::thread::hardware_concurrency());
+}
+
+void forEach(size_t count,
+             const std::function<void(size_t)>& task,
+             unsigned int threadCount) {
+    if (count == 0) {
+        return;
+    }
+
+    if (threadCount == 0) {
+        threadCount = defaultThreadCount();
+    }
+
+    threadCount = (unsigned int)std::min<size_t>(threadCount, count);
+
+    // Not worth spinning up threads for
+    if (threadCount == 1) {
+        for (size_t i = 0; i < count; i++) {
+            task(i);
+        }
+
+        return;
+    }
+
+    std::atomic<size_t> next = 0;
+    std::atomic<bool> failed = false;
+
+    std::mutex exceptionMutex;
+    std::exception_ptr exception = nullptr;
+
+    auto worker = [&]() {
+        while (!failed.load(std::memory_order_relaxed)) {
+            size_t i = next.fetch_add(1, std::memory_order_relaxed);
+            if (i >= count) {
+                break;
+            }
+
+            try {
+                task(i);
+            } catch (...) {
+                std::lock_guard<std::mutex> lock(exceptionMutex);
+                if (exception == nullptr) {
+                    exception = std::current_exception();
+                }
+
+                failed = true;
+            }
+        }
+    };
+
+    std::vector<std::thread> threads;
+    threads.reserve(threadCount - 1);
+
+    for (unsigned int i = 0; i < threadCount - 1; i++) {
+        threads.emplace_back(worker);
+    }
+
+    worker();
+
+    for (auto& thread : threads) {
+        thread.join();
+    }
+
+    if (exception != nullptr) {
+        std::rethrow_exception(exception);
+    }
+}
+
+}  // namespace s4pkg::internal::parallel
@@ -0,0 +1,263 @@
+/*
+ * Copyright (c) 2022- Gerber Lóránt Viktor
+ * Author: Gerber Lóránt Viktor <glorantv@student.elte.hu>
+ *
+ * This file is part of s4pkg.
+ *
+ * s4pkg is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <s4pkg/internal/recordstore.h>
+
+#include <s4pkg/internal/streams.h>
+#include <s4pkg/packageexception.h>
+
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+
+#include <fmt/core.h>
+
+namespace s4pkg::internal::recordstore {
+
+namespace fs = std::filesystem;
+
+static const uint8_t g_packMagic[4] = {'S', '4', 'R', 'P'};
+static const uint8_t g_manifestMagic[4] = {'S', '4', 'M', 'F'};
+static constexpr uint32_t g_version = 1;
+
+static constexpr uint64_t g_packHeaderSize = 8;
+static constexpr uint64_t g_recordHeaderSize = 12;  // Hash and size
+static constexpr uint64_t g_manifestEntrySize = 38;  // Index entry and hash
+
+uint64_t scanPack(const std::string& path,
+                  std::unordered_map<uint64_t, pack_location_t>& value) {
+    value.clear();
+
+    std::error_code error;
+    uint64_t fileSize = fs::file_size(fs::u8path(path), error);
+    if (error) {
+        return 0;  // Nothing stored yet
+    }
+
+    uint64_t validSize = 0;
+
+    if (fileSize >= g_packHeaderSize) {
+        std::ifstream stream(fs::u8path(path), std::ios_base::binary);
+
+        uint8_t magic[4];
+        uint32_t version;
+        streams::readBytes(stream, magic, 4);
+        streams::readUint32(stream, version);
+
+        if (memcmp(magic, g_packMagic, 4) != 0 || version != g_version) {
+            throw PackageException(
+                fmt::format("{} is not a pack file of this version", path));
+        }
+
+        validSize = g_packHeaderSize;
+
+        // Only the record headers are read, the records are skipped
+        while (validSize + g_recordHeaderSize <= fileSize) {
+            uint64_t hash;
+            uint32_t size;
+
+            stream.seekg(validSize);
+            streams::readUint64(stream, hash);
+            streams::readUint32(stream, size);
+
+            uint64_t end = validSize + g_recordHeaderSize + size;
+            if (end > fileSize) {
+                break;
+            }
+
+            value.emplace(hash, pack_location_t{
+                                    validSize + g_recordHeaderSize, size});
+            validSize = end;
+        }
+    }
+
+    if (validSize != fileSize) {
+        fs::resize_file(fs::u8path(path), validSize, error);
+        if (error) {
+            throw PackageException(fmt::format(
+                "Failed to truncate pack file {}: {}", path, error.message()));
+        }
+    }
+
+    return validSize;
+}
+
+pack_location_t appendRecord(std::ostream& stream,
+                             uint64_t& packSize,
+                             uint64_t hash,
+                             const lib::ByteBuffer& value) {
+    if (packSize == 0) {
+        streams::writeBytes(stream, g_packMagic, 4);
+        streams::writeUint32(stream, g_version);
+        packSize = g_packHeaderSize;
+    }
+
+    streams::writeUint64(stream, hash);
+    streams::writeUint32(stream, (uint32_t)value.size());
+    streams::writeBytes(stream, value.data(), (int)value.size());
+
+    if (!stream.good()) {
+        throw PackageException("Failed to append record to pack file");
+    }
+
+    pack_location_t location{packSize + g_recordHeaderSize,
+                             (uint32_t)value.size()};
+    packSize = location.m_offset + location.m_size;
+
+    return location;
+}
+
+void readRecord(std::istream& stream,
+                const pack_location_t& location,
+                lib::ByteBuffer& value) {
+    value = lib::ByteBuffer(location.m_size);
+
+    if (location.m_size == 0) {
+        return;
+    }
+
+    stream.seekg(location.m_offset);
+    stream.read((char*)value.data(), location.m_size);
+
+    if (!stream.good()) {
+        throw PackageException(
+            fmt::format("Unexpected end of stream! Tried reading {} bytes.",
+                        location.m_size));
+    }
+}
+
+void readManifest(const std::string& path, package_manifest_t& value) {
+    std::ifstream stream(fs::u8path(path), std::ios_base::binary);
+    if (!stream.good()) {
+        throw PackageException(
+            fmt::format("Failed to open manifest {}", path));
+    }
+
+    uint8_t magic[4];
+    uint32_t version;
+    streams::readBytes(stream, magic, 4);
+    streams::readUint32(stream, version);
+
+    if (memcmp(magic, g_manifestMagic, 4) != 0 || version != g_version) {
+        throw PackageException(
+            fmt::format("{} is not a manifest of this version", path));
+    }
+
+    package_table_t& table = value.m_table;
+    streams::readPackageHeader(stream, table.m_header);
+    streams::readPackageFlags(stream, table.m_flags);
+    streams::readUint32(stream, table.m_constantType);
+    streams::readUint32(stream, table.m_constantGroup);
+    streams::readUint32(stream, table.m_constantInstanceEx);
+
+    uint32_t entryCount;
+    streams::readUint32(stream, entryCount);
+
+    // Checked before allocating, a corrupt count could ask for gigabytes
+    uint64_t entriesStart = (uint64_t)stream.tellg();
+    stream.seekg(0, std::ios_base::end);
+    uint64_t remaining = (uint64_t)stream.tellg() - entriesStart;
+    stream.seekg((std::streamoff)entriesStart);
+
+    if ((uint64_t)entryCount * g_manifestEntrySize > remaining) {
+        throw PackageException(
+            fmt::format("Manifest {} claims {} entries, but only has {} bytes "
+                        "left for them",
+                        path, entryCount, remaining));
+    }
+
+    table.m_index.m_entries.assign(entryCount, index_entry_t{});
+    value.m_hashes.assign(entryCount, 0);
+
+    for (uint32_t i = 0; i < entryCount; i++) {
+        index_entry_t& entry = table.m_index.m_entries[i];
+
+        uint32_t size;
+        uint16_t extendedCompressionType;
+
+        streams::readUint32(stream, entry.m_type);
+        streams::readUint32(stream, entry.m_group);
+        streams::readUint32(stream, entry.m_instanceEx);
+        streams::readUint32(stream, entry.m_instance);
+        streams::readUint32(stream, size);
+        streams::readUint16(stream, extendedCompressionType);
+        streams::readUint32(stream, entry.m_sizeDecompressed);
+        streams::readUint16(stream, entry.m_compressionType);
+        streams::readUint16(stream, entry.m_committed);
+        streams::readUint64(stream, value.m_hashes[i]);
+
+        entry.m_size = size;
+        entry.m_extendedCompressionType = extendedCompressionType;
+    }
+}
+
+void writeManifest(const std::string& path, const package_manifest_t& value) {
+    fs::path target = fs::u8path(path);
+    fs::path temporary = target;
+    temporary += ".tmp";
+
+    {
+        std::ofstream stream(temporary, std::ios_base::binary);
+        if (!stream.good()) {
+            throw PackageException(
+                fmt::format("Failed to open manifest {} for writing", path));
+        }
+
+        const package_table_t& table = value.m_table;
+
+        streams::writeBytes(stream, g_manifestMagic, 4);
+        streams::writeUint32(stream, g_version);
+        streams::writePackageHeader(stream, table.m_header);
+        streams::writePackageFlags(stream, table.m_flags);
+        streams::writeUint32(stream, table.m_constantType);
+        streams::writeUint32(stream, table.m_constantGroup);
+        streams::writeUint32(stream, table.m_constantInstanceEx);
+        streams::writeUint32(stream, (uint32_t)table.m_index.m_entries.size());
+
+        for (size_t i = 0; i < table.m_index.m_entries.size(); i++) {
+            const index_entry_t& entry = table.m_index.m_entries[i];
+
+            streams::writeUint32(stream, entry.m_type);
+            streams::writeUint32(stream, entry.m_group);
+            streams::writeUint32(stream, entry.m_instanceEx);
+            streams::writeUint32(stream, entry.m_instance);
+            streams::writeUint32(stream, entry.m_size);
+            streams::writeUint16(stream, entry.m_extendedCompressionType);
+            streams::writeUint32(stream, entry.m_sizeDecompressed);
+            streams::writeUint16(stream, entry.m_compressionType);
+            streams::writeUint16(stream, entry.m_committed);
+            streams::writeUint64(stream, value.m_hashes[i]);
+        }
+
+        if (!stream.good()) {
+            throw PackageException(
+                fmt::format("Failed to write manifest {}", path));
+        }
+    }
+
+    std::error_code error;
+    fs::rename(temporary, target, error);
+    if (error) {
+        throw PackageException(fmt::format(
+            "Failed to replace manifest {}: {}", path, error.message()));
+    }
+}
+
+}  // namespace s4pkg::internal::recordstore
@@ -20,30 +20,26 @@
 
 #include <s4pkg/internal/rle.h>
 
-#include <s4pkg/internal/streams.h>
+#include <s4pkg/internal/binarycursor.h>
+#include <s4pkg/internal/dst.h>
+#include <s4pkg/internal/layout.h>
 #include <s4pkg/packageexception.h>
 
 #include <fmt/core.h>
 
+#include <cstring>
+
 s4pkg::internal::rle::rle_header_t s4pkg::internal::rle::readHeader(
-    std::istream& stream) {
+    BinaryCursor& cursor) {
     // Get the size of the whole stream, we'll need this later
-    stream.seekg(0, std::istream::end);
-    int32_t streamSize = (int32_t)stream.tellg();
-    stream.seekg(0, std::istream::beg);
+    int32_t streamSize = (int32_t)cursor.size();
+    cursor.seek(0);
 
     // Read in basic information about the file, such as the RLE version and the
     // underlying format (DXT5 or L8 as far as I can tell)
     rle_header_t header{};
 
-    streams::readUint32(stream, header.m_fourCC);
-    streams::readUint32(stream, header.m_rleVersion);
-
-    streams::readUint16(stream, header.m_width);
-    streams::readUint16(stream, header.m_height);
-    streams::readUint16(stream, header.m_mipCount);
-
-    streams::readUint16(stream, header.m_unknown0);
+    layout::read(cursor, header);
 
     header.m_mipHeaders = std::vector<mip_header_t>(header.m_mipCount + 1);
 
@@ -52,18 +48,15 @@ s4pkg::internal::rle::rle_header_t s4pkg::internal::rle::readHeader(
         mip_header_t mipHeader{};
 
         if (header.m_fourCC == fourcc_t::L8) {
-            streams::readInt32(stream, mipHeader.m_commandOffset);
-            streams::readInt32(stream, mipHeader.m_offset0);
+            cursor.read(mipHeader.m_commandOffset, mipHeader.m_offset0);
         } else {
-            streams::readInt32(stream, mipHeader.m_commandOffset);
-            streams::readInt32(stream, mipHeader.m_offset2);
-            streams::readInt32(stream, mipHeader.m_offset3);
-            streams::readInt32(stream, mipHeader.m_offset0);
-            streams::readInt32(stream, mipHeader.m_offset1);
+            cursor.read(mipHeader.m_commandOffset, mipHeader.m_offset2,
+                        mipHeader.m_offset3, mipHeader.m_offset0,
+                        mipHeader.m_offset1);
 
             if (header.m_rleVersion == rle_version_t::RLES) {
-                streams::readInt32(stream,
-                                   mipHeader.m_offset4);  // Specular mask
+                // Specular mask
+                mipHeader.m_offset4 = cursor.readLE<int32_t>();
             }
         }
 
@@ -93,6 +86,18 @@ s4pkg::internal::rle::rle_header_t s4pkg::internal::rle::readHeader(
     return header;
 }
 
+s4pkg::internal::rle::rle_header_t s4pkg::internal::rle::readHeader(
+    ByteSource& source) {
+    // The offsets of the mipmaps are checked against the size of everything,
+    // so the header is parsed from all of it
+    lib::ByteBuffer data(source.getSize());
+    source.readAt(0, data.data(), data.size());
+    source.seek(data.size());
+
+    BinaryCursor cursor(data.data(), data.size());
+    return readHeader(cursor);
+}
+
 // Constant blocks for decompression
 static constexpr uint8_t g_fullDark[] = {0x00, 0x00, 0x00, 0x00};
 static constexpr uint8_t g_fullBright[] = {0xFF, 0xFF, 0xFF, 0xFF};
@@ -105,39 +110,147 @@ static constexpr uint8_t g_fullTransparentBlack[] = {0x00, 0x00, 0x00, 0x00,
 static constexpr uint8_t g_fullOpaqueAlpha[] = {0x00, 0x05, 0xFF, 0xFF,
                                                 0xFF, 0xFF, 0xFF, 0xFF};
 
+namespace s4pkg::internal::rle {
+
+// The bytes of one plane of a mipmap, which end where the same plane of the
+// next mipmap starts
+static BinaryCursor planeOf(const BinaryCursor& cursor,
+                            int32_t offset,
+                            int32_t nextOffset) {
+    if (offset < 0 || nextOffset < offset) {
+        throw PackageException(fmt::format(
+            "Invalid RLE plane offsets {} and {}", offset, nextOffset));
+    }
+
+    return cursor.subspan(offset, nextOffset - offset);
+}
+
+// Decodes the blocks of a mipmap straight into its surface. The planes of a
+// run of blocks are contiguous, so whole runs are gathered at once with the DST
+// kernels. The planes have to be used up exactly, and the surface filled.
+static void decodeMipmap(const BinaryCursor& cursor,
+                         const rle_header_t& header,
+                         int mip,
+                         lib::ByteBuffer& surface) {
+    const mip_header_t& mipHeader = header.m_mipHeaders[mip];
+    const mip_header_t& nextMipHeader = header.m_mipHeaders[mip + 1];
+
+    bool specular = header.m_rleVersion == rle_version_t::RLES;
+    const char* version = specular ? "RLES" : "RLE2";
+
+    BinaryCursor commands = planeOf(cursor, mipHeader.m_commandOffset,
+                                    nextMipHeader.m_commandOffset);
+    BinaryCursor alphaEndpoints =
+        planeOf(cursor, mipHeader.m_offset0, nextMipHeader.m_offset0);
+    BinaryCursor alphaIndices =
+        planeOf(cursor, mipHeader.m_offset1, nextMipHeader.m_offset1);
+    BinaryCursor colourEndpoints =
+        planeOf(cursor, mipHeader.m_offset2, nextMipHeader.m_offset2);
+    BinaryCursor colourIndices =
+        planeOf(cursor, mipHeader.m_offset3, nextMipHeader.m_offset3);
+    BinaryCursor specularMask =
+        specular ? planeOf(cursor, mipHeader.m_offset4, nextMipHeader.m_offset4)
+                 : BinaryCursor(nullptr, 0);
+
+    // Fully transparent blocks are white in RLE2, and black in RLES
+    uint8_t transparentBlock[16];
+    memcpy(transparentBlock, g_fullTransparentAlpha, 8);
+    memcpy(transparentBlock + 8,
+           specular ? g_fullTransparentBlack : g_fullTransparentWhite, 8);
+
+    uint8_t* output = surface.data();
+    uint64_t blocksLeft = surface.size() / 16;
+
+    while (commands.position() < commands.size()) {
+        uint16_t command = commands.readLE<uint16_t>();
+
+        uint16_t operation = command & 3;
+        uint16_t count = command >> 2;
+
+        if (count > blocksLeft) {
+            throw PackageException(fmt::format(
+                "Got out of sync while decoding {} image!", version));
+        }
+
+        if (operation == 0) {
+            for (uint16_t j = 0; j < count; j++) {
+                memcpy(output + j * 16, transparentBlock, 16);
+            }
+        } else if (operation == 1 || (operation == 2 && specular)) {
+            dst::dst5_view_t<const uint8_t> planes(
+                alphaEndpoints.take(count * 2).data(),
+                colourEndpoints.take(count * 4).data(),
+                alphaIndices.take(count * 6).data(),
+                colourIndices.take(count * 4).data());
+
+            dst::unshuffleDst5(planes, output, count);
+
+            // The specular mask isn't decoded, only kept in sync
+            if (specular && operation == 1) {
+                specularMask.skip(count * 16);
+            }
+        } else if (operation == 2) {
+            // Opaque blocks, only the colour is stored
+            const uint8_t* endpoints = colourEndpoints.take(count * 4).data();
+            const uint8_t* indices = colourIndices.take(count * 4).data();
+
+            for (uint16_t j = 0; j < count; j++) {
+                memcpy(output + j * 16, g_fullOpaqueAlpha, 8);
+                memcpy(output + j * 16 + 8, endpoints + j * 4, 4);
+                memcpy(output + j * 16 + 12, indices + j * 4, 4);
+            }
+        } else {
+            throw PackageException(
+                fmt::format("Unknown command {} while decoding {} image!",
+                            operation, version));
+        }
+
+        output += count * 16;
+        blocksLeft -= count;
+    }
+
+    if (blocksLeft != 0 ||
+        alphaEndpoints.position() != alphaEndpoints.size() ||
+        alphaIndices.position() != alphaIndices.size() ||
+        colourEndpoints.position() != colourEndpoints.size() ||
+        colourIndices.position() != colourIndices.size() ||
+        specularMask.position() != specularMask.size()) {
+        throw PackageException(
+            fmt::format("Got out of sync while decoding {} image!", version));
+    }
+}
+
+}  // namespace s4pkg::internal::rle
+
 s4pkg::internal::rle::rle_file_t s4pkg::internal::rle::readFile(
-    std::istream& stream) {
+    BinaryCursor& cursor) {
     rle_file_t rleFile{};
 
     // Try to read in the file header
     try {
-        rleFile.m_rleHeader = readHeader(stream);
+        rleFile.m_rleHeader = readHeader(cursor);
     } catch (PackageException e) {
         throw PackageException(
             fmt::format("Failed to read RLE header: {}", e.what()));
     }
 
-    // Seek to the beginning of the stream and read in everything
-    stream.seekg(std::istream::beg);
-    rleFile.m_rleData = std::vector<uint8_t>(rleFile.m_rleHeader.m_streamSize);
-    streams::readBytes(stream, rleFile.m_rleData.data(),
-                       (int)rleFile.m_rleData.size());
+    const rle_header_t& rleHeader = rleFile.m_rleHeader;
+
+    if (rleHeader.m_mipCount == 0) {
+        throw PackageException("RLE image has no mipmaps!");
+    }
 
     // RLE images contain a DDS image, so we set that up here based on
     // information from the RLE header, this is all stuff that has been
     // documented either in the DDS implementation or the imagecoder dealing
     // with DDS files
     uint8_t blockSize = 16;
-    if (rleFile.m_rleHeader.m_fourCC == MAKE_FOURCC('D', 'X', 'T', '1') ||
-        rleFile.m_rleHeader.m_fourCC == MAKE_FOURCC('D', 'S', 'T', '1')) {
-        blockSize = 8;
-    }
 
     dds::dds_pixelformat_t ddsPixelFormat{
         32,
     };
 
-    if (rleFile.m_rleHeader.m_fourCC == fourcc_t::L8) {
+    if (rleHeader.m_fourCC == fourcc_t::L8) {
         ddsPixelFormat.m_flags = dds::DDPF_LUMINANCE;
         ddsPixelFormat.m_rgbBitCount = 8;
         ddsPixelFormat.m_rBitMask = 0x000000FF;
@@ -154,18 +267,19 @@ s4pkg::internal::rle::rle_file_t s4pkg::internal::rle::readFile(
         ddsPixelFormat.m_fourCC = fourcc_t::DXT5;
     }
 
-    uint32_t pitchOrLinearSize = DDS_IMAGE_SIZE(
-        rleFile.m_rleHeader.m_width, rleFile.m_rleHeader.m_height, blockSize);
+    uint32_t pitchOrLinearSize =
+        DDS_IMAGE_SIZE(rleHeader.m_width, rleHeader.m_height, blockSize);
 
-    dds::dds_header_t ddsHeader{
+    dds::dds_header_t& ddsHeader = rleFile.m_ddsFile.m_header;
+    ddsHeader = {
         124,
         dds::DDSD_CAPS | dds::DDSD_HEIGHT | dds::DDSD_WIDTH |
             dds::DDSD_PIXELFORMAT | dds::DDSD_PITCH,
-        rleFile.m_rleHeader.m_height,
-        rleFile.m_rleHeader.m_width,
+        rleHeader.m_height,
+        rleHeader.m_width,
         pitchOrLinearSize,
         0,
-        rleFile.m_rleHeader.m_mipCount,
+        rleHeader.m_mipCount,
         {0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0},
         ddsPixelFormat,
         dds::DDSCAPS_TEXTURE,
@@ -175,229 +289,323 @@ s4pkg::internal::rle::rle_file_t s4pkg::internal::rle::readFile(
         0,
     };
 
-    if (rleFile.m_rleHeader.m_mipCount > 1) {
+    if (rleHeader.m_mipCount > 1) {
         ddsHeader.m_flags |= dds::DDSD_MIPMAPCOUNT;
     }
 
-    dds::dds_file_t ddsFile{
-        ddsHeader,
-    };
+    // Every surface gets its final size up front, and the blocks are decoded
+    // into them directly
+    dds::dds_file_t& ddsFile = rleFile.m_ddsFile;
+    ddsFile.m_mipmaps.resize(rleHeader.m_mipCount - 1);
+
+    uint32_t width = rleHeader.m_width;
+    uint32_t height = rleHeader.m_height;
+
+    for (int i = 0; i < rleHeader.m_mipCount; i++) {
+        lib::ByteBuffer& surface =
+            i == 0 ? ddsFile.m_mainImage : ddsFile.m_mipmaps[i - 1];
+        surface = lib::ByteBuffer(DDS_IMAGE_SIZE(width, height, blockSize));
+
+        if (rleHeader.m_fourCC == fourcc_t::L8) {
+            // TODO: Implement L8
+            memset(surface.data(), 0, surface.size());
+        } else {
+            decodeMipmap(cursor, rleHeader, i, surface);
+        }
+
+        width = std::max<uint32_t>(1, width / 2);
+        height = std::max<uint32_t>(1, height / 2);
+    }
+
+    return rleFile;
+}
+
+s4pkg::internal::rle::rle_file_t s4pkg::internal::rle::readFile(
+    ByteSource& source) {
+    // Read in everything, from the beginning of the stream
+    lib::ByteBuffer data(source.getSize());
+    source.readAt(0, data.data(), data.size());
+    source.seek(data.size());
+
+    BinaryCursor cursor(data.data(), data.size());
+    return readFile(cursor);
+}
+
+s4pkg::internal::rle::rle_header_t s4pkg::internal::rle::readHeader(
+    std::istream& stream) {
+    StreamByteSource source(stream);
+    return readHeader(source);
+}
+
+s4pkg::internal::rle::rle_file_t s4pkg::internal::rle::readFile(
+    std::istream& stream) {
+    StreamByteSource source(stream);
+    return readFile(source);
+}
+
+// Encoding
+
+// The lowest bit of each of the 16 alpha indices of a block
+static constexpr uint64_t g_indexFieldLow = 0x249249249249;
+
+// The alpha indices of a block which decode to value exactly
+static uint8_t alphaIndicesOf(uint8_t alpha0, uint8_t alpha1, uint8_t value) {
+    uint8_t indices = 0;
+
+    if (alpha0 == value) {
+        indices |= 0x01;
+    }
+
+    if (alpha1 == value) {
+        indices |= 0x02;
+    }
+
+    // With the first endpoint not above the second, there are 4 values
+    // between the endpoints, then 0 and 255
+    if (alpha0 <= alpha1) {
+        if (alpha0 == value && alpha1 == value) {
+            indices |= 0x3C;
+        }
+
+        if (value == 0x00) {
+            indices |= 0x40;
+        } else if (value == 0xFF) {
+            indices |= 0x80;
+        }
+    }
+
+    return indices;
+}
+
+// Whether every one of the 16 alpha indices is in the set. For each index
+// that isn't, the fields equal to it are found at once, by zeroing them and
+// checking for zero fields.
+static bool alphaIndicesWithin(uint64_t fields, uint8_t indices) {
+    for (uint64_t index = 0; index < 8; index++) {
+        if (((indices >> index) & 1) != 0) {
+            continue;
+        }
 
-    uint32_t ddsImageDataSize = 0;
-    {
-        uint32_t width = rleFile.m_rleHeader.m_width;
-        uint32_t height = rleFile.m_rleHeader.m_height;
+        uint64_t difference = fields ^ (index * g_indexFieldLow);
+        uint64_t nonZero =
+            (difference | difference >> 1 | difference >> 2) & g_indexFieldLow;
+
+        if (nonZero != g_indexFieldLow) {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+void s4pkg::internal::rle::classifyBlocks(const uint8_t* blocks,
+                                          uint64_t blockCount,
+                                          uint8_t* classes) {
+    for (uint64_t i = 0; i < blockCount; i++) {
+        const uint8_t* block = blocks + i * 16;
+
+        uint64_t fields = 0;
+        for (int j = 0; j < 6; j++) {
+            fields |= (uint64_t)block[2 + j] << (j * 8);
+        }
 
-        for (int i = 0; i < rleFile.m_rleHeader.m_mipCount; i++) {
-            ddsImageDataSize += DDS_IMAGE_SIZE(width, height, blockSize);
+        if (alphaIndicesWithin(fields,
+                               alphaIndicesOf(block[0], block[1], 0x00))) {
+            classes[i] = TRANSPARENT_BLOCK;
+        } else if (alphaIndicesWithin(
+                       fields, alphaIndicesOf(block[0], block[1], 0xFF))) {
+            classes[i] = OPAQUE_BLOCK;
+        } else {
+            classes[i] = MIXED_BLOCK;
+        }
+    }
+}
+
+s4pkg::lib::ByteBuffer s4pkg::internal::rle::writeFile(
+    const dds::dds_file_t& ddsFile,
+    rle_version_t version,
+    const dds::dds_file_t* specularMask) {
+    bool specular = version == rle_version_t::RLES;
+
+    if (ddsFile.m_header.m_pixelFormat.m_fourCC != fourcc_t::DXT5) {
+        throw PackageException(
+            "Only DXT5 images can be encoded as RLE images!");
+    }
+
+    std::vector<const lib::ByteBuffer*> surfaces{&ddsFile.m_mainImage};
+    for (const lib::ByteBuffer& mipmap : ddsFile.m_mipmaps) {
+        surfaces.push_back(&mipmap);
+    }
+
+    if (ddsFile.m_header.m_width > 0xFFFF ||
+        ddsFile.m_header.m_height > 0xFFFF || surfaces.size() > 0xFFFF) {
+        throw PackageException(fmt::format(
+            "DDS image {}x{} with {} surfaces is too large for an RLE image!",
+            ddsFile.m_header.m_width, ddsFile.m_header.m_height,
+            surfaces.size()));
+    }
+
+    if (specularMask != nullptr) {
+        bool matches =
+            specularMask->m_mainImage.size() == ddsFile.m_mainImage.size() &&
+            specularMask->m_mipmaps.size() == ddsFile.m_mipmaps.size();
+
+        for (size_t i = 0; matches && i < ddsFile.m_mipmaps.size(); i++) {
+            matches = specularMask->m_mipmaps[i].size() ==
+                      ddsFile.m_mipmaps[i].size();
+        }
 
-            width /= 2;
-            height /= 2;
+        if (!matches) {
+            throw PackageException(
+                "The specular mask doesn't match the RLE image!");
         }
     }
 
-    // Make room for the RLE-decoded blocks of the image, and do the actual
-    // decoding
-    std::vector<uint8_t> ddsImageData(ddsImageDataSize);
-
-    uint32_t c = 0;
-
-    if (rleFile.m_rleHeader.m_fourCC == fourcc_t::L8) {
-        // TODO: Implement L8
-    } else if (rleFile.m_rleHeader.m_rleVersion == rle_version_t::RLE2) {
-        for (int i = 0; i < rleFile.m_rleHeader.m_mipCount; i++) {
-            mip_header_t mipHeader = rleFile.m_rleHeader.m_mipHeaders[i];
-            mip_header_t nextMipHeader =
-                rleFile.m_rleHeader.m_mipHeaders[i + 1];
-
-            int blockOffset2 = mipHeader.m_offset2;
-            int blockOffset3 = mipHeader.m_offset3;
-            int blockOffset0 = mipHeader.m_offset0;
-            int blockOffset1 = mipHeader.m_offset1;
-
-            for (int commandOffset = mipHeader.m_commandOffset;
-                 commandOffset < nextMipHeader.m_commandOffset;
-                 commandOffset += 2) {
-                uint16_t command =
-                    ((uint16_t)rleFile.m_rleData[commandOffset + 1] << 8 |
-                     (uint16_t)rleFile.m_rleData[commandOffset + 0]);
-
-                uint16_t operation = command & 3;
-                uint16_t count = command >> 2;
-
-                if (operation == 0) {
-                    for (int j = 0; j < count; j++) {
-                        COPY_BYTES(g_fullTransparentAlpha, ddsImageData, 0, 8,
-                                   c);
-                        COPY_BYTES(g_fullTransparentWhite, ddsImageData, 0, 8,
-                                   c);
-                    }
-                } else if (operation == 1) {
-                    for (int j = 0; j < count; j++) {
-                        COPY_BYTES(rleFile.m_rleData, ddsImageData,
-                                   blockOffset0, 2, c);
-                        COPY_BYTES(rleFile.m_rleData, ddsImageData,
-                                   blockOffset1, 6, c);
-                        COPY_BYTES(rleFile.m_rleData, ddsImageData,
-                                   blockOffset2, 4, c);
-                        COPY_BYTES(rleFile.m_rleData, ddsImageData,
-                                   blockOffset3, 4, c);
-
-                        blockOffset2 += 4;
-                        blockOffset3 += 4;
-                        blockOffset0 += 2;
-                        blockOffset1 += 6;
-                    }
-                } else if (operation == 2) {
-                    for (int j = 0; j < count; j++) {
-                        COPY_BYTES(g_fullOpaqueAlpha, ddsImageData, 0, 8, c);
-                        COPY_BYTES(rleFile.m_rleData, ddsImageData,
-                                   blockOffset2, 4, c);
-                        COPY_BYTES(rleFile.m_rleData, ddsImageData,
-                                   blockOffset3, 4, c);
-
-                        blockOffset2 += 4;
-                        blockOffset3 += 4;
-                    }
+    bool withSpecularMask = specular && specularMask != nullptr;
+
+    // Every run of blocks stored the same way becomes a command, and the
+    // operations of the commands decide which planes the blocks go into
+    typedef struct run_t {
+        uint16_t m_operation;
+        uint16_t m_count;
+        uint64_t m_first;
+    } run_t;
+
+    std::vector<std::vector<run_t>> runs(surfaces.size());
+
+    uint64_t commandCount = 0;
+    uint64_t colourBlocks = 0;
+    uint64_t alphaBlocks = 0;
+    uint64_t specularBlocks = 0;
+
+    std::vector<uint8_t> classes;
+    for (size_t i = 0; i < surfaces.size(); i++) {
+        uint64_t blockCount = surfaces[i]->size() / 16;
+
+        classes.resize(blockCount);
+        classifyBlocks(surfaces[i]->data(), blockCount, classes.data());
+
+        for (uint64_t j = 0; j < blockCount; j++) {
+            uint16_t operation = 0;
+            if (classes[j] != TRANSPARENT_BLOCK) {
+                if (specular) {
+                    operation = withSpecularMask ? 1 : 2;
                 } else {
-                    throw PackageException(fmt::format(
-                        "Unknown command {} while decoding RLE2 image!",
-                        operation));
+                    operation = classes[j] == OPAQUE_BLOCK ? 2 : 1;
                 }
             }
 
-            if (blockOffset0 != nextMipHeader.m_offset0 ||
-                blockOffset1 != nextMipHeader.m_offset1 ||
-                blockOffset2 != nextMipHeader.m_offset2 ||
-                blockOffset3 != nextMipHeader.m_offset3) {
-                throw PackageException(
-                    "Got out of sync while decoding RLE2 image!");
+            // The count of a command has 14 bits
+            if (runs[i].empty() || runs[i].back().m_operation != operation ||
+                runs[i].back().m_count == 0x3FFF) {
+                runs[i].push_back({operation, 0, j});
+                commandCount++;
             }
-        }
-    } else {
-        for (int i = 0; i < rleFile.m_rleHeader.m_mipCount; i++) {
-            mip_header_t mipHeader = rleFile.m_rleHeader.m_mipHeaders[i];
-            mip_header_t nextMipHeader =
-                rleFile.m_rleHeader.m_mipHeaders[i + 1];
-
-            int blockOffset2 = mipHeader.m_offset2;
-            int blockOffset3 = mipHeader.m_offset3;
-            int blockOffset0 = mipHeader.m_offset0;
-            int blockOffset1 = mipHeader.m_offset1;
-            int blockOffset4 = mipHeader.m_offset4;
-
-            for (int commandOffset = mipHeader.m_commandOffset;
-                 commandOffset < nextMipHeader.m_commandOffset;
-                 commandOffset += 2) {
-                uint16_t command =
-                    ((uint16_t)rleFile.m_rleData[commandOffset + 1] << 8 |
-                     (uint16_t)rleFile.m_rleData[commandOffset + 0]);
-
-                uint16_t operation = command & 3;
-                uint16_t count = command >> 2;
-
-                if (operation == 0) {
-                    for (int j = 0; j < count; j++) {
-                        COPY_BYTES(g_fullTransparentAlpha, ddsImageData, 0, 8,
-                                   c);
-                        COPY_BYTES(g_fullTransparentBlack, ddsImageData, 0, 8,
-                                   c);
-                    }
-                } else if (operation == 1) {
-                    for (int j = 0; j < count; j++) {
-                        COPY_BYTES(rleFile.m_rleData, ddsImageData,
-                                   blockOffset0, 2, c);
-                        COPY_BYTES(rleFile.m_rleData, ddsImageData,
-                                   blockOffset1, 6, c);
-                        COPY_BYTES(rleFile.m_rleData, ddsImageData,
-                                   blockOffset2, 4, c);
-                        COPY_BYTES(rleFile.m_rleData, ddsImageData,
-                                   blockOffset3, 4, c);
-
-                        blockOffset2 += 4;
-                        blockOffset3 += 4;
-                        blockOffset0 += 2;
-                        blockOffset1 += 6;
-
-                        blockOffset4 += 16;
-                    }
-                } else if (operation == 2) {
-                    for (int j = 0; j < count; j++) {
-                        COPY_BYTES(rleFile.m_rleData, ddsImageData,
-                                   blockOffset0, 2, c);
-                        COPY_BYTES(rleFile.m_rleData, ddsImageData,
-                                   blockOffset1, 6, c);
-                        COPY_BYTES(rleFile.m_rleData, ddsImageData,
-                                   blockOffset2, 4, c);
-                        COPY_BYTES(rleFile.m_rleData, ddsImageData,
-                                   blockOffset3, 4, c);
-
-                        blockOffset2 += 4;
-                        blockOffset3 += 4;
-                        blockOffset0 += 2;
-                        blockOffset1 += 6;
-                    }
-                } else {
-                    throw PackageException(fmt::format(
-                        "Unknown command {} while decoding RLES image!",
-                        operation));
-                }
+
+            runs[i].back().m_count++;
+
+            if (operation != 0) {
+                colourBlocks++;
             }
 
-            if (blockOffset0 != nextMipHeader.m_offset0 ||
-                blockOffset1 != nextMipHeader.m_offset1 ||
-                blockOffset2 != nextMipHeader.m_offset2 ||
-                blockOffset3 != nextMipHeader.m_offset3 ||
-                blockOffset4 != nextMipHeader.m_offset4) {
-                throw PackageException(
-                    "Got out of sync while decoding RLES image!");
+            if (operation == 1 || (operation == 2 && specular)) {
+                alphaBlocks++;
+            }
+
+            if (operation == 1 && specular) {
+                specularBlocks++;
             }
         }
     }
 
-    // This is yet again taken from the imagecoder, we take the continous stream
-    // of blocks we decoded above, and split it up into a main surface and its
-    // mipmaps
+    // Every plane holds the blocks of every mipmap, one after the other
+    uint64_t commandOffset = layout::encodedSize<rle_header_t>() +
+                             surfaces.size() * (specular ? 24 : 20);
+    uint64_t colourEndpointOffset = commandOffset + commandCount * 2;
+    uint64_t colourIndexOffset = colourEndpointOffset + colourBlocks * 4;
+    uint64_t alphaEndpointOffset = colourIndexOffset + colourBlocks * 4;
+    uint64_t alphaIndexOffset = alphaEndpointOffset + alphaBlocks * 2;
+    uint64_t specularOffset = alphaIndexOffset + alphaBlocks * 6;
+    uint64_t streamSize = specularOffset + specularBlocks * 16;
+
+    if (streamSize > INT32_MAX) {
+        throw PackageException(
+            fmt::format("RLE image of {} bytes is too large!", streamSize));
+    }
+
+    lib::ByteBuffer output(streamSize);
+
+    rle_header_t header{};
+    header.m_fourCC = fourcc_t::DXT5;
+    header.m_rleVersion = version;
+    header.m_width = (uint16_t)ddsFile.m_header.m_width;
+    header.m_height = (uint16_t)ddsFile.m_header.m_height;
+    header.m_mipCount = (uint16_t)surfaces.size();
 
-    uint32_t mipmapCopyIdx = 0;
+    layout::write(output.data(), header);
 
-    uint32_t mipmapPosition = DDS_IMAGE_SIZE(
-        rleFile.m_rleHeader.m_width, rleFile.m_rleHeader.m_height, blockSize);
+    uint8_t* mipHeaders = output.data() + layout::encodedSize<rle_header_t>();
+    uint8_t* commands = output.data() + commandOffset;
 
-    lib::ByteBuffer reconstructedMainImage(mipmapPosition);
-    COPY_BYTES(ddsImageData, reconstructedMainImage, 0,
-               reconstructedMainImage.size(), mipmapCopyIdx);
-    mipmapCopyIdx = 0;
+    dst::dst5_view_t<uint8_t> planes(
+        output.data() + alphaEndpointOffset,
+        output.data() + colourEndpointOffset, output.data() + alphaIndexOffset,
+        output.data() + colourIndexOffset);
+    uint8_t* specularBlock = output.data() + specularOffset;
 
-    std::vector<lib::ByteBuffer> reconstructedMipmaps(
-        std::max<int32_t>(0, ddsFile.m_header.m_mipMapCount - 1));
+    auto offsetOf = [&output](const uint8_t* position) {
+        return (int32_t)(position - output.data());
+    };
 
-    {
-        uint32_t width = rleFile.m_rleHeader.m_width;
-        uint32_t height = rleFile.m_rleHeader.m_height;
+    for (size_t i = 0; i < surfaces.size(); i++) {
+        // Where this mipmap starts in every plane
+        layout::store(mipHeaders, offsetOf(commands));
+        layout::store(mipHeaders, offsetOf(planes.m_colourEndpoints));
+        layout::store(mipHeaders, offsetOf(planes.m_colourIndices));
+        layout::store(mipHeaders, offsetOf(planes.m_alphaEndpoints));
+        layout::store(mipHeaders, offsetOf(planes.m_alphaIndices));
 
-        for (int i = 0; i < reconstructedMipmaps.size(); i++) {
-            width /= 2;
-            height /= 2;
+        if (specular) {
+            layout::store(mipHeaders, offsetOf(specularBlock));
+        }
 
-            width = std::max<uint32_t>(1, width);
-            height = std::max<uint32_t>(1, height);
+        for (const run_t& run : runs[i]) {
+            layout::store(commands,
+                          (uint16_t)(run.m_count << 2 | run.m_operation));
 
-            lib::ByteBuffer mipmap(DDS_IMAGE_SIZE(width, height, blockSize));
-            COPY_BYTES(ddsImageData, mipmap, mipmapPosition, mipmap.size(),
-                       mipmapCopyIdx);
+            const uint8_t* blocks = surfaces[i]->data() + run.m_first * 16;
 
-            mipmapCopyIdx = 0;
-            mipmapPosition += (uint32_t)mipmap.size();
+            if (run.m_operation == 1 || (run.m_operation == 2 && specular)) {
+                dst::shuffleDst5(blocks, planes, run.m_count);
 
-            reconstructedMipmaps[i] = mipmap;
+                planes.m_alphaEndpoints += run.m_count * 2;
+                planes.m_alphaIndices += run.m_count * 6;
+            } else if (run.m_operation == 2) {
+                // Opaque, only the colour is stored
+                for (uint16_t j = 0; j < run.m_count; j++) {
+                    memcpy(planes.m_colourEndpoints + j * 4,
+                           blocks + j * 16 + 8, 4);
+                    memcpy(planes.m_colourIndices + j * 4,
+                           blocks + j * 16 + 12, 4);
+                }
+            }
+
+            if (run.m_operation != 0) {
+                planes.m_colourEndpoints += run.m_count * 4;
+                planes.m_colourIndices += run.m_count * 4;
+            }
+
+            if (run.m_operation == 1 && specular) {
+                const lib::ByteBuffer& mask =
+                    i == 0 ? specularMask->m_mainImage
+                           : specularMask->m_mipmaps[i - 1];
+
+                memcpy(specularBlock, mask.data() + run.m_first * 16,
+                       run.m_count * 16);
+                specularBlock += run.m_count * 16;
+            }
         }
     }
 
-    ddsFile.m_mainImage = reconstructedMainImage;
-    ddsFile.m_mipmaps = reconstructedMipmaps;
-
-    // Finally we store the DDS file we decompressed
-    rleFile.m_ddsFile = ddsFile;
-    return rleFile;
+    return output;
 }
@@ -0,0 +1,200 @@
+/*
+ * Copyright (c) 2022- Gerber Lóránt Viktor
+ * Author: Gerber Lóránt Viktor <glorantv@student.elte.hu>
+ *
+ * This file is part of s4pkg.
+ *
+ * s4pkg is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <s4pkg/internal/soaindex.h>
+
+#if defined(__SSE2__) || defined(_M_X64) || \
+    (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define S4PKG_SOAINDEX_SSE2
+#include <emmintrin.h>
+#endif
+
+namespace s4pkg::internal::soaindex {
+
+soa_index_t build(const index_t& index,
+                  const flags_t& flags,
+                  uint32_t constantType,
+                  uint32_t constantGroup,
+                  uint32_t constantInstanceEx) {
+    soa_index_t soaIndex{};
+
+    size_t count = index.m_entries.size();
+
+    soaIndex.m_types.reserve(count);
+    soaIndex.m_groups.reserve(count);
+    soaIndex.m_instanceExs.reserve(count);
+    soaIndex.m_instances.reserve(count);
+    soaIndex.m_positions.reserve(count);
+    soaIndex.m_sizes.reserve(count);
+    soaIndex.m_sizesDecompressed.reserve(count);
+    soaIndex.m_compressionTypes.reserve(count);
+    soaIndex.m_committed.reserve(count);
+    soaIndex.m_extendedCompressionTypes.reserve(count);
+
+    for (const auto& entry : index.m_entries) {
+        // The entries themselves don't have these fields set when they are
+        // constant for the whole package, so we fill them in here
+        soaIndex.m_types.push_back(flags.m_constantType != 0 ? constantType
+                                                             : entry.m_type);
+        soaIndex.m_groups.push_back(
+            flags.m_constantGroup != 0 ? constantGroup : entry.m_group);
+        soaIndex.m_instanceExs.push_back(flags.m_constantInstanceEx != 0
+                                             ? constantInstanceEx
+                                             : entry.m_instanceEx);
+
+        soaIndex.m_instances.push_back(entry.m_instance);
+        soaIndex.m_positions.push_back(entry.m_position);
+        soaIndex.m_sizes.push_back(entry.m_size);
+        soaIndex.m_sizesDecompressed.push_back(entry.m_sizeDecompressed);
+        soaIndex.m_compressionTypes.push_back(entry.m_compressionType);
+        soaIndex.m_committed.push_back(entry.m_committed);
+        soaIndex.m_extendedCompressionTypes.push_back(
+            (uint8_t)entry.m_extendedCompressionType);
+    }
+
+    return soaIndex;
+}
+
+template <typename T>
+static void appendColumn(std::vector<T>& into, const std::vector<T>& from) {
+    into.insert(into.end(), from.begin(), from.end());
+}
+
+void append(soa_index_t& into, const soa_index_t& from) {
+    appendColumn(into.m_types, from.m_types);
+    appendColumn(into.m_groups, from.m_groups);
+    appendColumn(into.m_instanceExs, from.m_instanceExs);
+    appendColumn(into.m_instances, from.m_instances);
+    appendColumn(into.m_positions, from.m_positions);
+    appendColumn(into.m_sizes, from.m_sizes);
+    appendColumn(into.m_sizesDecompressed, from.m_sizesDecompressed);
+    appendColumn(into.m_compressionTypes, from.m_compressionTypes);
+    appendColumn(into.m_committed, from.m_committed);
+    appendColumn(into.m_extendedCompressionTypes,
+                 from.m_extendedCompressionTypes);
+}
+
+index_entry_t entryAt(const soa_index_t& index, uint32_t position) {
+    index_entry_t entry{};
+
+    entry.m_type = index.m_types[position];
+    entry.m_group = index.m_groups[position];
+    entry.m_instanceEx = index.m_instanceExs[position];
+    entry.m_instance = index.m_instances[position];
+    entry.m_position = index.m_positions[position];
+    entry.m_size = index.m_sizes[position];
+    entry.m_extendedCompressionType =
+        index.m_extendedCompressionTypes[position];
+    entry.m_sizeDecompressed = index.m_sizesDecompressed[position];
+    entry.m_compressionType = index.m_compressionTypes[position];
+    entry.m_committed = index.m_committed[position];
+
+    return entry;
+}
+
+static bool matchesScalar(const soa_index_t& index,
+                          const soa_filter_t& filter,
+                          size_t position) {
+    if (filter.m_matchGroup && index.m_groups[position] != filter.m_group) {
+        return false;
+    }
+
+    if (filter.m_types.empty()) {
+        return true;
+    }
+
+    for (uint32_t type : filter.m_types) {
+        if (index.m_types[position] == type) {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+std::vector<uint32_t> filter(const soa_index_t& index,
+                             const soa_filter_t& filter) {
+    std::vector<uint32_t> matches;
+
+    size_t count = index.size();
+    size_t i = 0;
+
+#ifdef S4PKG_SOAINDEX_SSE2
+    // Compare four entries at a time. Every requested type is broadcast into
+    // its own register once, the comparison results are OR-ed together, then
+    // AND-ed with the group comparison. The resulting lane mask tells us which
+    // of the four entries matched.
+    struct broadcast_t {
+        __m128i m_value;
+    };
+
+    std::vector<broadcast_t> typeVectors;
+    typeVectors.reserve(filter.m_types.size());
+
+    for (uint32_t type : filter.m_types) {
+        typeVectors.push_back({_mm_set1_epi32((int32_t)type)});
+    }
+
+    const __m128i groupVector = _mm_set1_epi32((int32_t)filter.m_group);
+    const __m128i allSet = _mm_set1_epi32(-1);
+
+    const uint32_t* types = index.m_types.data();
+    const uint32_t* groups = index.m_groups.data();
+
+    for (; i + 4 <= count; i += 4) {
+        __m128i match = allSet;
+
+        if (!typeVectors.empty()) {
+            __m128i typeValues = _mm_loadu_si128((const __m128i*)(types + i));
+
+            match = _mm_setzero_si128();
+            for (const auto& typeVector : typeVectors) {
+                match = _mm_or_si128(
+                    match, _mm_cmpeq_epi32(typeValues, typeVector.m_value));
+            }
+        }
+
+        if (filter.m_matchGroup) {
+            __m128i groupValues =
+                _mm_loadu_si128((const __m128i*)(groups + i));
+            match =
+                _mm_and_si128(match, _mm_cmpeq_epi32(groupValues, groupVector));
+        }
+
+        int mask = _mm_movemask_ps(_mm_castsi128_ps(match));
+        for (int lane = 0; mask != 0; lane++, mask >>= 1) {
+            if ((mask & 1) != 0) {
+                matches.push_back((uint32_t)(i + lane));
+            }
+        }
+    }
+#endif
+
+    // Whatever is left (or everything, without SSE2)
+    for (; i < count; i++) {
+        if (matchesScalar(index, filter, i)) {
+            matches.push_back((uint32_t)i);
+        }
+    }
+
+    return matches;
+}
+
+}  // namespace s4pkg::internal::soaindex
@@ -0,0 +1,264 @@
+/*
+ * Copyright (c) 2022- Gerber Lóránt Viktor
+ * Author: Gerber Lóránt Viktor <glorantv@student.elte.hu>
+ *
+ * This file is part of s4pkg.
+ *
+ * s4pkg is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <s4pkg/internal/sockets.h>
+
+#include <s4pkg/packageexception.h>
+
+#include <algorithm>
+#include <cstring>
+
+#include <fmt/core.h>
+
+#if defined(__unix__) || defined(__APPLE__)
+#define S4PKG_SOCKETS_UNIX
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+#include <sys/un.h>
+#include <unistd.h>
+#endif
+
+#if defined(__linux__)
+#define S4PKG_SOCKETS_SENDFILE
+#include <sys/sendfile.h>
+#endif
+
+namespace s4pkg::internal::sockets {
+
+#ifdef S4PKG_SOCKETS_UNIX
+#ifdef MSG_NOSIGNAL
+static constexpr int g_sendFlags = MSG_NOSIGNAL;
+#else
+static constexpr int g_sendFlags = 0;
+#endif
+
+static sockaddr_un addressOf(const std::string& path) {
+    sockaddr_un address{};
+    address.sun_family = AF_UNIX;
+
+    if (path.size() >= sizeof(address.sun_path)) {
+        throw PackageException(
+            fmt::format("Socket path is too long: {}", path));
+    }
+
+    memcpy(address.sun_path, path.c_str(), path.size() + 1);
+    return address;
+}
+
+static int createSocket() {
+    int descriptor = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (descriptor < 0) {
+        throw PackageException(
+            fmt::format("Failed to create socket: {}", strerror(errno)));
+    }
+
+    fcntl(descriptor, F_SETFD, FD_CLOEXEC);
+    return descriptor;
+}
+#endif
+
+int listenAt(const std::string& path) {
+#ifdef S4PKG_SOCKETS_UNIX
+    sockaddr_un address = addressOf(path);
+
+    // A socket file nobody listens at is left over from a process that died
+    int probe = createSocket();
+    bool listening =
+        connect(probe, (const sockaddr*)&address, sizeof(address)) == 0;
+    close(probe);
+
+    if (listening) {
+        throw PackageException(
+            fmt::format("Another process is listening at {}", path));
+    }
+
+    struct stat status {};
+    if (lstat(path.c_str(), &status) == 0) {
+        if (!S_ISSOCK(status.st_mode)) {
+            throw PackageException(
+                fmt::format("{} exists and isn't a socket", path));
+        }
+
+        unlink(path.c_str());
+    }
+
+    int descriptor = createSocket();
+    if (bind(descriptor, (const sockaddr*)&address, sizeof(address)) != 0 ||
+        listen(descriptor, SOMAXCONN) != 0) {
+        std::string error = strerror(errno);
+        close(descriptor);
+
+        throw PackageException(
+            fmt::format("Failed to listen at {}: {}", path, error));
+    }
+
+    return descriptor;
+#else
+    throw PackageException("Unix domain sockets aren't supported");
+#endif
+}
+
+int connectTo(const std::string& path) {
+#ifdef S4PKG_SOCKETS_UNIX
+    sockaddr_un address = addressOf(path);
+
+    int descriptor = createSocket();
+    if (connect(descriptor, (const sockaddr*)&address, sizeof(address)) != 0) {
+        std::string error = strerror(errno);
+        close(descriptor);
+
+        throw PackageException(
+            fmt::format("Failed to connect to {}: {}", path, error));
+    }
+
+    return descriptor;
+#else
+    throw PackageException("Unix domain sockets aren't supported");
+#endif
+}
+
+void closeSocket(int descriptor) {
+#ifdef S4PKG_SOCKETS_UNIX
+    if (descriptor >= 0) {
+        close(descriptor);
+    }
+#endif
+}
+
+void setReceiveTimeout(int descriptor, uint32_t milliseconds) {
+#ifdef S4PKG_SOCKETS_UNIX
+    timeval timeout{};
+    timeout.tv_sec = milliseconds / 1000;
+    timeout.tv_usec = (milliseconds % 1000) * 1000;
+
+    if (setsockopt(descriptor, SOL_SOCKET, SO_RCVTIMEO, &timeout,
+                   sizeof(timeout)) != 0) {
+        throw PackageException(fmt::format("Failed to set receive timeout: {}",
+                                           strerror(errno)));
+    }
+#else
+    throw PackageException("Unix domain sockets aren't supported");
+#endif
+}
+
+void sendAll(int descriptor, const void* buffer, size_t size) {
+#ifdef S4PKG_SOCKETS_UNIX
+    const char* bytes = (const char*)buffer;
+
+    while (size > 0) {
+        ssize_t sent = send(descriptor, bytes, size, g_sendFlags);
+        if (sent < 0 && errno == EINTR) {
+            continue;
+        }
+
+        if (sent <= 0) {
+            throw PackageException(
+                fmt::format("Failed to send: {}", strerror(errno)));
+        }
+
+        bytes += sent;
+        size -= (size_t)sent;
+    }
+#else
+    throw PackageException("Unix domain sockets aren't supported");
+#endif
+}
+
+bool receiveAll(int descriptor, void* buffer, size_t size) {
+#ifdef S4PKG_SOCKETS_UNIX
+    char* bytes = (char*)buffer;
+    size_t received = 0;
+
+    while (received < size) {
+        ssize_t count = recv(descriptor, bytes + received, size - received, 0);
+        if (count < 0 && errno == EINTR) {
+            continue;
+        }
+
+        if (count == 0 && received == 0) {
+            return false;
+        }
+
+        if (count <= 0) {
+            throw PackageException(
+                count == 0 ? std::string("Connection closed halfway")
+                           : fmt::format("Failed to receive: {}",
+                                         strerror(errno)));
+        }
+
+        received += (size_t)count;
+    }
+
+    return true;
+#else
+    throw PackageException("Unix domain sockets aren't supported");
+#endif
+}
+
+void sendFileRange(int descriptor,
+                   int fileDescriptor,
+                   uint64_t offset,
+                   uint64_t size) {
+#if defined(S4PKG_SOCKETS_SENDFILE)
+    off_t position = (off_t)offset;
+
+    while (size > 0) {
+        ssize_t sent = sendfile(descriptor, fileDescriptor, &position, size);
+        if (sent < 0 && (errno == EINTR || errno == EAGAIN)) {
+            continue;
+        }
+
+        if (sent <= 0) {
+            throw PackageException(
+                sent == 0 ? std::string("File ended before the record did")
+                          : fmt::format("Failed to send file: {}",
+                                        strerror(errno)));
+        }
+
+        size -= (uint64_t)sent;
+    }
+#elif defined(S4PKG_SOCKETS_UNIX)
+    char buffer[64 * 1024];
+
+    while (size > 0) {
+        ssize_t count = pread(fileDescriptor, buffer,
+                              (size_t)std::min<uint64_t>(size, sizeof(buffer)),
+                              (off_t)offset);
+        if (count < 0 && errno == EINTR) {
+            continue;
+        }
+
+        if (count <= 0) {
+            throw PackageException("File ended before the record did");
+        }
+
+        sendAll(descriptor, buffer, (size_t)count);
+        offset += (uint64_t)count;
+        size -= (uint64_t)count;
+    }
+#else
+    throw PackageException("Unix domain sockets aren't supported");
+#endif
+}
+
+}  // namespace s4pkg::internal::sockets
@@ -20,8 +20,13 @@
 
 #include <s4pkg/internal/streams.h>
 
+#include <s4pkg/internal/binarycursor.h>
+#include <s4pkg/internal/layout.h>
 #include <s4pkg/packageexception.h>
 
+#include <algorithm>
+#include <cstring>
+
 #include <fmt/core.h>
 #include <fmt/printf.h>
 
@@ -29,77 +34,69 @@
 
 namespace s4pkg::internal::streams {
 
-void readBytes(std::istream& stream, uint8_t* buffer, int size) {
-    for (int i = 0; i < size; i++) {
-        stream.read((char*)(buffer + i), 1);
+static constexpr uint64_t g_maxIndexEntrySize = 32;
 
-        if (!stream.good()) {
-            throw PackageException(fmt::format(
-                "Unexpected end of stream! Tried reading {} bytes.", size));
-        }
-    }
+void readBytes(ByteSource& source, uint8_t* buffer, uint64_t size) {
+    source.read(buffer, size);
 }
 
-void readUint8(std::istream& stream, uint8_t& value) {
-    uint8_t temp;
-    stream.read((char*)&temp, 1);
-
-    if (!stream.good()) {
-        throw PackageException(
-            "Unexpected end of stream! Tried reading 1 uint8_t.");
-    }
-
-    value = temp;
+void readUint8(ByteSource& source, uint8_t& value) {
+    source.read(&value, 1);
 }
 
-void readUint32(std::istream& stream, uint32_t& value) {
+void readUint32(ByteSource& source, uint32_t& value) {
     uint8_t buffer[4];
-    readBytes(stream, buffer, 4);
+    readBytes(source, buffer, 4);
 
     value = ((uint32_t)buffer[3] << 24 | (uint32_t)buffer[2] << 16 |
              (uint32_t)buffer[1] << 8 | (uint32_t)buffer[0]);
 }
 
-void readInt32(std::istream& stream, int32_t& value) {
+void readInt32(ByteSource& source, int32_t& value) {
     uint32_t temp;
-    readUint32(stream, temp);
+    readUint32(source, temp);
 
     value = (int32_t)temp;
 }
 
-void readUint64(std::istream& stream, uint64_t& value) {
+void readUint64(ByteSource& source, uint64_t& value) {
     uint8_t buffer[8];
-    readBytes(stream, buffer, 8);
+    readBytes(source, buffer, 8);
     value = ((uint64_t)buffer[7] << 56 | (uint64_t)buffer[6] << 48 |
              (uint64_t)buffer[5] << 40 | (uint64_t)buffer[4] << 32 |
              (uint64_t)buffer[3] << 24 | (uint64_t)buffer[2] << 16 |
              (uint64_t)buffer[1] << 8 | (uint64_t)buffer[0]);
 }
 
-void readUint16(std::istream& stream, uint16_t& value) {
+void readUint16(ByteSource& source, uint16_t& value) {
     uint8_t buffer[2];
-    readBytes(stream, buffer, 2);
+    readBytes(source, buffer, 2);
 
     value = ((uint16_t)buffer[1] << 8 | (uint16_t)buffer[0]);
 }
 
-void readUint32Array(std::istream& stream, uint32_t* buffer, int size) {
+void readUint32Array(ByteSource& source, uint32_t* buffer, int size) {
     for (int i = 0; i < size; i++) {
-        readUint32(stream, buffer[i]);
+        readUint32(source, buffer[i]);
     }
 }
 
-void readPackageTime(std::istream& stream, package_time_t& value) {
-    readInt32(stream, value);
+void readPackageTime(ByteSource& source, package_time_t& value) {
+    readInt32(source, value);
 }
 
-void readPackageVersion(std::istream& stream, package_version_t& value) {
-    readUint32(stream, value.m_major);
-    readUint32(stream, value.m_minor);
+void readPackageVersion(ByteSource& source, package_version_t& value) {
+    readUint32(source, value.m_major);
+    readUint32(source, value.m_minor);
 }
 
-void readPackageHeader(std::istream& stream, package_header_t& value) {
-    readBytes(stream, value.m_fileIdentifier, 4);
+void readPackageHeader(ByteSource& source, package_header_t& value) {
+    // One read for the whole header, the fields are parsed from memory
+    uint8_t buffer[layout::encodedSize<package_header_t>()];
+    readBytes(source, buffer, sizeof(buffer));
+
+    BinaryCursor header(buffer, sizeof(buffer));
+    layout::read(header, value);
 
     uint8_t expectedIdentifier[] = {'D', 'B', 'P', 'F'};
 
@@ -108,33 +105,25 @@ void readPackageHeader(std::istream& stream, package_header_t& value) {
             throw PackageException("Invalid file identifier!");
         }
     }
+}
 
-    readPackageVersion(stream, value.m_fileVersion);
-    readPackageVersion(stream, value.m_userVersion);
-
-    readUint32(stream, value.m_unused1);
-
-    readPackageTime(stream, value.m_creationTime);
-    readPackageTime(stream, value.m_updatedTime);
-
-    readUint32(stream, value.m_unused2);
-
-    readUint32(stream, value.m_indexRecordEntryCount);
-    readUint32(stream, value.m_indexRecordPositionLow);
-    readUint32(stream, value.m_indexRecordSize);
-
-    readUint32Array(stream, value.m_unused3, 3);
-    readUint32(stream, value.m_unused4);
+bool hasPackageIdentifier(ByteSource& source) {
+    uint8_t identifier[4];
 
-    readUint64(stream, value.m_indexRecordPosition);
+    try {
+        source.read(identifier, 4);
+    } catch (PackageException) {
+        return false;
+    }
 
-    readUint32Array(stream, value.m_unused5, 6);
+    return identifier[0] == 'D' && identifier[1] == 'B' &&
+           identifier[2] == 'P' && identifier[3] == 'F';
 }
 
-void readPackageFlags(std::istream& stream, flags_t& value) {
+void readPackageFlags(ByteSource& source, flags_t& value) {
     uint32_t bitField;
 
-    readUint32(stream, bitField);
+    readUint32(source, bitField);
 
     uint32_t constantType = bitField & 1;
     uint32_t constantGroup = bitField >> 1 & 1;
@@ -147,54 +136,244 @@ void readPackageFlags(std::istream& stream, flags_t& value) {
     value.m_reserved = reserved;
 }
 
-void readIndexEntry(std::istream& stream,
+void readIndexEntry(ByteSource& source,
                     const flags_t& flags,
                     index_entry_t& value) {
     if (flags.m_constantType == 0) {
-        readUint32(stream, value.m_type);
+        readUint32(source, value.m_type);
     }
 
     if (flags.m_constantGroup == 0) {
-        readUint32(stream, value.m_group);
+        readUint32(source, value.m_group);
     }
 
     if (flags.m_constantInstanceEx == 0) {
-        readUint32(stream, value.m_instanceEx);
+        readUint32(source, value.m_instanceEx);
     }
 
-    readUint32(stream, value.m_instance);
-    readUint32(stream, value.m_position);
+    readUint32(source, value.m_instance);
+    readUint32(source, value.m_position);
 
     uint32_t sizeCompressionBitField;
-    readUint32(stream, sizeCompressionBitField);
+    readUint32(source, sizeCompressionBitField);
 
     value.m_size = (sizeCompressionBitField << 1) >> 1;
     value.m_extendedCompressionType = sizeCompressionBitField >> 31;
 
-    readUint32(stream, value.m_sizeDecompressed);
+    readUint32(source, value.m_sizeDecompressed);
 
     if (value.m_extendedCompressionType > 0) {
         uint16_t compressionType;
-        readUint16(stream, compressionType);
+        readUint16(source, compressionType);
         value.m_compressionType = (compression_type_t)compressionType;
 
-        readUint16(stream, value.m_committed);
+        readUint16(source, value.m_committed);
     }
 }
 
-void readIndex(std::istream& stream,
+void readIndexEntry(BinaryCursor& cursor,
+                    const flags_t& flags,
+                    index_entry_t& value) {
+    if (flags.m_constantType == 0) {
+        value.m_type = cursor.readLE<uint32_t>();
+    }
+
+    if (flags.m_constantGroup == 0) {
+        value.m_group = cursor.readLE<uint32_t>();
+    }
+
+    if (flags.m_constantInstanceEx == 0) {
+        value.m_instanceEx = cursor.readLE<uint32_t>();
+    }
+
+    uint32_t sizeCompressionBitField;
+    cursor.read(value.m_instance, value.m_position, sizeCompressionBitField,
+                value.m_sizeDecompressed);
+
+    value.m_size = (sizeCompressionBitField << 1) >> 1;
+    value.m_extendedCompressionType = sizeCompressionBitField >> 31;
+
+    if (value.m_extendedCompressionType > 0) {
+        cursor.read(value.m_compressionType, value.m_committed);
+    }
+}
+
+void readIndex(ByteSource& source,
                const flags_t& flags,
                uint32_t indexRecordCount,
                index_t& value) {
+    // The bytes the entries can take up are parsed from memory, read at once
+    // unless the source is in memory already (entries with extended
+    // compression are the longest)
+    uint64_t position = source.tell();
+    uint64_t size = source.getSize();
+    uint64_t available = position < size ? size - position : 0;
+
+    uint64_t entrySize =
+        g_maxIndexEntrySize - 4 * (flags.m_constantType +
+                                   flags.m_constantGroup +
+                                   flags.m_constantInstanceEx);
+    uint64_t regionSize =
+        std::min((uint64_t)indexRecordCount * entrySize, available);
+
+    lib::ByteBuffer region;
+    const uint8_t* bytes = source.getData();
+
+    if (bytes != nullptr) {
+        bytes += std::min(position, size);
+    } else {
+        region = lib::ByteBuffer(regionSize);
+        source.readAt(position, region.data(), regionSize);
+        bytes = region.data();
+    }
+
+    BinaryCursor cursor(bytes, regionSize);
+
     for (uint32_t i = 0; i < indexRecordCount; i++) {
         index_entry_t indexEntry{};
 
-        readIndexEntry(stream, flags, indexEntry);
+        readIndexEntry(cursor, flags, indexEntry);
         value.m_entries.push_back(indexEntry);
     }
+
+    source.seek(position + cursor.position());
 }
 
-void readRecord(std::istream& stream,
+void readPackageTable(ByteSource& source, package_table_t& value) {
+    try {
+        readPackageHeader(source, value.m_header);
+    } catch (PackageException e) {
+        throw PackageException(fmt::format(
+            "Exception while reading package header: {}", e.what()));
+    }
+
+    uint64_t indexPosition;
+    if (value.m_header.m_indexRecordPosition != 0) {
+        indexPosition = value.m_header.m_indexRecordPosition;
+    } else {
+        indexPosition = value.m_header.m_indexRecordPositionLow;
+    }
+
+    source.seek(indexPosition);
+
+    value.m_constantType = 0;
+    value.m_constantGroup = 0;
+    value.m_constantInstanceEx = 0;
+
+    try {
+        readPackageFlags(source, value.m_flags);
+
+        if (value.m_flags.m_constantType != 0) {
+            readUint32(source, value.m_constantType);
+        }
+
+        if (value.m_flags.m_constantGroup != 0) {
+            readUint32(source, value.m_constantGroup);
+        }
+
+        if (value.m_flags.m_constantInstanceEx != 0) {
+            readUint32(source, value.m_constantInstanceEx);
+        }
+    } catch (PackageException e) {
+        throw PackageException(
+            fmt::format("Exception while reading package flags: {}", e.what()));
+    }
+
+    try {
+        readIndex(source, value.m_flags,
+                  value.m_header.m_indexRecordEntryCount, value.m_index);
+    } catch (PackageException e) {
+        throw PackageException(
+            fmt::format("Exception while reading package index: {}", e.what()));
+    }
+}
+
+void readRawRecord(const ByteSource& source,
+                   const index_entry_t& indexEntry,
+                   lib::ByteBuffer& value) {
+    value = lib::ByteBuffer(indexEntry.m_size);
+
+    if (indexEntry.m_size == 0) {
+        return;
+    }
+
+    source.readAt(indexEntry.m_position, value.data(), indexEntry.m_size);
+}
+
+void decompressRecord(const index_entry_t& indexEntry,
+                      const lib::ByteBuffer& compressedBuffer,
+                      lib::ByteBuffer& value) {
+    if (indexEntry.m_compressionType == compression_type_t::DELETED) {
+        throw PackageException("Unimplemented compression type: DELETED");
+    } else if (indexEntry.m_compressionType == compression_type_t::INTERNAL) {
+        throw PackageException("Unimplemented compression type: INTERNAL");
+    } else if (indexEntry.m_compressionType ==
+               compression_type_t::STREAMABLE) {
+        throw PackageException("Unimplemented compression type: STREAMABLE");
+    } else if (indexEntry.m_compressionType == compression_type_t::ZLIB) {
+        mz_stream zInflateStream;
+        zInflateStream.zalloc = nullptr;
+        zInflateStream.zfree = nullptr;
+        zInflateStream.opaque = nullptr;
+
+        zInflateStream.avail_in = (unsigned int)compressedBuffer.size();
+        zInflateStream.next_in = compressedBuffer.data();
+
+        lib::ByteBuffer buffer(indexEntry.m_sizeDecompressed);
+
+        zInflateStream.avail_out = (unsigned int)indexEntry.m_sizeDecompressed;
+        zInflateStream.next_out = buffer.data();
+
+        mz_inflateInit(&zInflateStream);
+
+        int inflateResult = mz_inflate(&zInflateStream, MZ_NO_FLUSH);
+        if (inflateResult != MZ_OK && inflateResult != MZ_STREAM_END) {
+            std::string errorName;
+            switch (inflateResult) {
+                case MZ_OK:
+                    errorName = "MZ_OK";
+                    break;
+
+                case MZ_STREAM_END:
+                    errorName = "MZ_STREAM_END";
+                    break;
+
+                case MZ_STREAM_ERROR:
+                    errorName = "MZ_STREAM_ERROR";
+                    break;
+
+                case MZ_DATA_ERROR:
+                    errorName = "MZ_DATA_ERROR";
+                    break;
+
+                case MZ_PARAM_ERROR:
+                    errorName = "MZ_PARAM_ERROR";
+                    break;
+
+                case MZ_BUF_ERROR:
+                    errorName = "MZ_BUF_ERROR";
+                    break;
+
+                default:
+                    errorName = "?";
+            }
+
+            mz_inflateEnd(&zInflateStream);
+
+            throw PackageException(
+                fmt::format("Failed to decompress resource {}, result is {}",
+                            indexEntry.m_instance, errorName));
+        }
+
+        mz_inflateEnd(&zInflateStream);
+
+        value = std::move(buffer);
+    } else {
+        value = compressedBuffer;
+    }
+}
+
+void readRecord(const ByteSource& source,
                 const index_t& packageIndex,
                 uint32_t index,
                 raw_record_t& value) {
@@ -211,120 +390,138 @@ void readRecord(std::istream& stream,
     value.m_index = index;
     value.m_size = indexEntry.m_size;
 
-    stream.seekg(indexEntry.m_position);
     if (indexEntry.m_size > 0) {
-        lib::ByteBuffer compressedBuffer(indexEntry.m_size);
+        lib::ByteBuffer compressedBuffer;
+        readRawRecord(source, indexEntry, compressedBuffer);
 
-        uint8_t byte;
-        for (uint32_t i = 0; i < indexEntry.m_size; i++) {
-            readUint8(stream, byte);
-            compressedBuffer[i] = byte;
-        }
+        decompressRecord(indexEntry, compressedBuffer, value.m_data);
+    }
+}
 
-        if (indexEntry.m_compressionType == compression_type_t::DELETED) {
-            throw PackageException("Unimplemented compression type: DELETED");
-        } else if (indexEntry.m_compressionType ==
-                   compression_type_t::INTERNAL) {
-            throw PackageException("Unimplemented compression type: INTERNAL");
-        } else if (indexEntry.m_compressionType ==
-                   compression_type_t::STREAMABLE) {
-            throw PackageException(
-                "Unimplemented compression type: STREAMABLE");
-        } else if (indexEntry.m_compressionType == compression_type_t::ZLIB) {
-            mz_stream zInflateStream;
-            zInflateStream.zalloc = nullptr;
-            zInflateStream.zfree = nullptr;
-            zInflateStream.opaque = nullptr;
+void readRecords(const ByteSource& source,
+                 const index_t& index,
+                 records_t& value) {
+    for (uint32_t i = 0; i < index.m_entries.size(); i++) {
+        raw_record_t record{};
+        readRecord(source, index, i, record);
 
-            zInflateStream.avail_in = (unsigned int)indexEntry.m_size;
-            zInflateStream.next_in = compressedBuffer.data();
+        value.m_records.push_back(record);
+    }
+}
 
-            lib::ByteBuffer buffer(indexEntry.m_sizeDecompressed);
+void readBytes(std::istream& stream, uint8_t* buffer, int size) {
+    StreamByteSource source(stream);
+    readBytes(source, buffer, (uint64_t)std::max(size, 0));
+}
 
-            zInflateStream.avail_out =
-                (unsigned int)indexEntry.m_sizeDecompressed;
-            zInflateStream.next_out = buffer.data();
+void readUint8(std::istream& stream, uint8_t& value) {
+    StreamByteSource source(stream);
+    readUint8(source, value);
+}
 
-            mz_inflateInit(&zInflateStream);
+void readUint32(std::istream& stream, uint32_t& value) {
+    StreamByteSource source(stream);
+    readUint32(source, value);
+}
 
-            int inflateResult = mz_inflate(&zInflateStream, MZ_NO_FLUSH);
-            if (inflateResult != MZ_OK && inflateResult != MZ_STREAM_END) {
-                std::string errorName;
-                switch (inflateResult) {
-                    case MZ_OK:
-                        errorName = "MZ_OK";
-                        break;
+void readInt32(std::istream& stream, int32_t& value) {
+    StreamByteSource source(stream);
+    readInt32(source, value);
+}
 
-                    case MZ_STREAM_END:
-                        errorName = "MZ_STREAM_END";
-                        break;
+void readUint64(std::istream& stream, uint64_t& value) {
+    StreamByteSource source(stream);
+    readUint64(source, value);
+}
 
-                    case MZ_STREAM_ERROR:
-                        errorName = "MZ_STREAM_ERROR";
-                        break;
+void readUint16(std::istream& stream, uint16_t& value) {
+    StreamByteSource source(stream);
+    readUint16(source, value);
+}
 
-                    case MZ_DATA_ERROR:
-                        errorName = "MZ_DATA_ERROR";
-                        break;
+void readUint32Array(std::istream& stream, uint32_t* buffer, int size) {
+    StreamByteSource source(stream);
+    readUint32Array(source, buffer, size);
+}
 
-                    case MZ_PARAM_ERROR:
-                        errorName = "MZ_PARAM_ERROR";
-                        break;
+void readPackageTime(std::istream& stream, package_time_t& value) {
+    StreamByteSource source(stream);
+    readPackageTime(source, value);
+}
 
-                    case MZ_BUF_ERROR:
-                        errorName = "MZ_BUF_ERROR";
-                        break;
+void readPackageVersion(std::istream& stream, package_version_t& value) {
+    StreamByteSource source(stream);
+    readPackageVersion(source, value);
+}
 
-                    default:
-                        errorName = "?";
-                }
+void readPackageHeader(std::istream& stream, package_header_t& value) {
+    StreamByteSource source(stream);
+    readPackageHeader(source, value);
+}
 
-                throw PackageException(fmt::format(
-                    "Failed to decompress resource {}, result is {}",
-                    indexEntry.m_instance, errorName));
-            }
+bool hasPackageIdentifier(std::istream& stream) {
+    StreamByteSource source(stream);
+    return hasPackageIdentifier(source);
+}
 
-            mz_inflateEnd(&zInflateStream);
+void readPackageFlags(std::istream& stream, flags_t& value) {
+    StreamByteSource source(stream);
+    readPackageFlags(source, value);
+}
 
-            value.m_data = buffer;
-        } else {
-            value.m_data = compressedBuffer;
-        }
-    }
+void readIndexEntry(std::istream& stream,
+                    const flags_t& flags,
+                    index_entry_t& value) {
+    StreamByteSource source(stream);
+    readIndexEntry(source, flags, value);
 }
 
-void readRecords(std::istream& stream, const index_t& index, records_t& value) {
-    for (uint32_t i = 0; i < index.m_entries.size(); i++) {
-        raw_record_t record{};
-        readRecord(stream, index, i, record);
+void readIndex(std::istream& stream,
+               const flags_t& flags,
+               uint32_t indexRecordCount,
+               index_t& value) {
+    StreamByteSource source(stream);
+    readIndex(source, flags, indexRecordCount, value);
+}
 
-        value.m_records.push_back(record);
-    }
+void readPackageTable(std::istream& stream, package_table_t& value) {
+    StreamByteSource source(stream);
+    readPackageTable(source, value);
 }
 
-void writeBytes(std::ostream& stream, const uint8_t* buffer, int size) {
-    if (!stream.good()) {
-        throw PackageException(fmt::format(
-            "Unexpected stream failure! Tried writing {} bytes.", size));
-    }
+void readRawRecord(std::istream& stream,
+                   const index_entry_t& indexEntry,
+                   lib::ByteBuffer& value) {
+    StreamByteSource source(stream);
+    readRawRecord(source, indexEntry, value);
+}
 
+void readRecord(std::istream& stream,
+                const index_t& packageIndex,
+                uint32_t index,
+                raw_record_t& value) {
+    StreamByteSource source(stream);
+    readRecord(source, packageIndex, index, value);
+}
+
+void readRecords(std::istream& stream, const index_t& index, records_t& value) {
+    StreamByteSource source(stream);
+    readRecords(source, index, value);
+}
+
+void writeBytes(ByteSink& sink, const uint8_t* buffer, uint64_t size) {
     if (buffer == nullptr && size > 0) {
         throw PackageException("Buffer to be written is nullptr!");
     }
 
-    stream.write((const char*)buffer, size);
+    sink.write(buffer, size);
 }
 
-void writeUint8(std::ostream& stream, const uint8_t& value) {
-    if (!stream.good()) {
-        throw PackageException(
-            "Unexpected stream failure! Tried writing 1 uint8_t.");
-    }
-
-    stream.write((const char*)&value, 1);
+void writeUint8(ByteSink& sink, const uint8_t& value) {
+    sink.write(&value, 1);
 }
 
-void writeUint32(std::ostream& stream, const uint32_t& value) {
+void writeUint32(ByteSink& sink, const uint32_t& value) {
     uint8_t buffer[4];
 
     buffer[3] = (value >> 24) & 0xFF;
@@ -332,15 +529,15 @@ void writeUint32(std::ostream& stream, const uint32_t& value) {
     buffer[1] = (value >> 8) & 0xFF;
     buffer[0] = value & 0xFF;
 
-    writeBytes(stream, buffer, 4);
+    writeBytes(sink, buffer, 4);
 }
 
-void writeInt32(std::ostream& stream, const int32_t& value) {
+void writeInt32(ByteSink& sink, const int32_t& value) {
     uint32_t temp = (uint32_t)value;
-    writeUint32(stream, temp);
+    writeUint32(sink, temp);
 }
 
-void writeUint64(std::ostream& stream, const uint64_t& value) {
+void writeUint64(ByteSink& sink, const uint64_t& value) {
     uint8_t buffer[8];
 
     buffer[7] = (value >> 56) & 0xFF;
@@ -352,60 +549,45 @@ void writeUint64(std::ostream& stream, const uint64_t& value) {
     buffer[1] = (value >> 8) & 0xFF;
     buffer[0] = value & 0xFF;
 
-    writeBytes(stream, buffer, 8);
+    writeBytes(sink, buffer, 8);
 }
 
-void writeUint16(std::ostream& stream, const uint16_t& value) {
+void writeUint16(ByteSink& sink, const uint16_t& value) {
     uint8_t buffer[2];
 
     buffer[1] = (value >> 8) & 0xFF;
     buffer[0] = value & 0xFF;
 
-    writeBytes(stream, buffer, 2);
+    writeBytes(sink, buffer, 2);
 }
 
-void writeUint32Array(std::ostream& stream, const uint32_t* array, int size) {
+void writeUint32Array(ByteSink& sink, const uint32_t* array, int size) {
     for (int i = 0; i < size; i++) {
-        writeUint32(stream, array[i]);
+        writeUint32(sink, array[i]);
     }
 }
 
-void writePackageTime(std::ostream& stream, const package_time_t& value) {
-    writeInt32(stream, value);
+void writePackageTime(ByteSink& sink, const package_time_t& value) {
+    writeInt32(sink, value);
 }
 
-void writePackageVersion(std::ostream& stream, const package_version_t& value) {
-    writeUint32(stream, value.m_major);
-    writeUint32(stream, value.m_minor);
+void writePackageVersion(ByteSink& sink, const package_version_t& value) {
+    writeUint32(sink, value.m_major);
+    writeUint32(sink, value.m_minor);
 }
 
-void writePackageHeader(std::ostream& stream, const package_header_t& value) {
-    uint8_t expectedIdentifier[] = {'D', 'B', 'P', 'F'};
-    writeBytes(stream, expectedIdentifier, 4);
-
-    writePackageVersion(stream, value.m_fileVersion);
-    writePackageVersion(stream, value.m_userVersion);
-
-    writeUint32(stream, value.m_unused1);
+void writePackageHeader(ByteSink& sink, const package_header_t& value) {
+    uint8_t buffer[layout::encodedSize<package_header_t>()];
+    layout::write(buffer, value);
 
-    writePackageTime(stream, value.m_creationTime);
-    writePackageTime(stream, value.m_updatedTime);
-
-    writeUint32(stream, value.m_unused2);
-
-    writeUint32(stream, value.m_indexRecordEntryCount);
-    writeUint32(stream, value.m_indexRecordPositionLow);
-    writeUint32(stream, value.m_indexRecordSize);
-
-    writeUint32Array(stream, value.m_unused3, 3);
-    writeUint32(stream, value.m_unused4);
-
-    writeUint64(stream, value.m_indexRecordPosition);
+    // The identifier is always written, whatever the struct holds
+    uint8_t expectedIdentifier[] = {'D', 'B', 'P', 'F'};
+    memcpy(buffer, expectedIdentifier, 4);
 
-    writeUint32Array(stream, value.m_unused5, 6);
+    writeBytes(sink, buffer, sizeof(buffer));
 }
 
-void writePackageFlags(std::ostream& stream, const flags_t& value) {
+void writePackageFlags(ByteSink& sink, const flags_t& value) {
     uint32_t bitField = 0;
 
     bitField |= value.m_constantType & 1;
@@ -413,56 +595,56 @@ void writePackageFlags(std::ostream& stream, const flags_t& value) {
     bitField |= (value.m_constantInstanceEx & 1) << 2;
     bitField |= (value.m_reserved << 3) >> 3;
 
-    writeUint32(stream, bitField);
+    writeUint32(sink, bitField);
 }
 
-void writeIndexEntry(std::ostream& stream,
+void writeIndexEntry(ByteSink& sink,
                      const flags_t& flags,
                      const index_entry_t& value) {
     if (flags.m_constantType == 0) {
-        writeUint32(stream, value.m_type);
+        writeUint32(sink, value.m_type);
     }
 
     if (flags.m_constantGroup == 0) {
-        writeUint32(stream, value.m_group);
+        writeUint32(sink, value.m_group);
     }
 
     if (flags.m_constantInstanceEx == 0) {
-        writeUint32(stream, value.m_instanceEx);
+        writeUint32(sink, value.m_instanceEx);
     }
 
-    writeUint32(stream, value.m_instance);
-    writeUint32(stream, value.m_position);
+    writeUint32(sink, value.m_instance);
+    writeUint32(sink, value.m_position);
 
     uint32_t sizeCompressionBitField = 0;
     sizeCompressionBitField |= (value.m_extendedCompressionType & 1) << 31;
     sizeCompressionBitField |= (value.m_size << 1) >> 1;
 
-    writeUint32(stream, sizeCompressionBitField);
+    writeUint32(sink, sizeCompressionBitField);
 
-    writeUint32(stream, value.m_sizeDecompressed);
+    writeUint32(sink, value.m_sizeDecompressed);
     if (value.m_extendedCompressionType > 0) {
         uint16_t compressionType = value.m_compressionType;
-        writeUint16(stream, compressionType);
-        writeUint16(stream, value.m_committed);
+        writeUint16(sink, compressionType);
+        writeUint16(sink, value.m_committed);
     }
 }
 
-void writeIndex(std::ostream& stream,
+void writeIndex(ByteSink& sink,
                 const flags_t& flags,
                 const index_t& value) {
     for (int i = 0; i < value.m_entries.size(); i++) {
-        writeIndexEntry(stream, flags, value.m_entries[i]);
+        writeIndexEntry(sink, flags, value.m_entries[i]);
     }
 }
 
-void writeRecord(std::ostream& stream,
+void writeRecord(ByteSink& sink,
                  index_t& packageIndex,
                  uint32_t index,
                  const raw_record_t& value) {
     index_entry_t& associatedEntry = packageIndex.m_entries[value.m_index];
 
-    associatedEntry.m_position = (unsigned int)stream.tellp();
+    associatedEntry.m_position = (unsigned int)sink.tell();
 
     lib::ByteBuffer buffer(value.m_data.size());
     uint32_t actualSize = 0;
@@ -533,17 +715,124 @@ void writeRecord(std::ostream& stream,
         }
     }
 
-    writeBytes(stream, buffer.data(), actualSize);
+    writeBytes(sink, buffer.data(), actualSize);
 
     associatedEntry.m_size = actualSize;
     associatedEntry.m_sizeDecompressed = (uint32_t)buffer.size();
 }
 
-void writeRecords(std::ostream& stream,
+void writeRecords(ByteSink& sink,
                   index_t& index,
                   const records_t& value) {
     for (uint32_t i = 0; i < index.m_entries.size(); i++) {
-        writeRecord(stream, index, i, value.m_records[i]);
+        writeRecord(sink, index, i, value.m_records[i]);
+    }
+}
+
+void writeBytes(std::ostream& stream, const uint8_t* buffer, int size) {
+    StreamByteSink sink(stream);
+    writeBytes(sink, buffer, (uint64_t)std::max(size, 0));
+}
+
+void writeUint8(std::ostream& stream, const uint8_t& value) {
+    StreamByteSink sink(stream);
+    writeUint8(sink, value);
+}
+
+void writeUint32(std::ostream& stream, const uint32_t& value) {
+    StreamByteSink sink(stream);
+    writeUint32(sink, value);
+}
+
+void writeInt32(std::ostream& stream, const int32_t& value) {
+    StreamByteSink sink(stream);
+    writeInt32(sink, value);
+}
+
+void writeUint64(std::ostream& stream, const uint64_t& value) {
+    StreamByteSink sink(stream);
+    writeUint64(sink, value);
+}
+
+void writeUint16(std::ostream& stream, const uint16_t& value) {
+    StreamByteSink sink(stream);
+    writeUint16(sink, value);
+}
+
+void writeUint32Array(std::ostream& stream, const uint32_t* array, int size) {
+    StreamByteSink sink(stream);
+    writeUint32Array(sink, array, size);
+}
+
+void writePackageTime(std::ostream& stream, const package_time_t& value) {
+    StreamByteSink sink(stream);
+    writePackageTime(sink, value);
+}
+
+void writePackageVersion(std::ostream& stream, const package_version_t& value) {
+    StreamByteSink sink(stream);
+    writePackageVersion(sink, value);
+}
+
+void writePackageHeader(std::ostream& stream, const package_header_t& value) {
+    StreamByteSink sink(stream);
+    writePackageHeader(sink, value);
+}
+
+void writePackageFlags(std::ostream& stream, const flags_t& value) {
+    StreamByteSink sink(stream);
+    writePackageFlags(sink, value);
+}
+
+void writeIndexEntry(std::ostream& stream,
+                     const flags_t& flags,
+                     const index_entry_t& value) {
+    StreamByteSink sink(stream);
+    writeIndexEntry(sink, flags, value);
+}
+
+void writeIndex(std::ostream& stream,
+                const flags_t& flags,
+                const index_t& value) {
+    StreamByteSink sink(stream);
+    writeIndex(sink, flags, value);
+}
+
+void writeRecord(std::ostream& stream,
+                 index_t& packageIndex,
+                 uint32_t index,
+                 const raw_record_t& value) {
+    StreamByteSink sink(stream);
+    writeRecord(sink, packageIndex, index, value);
+}
+
+void writeRecords(std::ostream& stream,
+                  index_t& index,
+                  const records_t& value) {
+    StreamByteSink sink(stream);
+    writeRecords(sink, index, value);
+}
+
+void copyBytes(std::istream& input, std::ostream& output, uint64_t size) {
+    constexpr uint64_t chunkSize = 64 * 1024;
+    char buffer[chunkSize];
+
+    while (size > 0) {
+        uint64_t count = std::min(size, chunkSize);
+
+        input.read(buffer, count);
+        if (!input.good()) {
+            throw PackageException(fmt::format(
+                "Unexpected end of stream! Tried copying {} bytes.", count));
+        }
+
+        output.write(buffer, count);
+        if (!output.good()) {
+            throw PackageException(fmt::format(
+                "Unexpected stream failure! Tried writing {} bytes.", count));
+        }
+
+        size -= count;
     }
 }
 
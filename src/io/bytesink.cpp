@@ -0,0 +1,184 @@
+/*
+ * Copyright (c) 2022- Gerber Lóránt Viktor
+ * Author: Gerber Lóránt Viktor <glorantv@student.elte.hu>
+ *
+ * This file is part of s4pkg.
+ *
+ * s4pkg is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#include <s4pkg/io/bytesink.h>
+
+#include <s4pkg/packageexception.h>
+
+#include <cstring>
+#include <filesystem>
+
+#include <fmt/core.h>
+
+#if defined(__unix__) || defined(__APPLE__)
+#define S4PKG_BYTESINK_PWRITE
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+namespace s4pkg {
+
+namespace fs = std::filesystem;
+
+void ByteSink::write(const uint8_t* buffer, uint64_t size) {
+    this->writeAt(this->m_position, buffer, size);
+    this->m_position += size;
+}
+
+void ByteSink::seek(uint64_t position) {
+    this->m_position = position;
+}
+
+uint64_t ByteSink::tell() const {
+    return this->m_position;
+}
+
+FileByteSink::FileByteSink(const std::string& path)
+    : m_path(path), m_descriptor(-1) {
+#ifdef S4PKG_BYTESINK_PWRITE
+    this->m_descriptor =
+        open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (this->m_descriptor < 0) {
+        throw PackageException(
+            fmt::format("Failed to open {} for writing", path));
+    }
+#else
+    this->m_stream.open(fs::u8path(path), std::ios_base::binary);
+    if (!this->m_stream.good()) {
+        throw PackageException(
+            fmt::format("Failed to open {} for writing", path));
+    }
+#endif
+}
+
+FileByteSink::~FileByteSink() {
+#ifdef S4PKG_BYTESINK_PWRITE
+    if (this->m_descriptor >= 0) {
+        close(this->m_descriptor);
+    }
+#endif
+}
+
+void FileByteSink::writeAt(uint64_t offset,
+                           const uint8_t* buffer,
+                           uint64_t size) {
+#ifdef S4PKG_BYTESINK_PWRITE
+    uint64_t done = 0;
+    while (done < size) {
+        ssize_t count = pwrite(this->m_descriptor, buffer + done, size - done,
+                               (off_t)(offset + done));
+
+        if (count < 0 && errno == EINTR) {
+            continue;
+        }
+
+        if (count <= 0) {
+            throw PackageException(fmt::format("Failed to write {}: {}",
+                                               this->m_path, strerror(errno)));
+        }
+
+        done += (uint64_t)count;
+    }
+#else
+    this->m_stream.seekp((std::streamoff)offset);
+    this->m_stream.write((const char*)buffer, (std::streamsize)size);
+
+    if (!this->m_stream.good()) {
+        throw PackageException(
+            fmt::format("Failed to write {}", this->m_path));
+    }
+#endif
+}
+
+const lib::String FileByteSink::toString() const {
+    return fmt::format("FileByteSink [ path={}, pwrite={} ]", this->m_path,
+                       this->m_descriptor >= 0);
+}
+
+void MemoryByteSink::writeAt(uint64_t offset,
+                             const uint8_t* buffer,
+                             uint64_t size) {
+    if (offset + size > this->m_data.size()) {
+        this->m_data.resize(offset + size);
+    }
+
+    if (size > 0) {
+        memcpy(this->m_data.data() + offset, buffer, size);
+    }
+}
+
+lib::ByteBuffer MemoryByteSink::getBuffer() const {
+    return lib::ByteBuffer((uint8_t*)this->m_data.data(), this->m_data.size());
+}
+
+const lib::String MemoryByteSink::toString() const {
+    return fmt::format("MemoryByteSink [ size={} ]", this->m_data.size());
+}
+
+CallbackByteSink::CallbackByteSink(ByteSinkCallback callback)
+    : m_callback(std::move(callback)) {}
+
+void CallbackByteSink::writeAt(uint64_t offset,
+                               const uint8_t* buffer,
+                               uint64_t size) {
+    this->m_callback(offset, buffer, size);
+}
+
+const lib::String CallbackByteSink::toString() const {
+    return "CallbackByteSink [ ]";
+}
+
+void StreamByteSink::writeAt(uint64_t offset,
+                             const uint8_t* buffer,
+                             uint64_t size) {
+    this->m_stream.seekp((std::streamoff)offset);
+    this->write(buffer, size);
+}
+
+void StreamByteSink::write(const uint8_t* buffer, uint64_t size) {
+    if (!this->m_stream.good()) {
+        throw PackageException(fmt::format(
+            "Unexpected stream failure! Tried writing {} bytes.", size));
+    }
+
+    this->m_stream.write((const char*)buffer, (std::streamsize)size);
+
+    // A full disk only shows up once the write fails
+    if (!this->m_stream.good()) {
+        throw PackageException(fmt::format(
+            "Unexpected stream failure! Tried writing {} bytes.", size));
+    }
+}
+
+void StreamByteSink::seek(uint64_t position) {
+    this->m_stream.seekp((std::streamoff)position);
+}
+
+uint64_t StreamByteSink::tell() const {
+    return (uint64_t)this->m_stream.tellp();
+}
+
+const lib::String StreamByteSink::toString() const {
+    return "StreamByteSink [ ]";
+}
+
+}  // namespace s4pkg
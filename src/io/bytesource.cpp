@@ -0,0 +1,351 @@
+/*
+ * Copyright (c) 2022- Gerber Lóránt Viktor
+ * Author: Gerber Lóránt Viktor <glorantv@student.elte.hu>
+ *
+ * This file is part of s4pkg.
+ *
+ * s4pkg is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#include <s4pkg/io/bytesource.h>
+
+#include <s4pkg/packageexception.h>
+
+#include <algorithm>
+#include <cstring>
+#include <filesystem>
+
+#include <fmt/core.h>
+
+#if defined(__unix__) || defined(__APPLE__)
+#define S4PKG_BYTESOURCE_PREAD
+#define S4PKG_BYTESOURCE_MMAP
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace s4pkg {
+
+namespace fs = std::filesystem;
+
+void ByteSource::readAt(uint64_t offset, uint8_t* buffer, uint64_t size) const {
+    if (size == 0) {
+        return;
+    }
+
+    uint64_t count = this->readSome(offset, buffer, size);
+    if (count != size) {
+        throw PackageException(fmt::format(
+            "Unexpected end of stream! Tried reading {} bytes at {}.", size,
+            offset));
+    }
+}
+
+void ByteSource::read(uint8_t* buffer, uint64_t size) {
+    this->readAt(this->m_position, buffer, size);
+    this->m_position += size;
+}
+
+void ByteSource::seek(uint64_t position) {
+    this->m_position = position;
+}
+
+uint64_t ByteSource::tell() const {
+    return this->m_position;
+}
+
+FileByteSource::FileByteSource(const std::string& path)
+    : m_path(path), m_size(0), m_descriptor(-1) {
+#ifdef S4PKG_BYTESOURCE_PREAD
+    this->m_descriptor = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (this->m_descriptor < 0) {
+        throw PackageException(fmt::format("Failed to open file {}", path));
+    }
+
+    struct stat status;
+    if (fstat(this->m_descriptor, &status) != 0) {
+        close(this->m_descriptor);
+        throw PackageException(fmt::format("Failed to stat file {}", path));
+    }
+
+    this->m_size = (uint64_t)status.st_size;
+    this->m_identity = {(uint64_t)status.st_dev, (uint64_t)status.st_ino,
+                        this->m_size, (int64_t)status.st_mtime};
+#else
+    this->m_stream.open(fs::u8path(path), std::ios_base::binary);
+    if (!this->m_stream.good()) {
+        throw PackageException(fmt::format("Failed to open file {}", path));
+    }
+
+    this->m_stream.seekg(0, std::ios_base::end);
+    this->m_size = (uint64_t)this->m_stream.tellg();
+
+    std::error_code error;
+    fs::file_time_type modifiedTime =
+        fs::last_write_time(fs::u8path(path), error);
+    this->m_identity = {0, 0, this->m_size,
+                        (int64_t)modifiedTime.time_since_epoch().count()};
+#endif
+}
+
+FileByteSource::~FileByteSource() {
+#ifdef S4PKG_BYTESOURCE_PREAD
+    if (this->m_descriptor >= 0) {
+        close(this->m_descriptor);
+    }
+#endif
+}
+
+uint64_t FileByteSource::readSome(uint64_t offset,
+                                  uint8_t* buffer,
+                                  uint64_t size) const {
+    if (offset >= this->m_size) {
+        return 0;
+    }
+
+    size = std::min(size, this->m_size - offset);
+
+#ifdef S4PKG_BYTESOURCE_PREAD
+    uint64_t done = 0;
+    while (done < size) {
+        ssize_t count = pread(this->m_descriptor, buffer + done, size - done,
+                              (off_t)(offset + done));
+
+        if (count < 0 && errno == EINTR) {
+            continue;
+        }
+
+        if (count < 0) {
+            throw PackageException(fmt::format("Failed to read file {}: {}",
+                                               this->m_path, strerror(errno)));
+        }
+
+        if (count == 0) {
+            break;  // Truncated since it was opened
+        }
+
+        done += (uint64_t)count;
+    }
+
+    return done;
+#else
+    std::lock_guard<std::mutex> lock(this->m_streamMutex);
+
+    this->m_stream.clear();
+    this->m_stream.seekg((std::streamoff)offset);
+    this->m_stream.read((char*)buffer, (std::streamsize)size);
+
+    return (uint64_t)this->m_stream.gcount();
+#endif
+}
+
+const lib::String FileByteSource::toString() const {
+    return fmt::format("FileByteSource [ path={}, size={}, pread={} ]",
+                       this->m_path, this->m_size, this->m_descriptor >= 0);
+}
+
+MappedByteSource::MappedByteSource(const std::string& path)
+    : m_path(path), m_size(0), m_region(nullptr) {
+#ifdef S4PKG_BYTESOURCE_MMAP
+    int descriptor = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (descriptor < 0) {
+        throw PackageException(fmt::format("Failed to open file {}", path));
+    }
+
+    struct stat status;
+    if (fstat(descriptor, &status) != 0) {
+        close(descriptor);
+        throw PackageException(fmt::format("Failed to stat file {}", path));
+    }
+
+    this->m_size = (uint64_t)status.st_size;
+
+    // Mapping nothing fails, an empty file has no region
+    if (this->m_size > 0) {
+        void* region = mmap(nullptr, (size_t)this->m_size, PROT_READ,
+                            MAP_PRIVATE, descriptor, 0);
+        if (region == MAP_FAILED) {
+            close(descriptor);
+            throw PackageException(fmt::format("Failed to map file {}: {}",
+                                               path, strerror(errno)));
+        }
+
+        this->m_region = region;
+    }
+
+    // The mapping stays valid without the descriptor
+    close(descriptor);
+#else
+    std::ifstream stream(fs::u8path(path), std::ios_base::binary);
+    if (!stream.good()) {
+        throw PackageException(fmt::format("Failed to open file {}", path));
+    }
+
+    stream.seekg(0, std::ios_base::end);
+    this->m_size = (uint64_t)stream.tellg();
+    stream.seekg(0);
+
+    this->m_buffer = lib::ByteBuffer(this->m_size);
+    stream.read((char*)this->m_buffer.data(), (std::streamsize)this->m_size);
+
+    if (!stream.good()) {
+        throw PackageException(fmt::format("Failed to read file {}", path));
+    }
+#endif
+}
+
+MappedByteSource::~MappedByteSource() {
+#ifdef S4PKG_BYTESOURCE_MMAP
+    if (this->m_region != nullptr) {
+        munmap(this->m_region, (size_t)this->m_size);
+    }
+#endif
+}
+
+uint64_t MappedByteSource::readSome(uint64_t offset,
+                                    uint8_t* buffer,
+                                    uint64_t size) const {
+    if (offset >= this->m_size) {
+        return 0;
+    }
+
+    size = std::min(size, this->m_size - offset);
+    memcpy(buffer, this->getData() + offset, size);
+
+    return size;
+}
+
+const uint8_t* MappedByteSource::getData() const {
+    return this->m_region != nullptr ? (const uint8_t*)this->m_region
+                                     : this->m_buffer.data();
+}
+
+const lib::String MappedByteSource::toString() const {
+    return fmt::format("MappedByteSource [ path={}, size={}, mapped={} ]",
+                       this->m_path, this->m_size, this->m_region != nullptr);
+}
+
+MemoryByteSource::MemoryByteSource(const uint8_t* data, uint64_t size)
+    : m_buffer(0), m_data(data), m_size(size) {}
+
+MemoryByteSource::MemoryByteSource(lib::ByteBuffer buffer) {
+    this->m_buffer = std::move(buffer);
+    this->m_data = this->m_buffer.data();
+    this->m_size = this->m_buffer.size();
+}
+
+uint64_t MemoryByteSource::readSome(uint64_t offset,
+                                    uint8_t* buffer,
+                                    uint64_t size) const {
+    if (offset >= this->m_size) {
+        return 0;
+    }
+
+    size = std::min(size, this->m_size - offset);
+    memcpy(buffer, this->m_data + offset, size);
+
+    return size;
+}
+
+const lib::String MemoryByteSource::toString() const {
+    return fmt::format("MemoryByteSource [ size={}, owned={} ]", this->m_size,
+                       this->m_buffer.size() > 0);
+}
+
+CallbackByteSource::CallbackByteSource(uint64_t size,
+                                       ByteSourceCallback callback)
+    : m_size(size), m_callback(std::move(callback)) {}
+
+uint64_t CallbackByteSource::readSome(uint64_t offset,
+                                      uint8_t* buffer,
+                                      uint64_t size) const {
+    if (offset >= this->m_size) {
+        return 0;
+    }
+
+    size = std::min(size, this->m_size - offset);
+
+    // Callbacks may return less than asked for before the end, like read()
+    uint64_t done = 0;
+    while (done < size) {
+        uint64_t count =
+            this->m_callback(offset + done, buffer + done, size - done);
+        if (count == 0) {
+            break;
+        }
+
+        done += std::min(count, size - done);
+    }
+
+    return done;
+}
+
+const lib::String CallbackByteSource::toString() const {
+    return fmt::format("CallbackByteSource [ size={} ]", this->m_size);
+}
+
+uint64_t StreamByteSource::getSize() const {
+    std::lock_guard<std::mutex> lock(this->m_streamMutex);
+
+    std::istream::pos_type position = this->m_stream.tellg();
+    this->m_stream.seekg(0, std::ios_base::end);
+    uint64_t size = (uint64_t)this->m_stream.tellg();
+    this->m_stream.seekg(position);
+
+    return size;
+}
+
+uint64_t StreamByteSource::readSome(uint64_t offset,
+                                    uint8_t* buffer,
+                                    uint64_t size) const {
+    std::lock_guard<std::mutex> lock(this->m_streamMutex);
+
+    this->m_stream.clear();
+    this->m_stream.seekg((std::streamoff)offset);
+    this->m_stream.read((char*)buffer, (std::streamsize)size);
+
+    return (uint64_t)this->m_stream.gcount();
+}
+
+void StreamByteSource::read(uint8_t* buffer, uint64_t size) {
+    if (size == 0) {
+        return;
+    }
+
+    this->m_stream.read((char*)buffer, (std::streamsize)size);
+
+    if (!this->m_stream.good()) {
+        throw PackageException(fmt::format(
+            "Unexpected end of stream! Tried reading {} bytes.", size));
+    }
+}
+
+void StreamByteSource::seek(uint64_t position) {
+    this->m_stream.clear();
+    this->m_stream.seekg((std::streamoff)position);
+}
+
+uint64_t StreamByteSource::tell() const {
+    return (uint64_t)this->m_stream.tellg();
+}
+
+const lib::String StreamByteSource::toString() const {
+    return "StreamByteSource [ ]";
+}
+
+}  // namespace s4pkg
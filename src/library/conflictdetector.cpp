@@ -0,0 +1,225 @@
+/*
+ * Copyright (c) 2022- Gerber Lóránt Viktor
+ * Author: Gerber Lóránt Viktor <glorantv@student.elte.hu>
+ *
+ * This file is part of s4pkg.
+ *
+ * s4pkg is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <s4pkg/library/conflictdetector.h>
+
+#include <s4pkg/internal/parallel.h>
+#include <s4pkg/packageexception.h>
+
+#include <algorithm>
+#include <filesystem>
+#include <unordered_set>
+
+#include <fmt/core.h>
+
+namespace s4pkg {
+
+namespace fs = std::filesystem;
+namespace libraryscan = internal::libraryscan;
+
+ConflictDetector::ConflictDetector(const PackageLibrary& library,
+                                   const std::vector<lib::String>& basePaths)
+    : m_library(library), m_hashedRecordCount(0) {
+    for (const lib::String& basePath : basePaths) {
+        m_basePaths.push_back(basePath.c_str());
+    }
+}
+
+bool ConflictDetector::isBasePackage(const std::string& path) const {
+    fs::path packagePath = fs::u8path(path).lexically_normal();
+
+    return std::any_of(
+        m_basePaths.begin(), m_basePaths.end(),
+        [&packagePath](const std::string& basePath) {
+            fs::path base = fs::u8path(basePath).lexically_normal();
+            if (base.has_parent_path() && base.filename().empty()) {
+                base = base.parent_path();  // A trailing separator
+            }
+
+            // Whole components, so Data doesn't hold DataMods/x.package
+            auto mismatch = std::mismatch(base.begin(), base.end(),
+                                          packagePath.begin(),
+                                          packagePath.end());
+            return mismatch.first == base.end();
+        });
+}
+
+const std::vector<ResourceConflict> ConflictDetector::analyze() {
+    m_hashedRecordCount = 0;
+    m_errors.clear();
+
+    typedef struct package_state_t {
+        std::string m_path;
+        bool m_base;
+        libraryscan::record_hashes_t* m_hashes;
+        std::vector<uint32_t> m_missing;
+    } package_state_t;
+
+    std::vector<LibraryOverride> overrides = m_library.getOverrides();
+    std::unordered_map<uint32_t, package_state_t> packages;
+
+    auto stateFor = [&](uint32_t packageId) -> package_state_t& {
+        auto found = packages.find(packageId);
+        if (found != packages.end()) {
+            return found->second;
+        }
+
+        std::string path = m_library.getPackagePath(packageId).c_str();
+        uint64_t fileSize = m_library.getPackageFileSize(packageId);
+        int64_t modifiedTime = m_library.getPackageModifiedTime(packageId);
+
+        // Hashes of a package that changed since they were computed are
+        // useless, the records may have moved
+        libraryscan::record_hashes_t& hashes = m_hashCache[path];
+        if (hashes.m_fileSize != fileSize ||
+            hashes.m_modifiedTime != modifiedTime) {
+            hashes = {fileSize, modifiedTime, {}};
+        }
+
+        return packages[packageId] = {path, isBasePackage(path), &hashes, {}};
+    };
+
+    for (const LibraryOverride& override : overrides) {
+        for (const LibraryLocation& location : override.m_overridden) {
+            package_state_t& state = stateFor(location.m_packageId);
+            if (state.m_hashes->m_hashes.count(location.m_entry) == 0) {
+                state.m_missing.push_back(location.m_entry);
+            }
+        }
+
+        package_state_t& state = stateFor(override.m_winner.m_packageId);
+        if (state.m_hashes->m_hashes.count(override.m_winner.m_entry) == 0) {
+            state.m_missing.push_back(override.m_winner.m_entry);
+        }
+    }
+
+    // Only paths still taking part in a collision stay cached
+    std::unordered_set<std::string> usedPaths;
+    for (const auto& [packageId, state] : packages) {
+        usedPaths.insert(state.m_path);
+    }
+
+    for (auto it = m_hashCache.begin(); it != m_hashCache.end();) {
+        it = usedPaths.count(it->first) != 0 ? std::next(it)
+                                             : m_hashCache.erase(it);
+    }
+
+    std::vector<uint32_t> pending;
+    for (const auto& [packageId, state] : packages) {
+        if (!state.m_missing.empty()) {
+            pending.push_back(packageId);
+        }
+    }
+
+    std::vector<std::vector<uint64_t>> hashes(pending.size());
+    std::vector<std::string> errors(pending.size());
+
+    internal::parallel::forEach(pending.size(), [&](size_t i) {
+        const package_state_t& state = packages.at(pending[i]);
+        const IndexView index = m_library.getPackageIndex(pending[i]);
+
+        std::vector<index_entry_t> entries;
+        for (uint32_t entry : state.m_missing) {
+            index_entry_t indexEntry{};
+            indexEntry.m_instance = index.getInstance(entry);
+            indexEntry.m_position = index.getPosition(entry);
+            indexEntry.m_size = index.getSize(entry);
+            indexEntry.m_sizeDecompressed = index.getSizeDecompressed(entry);
+            indexEntry.m_compressionType =
+                (compression_type_t)index.getCompressionType(entry);
+
+            entries.push_back(indexEntry);
+        }
+
+        try {
+            libraryscan::hashRecords(state.m_path, entries, true, hashes[i]);
+        } catch (PackageException e) {
+            errors[i] = e.what();
+        }
+    });
+
+    for (size_t i = 0; i < pending.size(); i++) {
+        package_state_t& state = packages.at(pending[i]);
+
+        if (!errors[i].empty()) {
+            m_errors.push_back({state.m_path, errors[i]});
+            continue;
+        }
+
+        for (size_t j = 0; j < state.m_missing.size(); j++) {
+            state.m_hashes->m_hashes[state.m_missing[j]] = hashes[i][j];
+        }
+
+        m_hashedRecordCount += state.m_missing.size();
+    }
+
+    std::vector<ResourceConflict> conflicts;
+    conflicts.reserve(overrides.size());
+
+    for (const LibraryOverride& override : overrides) {
+        ResourceConflict conflict{override.m_key, IDENTICAL_DUPLICATE,
+                                  override.m_winner,
+                                  m_library.find(override.m_key),
+                                  {}};
+
+        std::unordered_set<uint64_t> contents;
+        std::unordered_set<uint64_t> nonBaseContents;
+        bool unreadable = false;
+
+        for (const LibraryLocation& location : conflict.m_locations) {
+            const package_state_t& state = packages.at(location.m_packageId);
+
+            // Not hashed if its package couldn't be read
+            auto found = state.m_hashes->m_hashes.find(location.m_entry);
+            if (found == state.m_hashes->m_hashes.end()) {
+                conflict.m_contentHashes.push_back(std::nullopt);
+                unreadable = true;
+                continue;
+            }
+
+            conflict.m_contentHashes.push_back(found->second);
+
+            contents.insert(found->second);
+            if (!state.m_base) {
+                nonBaseContents.insert(found->second);
+            }
+        }
+
+        if (contents.size() > 1) {
+            conflict.m_kind = nonBaseContents.size() > 1 ? CONFLICT : OVERRIDE;
+        } else if (unreadable) {
+            conflict.m_kind = UNREADABLE;
+        }
+
+        conflicts.push_back(std::move(conflict));
+    }
+
+    return conflicts;
+}
+
+const lib::String ConflictDetector::toString() const {
+    return fmt::format(
+        "ConflictDetector [ basePaths={}, cachedPackages={}, "
+        "hashedRecordCount={}, errors={} ]",
+        m_basePaths.size(), m_hashCache.size(), m_hashedRecordCount,
+        m_errors.size());
+}
+
+}  // namespace s4pkg
@@ -0,0 +1,346 @@
+/*
+ * Copyright (c) 2022- Gerber Lóránt Viktor
+ * Author: Gerber Lóránt Viktor <glorantv@student.elte.hu>
+ *
+ * This file is part of s4pkg.
+ *
+ * s4pkg is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <s4pkg/library/dedupanalyzer.h>
+
+#include <s4pkg/internal/libraryscan.h>
+#include <s4pkg/internal/parallel.h>
+#include <s4pkg/packageexception.h>
+
+#include <algorithm>
+#include <optional>
+#include <unordered_map>
+#include <unordered_set>
+
+#include <fmt/core.h>
+
+namespace s4pkg {
+
+namespace hashcache = internal::hashcache;
+
+namespace {
+
+// A record of the library, by its position in the load order
+typedef struct record_ref_t {
+    uint32_t m_package;
+    uint32_t m_entry;
+} record_ref_t;
+
+index_entry_t entryFor(const IndexView& view, uint32_t position) {
+    index_entry_t entry{};
+    entry.m_instance = view.getInstance(position);
+    entry.m_position = view.getPosition(position);
+    entry.m_size = view.getSize(position);
+    entry.m_sizeDecompressed = view.getSizeDecompressed(position);
+    entry.m_compressionType =
+        (compression_type_t)view.getCompressionType(position);
+
+    return entry;
+}
+
+}  // namespace
+
+DedupAnalyzer::DedupAnalyzer(const PackageLibrary& library,
+                             const lib::String& cachePath)
+    : m_library(library),
+      m_cachePath(cachePath.c_str() != nullptr ? cachePath.c_str() : ""),
+      m_hashedRecordCount(0),
+      m_decompressedRecordCount(0) {
+    if (!m_cachePath.empty()) {
+        hashcache::read(m_cachePath, m_cache);
+    }
+}
+
+const std::vector<DuplicateCluster> DedupAnalyzer::analyze() {
+    m_hashedRecordCount = 0;
+    m_decompressedRecordCount = 0;
+    m_errors.clear();
+
+    std::vector<uint32_t> packageIds = m_library.getPackageIds();
+    std::vector<std::string> paths(packageIds.size());
+    std::vector<IndexView> views;
+    std::vector<hashcache::package_hashes_t*> hashes(packageIds.size());
+    std::vector<bool> failed(packageIds.size(), false);
+
+    std::vector<size_t> pending;
+    std::unordered_set<std::string> usedPaths;
+
+    for (size_t i = 0; i < packageIds.size(); i++) {
+        paths[i] = m_library.getPackagePath(packageIds[i]).c_str();
+        views.push_back(m_library.getPackageIndex(packageIds[i]));
+        usedPaths.insert(paths[i]);
+
+        uint64_t fileSize = m_library.getPackageFileSize(packageIds[i]);
+        int64_t modifiedTime = m_library.getPackageModifiedTime(packageIds[i]);
+
+        hashcache::package_hashes_t& cached = m_cache[paths[i]];
+        if (cached.m_fileSize != fileSize ||
+            cached.m_modifiedTime != modifiedTime ||
+            cached.m_storedHashes.size() != views[i].size()) {
+            cached = {fileSize, modifiedTime, {}, {}};
+
+            if (!views[i].empty()) {
+                pending.push_back(i);
+            }
+        }
+
+        hashes[i] = &cached;
+    }
+
+    for (auto it = m_cache.begin(); it != m_cache.end();) {
+        if (usedPaths.count(it->first) == 0) {
+            it = m_cache.erase(it);
+        } else {
+            it++;
+        }
+    }
+
+    // First pass: the stored bytes of every record not in the cache
+    {
+        std::vector<std::vector<uint64_t>> results(pending.size());
+        std::vector<std::string> errors(pending.size());
+
+        internal::parallel::forEach(pending.size(), [&](size_t i) {
+            const IndexView& view = views[pending[i]];
+
+            std::vector<index_entry_t> entries;
+            entries.reserve(view.size());
+            for (uint32_t entry = 0; entry < view.size(); entry++) {
+                entries.push_back(entryFor(view, entry));
+            }
+
+            try {
+                internal::libraryscan::hashRecords(paths[pending[i]], entries,
+                                                   false, results[i]);
+            } catch (PackageException e) {
+                errors[i] = e.what();
+            }
+        });
+
+        for (size_t i = 0; i < pending.size(); i++) {
+            if (!errors[i].empty()) {
+                failed[pending[i]] = true;
+                m_errors.push_back({paths[pending[i]], errors[i]});
+                continue;
+            }
+
+            hashes[pending[i]]->m_storedHashes = std::move(results[i]);
+            m_hashedRecordCount += hashes[pending[i]]->m_storedHashes.size();
+        }
+    }
+
+    // Only records with the same decompressed size can have the same content
+    std::unordered_map<uint32_t, std::vector<record_ref_t>> bySize;
+
+    for (uint32_t i = 0; i < packageIds.size(); i++) {
+        if (failed[i]) {
+            continue;
+        }
+
+        for (uint32_t entry = 0; entry < views[i].size(); entry++) {
+            uint32_t sizeDecompressed = views[i].getSizeDecompressed(entry);
+
+            if (sizeDecompressed == 0 || views[i].getCompressionType(entry) ==
+                                             CompressionType::DELETED) {
+                continue;
+            }
+
+            bySize[sizeDecompressed].push_back({i, entry});
+        }
+    }
+
+    auto storedHash = [&](const record_ref_t& record) {
+        return hashes[record.m_package]->m_storedHashes[record.m_entry];
+    };
+
+    // Second pass: one record of every way records of the same size were
+    // stored is decompressed, for the content hash
+    std::unordered_map<uint32_t, std::vector<uint32_t>> toDecompress;
+
+    for (auto& [sizeDecompressed, records] : bySize) {
+        if (records.size() < 2) {
+            continue;
+        }
+
+        std::unordered_map<uint64_t, record_ref_t> representatives;
+        for (const record_ref_t& record : records) {
+            auto [it, inserted] =
+                representatives.emplace(storedHash(record), record);
+
+            // Prefer a record whose content was hashed by an earlier run
+            if (!inserted &&
+                hashes[it->second.m_package]->m_contentHashes.count(
+                    it->second.m_entry) == 0 &&
+                hashes[record.m_package]->m_contentHashes.count(
+                    record.m_entry) != 0) {
+                it->second = record;
+            }
+        }
+
+        for (const auto& [hash, record] : representatives) {
+            const IndexView& view = views[record.m_package];
+
+            if (view.getCompressionType(record.m_entry) !=
+                    CompressionType::UNCOMPRESSED &&
+                hashes[record.m_package]->m_contentHashes.count(
+                    record.m_entry) == 0) {
+                toDecompress[record.m_package].push_back(record.m_entry);
+            }
+        }
+    }
+
+    {
+        std::vector<uint32_t> packages;
+        for (const auto& [package, entries] : toDecompress) {
+            packages.push_back(package);
+        }
+
+        std::vector<std::vector<uint64_t>> results(packages.size());
+        std::vector<std::string> errors(packages.size());
+
+        internal::parallel::forEach(packages.size(), [&](size_t i) {
+            const IndexView& view = views[packages[i]];
+
+            std::vector<index_entry_t> entries;
+            for (uint32_t entry : toDecompress[packages[i]]) {
+                entries.push_back(entryFor(view, entry));
+            }
+
+            try {
+                internal::libraryscan::hashRecords(paths[packages[i]], entries,
+                                                   true, results[i]);
+            } catch (PackageException e) {
+                errors[i] = e.what();
+            }
+        });
+
+        for (size_t i = 0; i < packages.size(); i++) {
+            if (!errors[i].empty()) {
+                m_errors.push_back({paths[packages[i]], errors[i]});
+                continue;
+            }
+
+            const std::vector<uint32_t>& entries = toDecompress[packages[i]];
+            for (size_t j = 0; j < entries.size(); j++) {
+                hashes[packages[i]]->m_contentHashes[entries[j]] =
+                    results[i][j];
+            }
+
+            m_decompressedRecordCount += entries.size();
+        }
+    }
+
+    // Records stored the same way have the same content, so the stored hash
+    // finds the content hash of their representative
+    std::vector<DuplicateCluster> clusters;
+
+    for (auto& [sizeDecompressed, records] : bySize) {
+        if (records.size() < 2) {
+            continue;
+        }
+
+        std::unordered_map<uint64_t, std::optional<uint64_t>> contentOf;
+
+        for (const record_ref_t& record : records) {
+            uint64_t hash = storedHash(record);
+
+            const hashcache::package_hashes_t& packageHashes =
+                *hashes[record.m_package];
+            auto content = packageHashes.m_contentHashes.find(record.m_entry);
+
+            if (views[record.m_package].getCompressionType(record.m_entry) ==
+                CompressionType::UNCOMPRESSED) {
+                contentOf[hash] = hash;
+            } else if (content != packageHashes.m_contentHashes.end()) {
+                contentOf[hash] = content->second;
+            } else {
+                contentOf.emplace(hash, std::nullopt);
+            }
+        }
+
+        std::unordered_map<uint64_t, size_t> clusterOf;
+        size_t firstCluster = clusters.size();
+
+        for (const record_ref_t& record : records) {
+            // Couldn't be decompressed, the package is in the errors
+            const std::optional<uint64_t>& hash = contentOf[storedHash(record)];
+            if (!hash) {
+                continue;
+            }
+
+            auto [it, inserted] = clusterOf.emplace(*hash, clusters.size());
+            if (inserted) {
+                clusters.push_back({*hash, sizeDecompressed, {}, 0, 0});
+            }
+
+            DuplicateCluster& cluster = clusters[it->second];
+            cluster.m_locations.push_back(
+                {packageIds[record.m_package], record.m_entry});
+
+            uint32_t size = views[record.m_package].getSize(record.m_entry);
+            cluster.m_storedBytes += size;
+
+            // Temporarily the smallest copy
+            cluster.m_reclaimableBytes =
+                cluster.m_locations.size() == 1
+                    ? size
+                    : std::min<uint64_t>(cluster.m_reclaimableBytes, size);
+        }
+
+        // Drop the records that turned out to be unique
+        clusters.erase(
+            std::remove_if(clusters.begin() + firstCluster, clusters.end(),
+                           [](const DuplicateCluster& cluster) {
+                               return cluster.m_locations.size() < 2;
+                           }),
+            clusters.end());
+    }
+
+    for (DuplicateCluster& cluster : clusters) {
+        cluster.m_reclaimableBytes =
+            cluster.m_storedBytes - cluster.m_reclaimableBytes;
+    }
+
+    std::sort(clusters.begin(), clusters.end(),
+              [](const DuplicateCluster& a, const DuplicateCluster& b) {
+                  if (a.m_reclaimableBytes != b.m_reclaimableBytes) {
+                      return a.m_reclaimableBytes > b.m_reclaimableBytes;
+                  }
+
+                  return std::tie(a.m_sizeDecompressed, a.m_contentHash) <
+                         std::tie(b.m_sizeDecompressed, b.m_contentHash);
+              });
+
+    if (!m_cachePath.empty()) {
+        hashcache::write(m_cachePath, m_cache);
+    }
+
+    return clusters;
+}
+
+const lib::String DedupAnalyzer::toString() const {
+    return fmt::format(
+        "DedupAnalyzer [ cachePath={}, cachedPackages={}, "
+        "hashedRecordCount={}, decompressedRecordCount={}, errors={} ]",
+        m_cachePath, m_cache.size(), m_hashedRecordCount,
+        m_decompressedRecordCount, m_errors.size());
+}
+
+}  // namespace s4pkg
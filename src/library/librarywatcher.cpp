@@ -0,0 +1,235 @@
+/*
+ * Copyright (c) 2022- Gerber Lóránt Viktor
+ * Author: Gerber Lóránt Viktor <glorantv@student.elte.hu>
+ *
+ * This file is part of s4pkg.
+ *
+ * s4pkg is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <s4pkg/library/librarywatcher.h>
+
+#include <chrono>
+#include <filesystem>
+#include <thread>
+
+#include <fmt/core.h>
+
+#if defined(__linux__)
+#define S4PKG_LIBRARYWATCHER_INOTIFY
+#include <errno.h>
+#include <poll.h>
+#include <sys/inotify.h>
+#include <unistd.h>
+#endif
+
+namespace s4pkg {
+
+namespace fs = std::filesystem;
+
+#ifdef S4PKG_LIBRARYWATCHER_INOTIFY
+// Files are only looked at once they are complete, directories as soon as they
+// appear, so packages created inside them aren't missed
+static constexpr uint32_t g_watchMask = IN_CLOSE_WRITE | IN_MOVED_TO |
+                                        IN_MOVED_FROM | IN_DELETE | IN_CREATE |
+                                        IN_DONT_FOLLOW | IN_EXCL_UNLINK;
+#endif
+
+LibraryWatcher::LibraryWatcher(PackageLibrary& library)
+    : m_library(library), m_inotifyDescriptor(-1) {
+#ifdef S4PKG_LIBRARYWATCHER_INOTIFY
+    m_inotifyDescriptor = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+
+    if (m_inotifyDescriptor >= 0) {
+        watchTree(m_library.getRootPath().c_str(), 0);
+    }
+#endif
+}
+
+LibraryWatcher::~LibraryWatcher() {
+    fallBackToPolling();
+}
+
+void LibraryWatcher::fallBackToPolling() {
+#ifdef S4PKG_LIBRARYWATCHER_INOTIFY
+    if (m_inotifyDescriptor >= 0) {
+        close(m_inotifyDescriptor);
+    }
+#endif
+
+    m_inotifyDescriptor = -1;
+    m_watches.clear();
+}
+
+void LibraryWatcher::watchTree(const std::string& directory, int32_t depth) {
+#ifdef S4PKG_LIBRARYWATCHER_INOTIFY
+    int32_t maxDepth = m_library.getMaxDepth();
+    if (m_inotifyDescriptor < 0 || (maxDepth >= 0 && depth > maxDepth)) {
+        return;
+    }
+
+    int watch =
+        inotify_add_watch(m_inotifyDescriptor, directory.c_str(), g_watchMask);
+    if (watch < 0) {
+        // Out of watches, inotify can't see the whole tree anymore
+        if (errno == ENOSPC || errno == ENOMEM) {
+            fallBackToPolling();
+        }
+
+        return;
+    }
+
+    m_watches[watch] = {directory, depth};
+
+    std::error_code error;
+    fs::directory_iterator iterator(
+        fs::u8path(directory), fs::directory_options::skip_permission_denied,
+        error);
+
+    for (; !error && iterator != fs::directory_iterator();
+         iterator.increment(error)) {
+        std::error_code statError;
+        if (!iterator->is_symlink(statError) &&
+            iterator->is_directory(statError)) {
+            watchTree(iterator->path().u8string(), depth + 1);
+        }
+    }
+#endif
+}
+
+void LibraryWatcher::unwatchTree(const std::string& directory) {
+#ifdef S4PKG_LIBRARYWATCHER_INOTIFY
+    std::string prefix = (fs::u8path(directory) / "").u8string();
+
+    for (auto it = m_watches.begin(); it != m_watches.end();) {
+        const std::string& path = it->second.m_path;
+
+        if (path == directory || path.compare(0, prefix.size(), prefix) == 0) {
+            inotify_rm_watch(m_inotifyDescriptor, it->first);
+            it = m_watches.erase(it);
+        } else {
+            it++;
+        }
+    }
+#endif
+}
+
+void LibraryWatcher::readEvents(int32_t timeoutMilliseconds,
+                                std::vector<lib::String>& paths,
+                                bool& overflowed) {
+#ifdef S4PKG_LIBRARYWATCHER_INOTIFY
+    struct pollfd descriptor {};
+    descriptor.fd = m_inotifyDescriptor;
+    descriptor.events = POLLIN;
+
+    ::poll(&descriptor, 1, timeoutMilliseconds);
+
+    alignas(struct inotify_event) char buffer[64 * 1024];
+
+    while (m_inotifyDescriptor >= 0) {
+        ssize_t length = read(m_inotifyDescriptor, buffer, sizeof(buffer));
+        if (length <= 0) {
+            break;  // EAGAIN, nothing left to read
+        }
+
+        for (char* position = buffer; position < buffer + length;) {
+            const struct inotify_event* event =
+                (const struct inotify_event*)position;
+            position += sizeof(struct inotify_event) + event->len;
+
+            if ((event->mask & IN_Q_OVERFLOW) != 0) {
+                overflowed = true;
+                continue;
+            }
+
+            if ((event->mask & IN_IGNORED) != 0) {
+                m_watches.erase(event->wd);
+                continue;
+            }
+
+            auto watch = m_watches.find(event->wd);
+            if (watch == m_watches.end() || event->len == 0) {
+                continue;
+            }
+
+            std::string path =
+                (fs::u8path(watch->second.m_path) / event->name).u8string();
+            int32_t depth = watch->second.m_depth;
+
+            if ((event->mask & IN_ISDIR) != 0) {
+                if ((event->mask & (IN_CREATE | IN_MOVED_TO)) != 0) {
+                    watchTree(path, depth + 1);
+                } else if ((event->mask & IN_MOVED_FROM) != 0) {
+                    // The watches would follow the directory to its new name
+                    unwatchTree(path);
+                }
+            } else if ((event->mask & IN_CREATE) != 0) {
+                continue;  // Wait until it is written
+            }
+
+            paths.push_back(path);
+        }
+    }
+#endif
+}
+
+void LibraryWatcher::addListener(const LibraryChangeListener& listener) {
+    m_listeners.push_back(listener);
+}
+
+const std::vector<LibraryChange> LibraryWatcher::poll(
+    int32_t timeoutMilliseconds) {
+    std::vector<LibraryChange> changes;
+
+    if (isUsingInotify()) {
+        std::vector<lib::String> paths;
+        bool overflowed = false;
+        readEvents(timeoutMilliseconds, paths, overflowed);
+
+        if (overflowed && isUsingInotify()) {
+            // Events were lost, new directories may not be watched yet
+            watchTree(m_library.getRootPath().c_str(), 0);
+        }
+
+        if (overflowed || !isUsingInotify()) {
+            changes = m_library.refresh();
+        } else if (!paths.empty()) {
+            changes = m_library.update(paths);
+        }
+    } else {
+        if (timeoutMilliseconds > 0) {
+            std::this_thread::sleep_for(
+                std::chrono::milliseconds(timeoutMilliseconds));
+        }
+
+        changes = m_library.refresh();
+    }
+
+    for (const LibraryChange& change : changes) {
+        for (const LibraryChangeListener& listener : m_listeners) {
+            listener(change);
+        }
+    }
+
+    return changes;
+}
+
+const lib::String LibraryWatcher::toString() const {
+    return fmt::format(
+        "LibraryWatcher [ rootPath={}, inotify={}, watches={}, listeners={} ]",
+        m_library.getRootPath(), this->isUsingInotify(), m_watches.size(),
+        m_listeners.size());
+}
+
+}  // namespace s4pkg
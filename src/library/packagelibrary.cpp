@@ -0,0 +1,411 @@
+/*
+ * Copyright (c) 2022- Gerber Lóránt Viktor
+ * Author: Gerber Lóránt Viktor <glorantv@student.elte.hu>
+ *
+ * This file is part of s4pkg.
+ *
+ * s4pkg is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <s4pkg/library/packagelibrary.h>
+
+#include <s4pkg/internal/parallel.h>
+#include <s4pkg/packageexception.h>
+
+#include <algorithm>
+#include <filesystem>
+#include <unordered_set>
+
+#include <fmt/core.h>
+
+namespace s4pkg {
+
+PackageLibrary::PackageLibrary(const lib::String& rootPath,
+                               LoadOrderRule loadOrderRule,
+                               int32_t maxDepth)
+    : m_rootPath(rootPath.c_str()),
+      m_loadOrderRule(loadOrderRule),
+      m_maxDepth(maxDepth) {}
+
+bool PackageLibrary::loadsBefore(uint32_t packageId,
+                                 uint32_t otherPackageId) const {
+    return internal::libraryscan::loadsBefore(
+        m_packages[packageId].m_path, m_packages[otherPackageId].m_path);
+}
+
+void PackageLibrary::checkPackageId(uint32_t packageId) const {
+    if (packageId >= m_packages.size() || !m_packageValid[packageId]) {
+        throw PackageException(
+            fmt::format("No package with id {} in library", packageId));
+    }
+}
+
+void PackageLibrary::addLocations(uint32_t packageId) {
+    const internal::soaindex::soa_index_t& index =
+        m_packages[packageId].m_index;
+
+    for (uint32_t i = 0; i < index.size(); i++) {
+        ResourceKey key = ResourceKey::fromParts(
+            index.m_types[i], index.m_groups[i], index.m_instanceExs[i],
+            index.m_instances[i]);
+
+        std::vector<LibraryLocation>& locations = m_locations[key];
+
+        // Keep the locations in load order, packages are usually added in
+        // order, so this is almost always an append
+        auto insertAt = locations.end();
+        while (insertAt != locations.begin() &&
+               loadsBefore(packageId, (insertAt - 1)->m_packageId)) {
+            insertAt--;
+        }
+
+        locations.insert(insertAt, {packageId, i});
+    }
+}
+
+void PackageLibrary::removeLocations(uint32_t packageId) {
+    const internal::soaindex::soa_index_t& index =
+        m_packages[packageId].m_index;
+
+    for (uint32_t i = 0; i < index.size(); i++) {
+        ResourceKey key = ResourceKey::fromParts(
+            index.m_types[i], index.m_groups[i], index.m_instanceExs[i],
+            index.m_instances[i]);
+
+        auto found = m_locations.find(key);
+        if (found == m_locations.end()) {
+            continue;
+        }
+
+        std::vector<LibraryLocation>& locations = found->second;
+        locations.erase(std::remove_if(locations.begin(), locations.end(),
+                                       [packageId](const LibraryLocation& l) {
+                                           return l.m_packageId == packageId;
+                                       }),
+                        locations.end());
+
+        if (locations.empty()) {
+            m_locations.erase(found);
+        }
+    }
+}
+
+void PackageLibrary::dropPackage(uint32_t packageId) {
+    removeLocations(packageId);
+
+    // The id isn't reused, only the memory of the index is released
+    m_packageIds.erase(m_packages[packageId].m_path);
+    m_packageValid[packageId] = false;
+    m_packages[packageId].m_index = {};
+}
+
+void PackageLibrary::scan() {
+    m_packages.clear();
+    m_packageValid.clear();
+    m_packageIds.clear();
+    m_locations.clear();
+    m_errors.clear();
+
+    std::vector<std::string> paths = internal::libraryscan::findFiles(
+        m_rootPath, ".package", m_maxDepth);
+
+    std::vector<internal::libraryscan::library_package_t> packages(
+        paths.size());
+    std::vector<std::string> errors(paths.size());
+    std::vector<char> valid(paths.size(), 0);
+
+    internal::parallel::forEach(paths.size(), [&](size_t i) {
+        valid[i] =
+            internal::libraryscan::readPackage(paths[i], packages[i], errors[i])
+                ? 1
+                : 0;
+    });
+
+    // The paths are sorted, so package ids follow the load order
+    for (size_t i = 0; i < paths.size(); i++) {
+        if (valid[i] != 0) {
+            m_packageIds[paths[i]] = (uint32_t)m_packages.size();
+            m_packages.push_back(std::move(packages[i]));
+            m_packageValid.push_back(true);
+        } else if (!errors[i].empty()) {
+            m_errors.push_back({paths[i], errors[i]});
+        }
+    }
+
+    for (uint32_t i = 0; i < m_packages.size(); i++) {
+        addLocations(i);
+    }
+}
+
+const std::vector<LibraryChange> PackageLibrary::update(
+    const std::vector<lib::String>& paths) {
+    namespace fs = std::filesystem;
+
+    std::vector<std::string> files;
+
+    for (const lib::String& pathString : paths) {
+        std::string path = pathString.c_str();
+
+        std::error_code error;
+        fs::file_status status = fs::symlink_status(fs::u8path(path), error);
+
+        if (fs::is_directory(status)) {
+            // Same depth limit as if the directory was found by scan()
+            int32_t depth = internal::libraryscan::depthBelow(
+                m_rootPath, (fs::u8path(path) / "file").u8string());
+            if (depth < 0 || (m_maxDepth >= 0 && depth > m_maxDepth)) {
+                continue;
+            }
+
+            std::vector<std::string> found = internal::libraryscan::findFiles(
+                path, ".package", m_maxDepth >= 0 ? m_maxDepth - depth : -1);
+            files.insert(files.end(), found.begin(), found.end());
+        } else {
+            files.push_back(path);
+        }
+
+        // A directory that was removed, renamed, or is being updated may still
+        // have packages in the library
+        if (!fs::exists(status) || fs::is_directory(status)) {
+            std::string prefix = (fs::u8path(path) / "").u8string();
+
+            for (const auto& [packagePath, packageId] : m_packageIds) {
+                if (packagePath.compare(0, prefix.size(), prefix) == 0) {
+                    files.push_back(packagePath);
+                }
+            }
+        }
+    }
+
+    return updateFiles(std::move(files));
+}
+
+const std::vector<LibraryChange> PackageLibrary::refresh() {
+    std::vector<std::string> files = internal::libraryscan::findFiles(
+        m_rootPath, ".package", m_maxDepth);
+
+    for (const auto& [packagePath, packageId] : m_packageIds) {
+        files.push_back(packagePath);
+    }
+
+    return updateFiles(std::move(files));
+}
+
+const std::vector<LibraryChange> PackageLibrary::updateFiles(
+    std::vector<std::string> paths) {
+    std::sort(paths.begin(), paths.end(), internal::libraryscan::loadsBefore);
+    paths.erase(std::unique(paths.begin(), paths.end()), paths.end());
+
+    std::vector<LibraryChange> changes;
+    std::vector<std::string> toRead;
+    std::unordered_set<std::string> touched;
+
+    for (const std::string& path : paths) {
+        auto known = m_packageIds.find(path);
+
+        int32_t depth = internal::libraryscan::depthBelow(m_rootPath, path);
+        bool inLibrary = depth >= 0 &&
+                         (m_maxDepth < 0 || depth <= m_maxDepth) &&
+                         internal::libraryscan::hasExtension(path, ".package");
+
+        uint64_t fileSize = 0;
+        int64_t modifiedTime = 0;
+        if (!inLibrary ||
+            !internal::libraryscan::statFile(path, fileSize, modifiedTime)) {
+            if (known != m_packageIds.end()) {
+                changes.push_back({PACKAGE_REMOVED, known->second, path});
+                dropPackage(known->second);
+            }
+
+            touched.insert(path);
+            continue;
+        }
+
+        if (known != m_packageIds.end() &&
+            m_packages[known->second].m_fileSize == fileSize &&
+            m_packages[known->second].m_modifiedTime == modifiedTime) {
+            continue;
+        }
+
+        toRead.push_back(path);
+        touched.insert(path);
+    }
+
+    m_errors.erase(std::remove_if(m_errors.begin(), m_errors.end(),
+                                  [&touched](const LibraryScanError& error) {
+                                      return touched.count(
+                                                 error.m_path.c_str()) != 0;
+                                  }),
+                   m_errors.end());
+
+    std::vector<internal::libraryscan::library_package_t> packages(
+        toRead.size());
+    std::vector<std::string> errors(toRead.size());
+    std::vector<char> valid(toRead.size(), 0);
+
+    internal::parallel::forEach(toRead.size(), [&](size_t i) {
+        valid[i] = internal::libraryscan::readPackage(toRead[i], packages[i],
+                                                      errors[i])
+                       ? 1
+                       : 0;
+    });
+
+    for (size_t i = 0; i < toRead.size(); i++) {
+        auto known = m_packageIds.find(toRead[i]);
+
+        if (valid[i] == 0) {
+            if (!errors[i].empty()) {
+                m_errors.push_back({toRead[i], errors[i]});
+            }
+
+            // A package that turned into something unreadable is dropped
+            if (known != m_packageIds.end()) {
+                changes.push_back({PACKAGE_REMOVED, known->second, toRead[i]});
+                dropPackage(known->second);
+            }
+
+            continue;
+        }
+
+        if (known != m_packageIds.end()) {
+            uint32_t packageId = known->second;
+
+            removeLocations(packageId);
+            m_packages[packageId] = std::move(packages[i]);
+            addLocations(packageId);
+
+            changes.push_back({PACKAGE_CHANGED, packageId, toRead[i]});
+        } else {
+            uint32_t packageId = (uint32_t)m_packages.size();
+
+            m_packageIds[toRead[i]] = packageId;
+            m_packages.push_back(std::move(packages[i]));
+            m_packageValid.push_back(true);
+            addLocations(packageId);
+
+            changes.push_back({PACKAGE_ADDED, packageId, toRead[i]});
+        }
+    }
+
+    return changes;
+}
+
+const std::vector<uint32_t> PackageLibrary::getPackageIds() const {
+    std::vector<uint32_t> ids;
+
+    for (uint32_t i = 0; i < m_packages.size(); i++) {
+        if (m_packageValid[i]) {
+            ids.push_back(i);
+        }
+    }
+
+    std::sort(ids.begin(), ids.end(), [this](uint32_t a, uint32_t b) {
+        return loadsBefore(a, b);
+    });
+
+    return ids;
+}
+
+const size_t PackageLibrary::getPackageCount() const {
+    return std::count(m_packageValid.begin(), m_packageValid.end(), true);
+}
+
+const lib::String PackageLibrary::getPackagePath(uint32_t packageId) const {
+    checkPackageId(packageId);
+
+    return m_packages[packageId].m_path;
+}
+
+const uint64_t PackageLibrary::getPackageFileSize(uint32_t packageId) const {
+    checkPackageId(packageId);
+
+    return m_packages[packageId].m_fileSize;
+}
+
+const int64_t PackageLibrary::getPackageModifiedTime(
+    uint32_t packageId) const {
+    checkPackageId(packageId);
+
+    return m_packages[packageId].m_modifiedTime;
+}
+
+const IndexView PackageLibrary::getPackageIndex(uint32_t packageId) const {
+    checkPackageId(packageId);
+
+    return IndexView(m_packages[packageId].m_index);
+}
+
+const std::vector<LibraryLocation> PackageLibrary::find(
+    const ResourceKey& key) const {
+    auto found = m_locations.find(key);
+    if (found == m_locations.end()) {
+        return {};
+    }
+
+    return found->second;
+}
+
+const std::optional<LibraryLocation> PackageLibrary::resolve(
+    const ResourceKey& key) const {
+    auto found = m_locations.find(key);
+    if (found == m_locations.end() || found->second.empty()) {
+        return std::nullopt;
+    }
+
+    if (m_loadOrderRule == FIRST_LOADED_WINS) {
+        return found->second.front();
+    }
+
+    return found->second.back();
+}
+
+const std::vector<LibraryOverride> PackageLibrary::getOverrides() const {
+    std::vector<LibraryOverride> overrides;
+
+    for (const auto& [key, locations] : m_locations) {
+        if (locations.size() < 2) {
+            continue;
+        }
+
+        LibraryOverride override{key, {}, {}};
+
+        if (m_loadOrderRule == FIRST_LOADED_WINS) {
+            override.m_winner = locations.front();
+            override.m_overridden.assign(locations.begin() + 1,
+                                         locations.end());
+        } else {
+            override.m_winner = locations.back();
+            override.m_overridden.assign(locations.begin(),
+                                         locations.end() - 1);
+        }
+
+        overrides.push_back(override);
+    }
+
+    std::sort(overrides.begin(), overrides.end(),
+              [](const LibraryOverride& a, const LibraryOverride& b) {
+                  return a.m_key < b.m_key;
+              });
+
+    return overrides;
+}
+
+const lib::String PackageLibrary::toString() const {
+    return fmt::format(
+        "PackageLibrary [ rootPath={}, packages={}, resources={}, errors={} ]",
+        m_rootPath, this->getPackageCount(), m_locations.size(),
+        m_errors.size());
+}
+
+}  // namespace s4pkg
@@ -0,0 +1,268 @@
+/*
+ * Copyright (c) 2022- Gerber Lóránt Viktor
+ * Author: Gerber Lóránt Viktor <glorantv@student.elte.hu>
+ *
+ * This file is part of s4pkg.
+ *
+ * s4pkg is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <s4pkg/internal/filepackage.h>
+
+#include <s4pkg/internal/filepool.h>
+#include <s4pkg/internal/globals.h>
+#include <s4pkg/internal/streams.h>
+#include <s4pkg/packageexception.h>
+#include <s4pkg/resources/imageresource.h>
+
+#include <algorithm>
+
+#include <fmt/core.h>
+
+namespace s4pkg {
+
+internal::FilePackage::FilePackage(const std::string& path,
+                                   const std::shared_ptr<ResourceCache>& cache)
+    : m_path(path),
+      m_cache(cache),
+      m_cacheOwner(ResourceCache::newOwnerId()) {
+    package_table_t table{};
+    {
+        // Closed once the index is read, records are read through the pool
+        FileByteSource source(path);
+        streams::readPackageTable(source, table);
+        this->m_identity = source.getIdentity();
+    }
+
+    this->m_packageHeader = table.m_header;
+    this->m_flags = table.m_flags;
+    this->m_constantTypeId = table.m_constantType;
+    this->m_constantGroupId = table.m_constantGroup;
+    this->m_constantInstanceIdEx = table.m_constantInstanceEx;
+    this->m_index = std::move(table.m_index);
+
+    this->m_soaIndex = soaindex::build(
+        this->m_index, this->m_flags, this->m_constantTypeId,
+        this->m_constantGroupId, this->m_constantInstanceIdEx);
+
+    this->m_keyFilter = bloomfilter::build(this->m_soaIndex);
+    this->m_deleted.assign(this->m_soaIndex.size(), false);
+}
+
+internal::FilePackage::~FilePackage() {
+    if (this->m_cache != nullptr) {
+        this->m_cache->eraseOwner(this->m_cacheOwner);
+    }
+}
+
+bool internal::FilePackage::deleteResource(
+    const std::shared_ptr<const IResource> resource) {
+    if (!resource) {
+        return false;
+    }
+
+    ResourceKey key = ResourceKey::fromParts(
+        (uint32_t)resource->getResourceType(), resource->getGroup(),
+        resource->getInstanceEx(), resource->getInstance());
+
+    bool deleted = false;
+    for (uint32_t i = 0; i < this->m_soaIndex.size(); i++) {
+        if (!this->m_deleted[i] &&
+            ResourceKey::fromParts(this->m_soaIndex.m_types[i],
+                                   this->m_soaIndex.m_groups[i],
+                                   this->m_soaIndex.m_instanceExs[i],
+                                   this->m_soaIndex.m_instances[i]) == key) {
+            this->m_deleted[i] = true;
+            deleted = true;
+        }
+    }
+
+    // Only matters if every resource was already read
+    this->m_resources.erase(
+        std::remove_if(this->m_resources.begin(), this->m_resources.end(),
+                       [&key](const std::shared_ptr<IResource>& loaded) {
+                           return ResourceKey::fromParts(
+                                      (uint32_t)loaded->getResourceType(),
+                                      loaded->getGroup(),
+                                      loaded->getInstanceEx(),
+                                      loaded->getInstance()) == key;
+                       }),
+        this->m_resources.end());
+
+    return deleted;
+}
+
+const PackageVersion internal::FilePackage::getFileVersion() const {
+    return {this->m_packageHeader.m_fileVersion.m_major,
+            this->m_packageHeader.m_fileVersion.m_minor};
+}
+
+const PackageVersion internal::FilePackage::getUserVersion() const {
+    return {this->m_packageHeader.m_userVersion.m_major,
+            this->m_packageHeader.m_userVersion.m_minor};
+}
+
+const int32_t internal::FilePackage::getCreationTime() const {
+    return this->m_packageHeader.m_creationTime;
+}
+
+const int32_t internal::FilePackage::getModifiedTime() const {
+    return this->m_packageHeader.m_updatedTime;
+}
+
+const PackageHeader internal::FilePackage::getPackageHeader() const {
+    return {this->m_packageHeader.m_indexRecordEntryCount,
+            this->m_packageHeader.m_indexRecordPositionLow,
+            this->m_packageHeader.m_indexRecordSize,
+            this->m_packageHeader.m_indexRecordPosition};
+}
+
+const PackageFlags internal::FilePackage::getPackageFlags() const {
+    return {this->m_flags.m_constantType != 0,
+            this->m_flags.m_constantGroup != 0,
+            this->m_flags.m_constantInstanceEx != 0};
+}
+
+const std::vector<IndexEntry> internal::FilePackage::getPackageIndex() const {
+    IndexView view = this->getIndexView();
+
+    std::vector<IndexEntry> entries;
+    entries.reserve(view.size());
+
+    for (const auto& entry : view) {
+        entries.push_back(entry);
+    }
+
+    return entries;
+}
+
+const IndexView internal::FilePackage::getIndexView() const {
+    return IndexView(this->m_soaIndex);
+}
+
+const std::vector<std::shared_ptr<IResource>>&
+internal::FilePackage::getResources() const {
+    std::call_once(this->m_resourcesLoaded, [this]() {
+        for (uint32_t i = 0; i < this->m_soaIndex.size(); i++) {
+            std::shared_ptr<IResource> resource = this->getResource(i);
+
+            if (resource != nullptr) {
+                this->m_resources.push_back(resource);
+            }
+        }
+    });
+
+    return this->m_resources;
+}
+
+std::shared_ptr<IResource> internal::FilePackage::getResource(
+    uint32_t position) const {
+    if (position >= this->m_soaIndex.size()) {
+        throw PackageException(
+            fmt::format("No index entry at position {}", position));
+    }
+
+    if (this->m_deleted[position]) {
+        return nullptr;
+    }
+
+    // The soa index has the constant type, group and instanceEx applied
+    index_entry_t entry = soaindex::entryAt(this->m_soaIndex, position);
+
+    auto readRecord = [this, &entry]() {
+        // Records are read at their position, so threads don't need to lock
+        std::shared_ptr<const FileByteSource> source =
+            filepool::acquire(this->m_path, this->m_identity);
+
+        lib::ByteBuffer stored;
+        streams::readRawRecord(*source, entry, stored);
+
+        lib::ByteBuffer data;
+        if (entry.m_size > 0) {
+            streams::decompressRecord(entry, stored, data);
+        }
+
+        return data;
+    };
+
+    if (this->m_cache == nullptr) {
+        return internal::globals::createResource(entry, readRecord());
+    }
+
+    std::shared_ptr<const lib::ByteBuffer> data = this->m_cache->getOrLoad(
+        {this->m_cacheOwner, position, CACHED_RECORD}, readRecord);
+
+    // Shares the cached record, so it stays pinned instead of being copied
+    std::shared_ptr<IResource> resource =
+        internal::globals::createResource(entry, data);
+
+    auto image = std::dynamic_pointer_cast<resources::IImageResource>(resource);
+    if (image != nullptr) {
+        image->setPixelCache(this->m_cache,
+                             {this->m_cacheOwner, position, CACHED_PIXELS});
+    }
+
+    return resource;
+}
+
+const std::vector<uint32_t> internal::FilePackage::findEntries(
+    const std::vector<ResourceType>& types,
+    std::optional<uint32_t> group) const {
+    soaindex::soa_filter_t filter{{}, group.has_value(), group.value_or(0)};
+
+    filter.m_types.reserve(types.size());
+    for (ResourceType type : types) {
+        filter.m_types.push_back((uint32_t)type);
+    }
+
+    return soaindex::filter(this->m_soaIndex, filter);
+}
+
+const internal::keyindex::key_index_t& internal::FilePackage::getKeyIndex()
+    const {
+    std::call_once(this->m_keyIndexBuilt, [this]() {
+        this->m_keyIndex = keyindex::build(this->m_soaIndex);
+    });
+
+    return this->m_keyIndex;
+}
+
+const int64_t internal::FilePackage::findEntry(const ResourceKey& key) const {
+    return keyindex::find(this->getKeyIndex(), key);
+}
+
+const std::vector<int64_t> internal::FilePackage::findMany(
+    const std::vector<ResourceKey>& keys) const {
+    std::vector<int64_t> positions(keys.size());
+    keyindex::findMany(this->getKeyIndex(), keys.data(), keys.size(),
+                       positions.data());
+
+    return positions;
+}
+
+const bool internal::FilePackage::mayContain(const ResourceKey& key) const {
+    return bloomfilter::mayContain(this->m_keyFilter, key);
+}
+
+const lib::String internal::FilePackage::toString() const {
+    return fmt::format(
+        "(FilePackage) [ path={}, header={}, fileVersion={}, userVersion={}, "
+        "createdTime={}, modifiedTime={}, flags={} ]",
+        this->m_path, this->getPackageHeader().toString(),
+        this->getFileVersion().toString(), this->getUserVersion().toString(),
+        this->getCreationTime(), this->getModifiedTime(),
+        this->getPackageFlags().toString());
+}
+
+};  // namespace s4pkg
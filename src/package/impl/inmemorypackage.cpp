@@ -23,8 +23,8 @@
 #include <s4pkg/internal/globals.h>
 #include <s4pkg/internal/streams.h>
 #include <s4pkg/packageexception.h>
-#include <s4pkg/resources/iresourcefactory.h>
 
+#include <algorithm>
 #include <istream>
 
 #include <fmt/core.h>
@@ -32,97 +32,53 @@
 
 namespace s4pkg {
 
+internal::InMemoryPackage::InMemoryPackage(ByteSource& source) {
+    this->read(source);
+}
+
 internal::InMemoryPackage::InMemoryPackage(std::istream& stream) {
     if (!stream.good()) {
         throw PackageException("stream.good() == false");
     }
 
-    try {
-        streams::readPackageHeader(stream, this->m_packageHeader);
-    } catch (PackageException e) {
-        throw PackageException(fmt::format(
-            "Exception while reading package header: {}", e.what()));
-    }
-
-    uint64_t indexPosition;
-    if (this->m_packageHeader.m_indexRecordPosition != 0) {
-        indexPosition = this->m_packageHeader.m_indexRecordPosition;
-    } else {
-        indexPosition = this->m_packageHeader.m_indexRecordPositionLow;
-    }
+    StreamByteSource source(stream);
+    this->read(source);
+}
 
-    stream.seekg(indexPosition);
+void internal::InMemoryPackage::read(ByteSource& source) {
+    package_table_t table{};
+    streams::readPackageTable(source, table);
 
-    try {
-        streams::readPackageFlags(stream, this->m_flags);
+    this->m_packageHeader = table.m_header;
+    this->m_flags = table.m_flags;
+    this->m_constantTypeId = table.m_constantType;
+    this->m_constantGroupId = table.m_constantGroup;
+    this->m_constantInstanceIdEx = table.m_constantInstanceEx;
+    this->m_index = std::move(table.m_index);
 
-        if (this->m_flags.m_constantType != 0) {
-            streams::readUint32(stream, this->m_constantTypeId);
-        }
+    this->m_soaIndex = soaindex::build(
+        this->m_index, this->m_flags, this->m_constantTypeId,
+        this->m_constantGroupId, this->m_constantInstanceIdEx);
 
-        if (this->m_flags.m_constantGroup != 0) {
-            streams::readUint32(stream, this->m_constantGroupId);
-        }
-
-        if (this->m_flags.m_constantInstanceEx != 0) {
-            streams::readUint32(stream, this->m_constantInstanceIdEx);
-        }
-    } catch (PackageException e) {
-        throw PackageException(
-            fmt::format("Exception while reading package flags: {}", e.what()));
-    }
-
-    try {
-        streams::readIndex(stream, this->m_flags,
-                           this->m_packageHeader.m_indexRecordEntryCount,
-                           this->m_index);
-    } catch (PackageException e) {
-        throw PackageException(
-            fmt::format("Exception while reading package index: {}", e.what()));
-    }
+    this->m_keyFilter = bloomfilter::build(this->m_soaIndex);
 
     try {
-        streams::readRecords(stream, this->m_index, this->m_records);
+        streams::readRecords(source, this->m_index, this->m_records);
     } catch (PackageException e) {
         throw PackageException(fmt::format(
             "Exception while reading package records: {}", e.what()));
     }
 
+    this->m_entryResources.resize(this->m_index.m_entries.size());
+
     for (const auto& record : this->m_records.m_records) {
         index_entry_t associatedEntry = this->m_index.m_entries[record.m_index];
 
-        const IResourceFactory* resourceFactory =
-            internal::globals::getResourceFactoryFor(
-                (ResourceType)associatedEntry.m_type);
-
-        if (resourceFactory != nullptr) {
-            try {
-                std::shared_ptr<IResource> parsedResource =
-                    resourceFactory->create(
-                        associatedEntry.m_type, associatedEntry.m_instanceEx,
-                        associatedEntry.m_instance, associatedEntry.m_group,
-                        record.m_data);
-
-                if (parsedResource != nullptr) {
-                    this->m_resources.push_back(parsedResource);
-                } else {
-                    throw PackageException(
-                        fmt::format("Resource of type {:#x} returned no parsed "
-                                    "implementation.",
-                                    associatedEntry.m_type));
-                }
-            } catch (PackageException e) {
-                throw PackageException(fmt::format(
-                    "Exception while reading resource {:#x} ({}): {}",
-                    associatedEntry.m_type, resourceFactory->toString(),
-                    e.what()));
-            }
-        } else {
-            throw PackageException(
-                fmt::format("Unknown resource {:#x}, and for some reason no "
-                            "fallback factory was returned.",
-                            associatedEntry.m_type));
-        }
+        std::shared_ptr<IResource> parsedResource =
+            internal::globals::createResource(associatedEntry, record.m_data);
+
+        this->m_resources.push_back(parsedResource);
+        this->m_entryResources[record.m_index] = parsedResource;
     }
 
     this->m_valid = true;  // There should be better validation here, but
@@ -137,6 +93,9 @@ bool internal::InMemoryPackage::deleteResource(
 
     for (auto it = this->m_resources.begin(); it != this->m_resources.end();) {
         if (it->get() != nullptr && resource->equals(it->get())) {
+            std::replace(this->m_entryResources.begin(),
+                         this->m_entryResources.end(), *it,
+                         std::shared_ptr<IResource>());
             this->m_resources.erase(it);
 
             return true;
@@ -185,31 +144,78 @@ const PackageFlags internal::InMemoryPackage::getPackageFlags() const {
 
 const std::vector<IndexEntry> internal::InMemoryPackage::getPackageIndex()
     const {
-    std::vector<IndexEntry> entries;
+    IndexView view = this->getIndexView();
 
-    for (const auto& index : this->m_index.m_entries) {
-        IndexEntry entry = {(ResourceType)index.m_type,
-                            index.m_group,
-                            index.m_instanceEx,
-                            index.m_instance,
-                            index.m_position,
-                            index.m_size,
-                            index.m_extendedCompressionType != 0,
-                            index.m_sizeDecompressed,
-                            (CompressionType)index.m_compressionType,
-                            index.m_committed};
+    std::vector<IndexEntry> entries;
+    entries.reserve(view.size());
 
+    for (const auto& entry : view) {
         entries.push_back(entry);
     }
 
     return entries;
 }
 
-const std::vector<std::shared_ptr<IResource>>
+const IndexView internal::InMemoryPackage::getIndexView() const {
+    return IndexView(this->m_soaIndex);
+}
+
+const std::vector<std::shared_ptr<IResource>>&
 internal::InMemoryPackage::getResources() const {
     return this->m_resources;
 }
 
+std::shared_ptr<IResource> internal::InMemoryPackage::getResource(
+    uint32_t position) const {
+    if (position >= this->m_entryResources.size()) {
+        throw PackageException(
+            fmt::format("No index entry at position {}", position));
+    }
+
+    return this->m_entryResources[position];
+}
+
+const std::vector<uint32_t> internal::InMemoryPackage::findEntries(
+    const std::vector<ResourceType>& types,
+    std::optional<uint32_t> group) const {
+    soaindex::soa_filter_t filter{{}, group.has_value(), group.value_or(0)};
+
+    filter.m_types.reserve(types.size());
+    for (ResourceType type : types) {
+        filter.m_types.push_back((uint32_t)type);
+    }
+
+    return soaindex::filter(this->m_soaIndex, filter);
+}
+
+const internal::keyindex::key_index_t&
+internal::InMemoryPackage::getKeyIndex() const {
+    std::call_once(this->m_keyIndexBuilt, [this]() {
+        this->m_keyIndex = keyindex::build(this->m_soaIndex);
+    });
+
+    return this->m_keyIndex;
+}
+
+const int64_t internal::InMemoryPackage::findEntry(
+    const ResourceKey& key) const {
+    return keyindex::find(this->getKeyIndex(), key);
+}
+
+const std::vector<int64_t> internal::InMemoryPackage::findMany(
+    const std::vector<ResourceKey>& keys) const {
+    std::vector<int64_t> positions(keys.size());
+    keyindex::findMany(this->getKeyIndex(), keys.data(), keys.size(),
+                       positions.data());
+
+    return positions;
+}
+
+const bool internal::InMemoryPackage::mayContain(
+    const ResourceKey& key) const {
+    return bloomfilter::mayContain(this->m_keyFilter, key);
+}
+
 const lib::String internal::InMemoryPackage::toString() const {
     return fmt::format(
         "(InMemoryPackage) [ header={}, fileVersion={}, userVersion={}, "
@@ -28,6 +28,27 @@
 namespace s4pkg {
 
 void IPackage::write(std::ostream& stream, bool updateTime) const {
+    StreamByteSink sink(stream);
+    this->write(sink, updateTime);
+}
+
+void IPackage::write(ByteSink& sink, bool updateTime) const {
+    const std::vector<std::shared_ptr<IResource>>& resources =
+        this->getResources();
+
+    this->writeResources(
+        sink, updateTime, resources.size(),
+        [&resources](size_t i) -> std::shared_ptr<const IResource> {
+            return resources[i];
+        });
+}
+
+void IPackage::writeResources(
+    ByteSink& sink,
+    bool updateTime,
+    size_t resourceCount,
+    const std::function<std::shared_ptr<const IResource>(size_t)>& resourceAt)
+    const {
     // Construct flags structure
     PackageFlags flags = this->getPackageFlags();
 
@@ -41,13 +62,18 @@ void IPackage::write(std::ostream& stream, bool updateTime) const {
 
     index_t packageIndex{};
 
-    // Create an index entry for every resource
+    // 0-th step: make room for writing the header later
+    sink.seek(internal::layout::encodedSize<package_header_t>());
 
-    const std::vector<std::shared_ptr<IResource>> resources =
-        this->getResources();
+    // First we write out the resource blobs, one at a time, so only a single
+    // resource is held in memory. Every resource gets an index entry, which the
+    // method in streams updates with its size, decompressed size, and position
 
-    for (int i = 0; i < resources.size(); i++) {
-        std::shared_ptr<IResource> resource = resources[i];
+    for (uint32_t i = 0; i < (uint32_t)resourceCount; i++) {
+        std::shared_ptr<const IResource> resource = resourceAt(i);
+        if (resource == nullptr) {
+            continue;  // Deleted
+        }
 
         index_entry_t indexEntry{
             (uint32_t)resource->getResourceType(),
@@ -62,62 +88,44 @@ void IPackage::write(std::ostream& stream, bool updateTime) const {
             1  // m_committed
         };
 
+        uint32_t position = (uint32_t)packageIndex.m_entries.size();
         packageIndex.m_entries.push_back(indexEntry);
-    }
 
-    // Create a record table
-
-    records_t recordTable{};
-
-    // Create raw records for each resource
-
-    for (int i = 0; i < resources.size(); i++) {
-        std::shared_ptr<IResource> resource = resources[i];
         lib::ByteBuffer resourceData = resource->write();
 
-        raw_record_t record{(uint32_t)i, (uint32_t)resourceData.size(),
+        raw_record_t record{position, (uint32_t)resourceData.size(),
                             resourceData};
-
-        recordTable.m_records.push_back(record);
+        internal::streams::writeRecord(sink, packageIndex, position, record);
     }
 
-    // 0-th step: make room for writing the header later
-    stream.seekp(sizeof(package_header_t));
-
-    // First we write out the resource blobs, the method in streams takes in the
-    // index we have and updates the corresponding entries for size,
-    // decompressed size, and position
-
-    internal::streams::writeRecords(stream, packageIndex, recordTable);
-
     // We now save the current position in the stream, to later reference the
     // start of the index in the header
 
-    uint32_t indexPosition = (uint32_t)stream.tellp();
+    uint32_t indexPosition = (uint32_t)sink.tell();
 
     // Now we write out the package flags
 
-    internal::streams::writePackageFlags(stream, packageFlags);
+    internal::streams::writePackageFlags(sink, packageFlags);
 
     // If we have a constant group, type, or instance(ex), write it here
 
     if (flags.m_isConstantType) {
-        internal::streams::writeUint32(stream, this->getConstantType());
+        internal::streams::writeUint32(sink, this->getConstantType());
     }
 
     if (flags.m_isConstantGroup) {
-        internal::streams::writeUint32(stream, this->getConstantGroup());
+        internal::streams::writeUint32(sink, this->getConstantGroup());
     }
 
     if (flags.m_isConstantInstance) {
-        internal::streams::writeUint32(stream, this->getConstantInstanceEx());
+        internal::streams::writeUint32(sink, this->getConstantInstanceEx());
     }
 
     // And the index
 
-    internal::streams::writeIndex(stream, packageFlags, packageIndex);
+    internal::streams::writeIndex(sink, packageFlags, packageIndex);
 
-    uint32_t indexEnd = (uint32_t)stream.tellp();
+    uint32_t indexEnd = (uint32_t)sink.tell();
 
     // Now we create a header for the file
 
@@ -154,8 +162,8 @@ void IPackage::write(std::ostream& stream, bool updateTime) const {
 
     // And write the header at the start of the file
 
-    stream.seekp(0);
-    internal::streams::writePackageHeader(stream, packageHeader);
+    sink.seek(0);
+    internal::streams::writePackageHeader(sink, packageHeader);
 }
 
 };  // namespace s4pkg
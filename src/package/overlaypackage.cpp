@@ -0,0 +1,295 @@
+/*
+ * Copyright (c) 2022- Gerber Lóránt Viktor
+ * Author: Gerber Lóránt Viktor <glorantv@student.elte.hu>
+ *
+ * This file is part of s4pkg.
+ *
+ * s4pkg is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <s4pkg/package/overlaypackage.h>
+
+#include <s4pkg/packageexception.h>
+
+#include <algorithm>
+#include <unordered_set>
+
+#include <fmt/core.h>
+
+namespace s4pkg {
+
+static void appendEntry(internal::soaindex::soa_index_t& index,
+                        const IndexView& view,
+                        uint32_t position) {
+    index.m_types.push_back((uint32_t)view.getType(position));
+    index.m_groups.push_back(view.getGroup(position));
+    index.m_instanceExs.push_back(view.getInstanceEx(position));
+    index.m_instances.push_back(view.getInstance(position));
+    index.m_positions.push_back(view.getPosition(position));
+    index.m_sizes.push_back(view.getSize(position));
+    index.m_sizesDecompressed.push_back(view.getSizeDecompressed(position));
+    index.m_compressionTypes.push_back(
+        (uint16_t)view.getCompressionType(position));
+    index.m_committed.push_back(view.getCommitted(position));
+    index.m_extendedCompressionTypes.push_back(
+        view.isExtendedCompressionType(position) ? 1 : 0);
+}
+
+OverlayPackage::OverlayPackage(
+    const std::vector<std::shared_ptr<IPackage>>& layers,
+    LayerPrecedence precedence)
+    : m_layers(layers), m_precedence(precedence) {
+    size_t entryCount = 0;
+    for (const auto& layer : m_layers) {
+        if (layer == nullptr) {
+            throw PackageException("Layer of overlay is nullptr");
+        }
+
+        entryCount += layer->getIndexView().size();
+    }
+
+    // Layers are visited from the winning one down, so the first copy of a key
+    // seen is the one that is kept
+    std::vector<uint32_t> layerOrder(m_layers.size());
+    for (uint32_t i = 0; i < m_layers.size(); i++) {
+        layerOrder[i] = m_precedence == LAST_LAYER_WINS
+                            ? (uint32_t)m_layers.size() - 1 - i
+                            : i;
+    }
+
+    std::unordered_set<ResourceKey, ResourceKeyHash> seen;
+    seen.reserve(entryCount);
+
+    for (uint32_t layer : layerOrder) {
+        const IndexView view = m_layers[layer]->getIndexView();
+
+        for (uint32_t position = 0; position < view.size(); position++) {
+            if (!seen.insert(view.getKey(position)).second) {
+                continue;
+            }
+
+            appendEntry(m_index, view, position);
+            m_sources.push_back({layer, position});
+        }
+    }
+
+    m_keyIndex = internal::keyindex::build(m_index);
+    m_keyFilter = internal::bloomfilter::build(m_index);
+}
+
+const std::shared_ptr<IPackage> OverlayPackage::getLayer(uint32_t layer) const {
+    if (layer >= m_layers.size()) {
+        throw PackageException(
+            fmt::format("No layer {} in overlay of {} layers", layer,
+                        m_layers.size()));
+    }
+
+    return m_layers[layer];
+}
+
+const OverlaySource OverlayPackage::getSource(uint32_t position) const {
+    if (position >= m_sources.size()) {
+        throw PackageException(
+            fmt::format("No index entry at position {}", position));
+    }
+
+    return m_sources[position];
+}
+
+void OverlayPackage::flatten(std::ostream& stream, bool updateTime) const {
+    StreamByteSink sink(stream);
+
+    this->writeResources(
+        sink, updateTime, m_sources.size(),
+        [this](size_t i) -> std::shared_ptr<const IResource> {
+            return this->getResource((uint32_t)i);
+        });
+}
+
+bool OverlayPackage::deleteResource(
+    const std::shared_ptr<const IResource> resource) {
+    if (!resource) {
+        return false;
+    }
+
+    ResourceKey key = ResourceKey::fromParts(
+        (uint32_t)resource->getResourceType(), resource->getGroup(),
+        resource->getInstanceEx(), resource->getInstance());
+
+    int64_t found = internal::keyindex::find(m_keyIndex, key);
+    if (found < 0) {
+        return false;
+    }
+
+    // Rare enough that rebuilding the index is fine. The Bloom filter is kept,
+    // a stale positive only costs a lookup.
+    internal::soaindex::soa_index_t index;
+    std::vector<OverlaySource> sources;
+    IndexView view(m_index);
+
+    for (uint32_t i = 0; i < m_sources.size(); i++) {
+        if (i != (uint32_t)found) {
+            appendEntry(index, view, i);
+            sources.push_back(m_sources[i]);
+        }
+    }
+
+    m_index = std::move(index);
+    m_sources = std::move(sources);
+    m_keyIndex = internal::keyindex::build(m_index);
+
+    m_resources.erase(
+        std::remove_if(m_resources.begin(), m_resources.end(),
+                       [&key](const std::shared_ptr<IResource>& loaded) {
+                           return ResourceKey::fromParts(
+                                      (uint32_t)loaded->getResourceType(),
+                                      loaded->getGroup(),
+                                      loaded->getInstanceEx(),
+                                      loaded->getInstance()) == key;
+                       }),
+        m_resources.end());
+
+    return true;
+}
+
+bool OverlayPackage::isValid() const {
+    return std::all_of(m_layers.begin(), m_layers.end(),
+                       [](const std::shared_ptr<IPackage>& layer) {
+                           return layer->isValid();
+                       });
+}
+
+const PackageVersion OverlayPackage::getFileVersion() const {
+    if (m_layers.empty()) {
+        return {2, 1};
+    }
+
+    return m_layers.front()->getFileVersion();
+}
+
+const PackageVersion OverlayPackage::getUserVersion() const {
+    if (m_layers.empty()) {
+        return {0, 0};
+    }
+
+    return m_layers.front()->getUserVersion();
+}
+
+const int32_t OverlayPackage::getCreationTime() const {
+    int32_t time = 0;
+    for (const auto& layer : m_layers) {
+        time = std::max(time, layer->getCreationTime());
+    }
+
+    return time;
+}
+
+const int32_t OverlayPackage::getModifiedTime() const {
+    int32_t time = 0;
+    for (const auto& layer : m_layers) {
+        time = std::max(time, layer->getModifiedTime());
+    }
+
+    return time;
+}
+
+const PackageHeader OverlayPackage::getPackageHeader() const {
+    // The overlay isn't stored anywhere, so only the entry count is known
+    return {(uint32_t)m_index.size(), 0, 0, 0};
+}
+
+const PackageFlags OverlayPackage::getPackageFlags() const {
+    return {false, false, false};
+}
+
+const std::vector<IndexEntry> OverlayPackage::getPackageIndex() const {
+    IndexView view = this->getIndexView();
+
+    std::vector<IndexEntry> entries;
+    entries.reserve(view.size());
+
+    for (const auto& entry : view) {
+        entries.push_back(entry);
+    }
+
+    return entries;
+}
+
+const IndexView OverlayPackage::getIndexView() const {
+    return IndexView(m_index);
+}
+
+const std::vector<std::shared_ptr<IResource>>& OverlayPackage::getResources()
+    const {
+    std::call_once(m_resourcesLoaded, [this]() {
+        for (uint32_t i = 0; i < m_sources.size(); i++) {
+            std::shared_ptr<IResource> resource = this->getResource(i);
+
+            if (resource != nullptr) {
+                m_resources.push_back(resource);
+            }
+        }
+    });
+
+    return m_resources;
+}
+
+std::shared_ptr<IResource> OverlayPackage::getResource(
+    uint32_t position) const {
+    OverlaySource source = this->getSource(position);
+
+    return m_layers[source.m_layer]->getResource(source.m_position);
+}
+
+const std::vector<uint32_t> OverlayPackage::findEntries(
+    const std::vector<ResourceType>& types,
+    std::optional<uint32_t> group) const {
+    internal::soaindex::soa_filter_t filter{
+        {}, group.has_value(), group.value_or(0)};
+
+    filter.m_types.reserve(types.size());
+    for (ResourceType type : types) {
+        filter.m_types.push_back((uint32_t)type);
+    }
+
+    return internal::soaindex::filter(m_index, filter);
+}
+
+const int64_t OverlayPackage::findEntry(const ResourceKey& key) const {
+    return internal::keyindex::find(m_keyIndex, key);
+}
+
+const std::vector<int64_t> OverlayPackage::findMany(
+    const std::vector<ResourceKey>& keys) const {
+    std::vector<int64_t> positions(keys.size());
+    internal::keyindex::findMany(m_keyIndex, keys.data(), keys.size(),
+                                 positions.data());
+
+    return positions;
+}
+
+const bool OverlayPackage::mayContain(const ResourceKey& key) const {
+    return internal::bloomfilter::mayContain(m_keyFilter, key);
+}
+
+const lib::String OverlayPackage::toString() const {
+    return fmt::format(
+        "OverlayPackage [ layers={}, precedence={}, entries={} ]",
+        m_layers.size(),
+        m_precedence == LAST_LAYER_WINS ? "LAST_LAYER_WINS"
+                                        : "FIRST_LAYER_WINS",
+        m_index.size());
+}
+
+}  // namespace s4pkg
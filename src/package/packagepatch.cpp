@@ -0,0 +1,383 @@
+/*
+ * Copyright (c) 2022- Gerber Lóránt Viktor
+ * Author: Gerber Lóránt Viktor <glorantv@student.elte.hu>
+ *
+ * This file is part of s4pkg.
+ *
+ * s4pkg is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <s4pkg/package/packagepatch.h>
+
+#include <s4pkg/internal/hash.h>
+#include <s4pkg/internal/streams.h>
+#include <s4pkg/package/resourcekey.h>
+#include <s4pkg/packageexception.h>
+
+#include <algorithm>
+#include <cstring>
+#include <unordered_map>
+#include <vector>
+
+#include <fmt/core.h>
+
+namespace s4pkg {
+
+namespace streams = internal::streams;
+
+static const uint8_t g_patchMagic[4] = {'S', '4', 'P', 'P'};
+static constexpr uint32_t g_patchVersion = 1;
+
+// A patch is a list of operations, building the new file from start to end
+enum PatchOperation : uint8_t { COPY = 0, DATA = 1, END = 2 };
+
+static uint64_t streamSize(std::istream& stream) {
+    stream.seekg(0, std::ios_base::end);
+    uint64_t size = (uint64_t)stream.tellg();
+    stream.seekg(0);
+
+    return size;
+}
+
+static void readTable(std::istream& stream, package_table_t& table) {
+    stream.seekg(0);
+
+    if (!streams::hasPackageIdentifier(stream)) {
+        throw PackageException("Stream doesn't contain a package");
+    }
+
+    stream.seekg(0);
+    streams::readPackageTable(stream, table);
+}
+
+static void readRange(std::istream& stream,
+                      uint64_t position,
+                      uint64_t size,
+                      lib::ByteBuffer& value) {
+    value = lib::ByteBuffer(size);
+
+    stream.seekg(position);
+    stream.read((char*)value.data(), size);
+
+    if (!stream.good()) {
+        throw PackageException(fmt::format(
+            "Unexpected end of stream! Tried reading {} bytes.", size));
+    }
+}
+
+// Identifies the package a patch was made against, without reading its records
+static uint64_t hashTable(std::istream& stream, const package_table_t& table) {
+    uint64_t indexPosition = table.m_header.m_indexRecordPosition != 0
+                                 ? table.m_header.m_indexRecordPosition
+                                 : table.m_header.m_indexRecordPositionLow;
+
+    lib::ByteBuffer header;
+    lib::ByteBuffer index;
+    readRange(stream, 0, sizeof(package_header_t), header);
+    readRange(stream, indexPosition, table.m_header.m_indexRecordSize, index);
+
+    return internal::hash::hash64(
+        index.data(), index.size(),
+        internal::hash::hashWide(header.data(), header.size()));
+}
+
+static ResourceKey keyOf(const package_table_t& table,
+                         const index_entry_t& entry) {
+    return ResourceKey::fromParts(
+        table.m_flags.m_constantType != 0 ? table.m_constantType
+                                          : entry.m_type,
+        table.m_flags.m_constantGroup != 0 ? table.m_constantGroup
+                                           : entry.m_group,
+        table.m_flags.m_constantInstanceEx != 0 ? table.m_constantInstanceEx
+                                                : entry.m_instanceEx,
+        entry.m_instance);
+}
+
+static std::vector<const index_entry_t*> inFileOrder(
+    const package_table_t& table) {
+    std::vector<const index_entry_t*> entries;
+    for (const index_entry_t& entry : table.m_index.m_entries) {
+        entries.push_back(&entry);
+    }
+
+    std::stable_sort(entries.begin(), entries.end(),
+                     [](const index_entry_t* a, const index_entry_t* b) {
+                         return a->m_position < b->m_position;
+                     });
+
+    return entries;
+}
+
+namespace {
+
+// Writes the operations of a patch, merging copies of adjacent ranges
+class PatchWriter {
+   private:
+    std::ostream& m_stream;
+    uint64_t m_size;
+
+    uint64_t m_copyPosition;
+    uint64_t m_copySize;
+
+    void flushCopy() {
+        if (m_copySize == 0) {
+            return;
+        }
+
+        streams::writeUint8(m_stream, PatchOperation::COPY);
+        streams::writeUint64(m_stream, m_copyPosition);
+        streams::writeUint64(m_stream, m_copySize);
+        m_size += 17;
+
+        m_copySize = 0;
+    }
+
+   public:
+    explicit PatchWriter(std::ostream& stream)
+        : m_stream(stream), m_size(0), m_copyPosition(0), m_copySize(0) {}
+
+    void writeHeader(uint64_t oldSize,
+                     uint64_t oldTableHash,
+                     uint64_t newSize) {
+        streams::writeBytes(m_stream, g_patchMagic, 4);
+        streams::writeUint32(m_stream, g_patchVersion);
+        streams::writeUint64(m_stream, oldSize);
+        streams::writeUint64(m_stream, oldTableHash);
+        streams::writeUint64(m_stream, newSize);
+        m_size += 32;
+    }
+
+    void copy(uint64_t position, uint64_t size) {
+        if (m_copySize != 0 && m_copyPosition + m_copySize == position) {
+            m_copySize += size;
+            return;
+        }
+
+        flushCopy();
+        m_copyPosition = position;
+        m_copySize = size;
+    }
+
+    void data(const uint8_t* buffer, uint64_t size) {
+        flushCopy();
+
+        streams::writeUint8(m_stream, PatchOperation::DATA);
+        streams::writeUint64(m_stream, size);
+        streams::writeBytes(m_stream, buffer, (int)size);
+        m_size += 9 + size;
+    }
+
+    void data(std::istream& input, uint64_t position, uint64_t size) {
+        flushCopy();
+
+        streams::writeUint8(m_stream, PatchOperation::DATA);
+        streams::writeUint64(m_stream, size);
+
+        input.seekg(position);
+        streams::copyBytes(input, m_stream, size);
+        m_size += 9 + size;
+    }
+
+    void end() {
+        flushCopy();
+
+        streams::writeUint8(m_stream, PatchOperation::END);
+        m_size += 1;
+    }
+
+    uint64_t getSize() const { return m_size; }
+};
+
+}  // namespace
+
+const PackageDiffResult diffPackages(std::istream& oldPackage,
+                                     std::istream& newPackage,
+                                     std::ostream& patch) {
+    package_table_t oldTable{};
+    package_table_t newTable{};
+    readTable(oldPackage, oldTable);
+    readTable(newPackage, newTable);
+
+    PatchWriter writer(patch);
+    writer.writeHeader(streamSize(oldPackage),
+                       hashTable(oldPackage, oldTable),
+                       streamSize(newPackage));
+
+    // Every record of the old version, by the hash of its stored bytes
+    std::unordered_map<uint64_t, const index_entry_t*> oldRecords;
+    std::unordered_map<ResourceKey, uint64_t, ResourceKeyHash> oldHashes;
+
+    lib::ByteBuffer stored;
+    lib::ByteBuffer existing;
+
+    for (const index_entry_t* entry : inFileOrder(oldTable)) {
+        streams::readRawRecord(oldPackage, *entry, stored);
+
+        uint64_t hash = internal::hash::hashWide(stored.data(), stored.size());
+        oldRecords.emplace(hash, entry);
+        oldHashes[keyOf(oldTable, *entry)] = hash;
+    }
+
+    // The new version is rebuilt from start to end: its records are copied
+    // from the old version where possible, everything else (the header, the
+    // index, new records and any gaps) is stored in the patch
+    std::unordered_map<ResourceKey, uint64_t, ResourceKeyHash> newHashes;
+    uint64_t newSize = streamSize(newPackage);
+    uint64_t cursor = 0;
+
+    for (const index_entry_t* entry : inFileOrder(newTable)) {
+        uint64_t start = entry->m_position;
+        uint64_t end = start + entry->m_size;
+
+        streams::readRawRecord(newPackage, *entry, stored);
+        uint64_t hash = internal::hash::hashWide(stored.data(), stored.size());
+        newHashes[keyOf(newTable, *entry)] = hash;
+
+        if (end <= cursor) {
+            continue;  // Shares its bytes with an earlier record
+        }
+
+        if (start < cursor) {
+            writer.data(newPackage, cursor, end - cursor);
+            cursor = end;
+            continue;
+        }
+
+        if (start > cursor) {
+            writer.data(newPackage, cursor, start - cursor);
+        }
+
+        // Same hash isn't enough, the bytes have to be the same
+        auto found = oldRecords.find(hash);
+        bool identical = false;
+
+        if (found != oldRecords.end() &&
+            found->second->m_size == entry->m_size) {
+            streams::readRawRecord(oldPackage, *found->second, existing);
+            identical = memcmp(existing.data(), stored.data(),
+                               stored.size()) == 0;
+        }
+
+        if (identical) {
+            writer.copy(found->second->m_position, entry->m_size);
+        } else {
+            writer.data(stored.data(), stored.size());
+        }
+
+        cursor = end;
+    }
+
+    if (newSize > cursor) {
+        writer.data(newPackage, cursor, newSize - cursor);
+    }
+
+    writer.end();
+
+    if (!patch.good()) {
+        throw PackageException("Failed to write patch");
+    }
+
+    PackageDiffResult result{0, 0, 0, 0, writer.getSize()};
+
+    for (const auto& [key, hash] : newHashes) {
+        auto found = oldHashes.find(key);
+
+        if (found == oldHashes.end()) {
+            result.m_addedCount++;
+        } else if (found->second != hash) {
+            result.m_changedCount++;
+        } else {
+            result.m_unchangedCount++;
+        }
+    }
+
+    for (const auto& [key, hash] : oldHashes) {
+        if (newHashes.count(key) == 0) {
+            result.m_removedCount++;
+        }
+    }
+
+    return result;
+}
+
+void applyPatch(std::istream& oldPackage,
+                std::istream& patch,
+                std::ostream& newPackage) {
+    uint8_t magic[4];
+    uint32_t version;
+    streams::readBytes(patch, magic, 4);
+    streams::readUint32(patch, version);
+
+    if (memcmp(magic, g_patchMagic, 4) != 0 || version != g_patchVersion) {
+        throw PackageException(
+            "Stream doesn't contain a patch of this version");
+    }
+
+    uint64_t oldSize;
+    uint64_t oldTableHash;
+    uint64_t newSize;
+    streams::readUint64(patch, oldSize);
+    streams::readUint64(patch, oldTableHash);
+    streams::readUint64(patch, newSize);
+
+    package_table_t oldTable{};
+    readTable(oldPackage, oldTable);
+
+    if (streamSize(oldPackage) != oldSize ||
+        hashTable(oldPackage, oldTable) != oldTableHash) {
+        throw PackageException(
+            "The patch was made against a different package");
+    }
+
+    uint64_t written = 0;
+
+    while (true) {
+        uint8_t operation;
+        streams::readUint8(patch, operation);
+
+        if (operation == PatchOperation::END) {
+            break;
+        }
+
+        uint64_t size;
+
+        if (operation == PatchOperation::COPY) {
+            uint64_t position;
+            streams::readUint64(patch, position);
+            streams::readUint64(patch, size);
+
+            if (position > oldSize || size > oldSize - position) {
+                throw PackageException("Patch copies beyond the old package");
+            }
+
+            oldPackage.seekg(position);
+            streams::copyBytes(oldPackage, newPackage, size);
+        } else if (operation == PatchOperation::DATA) {
+            streams::readUint64(patch, size);
+            streams::copyBytes(patch, newPackage, size);
+        } else {
+            throw PackageException(
+                fmt::format("Unknown patch operation {}", operation));
+        }
+
+        written += size;
+    }
+
+    if (written != newSize) {
+        throw PackageException(fmt::format(
+            "Patch produced {} bytes instead of {}", written, newSize));
+    }
+}
+
+}  // namespace s4pkg
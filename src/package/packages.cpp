@@ -20,6 +20,7 @@
 
 #include <s4pkg/package/packages.h>
 
+#include <s4pkg/internal/filepackage.h>
 #include <s4pkg/internal/inmemorypackage.h>
 #include <s4pkg/packageexception.h>
 
@@ -29,9 +30,7 @@ namespace s4pkg {
 
 S4PKG_EXPORT const PackageLoadResult loadPackage(std::istream& stream) {
     try {
-        return {std::make_shared<internal::InMemoryPackage>(
-                    internal::InMemoryPackage(stream)),
-                ""};
+        return {std::make_shared<internal::InMemoryPackage>(stream), ""};
     } catch (PackageException e) {
         return {nullptr, e.what()};
     }
@@ -39,4 +38,43 @@ S4PKG_EXPORT const PackageLoadResult loadPackage(std::istream& stream) {
     return {nullptr, ""};
 }
 
+S4PKG_EXPORT const PackageLoadResult loadPackage(ByteSource& source) {
+    try {
+        source.seek(0);
+        return {std::make_shared<internal::InMemoryPackage>(source), ""};
+    } catch (PackageException e) {
+        return {nullptr, e.what()};
+    }
+}
+
+S4PKG_EXPORT const PackageLoadResult openPackage(
+    const lib::String& path,
+    const std::shared_ptr<ResourceCache>& cache) {
+    try {
+        return {std::make_shared<internal::FilePackage>(path.c_str(), cache),
+                ""};
+    } catch (PackageException e) {
+        return {nullptr, e.what()};
+    }
+}
+
+S4PKG_EXPORT const std::vector<PackageLookupResult> findInPackages(
+    const std::vector<std::shared_ptr<IPackage>>& packages,
+    const ResourceKey& key) {
+    std::vector<PackageLookupResult> results;
+
+    for (const auto& package : packages) {
+        if (package == nullptr || !package->mayContain(key)) {
+            continue;
+        }
+
+        int64_t position = package->findEntry(key);
+        if (position >= 0) {
+            results.push_back({package, position});
+        }
+    }
+
+    return results;
+}
+
 }  // namespace s4pkg
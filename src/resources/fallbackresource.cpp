@@ -25,12 +25,12 @@
 namespace s4pkg::resources {
 
 lib::ByteBuffer FallbackResource::write() const {
-    return this->m_data;
+    return *this->m_data;
 }
 
 const lib::String FallbackResource::toString() const {
     return fmt::format("FallbackResource [ size={}, type={:#x} ]",
-                       this->m_data.size(), this->getResourceType());
+                       this->m_data->size(), this->getResourceType());
 }
 
 }  // namespace s4pkg::resources
@@ -28,7 +28,7 @@ std::shared_ptr<s4pkg::IResource> FallbackResourceFactory::create(
     uint32_t instanceEx,
     uint32_t instance,
     uint32_t group,
-    const lib::ByteBuffer& data) const {
+    const std::shared_ptr<const lib::ByteBuffer>& data) const {
     return std::make_shared<resources::FallbackResource>(type, instanceEx,
                                                          instance, group, data);
 }
@@ -22,9 +22,112 @@
 
 namespace s4pkg::resources {
 
+std::shared_ptr<internal::Image> IImageResource::getImage() const {
+    std::lock_guard<std::mutex> lock(m_imageMutex);
+
+    if (m_pixelCache != nullptr && !m_modified && m_probed) {
+        std::shared_ptr<const lib::ByteBuffer> pixels =
+            m_pixelCache->getOrLoad(m_pixelCacheKey, [this]() {
+                std::shared_ptr<internal::Image> image =
+                    internal::imagecoder::decode(*m_data, m_format);
+
+                return image ? image->getPixelData() : lib::ByteBuffer();
+            });
+        m_decoded = true;
+
+        // Empty when decoding gave no image
+        if (pixels->size() != (size_t)m_width * m_height * 4) {
+            return nullptr;
+        }
+
+        return std::make_shared<internal::Image>(m_width, m_height, *pixels);
+    }
+
+    if (!m_decoded) {
+        m_image = internal::imagecoder::decode(*m_data, m_format);
+        m_decoded = true;
+    }
+
+    return m_image;
+}
+
+uint32_t IImageResource::getWidth() const {
+    if (m_probed) {
+        return m_width;
+    }
+
+    std::shared_ptr<internal::Image> image = getImage();
+    return image ? image->getWidth() : 0;
+}
+
+uint32_t IImageResource::getHeight() const {
+    if (m_probed) {
+        return m_height;
+    }
+
+    std::shared_ptr<internal::Image> image = getImage();
+    return image ? image->getHeight() : 0;
+}
+
+const lib::ByteBuffer IImageResource::getPixelData() const {
+    std::shared_ptr<internal::Image> image = getImage();
+    if (image) {
+        return image->getPixelData();
+    } else {
+        return {};
+    }
+}
+
+bool IImageResource::isDecoded() const {
+    std::lock_guard<std::mutex> lock(m_imageMutex);
+    return m_decoded;
+}
+
+void IImageResource::setImage(uint32_t width,
+                              uint32_t height,
+                              lib::ByteBuffer pixelData) {
+    std::lock_guard<std::mutex> lock(m_imageMutex);
+
+    m_image = std::make_shared<internal::Image>(width, height, pixelData);
+    m_decoded = true;
+    m_modified = true;
+
+    m_width = width;
+    m_height = height;
+    m_probed = true;
+}
+
+void IImageResource::setPixelCache(const std::shared_ptr<ResourceCache>& cache,
+                                   const ResourceCacheKey& key) {
+    std::lock_guard<std::mutex> lock(m_imageMutex);
+
+    m_pixelCache = cache;
+    m_pixelCacheKey = key;
+}
+
+void IImageResource::setDataWithFormat(
+    internal::imagecoder::ImageFormat format,
+    const std::shared_ptr<const lib::ByteBuffer>& data) {
+    std::lock_guard<std::mutex> lock(m_imageMutex);
+
+    m_format = format;
+    m_data = data;
+    m_probed = internal::imagecoder::probe(*data, format, m_width, m_height);
+    m_modified = false;
+
+    m_image = nullptr;
+    m_decoded = false;
+}
+
 lib::ByteBuffer IImageResource::write() const {
-    if (m_image) {
-        return internal::imagecoder::encode(*this->m_image, this->m_format);
+    if (!m_modified) {
+        return *m_data;
+    }
+
+    std::shared_ptr<internal::Image> image = getImage();
+    if (image) {
+        return internal::imagecoder::encode(*image, this->m_format,
+                                            this->m_encodeOptions);
     } else {
         return {};
     }
@@ -28,7 +28,7 @@ std::shared_ptr<s4pkg::IResource> ThumbnailResourceFactory::create(
     uint32_t instanceEx,
     uint32_t instance,
     uint32_t group,
-    const lib::ByteBuffer& data) const {
+    const std::shared_ptr<const lib::ByteBuffer>& data) const {
     if (type == ResourceType::THUMBNAIL_IMAGE) {
         return std::make_shared<resources::ts4::ThumbnailResource>(
             (s4pkg::ResourceType)type, instanceEx, instance, group, data);
@@ -0,0 +1,303 @@
+/*
+ * Copyright (c) 2022- Gerber Lóránt Viktor
+ * Author: Gerber Lóránt Viktor <glorantv@student.elte.hu>
+ *
+ * This file is part of s4pkg.
+ *
+ * s4pkg is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <s4pkg/store/recordstore.h>
+
+#include <s4pkg/internal/hash.h>
+#include <s4pkg/internal/streams.h>
+#include <s4pkg/packageexception.h>
+
+#include <algorithm>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <limits>
+#include <numeric>
+
+#include <fmt/core.h>
+
+namespace s4pkg {
+
+namespace fs = std::filesystem;
+namespace recordstore = internal::recordstore;
+namespace streams = internal::streams;
+
+static const std::string g_manifestExtension = ".manifest";
+
+static void checkName(const std::string& name) {
+    if (name.empty() || name == "." || name == ".." ||
+        name.find_first_of("/\\") != std::string::npos) {
+        throw PackageException(
+            fmt::format("Invalid package name in record store: {}", name));
+    }
+}
+
+RecordStore::RecordStore(const lib::String& rootPath)
+    : m_rootPath(rootPath.c_str()), m_packSize(0) {
+    std::error_code error;
+    fs::create_directories(fs::u8path(m_rootPath) / "manifests", error);
+    if (error) {
+        throw PackageException(
+            fmt::format("Failed to create record store {}: {}", m_rootPath,
+                        error.message()));
+    }
+
+    m_packSize = recordstore::scanPack(this->getPackPath(), m_records);
+}
+
+std::string RecordStore::getPackPath() const {
+    return (fs::u8path(m_rootPath) / "records.pack").u8string();
+}
+
+std::string RecordStore::getManifestPath(const std::string& name) const {
+    return (fs::u8path(m_rootPath) / "manifests" /
+            fs::u8path(name + g_manifestExtension))
+        .u8string();
+}
+
+const RecordStoreAddResult RecordStore::addPackage(
+    const lib::String& name,
+    const lib::String& packagePath) {
+    checkName(name.c_str());
+
+    std::ifstream stream(fs::u8path(packagePath.c_str()),
+                         std::ios_base::binary);
+    if (!stream.good() || !streams::hasPackageIdentifier(stream)) {
+        throw PackageException(
+            fmt::format("{} is not a package file", packagePath.c_str()));
+    }
+
+    stream.seekg(0);
+
+    recordstore::package_manifest_t manifest{};
+    streams::readPackageTable(stream, manifest.m_table);
+
+    const std::vector<index_entry_t>& entries =
+        manifest.m_table.m_index.m_entries;
+    manifest.m_hashes.assign(entries.size(), 0);
+
+    // Reading in file order keeps the reads sequential
+    std::vector<size_t> order(entries.size());
+    std::iota(order.begin(), order.end(), 0);
+    std::sort(order.begin(), order.end(), [&entries](size_t a, size_t b) {
+        return entries[a].m_position < entries[b].m_position;
+    });
+
+    RecordStoreAddResult result{(uint32_t)entries.size(), 0, 0};
+    uint64_t packSizeBefore = m_packSize;
+
+    std::ofstream pack(fs::u8path(this->getPackPath()),
+                       std::ios_base::binary | std::ios_base::app);
+    std::ifstream packReader;
+
+    lib::ByteBuffer stored;
+    lib::ByteBuffer existing;
+
+    try {
+        for (size_t i : order) {
+            streams::readRawRecord(stream, entries[i], stored);
+
+            uint64_t hash =
+                internal::hash::hashWide(stored.data(), stored.size());
+            manifest.m_hashes[i] = hash;
+
+            auto found = m_records.find(hash);
+            if (found == m_records.end()) {
+                m_records[hash] = recordstore::appendRecord(pack, m_packSize,
+                                                            hash, stored);
+                result.m_newRecordCount++;
+                continue;
+            }
+
+            // A record is only ever shared with a byte-identical one, even if
+            // the hashes collide
+            pack.flush();
+            if (!packReader.is_open()) {
+                packReader.open(fs::u8path(this->getPackPath()),
+                                std::ios_base::binary);
+            }
+
+            recordstore::readRecord(packReader, found->second, existing);
+            if (existing.size() != stored.size() ||
+                memcmp(existing.data(), stored.data(), stored.size()) != 0) {
+                throw PackageException(fmt::format(
+                    "Hash collision between records in {}",
+                    packagePath.c_str()));
+            }
+        }
+
+        // The records have to be in place before the manifest refers to them
+        pack.flush();
+        if (!pack.good()) {
+            throw PackageException("Failed to append to pack file");
+        }
+    } catch (PackageException e) {
+        // Whatever made it into the pack file is still usable
+        pack.close();
+        m_packSize = recordstore::scanPack(this->getPackPath(), m_records);
+        throw e;
+    }
+
+    pack.close();
+    recordstore::writeManifest(this->getManifestPath(name.c_str()), manifest);
+
+    result.m_newBytes = m_packSize - packSizeBefore;
+    return result;
+}
+
+void RecordStore::checkout(const lib::String& name,
+                           const lib::String& outputPath) const {
+    checkName(name.c_str());
+
+    if (!this->hasPackage(name)) {
+        throw PackageException(fmt::format(
+            "No package named {} in record store", name.c_str()));
+    }
+
+    recordstore::package_manifest_t manifest{};
+    recordstore::readManifest(this->getManifestPath(name.c_str()), manifest);
+
+    package_table_t& table = manifest.m_table;
+    std::vector<index_entry_t>& entries = table.m_index.m_entries;
+
+    // Every record is written once, in the order of the pack file, so that
+    // reading the pack file is sequential
+    std::vector<uint64_t> hashes = manifest.m_hashes;
+    for (uint64_t hash : hashes) {
+        if (m_records.count(hash) == 0) {
+            throw PackageException(fmt::format(
+                "Record {:016x} of {} is missing from the pack file", hash,
+                name.c_str()));
+        }
+    }
+
+    std::sort(hashes.begin(), hashes.end());
+    hashes.erase(std::unique(hashes.begin(), hashes.end()), hashes.end());
+    std::sort(hashes.begin(), hashes.end(), [this](uint64_t a, uint64_t b) {
+        return m_records.at(a).m_offset < m_records.at(b).m_offset;
+    });
+
+    std::ifstream pack(fs::u8path(this->getPackPath()), std::ios_base::binary);
+    std::ofstream stream(fs::u8path(outputPath.c_str()),
+                         std::ios_base::binary | std::ios_base::trunc);
+    if (!pack.good() || !stream.good()) {
+        throw PackageException(fmt::format("Failed to check out {} to {}",
+                                           name.c_str(), outputPath.c_str()));
+    }
+
+    // Make room for the header, it is written once the index position is
+    // known
+    streams::writePackageHeader(stream, table.m_header);
+
+    std::unordered_map<uint64_t, uint32_t> positions;
+    lib::ByteBuffer record;
+
+    for (uint64_t hash : hashes) {
+        uint64_t position = (uint64_t)stream.tellp();
+        if (position > std::numeric_limits<uint32_t>::max()) {
+            throw PackageException(
+                fmt::format("{} is too large for a package", name.c_str()));
+        }
+
+        positions[hash] = (uint32_t)position;
+
+        recordstore::readRecord(pack, m_records.at(hash), record);
+        streams::writeBytes(stream, record.data(), (int)record.size());
+    }
+
+    for (size_t i = 0; i < entries.size(); i++) {
+        entries[i].m_position = positions[manifest.m_hashes[i]];
+    }
+
+    uint64_t indexPosition = (uint64_t)stream.tellp();
+
+    streams::writePackageFlags(stream, table.m_flags);
+
+    if (table.m_flags.m_constantType != 0) {
+        streams::writeUint32(stream, table.m_constantType);
+    }
+
+    if (table.m_flags.m_constantGroup != 0) {
+        streams::writeUint32(stream, table.m_constantGroup);
+    }
+
+    if (table.m_flags.m_constantInstanceEx != 0) {
+        streams::writeUint32(stream, table.m_constantInstanceEx);
+    }
+
+    streams::writeIndex(stream, table.m_flags, table.m_index);
+
+    uint64_t indexEnd = (uint64_t)stream.tellp();
+
+    // The header is kept as it was, apart from where the index is
+    package_header_t header = table.m_header;
+    header.m_indexRecordEntryCount = (uint32_t)entries.size();
+    header.m_indexRecordPositionLow = 0;
+    header.m_indexRecordSize = (uint32_t)(indexEnd - indexPosition);
+    header.m_indexRecordPosition = indexPosition;
+
+    stream.seekp(0);
+    streams::writePackageHeader(stream, header);
+
+    if (!stream.good()) {
+        throw PackageException(
+            fmt::format("Failed to write {}", outputPath.c_str()));
+    }
+}
+
+bool RecordStore::removePackage(const lib::String& name) {
+    checkName(name.c_str());
+
+    std::error_code error;
+    return fs::remove(fs::u8path(this->getManifestPath(name.c_str())), error);
+}
+
+bool RecordStore::hasPackage(const lib::String& name) const {
+    std::error_code error;
+    return fs::is_regular_file(
+        fs::u8path(this->getManifestPath(name.c_str())), error);
+}
+
+const std::vector<lib::String> RecordStore::getPackageNames() const {
+    std::vector<std::string> names;
+
+    std::error_code error;
+    fs::directory_iterator iterator(fs::u8path(m_rootPath) / "manifests",
+                                    error);
+
+    for (; !error && iterator != fs::directory_iterator();
+         iterator.increment(error)) {
+        const fs::path& path = iterator->path();
+        if (path.extension().u8string() == g_manifestExtension) {
+            names.push_back(path.stem().u8string());
+        }
+    }
+
+    std::sort(names.begin(), names.end());
+    return std::vector<lib::String>(names.begin(), names.end());
+}
+
+const lib::String RecordStore::toString() const {
+    return fmt::format(
+        "RecordStore [ rootPath={}, recordCount={}, packSize={} ]", m_rootPath,
+        m_records.size(), m_packSize);
+}
+
+}  // namespace s4pkg
@@ -22,20 +22,141 @@
 #define CATCH_CONFIG_WINDOWS_CRTDBG 1
 #include "catch.hpp"
 
+#include <s4pkg/cache/resourcecache.h>
+#include <s4pkg/cache/shareddecodecache.h>
+#include <s4pkg/daemon/indexclient.h>
+#include <s4pkg/daemon/indexserver.h>
+#include <s4pkg/internal/binarycursor.h>
 #include <s4pkg/internal/dds.h>
+#include <s4pkg/internal/dst.h>
 #include <s4pkg/internal/imagecoder.h>
+#include <s4pkg/internal/layout.h>
+#include <s4pkg/internal/membuf.h>
+#include <s4pkg/internal/mipmap.h>
 #include <s4pkg/internal/rle.h>
+#include <s4pkg/io/bytesink.h>
+#include <s4pkg/io/bytesource.h>
+#include <s4pkg/library/conflictdetector.h>
+#include <s4pkg/library/dedupanalyzer.h>
+#include <s4pkg/library/librarywatcher.h>
+#include <s4pkg/library/packagelibrary.h>
 #include <s4pkg/package/ipackage.h>
+#include <s4pkg/package/overlaypackage.h>
+#include <s4pkg/package/packagepatch.h>
 #include <s4pkg/package/packages.h>
+#include <s4pkg/packageexception.h>
+#include <s4pkg/resources/ts4/dstresource.h>
+#include <s4pkg/store/recordstore.h>
 #include <s4pkg/version.h>
 
+#include <algorithm>
+#include <filesystem>
 #include <fstream>
 #include <iostream>
 #include <istream>
+#include <sstream>
+#include <string>
+#include <thread>
+
+#include <squish.h>
 
 #define STB_IMAGE_WRITE_IMPLEMENTATION
 #include <stb_image_write.h>
 
+// Resources used to build packages in memory, so that tests don't need files
+// on disk
+struct TestResource {
+    uint32_t m_type;
+    uint32_t m_group;
+    uint32_t m_instanceEx;
+    uint32_t m_instance;
+    std::string m_data;
+};
+
+static void appendUint32(std::string& out, uint32_t value) {
+    for (int i = 0; i < 4; i++) {
+        out.push_back((char)((value >> (i * 8)) & 0xFF));
+    }
+}
+
+// Wraps data in a zlib stream made of a single stored (not deflated) block
+static std::string zlibStored(const std::string& data) {
+    std::string out = "\x78\x01";
+    out.push_back(1);  // final block, stored
+    out.push_back((char)(data.size() & 0xFF));
+    out.push_back((char)(data.size() >> 8));
+    out.push_back((char)(~data.size() & 0xFF));
+    out.push_back((char)((~data.size() >> 8) & 0xFF));
+    out += data;
+
+    uint32_t a = 1, b = 0;
+    for (unsigned char c : data) {
+        a = (a + c) % 65521;
+        b = (b + a) % 65521;
+    }
+    for (int i = 3; i >= 0; i--) {
+        out.push_back((char)((((b << 16) | a) >> (i * 8)) & 0xFF));
+    }
+
+    return out;
+}
+
+// Builds a DBPF 2.1 package with uncompressed (or zlib) records and no
+// constant flags
+static std::string makePackage(const std::vector<TestResource>& resources,
+                               bool zlib = false) {
+    std::string records;
+    std::string index;
+
+    appendUint32(index, 0);  // flags
+
+    for (const auto& resource : resources) {
+        std::string stored =
+            zlib ? zlibStored(resource.m_data) : resource.m_data;
+
+        appendUint32(index, resource.m_type);
+        appendUint32(index, resource.m_group);
+        appendUint32(index, resource.m_instanceEx);
+        appendUint32(index, resource.m_instance);
+        appendUint32(index, 96 + (uint32_t)records.size());
+        appendUint32(index, (uint32_t)stored.size() | 0x80000000);
+        appendUint32(index, (uint32_t)resource.m_data.size());
+        // uncompressed or zlib, committed
+        appendUint32(index, zlib ? 0x00015a42 : 0x00010000);
+
+        records += stored;
+    }
+
+    std::string header = "DBPF";
+    appendUint32(header, 2);  // file version
+    appendUint32(header, 1);
+    for (int i = 0; i < 6; i++) {  // user version, unused, times, unused
+        appendUint32(header, 0);
+    }
+    appendUint32(header, (uint32_t)resources.size());
+    appendUint32(header, 0);
+    appendUint32(header, (uint32_t)index.size());
+    for (int i = 0; i < 3; i++) {
+        appendUint32(header, 0);
+    }
+    appendUint32(header, 3);
+    appendUint32(header, 96 + (uint32_t)records.size());  // 64-bit position
+    appendUint32(header, 0);
+    for (int i = 0; i < 6; i++) {
+        appendUint32(header, 0);
+    }
+
+    return header + records + index;
+}
+
+static void writeFile(const std::filesystem::path& path,
+                      const std::string& contents) {
+    std::filesystem::create_directories(path.parent_path());
+
+    std::ofstream stream(path, std::ios_base::binary);
+    stream.write(contents.data(), contents.size());
+}
+
 TEST_CASE("Test RLE2", "imagecoder") {
     std::ifstream rleStream("./test.rle2", std::ios_base::binary);
 
@@ -210,3 +331,1718 @@ TEST_CASE("Test bad in-memory package", "package") {
     INFO(package.m_errorMessage.c_str());
     REQUIRE(package.m_package == nullptr);
 }
+
+TEST_CASE("Test index queries", "package") {
+    std::vector<TestResource> resources;
+    for (uint32_t i = 0; i < 37; i++) {
+        resources.push_back({0x1000 + (i % 3), i % 2, 0, i, "data"});
+    }
+
+    std::istringstream packageStream(makePackage(resources));
+    s4pkg::PackageLoadResult package = s4pkg::loadPackage(packageStream);
+
+    INFO(package.m_errorMessage.c_str());
+    REQUIRE(package.m_package != nullptr);
+
+    std::vector<uint32_t> everything = package.m_package->findEntries({});
+    REQUIRE(everything.size() == resources.size());
+
+    std::vector<uint32_t> matches = package.m_package->findEntries(
+        {(s4pkg::ResourceType)0x1000, (s4pkg::ResourceType)0x1002}, 1);
+
+    std::vector<uint32_t> expected;
+    for (uint32_t i = 0; i < resources.size(); i++) {
+        if (resources[i].m_type != 0x1001 && resources[i].m_group == 1) {
+            expected.push_back(i);
+        }
+    }
+
+    REQUIRE(matches == expected);
+}
+
+TEST_CASE("Test index view", "package") {
+    std::vector<TestResource> resources;
+    for (uint32_t i = 0; i < 5; i++) {
+        resources.push_back({0x2000 + i, 7, i, 100 + i, std::string(i, 'x')});
+    }
+
+    std::istringstream packageStream(makePackage(resources));
+    s4pkg::PackageLoadResult package = s4pkg::loadPackage(packageStream);
+
+    INFO(package.m_errorMessage.c_str());
+    REQUIRE(package.m_package != nullptr);
+
+    s4pkg::IndexView view = package.m_package->getIndexView();
+    std::vector<s4pkg::IndexEntry> copied =
+        package.m_package->getPackageIndex();
+
+    REQUIRE(view.size() == resources.size());
+    REQUIRE(copied.size() == resources.size());
+
+    uint32_t i = 0;
+    for (const auto& entry : view) {
+        REQUIRE(entry.m_type == (s4pkg::ResourceType)resources[i].m_type);
+        REQUIRE(entry.m_instanceEx == resources[i].m_instanceEx);
+        REQUIRE(entry.m_size == resources[i].m_data.size());
+        REQUIRE(copied[i].m_instance == view.getInstance(i));
+        i++;
+    }
+
+    REQUIRE(&package.m_package->getResources() ==
+            &package.m_package->getResources());
+}
+
+TEST_CASE("Test key lookups", "package") {
+    std::vector<TestResource> resources;
+    for (uint32_t i = 0; i < 50; i++) {
+        // Deliberately not in key order
+        resources.push_back({0x3000 + (i * 7) % 5, i % 3, i, 50 - i, "x"});
+    }
+
+    std::istringstream packageStream(makePackage(resources));
+    s4pkg::PackageLoadResult package = s4pkg::loadPackage(packageStream);
+
+    INFO(package.m_errorMessage.c_str());
+    REQUIRE(package.m_package != nullptr);
+
+    std::vector<s4pkg::ResourceKey> keys;
+    for (uint32_t i = 0; i < resources.size(); i += 2) {
+        keys.push_back(s4pkg::ResourceKey::fromParts(
+            resources[i].m_type, resources[i].m_group,
+            resources[i].m_instanceEx, resources[i].m_instance));
+    }
+
+    keys.push_back(s4pkg::ResourceKey::fromParts(0x3001, 1, 999, 999));
+
+    std::vector<int64_t> unsortedPositions = package.m_package->findMany(keys);
+
+    std::sort(keys.begin(), keys.end());
+    std::vector<int64_t> sortedPositions = package.m_package->findMany(keys);
+
+    for (size_t i = 0; i < keys.size(); i++) {
+        int64_t expected = package.m_package->findEntry(keys[i]);
+        REQUIRE(sortedPositions[i] == expected);
+
+        if (expected >= 0) {
+            REQUIRE(package.m_package->getIndexView().getKey(
+                        (uint32_t)expected) == keys[i]);
+        }
+    }
+
+    REQUIRE(unsortedPositions.back() == -1);
+    REQUIRE(std::count(sortedPositions.begin(), sortedPositions.end(), -1) ==
+            1);
+}
+
+TEST_CASE("Test lookups across packages", "package") {
+    std::vector<std::shared_ptr<s4pkg::IPackage>> packages;
+
+    for (uint32_t p = 0; p < 20; p++) {
+        std::vector<TestResource> resources;
+        for (uint32_t i = 0; i < 100; i++) {
+            resources.push_back({0x4000, p, 0, p * 1000 + i, "y"});
+        }
+
+        // Every package also contains the same shared resource
+        resources.push_back({0x4001, 0, 0, 42, "shared"});
+
+        std::istringstream packageStream(makePackage(resources));
+        s4pkg::PackageLoadResult package = s4pkg::loadPackage(packageStream);
+
+        REQUIRE(package.m_package != nullptr);
+        packages.push_back(package.m_package);
+    }
+
+    auto shared = s4pkg::findInPackages(
+        packages, s4pkg::ResourceKey::fromParts(0x4001, 0, 0, 42));
+    REQUIRE(shared.size() == packages.size());
+    REQUIRE(shared[0].m_position == 100);
+
+    auto single = s4pkg::findInPackages(
+        packages, s4pkg::ResourceKey::fromParts(0x4000, 7, 0, 7042));
+    REQUIRE(single.size() == 1);
+    REQUIRE(single[0].m_package == packages[7]);
+
+    // No false negatives, and few false positives
+    uint32_t falsePositives = 0;
+    for (uint32_t i = 0; i < 1000; i++) {
+        auto key = s4pkg::ResourceKey::fromParts(0x4000, 3, 1, i);
+        for (const auto& package : packages) {
+            falsePositives += package->mayContain(key) ? 1 : 0;
+        }
+
+        REQUIRE(packages[3]->mayContain(
+            s4pkg::ResourceKey::fromParts(0x4000, 3, 0, 3000 + i % 100)));
+    }
+
+    REQUIRE(falsePositives < 500);
+}
+
+TEST_CASE("Test package library", "library") {
+    std::filesystem::path root =
+        std::filesystem::temp_directory_path() / "s4pkg_test_library";
+    std::filesystem::remove_all(root);
+
+    // Two packages share a resource, a third one is nested deeper
+    writeFile(root / "a.package", makePackage({{0x5000, 0, 0, 1, "a"},
+                                               {0x5000, 0, 0, 2, "shared"}}));
+    writeFile(root / "b.package", makePackage({{0x5000, 0, 0, 2, "shared"},
+                                               {0x5000, 0, 0, 3, "b"}}));
+    writeFile(root / "sub" / "dir" / "c.package",
+              makePackage({{0x5000, 0, 0, 4, "c"}}));
+
+    // Not packages
+    writeFile(root / "notes.txt", "hello");
+    writeFile(root / "fake.package", "not a package at all");
+
+    s4pkg::PackageLibrary library(root.u8string().c_str());
+    library.scan();
+
+    REQUIRE(library.getPackageCount() == 3);
+    REQUIRE(library.getErrors().empty());
+
+    auto shared = s4pkg::ResourceKey::fromParts(0x5000, 0, 0, 2);
+    auto locations = library.find(shared);
+    REQUIRE(locations.size() == 2);
+
+    std::string winnerPath =
+        library.getPackagePath(library.resolve(shared)->m_packageId).c_str();
+    REQUIRE(winnerPath.find("b.package") != std::string::npos);
+
+    auto overrides = library.getOverrides();
+    REQUIRE(overrides.size() == 1);
+    REQUIRE(overrides[0].m_key == shared);
+    REQUIRE(overrides[0].m_overridden.size() == 1);
+
+    auto nested =
+        library.resolve(s4pkg::ResourceKey::fromParts(0x5000, 0, 0, 4));
+    REQUIRE(nested.has_value());
+    REQUIRE(library.getPackageIndex(nested->m_packageId)
+                .getInstance(nested->m_entry) == 4);
+
+    s4pkg::PackageLibrary shallowLibrary(root.u8string().c_str(),
+                                         s4pkg::FIRST_LOADED_WINS, 0);
+    shallowLibrary.scan();
+
+    REQUIRE(shallowLibrary.getPackageCount() == 2);
+
+    std::string firstWinnerPath =
+        shallowLibrary
+            .getPackagePath(shallowLibrary.resolve(shared)->m_packageId)
+            .c_str();
+    REQUIRE(firstWinnerPath.find("a.package") != std::string::npos);
+
+    std::filesystem::remove_all(root);
+}
+
+TEST_CASE("Test conflict detection", "library") {
+    std::filesystem::path root =
+        std::filesystem::temp_directory_path() / "s4pkg_test_conflicts";
+    std::filesystem::remove_all(root);
+
+    writeFile(root / "base" / "game.package",
+              makePackage({{0x5000, 0, 0, 1, "one"},
+                           {0x5000, 0, 0, 2, "two"}}));
+    writeFile(root / "mods" / "a.package",
+              makePackage({{0x5000, 0, 0, 1, "one"},
+                           {0x5000, 0, 0, 2, "changed two"},
+                           {0x5000, 0, 0, 3, "three from a"}}));
+    writeFile(root / "mods" / "b.package",
+              makePackage({{0x5000, 0, 0, 3, "three, b"}}));
+
+    s4pkg::PackageLibrary library(root.u8string().c_str());
+    library.scan();
+
+    s4pkg::ConflictDetector detector(library,
+                                     {(root / "base").u8string().c_str()});
+
+    auto conflicts = detector.analyze();
+    REQUIRE(detector.getErrors().empty());
+    REQUIRE(detector.getHashedRecordCount() == 6);
+    REQUIRE(conflicts.size() == 3);
+
+    // Same content everywhere
+    REQUIRE(conflicts[0].m_key ==
+            s4pkg::ResourceKey::fromParts(0x5000, 0, 0, 1));
+    REQUIRE(conflicts[0].m_kind == s4pkg::IDENTICAL_DUPLICATE);
+    REQUIRE(conflicts[0].m_contentHashes[0] == conflicts[0].m_contentHashes[1]);
+
+    // A single mod replacing base content
+    REQUIRE(conflicts[1].m_kind == s4pkg::OVERRIDE);
+    REQUIRE(conflicts[1].m_locations.size() == 2);
+    std::string winnerPath =
+        library.getPackagePath(conflicts[1].m_winner.m_packageId).c_str();
+    REQUIRE(winnerPath.find("a.package") != std::string::npos);
+
+    // Two mods disagreeing
+    REQUIRE(conflicts[2].m_kind == s4pkg::CONFLICT);
+    REQUIRE(conflicts[2].m_contentHashes[0] != conflicts[2].m_contentHashes[1]);
+
+    // Nothing changed, so nothing is read again
+    detector.analyze();
+    REQUIRE(detector.getHashedRecordCount() == 0);
+
+    // Only the changed package is read again after a rescan
+    writeFile(root / "mods" / "b.package",
+              makePackage({{0x5000, 0, 0, 3, "three from a"}}));
+    library.scan();
+
+    conflicts = detector.analyze();
+    REQUIRE(detector.getHashedRecordCount() == 1);
+    REQUIRE(conflicts[2].m_kind == s4pkg::IDENTICAL_DUPLICATE);
+
+    // A copy that can't be read has no hash, and doesn't make the others look
+    // identical or conflicting
+    writeFile(root / "mods" / "c.package",
+              makePackage({{0x5000, 0, 0, 3, "three from c"}}));
+    library.scan();
+    std::filesystem::resize_file(root / "mods" / "c.package", 10);
+
+    conflicts = detector.analyze();
+    REQUIRE(detector.getErrors().size() == 1);
+    REQUIRE(conflicts[2].m_locations.size() == 3);
+    REQUIRE(conflicts[2].m_kind == s4pkg::UNREADABLE);
+    REQUIRE(std::count(conflicts[2].m_contentHashes.begin(),
+                       conflicts[2].m_contentHashes.end(), std::nullopt) == 1);
+
+    // A directory only sharing a prefix with the base path isn't base, so two
+    // mods still conflict
+    std::filesystem::path prefixRoot = root / "prefix";
+    writeFile(prefixRoot / "Data" / "game.package",
+              makePackage({{0x5000, 0, 0, 4, "four"}}));
+    writeFile(prefixRoot / "DataMods" / "c.package",
+              makePackage({{0x5000, 0, 0, 4, "four from c"}}));
+    writeFile(prefixRoot / "Mods" / "d.package",
+              makePackage({{0x5000, 0, 0, 4, "four from d"}}));
+
+    s4pkg::PackageLibrary prefixLibrary(prefixRoot.u8string().c_str());
+    prefixLibrary.scan();
+
+    s4pkg::ConflictDetector prefixDetector(
+        prefixLibrary, {(prefixRoot / "Data").u8string().c_str()});
+    conflicts = prefixDetector.analyze();
+    REQUIRE(conflicts.size() == 1);
+    REQUIRE(conflicts[0].m_kind == s4pkg::CONFLICT);
+
+    std::filesystem::remove_all(root);
+}
+
+TEST_CASE("Test library updates", "library") {
+    std::filesystem::path root =
+        std::filesystem::temp_directory_path() / "s4pkg_test_watcher";
+    std::filesystem::remove_all(root);
+
+    writeFile(root / "a.package", makePackage({{0x5000, 0, 0, 1, "a"}}));
+
+    s4pkg::PackageLibrary library(root.u8string().c_str());
+    s4pkg::LibraryWatcher watcher(library);
+    library.scan();
+
+    std::vector<s4pkg::LibraryChange> seen;
+    watcher.addListener([&seen](const s4pkg::LibraryChange& change) {
+        seen.push_back(change);
+    });
+
+    REQUIRE(watcher.poll().empty());
+
+    // A package in a new directory
+    writeFile(root / "sub" / "b.package",
+              makePackage({{0x5000, 0, 0, 2, "b"}}));
+
+    auto changes = watcher.poll(1000);
+    REQUIRE(changes.size() == 1);
+    REQUIRE(changes[0].m_kind == s4pkg::PACKAGE_ADDED);
+    REQUIRE(library.resolve(s4pkg::ResourceKey::fromParts(0x5000, 0, 0, 2))
+                .has_value());
+
+    // A package rewritten in place keeps its id
+    uint32_t id =
+        library.resolve(s4pkg::ResourceKey::fromParts(0x5000, 0, 0, 1))
+            ->m_packageId;
+    writeFile(root / "a.package", makePackage({{0x5000, 0, 0, 1, "changed"},
+                                               {0x5000, 0, 0, 3, "new"}}));
+
+    changes = watcher.poll(1000);
+    REQUIRE(changes.size() == 1);
+    REQUIRE(changes[0].m_kind == s4pkg::PACKAGE_CHANGED);
+    REQUIRE(changes[0].m_packageId == id);
+    REQUIRE(library.resolve(s4pkg::ResourceKey::fromParts(0x5000, 0, 0, 3))
+                ->m_packageId == id);
+
+    std::filesystem::remove(root / "sub" / "b.package");
+
+    changes = watcher.poll(1000);
+    REQUIRE(changes.size() == 1);
+    REQUIRE(changes[0].m_kind == s4pkg::PACKAGE_REMOVED);
+    REQUIRE_FALSE(
+        library.resolve(s4pkg::ResourceKey::fromParts(0x5000, 0, 0, 2))
+            .has_value());
+
+    REQUIRE(seen.size() == 3);
+    REQUIRE(library.getPackageCount() == 1);
+    REQUIRE(library.refresh().empty());
+
+    std::filesystem::remove_all(root);
+}
+
+static std::string resourceData(const std::shared_ptr<s4pkg::IResource>& r) {
+    s4pkg::lib::ByteBuffer data = r->write();
+    return std::string((const char*)data.data(), data.size());
+}
+
+TEST_CASE("Test overlay packages", "overlay") {
+    std::filesystem::path root =
+        std::filesystem::temp_directory_path() / "s4pkg_test_overlay";
+    std::filesystem::remove_all(root);
+
+    writeFile(root / "base.package",
+              makePackage({{0x5000, 0, 0, 1, "base 1"},
+                           {0x5000, 0, 0, 2, "base 2"}}));
+
+    std::stringstream modStream(makePackage(
+        {{0x5000, 0, 0, 2, "mod 2"}, {0x5000, 0, 0, 3, "mod 3"}}));
+
+    auto base = s4pkg::openPackage((root / "base.package").u8string().c_str());
+    auto mod = s4pkg::loadPackage(modStream);
+    REQUIRE(base.m_package != nullptr);
+    REQUIRE(mod.m_package != nullptr);
+
+    REQUIRE(s4pkg::openPackage((root / "missing.package").u8string().c_str())
+                .m_package == nullptr);
+
+    s4pkg::OverlayPackage overlay({base.m_package, mod.m_package});
+    REQUIRE(overlay.getIndexView().size() == 3);
+
+    auto key2 = s4pkg::ResourceKey::fromParts(0x5000, 0, 0, 2);
+    int64_t position = overlay.findEntry(key2);
+    REQUIRE(position >= 0);
+    REQUIRE(overlay.getSource((uint32_t)position).m_layer == 1);
+    REQUIRE(resourceData(overlay.getResource((uint32_t)position)) == "mod 2");
+
+    // Entries are copied from the winning layer, not made up
+    s4pkg::IndexEntry mergedEntry = overlay.getIndexView()[(uint32_t)position];
+    s4pkg::IndexEntry winningEntry = mod.m_package->getIndexView()[(
+        uint32_t)mod.m_package->findEntry(key2)];
+    REQUIRE(mergedEntry.m_committed == winningEntry.m_committed);
+    REQUIRE(mergedEntry.m_isExtendedCompressionType ==
+            winningEntry.m_isExtendedCompressionType);
+    REQUIRE(mergedEntry.m_compressionType == winningEntry.m_compressionType);
+
+    s4pkg::OverlayPackage firstWins({base.m_package, mod.m_package},
+                                    s4pkg::FIRST_LAYER_WINS);
+    REQUIRE(resourceData(firstWins.getResource(
+                (uint32_t)firstWins.findEntry(key2))) == "base 2");
+
+    // Hiding a resource doesn't touch the layers
+    auto key1 = s4pkg::ResourceKey::fromParts(0x5000, 0, 0, 1);
+    auto resource1 = overlay.getResource((uint32_t)overlay.findEntry(key1));
+    REQUIRE(overlay.deleteResource(resource1));
+    REQUIRE(overlay.findEntry(key1) == -1);
+    REQUIRE(base.m_package->findEntry(key1) >= 0);
+
+    std::filesystem::path flattenedPath = root / "flattened.package";
+    {
+        std::ofstream flattened(flattenedPath, std::ios_base::binary);
+        overlay.flatten(flattened);
+    }
+
+    std::ifstream flattened(flattenedPath, std::ios_base::binary);
+    auto merged = s4pkg::loadPackage(flattened);
+    REQUIRE(merged.m_package != nullptr);
+    REQUIRE(merged.m_package->getResources().size() == 2);
+    REQUIRE(resourceData(merged.m_package->getResource(
+                (uint32_t)merged.m_package->findEntry(key2))) == "mod 2");
+
+    flattened.close();
+    std::filesystem::remove_all(root);
+}
+
+TEST_CASE("Test duplicate detection", "library") {
+    std::filesystem::path root =
+        std::filesystem::temp_directory_path() / "s4pkg_test_dedup";
+    std::filesystem::path cachePath =
+        std::filesystem::temp_directory_path() / "s4pkg_test_dedup.cache";
+    std::filesystem::remove_all(root);
+    std::filesystem::remove(cachePath);
+
+    // The same content under different keys, and records of the same size
+    // with different content
+    writeFile(root / "a.package",
+              makePackage({{0x5000, 0, 0, 1, "a long shared record"},
+                           {0x5000, 0, 0, 2, "short"},
+                           {0x5000, 0, 0, 3, "other"}}));
+    writeFile(root / "b.package",
+              makePackage({{0x6000, 1, 0, 9, "a long shared record"},
+                           {0x6000, 1, 0, 8, "short"}}));
+    writeFile(root / "c.package",
+              makePackage({{0x7000, 0, 0, 1, "a long shared record"}}));
+
+    s4pkg::PackageLibrary library(root.u8string().c_str());
+    library.scan();
+
+    {
+        s4pkg::DedupAnalyzer analyzer(library, cachePath.u8string().c_str());
+
+        auto clusters = analyzer.analyze();
+        REQUIRE(analyzer.getErrors().empty());
+        REQUIRE(analyzer.getHashedRecordCount() == 6);
+        REQUIRE(analyzer.getDecompressedRecordCount() == 0);
+        REQUIRE(clusters.size() == 2);
+
+        REQUIRE(clusters[0].m_sizeDecompressed == 20);
+        REQUIRE(clusters[0].m_locations.size() == 3);
+        REQUIRE(clusters[0].m_storedBytes == 60);
+        REQUIRE(clusters[0].m_reclaimableBytes == 40);
+
+        REQUIRE(clusters[1].m_locations.size() == 2);
+        REQUIRE(clusters[1].m_reclaimableBytes == 5);
+        REQUIRE(clusters[1].m_locations[0].m_entry == 1);
+        REQUIRE(clusters[1].m_locations[1].m_entry == 1);
+    }
+
+    // A new analyser reuses the hashes of the cache file
+    s4pkg::DedupAnalyzer analyzer(library, cachePath.u8string().c_str());
+
+    auto clusters = analyzer.analyze();
+    REQUIRE(analyzer.getHashedRecordCount() == 0);
+    REQUIRE(clusters.size() == 2);
+
+    // Only the changed package is read again
+    writeFile(root / "c.package",
+              makePackage({{0x7000, 0, 0, 1, "now different content"}}));
+    library.scan();
+
+    clusters = analyzer.analyze();
+    REQUIRE(analyzer.getHashedRecordCount() == 1);
+    REQUIRE(clusters[0].m_locations.size() == 2);
+    REQUIRE(clusters[0].m_reclaimableBytes == 20);
+
+    // A corrupt cache is ignored, without allocating the lengths it claims
+    std::string corrupt = "S4HC";
+    appendUint32(corrupt, 1);           // version
+    appendUint32(corrupt, 1);           // package count
+    appendUint32(corrupt, 0xfffffff0);  // path length
+    writeFile(cachePath, corrupt);
+
+    s4pkg::DedupAnalyzer fresh(library, cachePath.u8string().c_str());
+    REQUIRE(fresh.analyze().size() == 2);
+    REQUIRE(fresh.getHashedRecordCount() == 6);
+
+    std::filesystem::remove_all(root);
+    std::filesystem::remove(cachePath);
+}
+
+TEST_CASE("Test duplicate content hashes", "library") {
+    std::filesystem::path root =
+        std::filesystem::temp_directory_path() / "s4pkg_test_dedup_hashes";
+    std::filesystem::remove_all(root);
+
+    // Clusters report the hash of the content, however the copies were stored
+    auto clusterHash = [&](const std::string& name, bool zlib) {
+        writeFile(root / name / "a.package",
+                  makePackage({{0x5000, 0, 0, 1, "compressed alike"}}, zlib));
+        writeFile(root / name / "b.package",
+                  makePackage({{0x5000, 0, 0, 2, "compressed alike"}}, zlib));
+
+        s4pkg::PackageLibrary library((root / name).u8string().c_str());
+        library.scan();
+
+        s4pkg::DedupAnalyzer analyzer(library);
+        auto clusters = analyzer.analyze();
+        REQUIRE(analyzer.getErrors().empty());
+        REQUIRE(clusters.size() == 1);
+        REQUIRE(clusters[0].m_locations.size() == 2);
+
+        // Only one of the copies stored alike is decompressed
+        REQUIRE(analyzer.getDecompressedRecordCount() == (zlib ? 1 : 0));
+        return clusters[0].m_contentHash;
+    };
+
+    REQUIRE(clusterHash("zlib", true) == clusterHash("uncompressed", false));
+
+    std::filesystem::remove_all(root);
+}
+
+TEST_CASE("Test record store", "store") {
+    std::filesystem::path root =
+        std::filesystem::temp_directory_path() / "s4pkg_test_store";
+    std::filesystem::remove_all(root);
+
+    std::string first = makePackage({{0x5000, 0, 0, 1, "shared record"},
+                                     {0x5000, 0, 0, 2, "only in first"}});
+    std::string second = makePackage({{0x5000, 0, 0, 1, "shared record"},
+                                      {0x5000, 0, 0, 3, "only in second"}});
+
+    writeFile(root / "in" / "first.package", first);
+    writeFile(root / "in" / "second.package", second);
+
+    {
+        s4pkg::RecordStore store((root / "store").u8string().c_str());
+
+        auto added = store.addPackage(
+            "first", (root / "in" / "first.package").u8string().c_str());
+        REQUIRE(added.m_recordCount == 2);
+        REQUIRE(added.m_newRecordCount == 2);
+
+        added = store.addPackage(
+            "second", (root / "in" / "second.package").u8string().c_str());
+        REQUIRE(added.m_newRecordCount == 1);
+        REQUIRE(store.getRecordCount() == 3);
+
+        // Storing the same package again adds nothing
+        added = store.addPackage(
+            "first", (root / "in" / "first.package").u8string().c_str());
+        REQUIRE(added.m_newRecordCount == 0);
+        REQUIRE(added.m_newBytes == 0);
+    }
+
+    // The records are found again when the store is reopened
+    s4pkg::RecordStore store((root / "store").u8string().c_str());
+    REQUIRE(store.getRecordCount() == 3);
+
+    auto names = store.getPackageNames();
+    REQUIRE(names.size() == 2);
+    REQUIRE(std::string(names[0].c_str()) == "first");
+
+    // Checked out packages are identical to the originals
+    store.checkout("second", (root / "out.package").u8string().c_str());
+
+    std::ifstream checkedOut(root / "out.package", std::ios_base::binary);
+    std::string contents((std::istreambuf_iterator<char>(checkedOut)),
+                         std::istreambuf_iterator<char>());
+    REQUIRE(contents == second);
+
+    REQUIRE(store.removePackage("first"));
+    REQUIRE_FALSE(store.hasPackage("first"));
+    REQUIRE_THROWS_AS(
+        store.checkout("first", (root / "out.package").u8string().c_str()),
+        s4pkg::PackageException);
+    REQUIRE_THROWS_AS(store.addPackage("../escape", "x"),
+                      s4pkg::PackageException);
+
+    // A manifest claiming more entries than it has is rejected before they
+    // are allocated. The count comes right before the two 38-byte entries.
+    std::filesystem::path manifest =
+        root / "store" / "manifests" / "second.manifest";
+    {
+        std::fstream stream(manifest, std::ios_base::in |
+                                          std::ios_base::out |
+                                          std::ios_base::binary);
+        stream.seekp(-(2 * 38 + 4), std::ios_base::end);
+        stream.write("\xff\xff\xff\x0f", 4);
+    }
+
+    REQUIRE_THROWS_AS(
+        store.checkout("second", (root / "out.package").u8string().c_str()),
+        s4pkg::PackageException);
+
+    std::filesystem::remove_all(root);
+}
+
+TEST_CASE("Test package patches", "package") {
+    std::string large(4096, 'x');
+    std::string other(4096, 'y');
+
+    std::string oldVersion =
+        makePackage({{0x5000, 0, 0, 1, large},
+                     {0x5000, 0, 0, 2, "changes"},
+                     {0x5000, 0, 0, 3, "removed"},
+                     {0x5000, 0, 0, 4, other}});
+    std::string newVersion =
+        makePackage({{0x5000, 0, 0, 1, large},
+                     {0x5000, 0, 0, 2, "changed"},
+                     {0x5000, 0, 0, 4, other},
+                     {0x5000, 0, 0, 5, "added"}});
+
+    std::istringstream oldStream(oldVersion);
+    std::istringstream newStream(newVersion);
+    std::stringstream patch;
+
+    auto diff = s4pkg::diffPackages(oldStream, newStream, patch);
+    REQUIRE(diff.m_addedCount == 1);
+    REQUIRE(diff.m_removedCount == 1);
+    REQUIRE(diff.m_changedCount == 1);
+    REQUIRE(diff.m_unchangedCount == 2);
+
+    // Unchanged records aren't part of the patch
+    REQUIRE(diff.m_patchSize == patch.str().size());
+    REQUIRE(diff.m_patchSize < 1024);
+
+    std::ostringstream rebuilt;
+    s4pkg::applyPatch(oldStream, patch, rebuilt);
+    REQUIRE(rebuilt.str() == newVersion);
+
+    // The patch only applies to the version it was made against
+    std::istringstream wrongStream(newVersion);
+    patch.seekg(0);
+    std::ostringstream unused;
+    REQUIRE_THROWS_AS(s4pkg::applyPatch(wrongStream, patch, unused),
+                      s4pkg::PackageException);
+}
+
+TEST_CASE("Test index daemon", "daemon") {
+    std::filesystem::path root =
+        std::filesystem::temp_directory_path() / "s4pkg_test_daemon";
+    std::filesystem::remove_all(root);
+
+    writeFile(root / "mods" / "a.package",
+              makePackage({{0x5000, 0, 0, 1, "from a"},
+                           {0x5000, 0, 0, 2, "only a"}}));
+    writeFile(root / "mods" / "b.package",
+              makePackage({{0x5000, 0, 0, 1, "from b"}}));
+
+    std::string socketPath = (root / "s4pkgd.sock").u8string();
+
+    s4pkg::PackageLibrary library((root / "mods").u8string().c_str());
+    s4pkg::IndexServer server(library, socketPath.c_str());
+    std::thread serverThread([&server]() { server.run(); });
+
+    {
+        s4pkg::IndexClient client(socketPath.c_str());
+
+        auto packages = client.listPackages();
+        REQUIRE(packages.size() == 2);
+        REQUIRE(packages[0].m_resourceCount == 2);
+
+        auto resources = client.listResources(packages[1].m_packageId);
+        REQUIRE(resources.size() == 1);
+        REQUIRE(resources[0].m_instance == 1);
+
+        auto lookup =
+            client.lookup(s4pkg::ResourceKey::fromParts(0x5000, 0, 0, 1));
+        REQUIRE(lookup.m_locations.size() == 2);
+        REQUIRE(std::string(lookup.m_locations[lookup.m_winner].m_path.c_str())
+                    .find("b.package") != std::string::npos);
+
+        // The winning copy, sent from the package file
+        auto record =
+            client.extract(s4pkg::ResourceKey::fromParts(0x5000, 0, 0, 1));
+        REQUIRE(record.has_value());
+        REQUIRE(std::string((const char*)record->m_data.data(),
+                            record->m_data.size()) == "from b");
+
+        auto missing = s4pkg::ResourceKey::fromParts(0x5000, 0, 0, 9);
+        REQUIRE(client.lookup(missing).m_locations.empty());
+        REQUIRE_FALSE(client.extract(missing).has_value());
+        REQUIRE_FALSE(client.thumbnail(missing).has_value());
+
+        // Not an image, but the connection stays usable
+        REQUIRE_THROWS_AS(
+            client.thumbnail(s4pkg::ResourceKey::fromParts(0x5000, 0, 0, 2)),
+            s4pkg::PackageException);
+        REQUIRE(client.listPackages().size() == 2);
+    }
+
+    server.stop();
+    serverThread.join();
+    REQUIRE(server.getRequestCount() == 9);
+
+    std::filesystem::remove_all(root);
+}
+
+TEST_CASE("Test shared decode cache", "cache") {
+    s4pkg::SharedDecodeCache::remove("s4pkg_test_cache");
+
+    auto imageOf = [](char fill) {
+        s4pkg::DecodedImage image{16, 16, s4pkg::DECODED_RGBA,
+                                  s4pkg::lib::ByteBuffer(1024)};
+        memset(image.m_data.data(), fill, image.m_data.size());
+        return image;
+    };
+
+    // Two mappings of the same cache, as two processes would have
+    s4pkg::SharedDecodeCache writer("s4pkg_test_cache", 3 * 1024, 16);
+    s4pkg::SharedDecodeCache reader("s4pkg_test_cache");
+    REQUIRE(writer.isShared());
+    REQUIRE(reader.getByteBudget() == 3 * 1024);
+
+    REQUIRE(writer.insert(1, imageOf('a')));
+    REQUIRE(writer.insert(2, imageOf('b')));
+    REQUIRE(writer.insert(3, imageOf('c')));
+
+    auto found = reader.find(1);
+    REQUIRE(found.has_value());
+    REQUIRE(found->m_width == 16);
+    REQUIRE(found->m_data.data()[1023] == 'a');
+    REQUIRE_FALSE(reader.find(4).has_value());
+    REQUIRE(writer.getHitCount() == 1);
+    REQUIRE(writer.getMissCount() == 1);
+
+    // The least recently used image makes room
+    REQUIRE(reader.insert(4, imageOf('d')));
+    REQUIRE(writer.getEntryCount() == 3);
+    REQUIRE(writer.getUsedBytes() == 3 * 1024);
+    REQUIRE_FALSE(writer.find(2).has_value());
+    REQUIRE(writer.find(1).has_value());
+    REQUIRE(writer.find(4)->m_data.data()[0] == 'd');
+
+    s4pkg::DecodedImage tooLarge{64, 64, s4pkg::DECODED_RGBA,
+                                 s4pkg::lib::ByteBuffer(4 * 1024)};
+    REQUIRE_FALSE(writer.insert(5, tooLarge));
+
+    // Churn through many more images than entries
+    for (uint64_t hash = 10; hash < 200; hash++) {
+        REQUIRE(writer.insert(hash, imageOf((char)hash)));
+        REQUIRE(reader.find(hash)->m_data.data()[0] == (uint8_t)hash);
+    }
+
+    REQUIRE(writer.getEntryCount() <= 3);
+    REQUIRE(s4pkg::SharedDecodeCache::remove("s4pkg_test_cache"));
+
+    // When the table runs out of slots first, they are freed in batches
+    s4pkg::SharedDecodeCache::remove("s4pkg_test_slots");
+    s4pkg::SharedDecodeCache slots("s4pkg_test_slots", 64 * 1024, 16);
+
+    for (uint64_t hash = 10; hash < 200; hash++) {
+        REQUIRE(slots.insert(hash, imageOf((char)hash)));
+        REQUIRE(slots.find(hash)->m_data.data()[0] == (uint8_t)hash);
+        REQUIRE(slots.getEntryCount() <= 12);
+    }
+
+    REQUIRE(slots.getEntryCount() >= 10);
+    REQUIRE(s4pkg::SharedDecodeCache::remove("s4pkg_test_slots"));
+}
+
+TEST_CASE("Test resource cache", "cache") {
+    s4pkg::ResourceCache cache(3 * 100);
+
+    auto keyOf = [](uint64_t id) {
+        return s4pkg::ResourceCacheKey{1, id, s4pkg::CACHED_RECORD};
+    };
+
+    cache.insert(keyOf(1), s4pkg::lib::ByteBuffer(100));
+    cache.insert(keyOf(2), s4pkg::lib::ByteBuffer(100));
+    cache.insert(keyOf(3), s4pkg::lib::ByteBuffer(100));
+
+    // Using the first makes the second the least recently used
+    REQUIRE(cache.find(keyOf(1)) != nullptr);
+    cache.insert(keyOf(4), s4pkg::lib::ByteBuffer(100));
+
+    REQUIRE(cache.find(keyOf(2)) == nullptr);
+    REQUIRE(cache.getUsedBytes() == 300);
+    REQUIRE(cache.getEvictionCount() == 1);
+    REQUIRE(cache.getHitCount() == 1);
+    REQUIRE(cache.getMissCount() == 1);
+
+    // Data in use is pinned, even over budget
+    {
+        auto pinned = cache.find(keyOf(1));
+        cache.setByteBudget(100);
+
+        REQUIRE(cache.getEntryCount() == 1);
+        REQUIRE(cache.getPinnedBytes() == 100);
+
+        cache.insert(keyOf(5), s4pkg::lib::ByteBuffer(100));
+        REQUIRE(cache.find(keyOf(1)) == pinned);
+    }
+
+    cache.setByteBudget(0);
+    REQUIRE(cache.getUsedBytes() == 0);
+
+    // Browsing a package through a small cache keeps memory flat
+    std::vector<TestResource> resources;
+    for (uint32_t i = 0; i < 50; i++) {
+        resources.push_back({0x5000, 0, 0, i, std::string(1000, 'a' + i % 26)});
+    }
+
+    std::filesystem::path path =
+        std::filesystem::temp_directory_path() / "s4pkg_test_cache.package";
+    writeFile(path, makePackage(resources));
+
+    auto packageCache = std::make_shared<s4pkg::ResourceCache>(10 * 1000);
+    {
+        auto result = s4pkg::openPackage(path.u8string().c_str(), packageCache);
+        REQUIRE(result.m_package != nullptr);
+
+        for (uint32_t i = 0; i < 50; i++) {
+            result.m_package->getResource(i);
+            REQUIRE(packageCache->getUsedBytes() <= 10 * 1000);
+        }
+
+        REQUIRE(packageCache->getMissCount() == 50);
+
+        auto again = result.m_package->getResource(49);
+        REQUIRE(packageCache->getHitCount() == 1);
+        REQUIRE(resourceData(again) == std::string(1000, 'a' + 49 % 26));
+
+        // The resource shares the cached record, instead of a copy
+        REQUIRE(packageCache->getPinnedBytes() == 1000);
+    }
+
+    // Closing the package drops its records
+    REQUIRE(packageCache->getEntryCount() == 0);
+
+    // Decoded pixels are cached too
+    s4pkg::lib::ByteBuffer pixels(16 * 8 * 4);
+    for (uint64_t i = 0; i < pixels.size(); i++) {
+        pixels[i] = (uint8_t)(i * 7);
+    }
+
+    s4pkg::resources::ts4::DSTResource source(
+        s4pkg::ResourceType::DST_IMAGE, 0, 0, 0, s4pkg::lib::ByteBuffer());
+    source.setImage(16, 8, pixels);
+    s4pkg::lib::ByteBuffer encoded = source.write();
+
+    writeFile(path, makePackage({{(uint32_t)s4pkg::ResourceType::DST_IMAGE, 0,
+                                  0, 1,
+                                  std::string((const char*)encoded.data(),
+                                              encoded.size())}}));
+    {
+        auto result = s4pkg::openPackage(path.u8string().c_str(), packageCache);
+        REQUIRE(result.m_package != nullptr);
+
+        auto image =
+            std::dynamic_pointer_cast<s4pkg::resources::IImageResource>(
+                result.m_package->getResource(0));
+        REQUIRE(image != nullptr);
+        REQUIRE(image->getPixelData().size() == pixels.size());
+        REQUIRE(packageCache->getEntryCount() == 2);
+
+        // Another copy of the resource finds the pixels in the cache
+        uint64_t hits = packageCache->getHitCount();
+        auto copy =
+            std::dynamic_pointer_cast<s4pkg::resources::IImageResource>(
+                result.m_package->getResource(0));
+        REQUIRE(copy->getPixelData().size() == pixels.size());
+        REQUIRE(packageCache->getHitCount() == hits + 2);
+        REQUIRE(packageCache->getEntryCount() == 2);
+    }
+
+    std::filesystem::remove(path);
+}
+
+TEST_CASE("Test byte sources", "io") {
+    std::vector<TestResource> resources;
+    for (uint32_t i = 0; i < 20; i++) {
+        resources.push_back({0x5000, 0, 0, i, "resource " + std::to_string(i)});
+    }
+
+    std::string contents = makePackage(resources);
+
+    std::filesystem::path path =
+        std::filesystem::temp_directory_path() / "s4pkg_test_io.package";
+    writeFile(path, contents);
+
+    s4pkg::FileByteSource file(path.u8string());
+    s4pkg::MappedByteSource mapped(path.u8string());
+    s4pkg::MemoryByteSource memory((const uint8_t*)contents.data(),
+                                   contents.size());
+
+    // Hands out a single byte per call, callers have to keep asking
+    s4pkg::CallbackByteSource callback(
+        contents.size(), [&contents](uint64_t offset, uint8_t* buffer,
+                                     uint64_t size) -> uint64_t {
+            buffer[0] = (uint8_t)contents[offset];
+            return 1;
+        });
+
+    std::istringstream stream(contents);
+    s4pkg::StreamByteSource streamSource(stream);
+
+    std::vector<s4pkg::ByteSource*> sources{&file, &mapped, &memory, &callback,
+                                            &streamSource};
+
+    for (s4pkg::ByteSource* source : sources) {
+        INFO(source->toString().c_str());
+        REQUIRE(source->getSize() == contents.size());
+
+        uint8_t buffer[8];
+        source->readAt(96, buffer, 8);
+        REQUIRE(std::string((char*)buffer, 8) == "resource");
+
+        REQUIRE(source->readSome(contents.size() - 2, buffer, 8) == 2);
+        REQUIRE_THROWS_AS(source->readAt(contents.size() - 2, buffer, 8),
+                          s4pkg::PackageException);
+
+        auto result = s4pkg::loadPackage(*source);
+        INFO(result.m_errorMessage.c_str());
+        REQUIRE(result.m_package != nullptr);
+        REQUIRE(result.m_package->getResources().size() == 20);
+        REQUIRE(resourceData(result.m_package->getResource(7)) ==
+                "resource 7");
+    }
+
+    REQUIRE(mapped.getData() != nullptr);
+    REQUIRE(file.getData() == nullptr);
+
+    // Packages written to sinks and to a stream are the same
+    auto package = s4pkg::loadPackage(memory).m_package;
+
+    s4pkg::MemoryByteSink sink;
+    package->write(sink);
+
+    std::filesystem::path sinkPath =
+        std::filesystem::temp_directory_path() / "s4pkg_test_io_sink.package";
+    {
+        s4pkg::FileByteSink fileSink(sinkPath.u8string());
+        package->write(fileSink);
+    }
+
+    std::filesystem::path streamPath =
+        std::filesystem::temp_directory_path() / "s4pkg_test_io_stream.package";
+    {
+        std::ofstream written(streamPath, std::ios_base::binary);
+        package->write(written);
+    }
+
+    auto readAll = [](const std::filesystem::path& from) {
+        std::ifstream stream(from, std::ios_base::binary);
+        return std::string(std::istreambuf_iterator<char>(stream), {});
+    };
+
+    std::string written = readAll(streamPath);
+    REQUIRE(std::string((const char*)sink.getData(), sink.getSize()) ==
+            written);
+    REQUIRE(readAll(sinkPath) == written);
+
+    s4pkg::MemoryByteSource rewritten(sink.getBuffer());
+    auto reloaded = s4pkg::loadPackage(rewritten);
+    REQUIRE(reloaded.m_package != nullptr);
+    REQUIRE(resourceData(reloaded.m_package->getResource(19)) ==
+            "resource 19");
+
+    // A stream that can't take the bytes fails the write, not a later one
+    struct FullBuffer : std::streambuf {};  // overflow() always fails
+    FullBuffer full;
+    std::ostream fullStream(&full);
+    s4pkg::StreamByteSink fullSink(fullStream);
+    REQUIRE_THROWS_AS(fullSink.write((const uint8_t*)"data", 4),
+                      s4pkg::PackageException);
+
+    // Seeking a memory stream out of its buffer fails, instead of moving past
+    // its end
+    s4pkg::internal::membuf buffer((const uint8_t*)contents.data(),
+                                   contents.size());
+    std::istream bufferStream(&buffer);
+
+    bufferStream.seekg(10);
+    bufferStream.seekg((std::streamoff)contents.size(), std::ios_base::cur);
+    REQUIRE(bufferStream.fail());
+
+    bufferStream.clear();
+    REQUIRE((uint64_t)bufferStream.tellg() == 10);
+
+    std::filesystem::remove(path);
+    std::filesystem::remove(sinkPath);
+    std::filesystem::remove(streamPath);
+}
+
+TEST_CASE("Test replaced package files", "io") {
+    std::filesystem::path path =
+        std::filesystem::temp_directory_path() / "s4pkg_test_replaced.package";
+    std::filesystem::path replacement = path;
+    replacement += ".new";
+
+    writeFile(path, makePackage({{0x5000, 0, 0, 1, "old record"}}));
+
+    auto first = s4pkg::openPackage(path.u8string().c_str());
+    REQUIRE(first.m_package != nullptr);
+    REQUIRE(resourceData(first.m_package->getResource(0)) == "old record");
+
+    // Replaced by renaming over it, as atomic writers do, with the records at
+    // other offsets
+    writeFile(replacement,
+              makePackage({{0x5000, 0, 0, 9, "padding record"},
+                           {0x5000, 0, 0, 1, "new record, longer"}}));
+    std::filesystem::rename(replacement, path);
+
+    auto second = s4pkg::openPackage(path.u8string().c_str());
+    REQUIRE(second.m_package != nullptr);
+    REQUIRE(resourceData(second.m_package->getResource(1)) ==
+            "new record, longer");
+
+    // The first package still reads the file it was opened on
+    REQUIRE(resourceData(first.m_package->getResource(0)) == "old record");
+
+    // Rewritten in place
+    writeFile(path, makePackage({{0x5000, 0, 0, 1, "rewritten"}}));
+
+    auto third = s4pkg::openPackage(path.u8string().c_str());
+    REQUIRE(third.m_package != nullptr);
+    REQUIRE(resourceData(third.m_package->getResource(0)) == "rewritten");
+
+    std::filesystem::remove(path);
+}
+
+TEST_CASE("Test binary cursor", "io") {
+    const uint8_t bytes[] = {0x01, 0x02, 0x03, 0x04, 0xFE, 0xFF,
+                             0x10, 0x00, 0x00, 0x00, 0x00, 0x00,
+                             0x00, 0x80, 0xAA, 0xBB};
+
+    s4pkg::internal::BinaryCursor cursor(bytes, sizeof(bytes));
+    REQUIRE(cursor.readLE<uint32_t>() == 0x04030201);
+
+    int16_t small;
+    uint64_t large;
+    cursor.read(small, large);
+    REQUIRE(small == -2);
+    REQUIRE(large == 0x8000000000000010);
+    REQUIRE(cursor.remaining() == 2);
+
+    // A failed read doesn't move the cursor
+    REQUIRE_THROWS_AS(cursor.readLE<uint32_t>(), s4pkg::PackageException);
+    REQUIRE(cursor.position() == 14);
+
+    uint8_t tail[2];
+    cursor.readArray(tail, 2);
+    REQUIRE(tail[1] == 0xBB);
+
+    cursor.seek(4);
+    s4pkg::internal::BinaryCursor span = cursor.take(2);
+    REQUIRE(span.readLE<uint16_t>() == 0xFFFE);
+    REQUIRE(cursor.position() == 6);
+
+    REQUIRE_THROWS_AS(cursor.subspan(10, 7), s4pkg::PackageException);
+    REQUIRE_THROWS_AS(cursor.subspan(UINT64_MAX, 1), s4pkg::PackageException);
+
+    // DDS headers parse the same from a cursor and from a stream
+    s4pkg::internal::dds::dds_file_t file{};
+    file.m_header.m_size = 124;
+    file.m_header.m_flags = s4pkg::internal::dds::DDSD_WIDTH |
+                            s4pkg::internal::dds::DDSD_HEIGHT;
+    file.m_header.m_width = 8;
+    file.m_header.m_height = 4;
+    file.m_header.m_pixelFormat.m_fourCC = MAKE_FOURCC('D', 'X', 'T', '5');
+    file.m_header.m_caps2 = 0x1234;
+    file.m_mainImage = s4pkg::lib::ByteBuffer(32);
+
+    s4pkg::lib::ByteBuffer dds = s4pkg::internal::dds::writeFile(file);
+
+    s4pkg::internal::BinaryCursor ddsCursor(dds.data(), dds.size());
+    ddsCursor.skip(4);
+    auto header = s4pkg::internal::dds::readHeader(ddsCursor);
+
+    s4pkg::MemoryByteSource source(dds.data(), dds.size());
+    source.seek(4);
+    auto sourceHeader = s4pkg::internal::dds::readHeader(source);
+
+    REQUIRE(header.m_width == 8);
+    REQUIRE(header.m_pixelFormat.m_fourCC == MAKE_FOURCC('D', 'X', 'T', '5'));
+    REQUIRE(header.m_caps2 == 0x1234);
+    REQUIRE(memcmp(&header, &sourceHeader, sizeof(header)) == 0);
+    REQUIRE(ddsCursor.position() == 128);
+
+    s4pkg::internal::BinaryCursor truncated(dds.data(), 100);
+    truncated.skip(4);
+    REQUIRE_THROWS_AS(s4pkg::internal::dds::readHeader(truncated),
+                      s4pkg::PackageException);
+}
+
+TEST_CASE("Test struct layouts", "io") {
+    namespace layout = s4pkg::internal::layout;
+
+    static_assert(layout::encodedSize<package_header_t>() == 96);
+    static_assert(layout::encodedSize<s4pkg::internal::rle::rle_header_t>() ==
+                  16);
+    static_assert(
+        !layout::layout_t<s4pkg::internal::rle::rle_header_t>::native);
+    static_assert(layout::layout_t<package_header_t>::native ==
+                  layout::g_littleEndian);
+    static_assert(
+        layout::layout_t<s4pkg::internal::dds::dds_header_t>::native ==
+        layout::g_littleEndian);
+
+    package_header_t header{{'D', 'B', 'P', 'F'}, {2, 1}, {0, 0}, 0, 10, 20};
+    header.m_indexRecordEntryCount = 3;
+    header.m_unused4 = 3;
+    header.m_indexRecordPosition = 0x0102030405060708;
+
+    uint8_t bytes[96];
+    layout::write(bytes, header);
+
+    REQUIRE(bytes[4] == 2);
+    REQUIRE(bytes[8] == 1);
+    REQUIRE(bytes[24] == 10);
+    REQUIRE(bytes[28] == 20);
+    REQUIRE(bytes[36] == 3);
+    REQUIRE(bytes[60] == 3);
+    REQUIRE(bytes[64] == 0x08);
+    REQUIRE(bytes[71] == 0x01);
+
+    package_header_t readBack{};
+    s4pkg::internal::BinaryCursor headerCursor(bytes, sizeof(bytes));
+    layout::read(headerCursor, readBack);
+    REQUIRE(memcmp(&readBack, &header, sizeof(header)) == 0);
+
+    // A layout covering only part of a struct goes field by field
+    s4pkg::internal::rle::rle_header_t rleHeader{};
+    rleHeader.m_fourCC = s4pkg::internal::rle::DXT5;
+    rleHeader.m_rleVersion = s4pkg::internal::rle::RLES;
+    rleHeader.m_width = 0x0201;
+    rleHeader.m_mipCount = 7;
+
+    uint8_t rleBytes[16];
+    layout::write(rleBytes, rleHeader);
+    REQUIRE(memcmp(rleBytes, "DXT5RLES", 8) == 0);
+    REQUIRE(rleBytes[8] == 0x01);
+    REQUIRE(rleBytes[9] == 0x02);
+    REQUIRE(rleBytes[12] == 7);
+
+    s4pkg::internal::rle::rle_header_t rleReadBack{};
+    s4pkg::internal::BinaryCursor cursor(rleBytes, 15);
+    REQUIRE_THROWS_AS(layout::read(cursor, rleReadBack),
+                      s4pkg::PackageException);
+    REQUIRE(cursor.position() == 0);
+
+    cursor = s4pkg::internal::BinaryCursor(rleBytes, 16);
+    layout::read(cursor, rleReadBack);
+    REQUIRE(rleReadBack.m_width == 0x0201);
+    REQUIRE(rleReadBack.m_mipCount == 7);
+    REQUIRE(cursor.remaining() == 0);
+}
+
+TEST_CASE("Test lazy image decoding", "imagecoder") {
+    s4pkg::lib::ByteBuffer pixels(16 * 8 * 4);
+    for (uint64_t i = 0; i < pixels.size(); i++) {
+        pixels[i] = (uint8_t)(i * 7);
+    }
+
+    s4pkg::resources::ts4::DSTResource source(
+        s4pkg::ResourceType::DST_IMAGE, 0, 0, 0, s4pkg::lib::ByteBuffer());
+    source.setImage(16, 8, pixels);
+    s4pkg::lib::ByteBuffer encoded = source.write();
+    REQUIRE(encoded.size() > 128);
+
+    s4pkg::resources::ts4::DSTResource image(s4pkg::ResourceType::DST_IMAGE,
+                                             0, 0, 0, encoded);
+
+    // The size comes from the header, and writing hands back the same bytes
+    REQUIRE(image.getFormat() == s4pkg::internal::imagecoder::DST5);
+    REQUIRE(image.getWidth() == 16);
+    REQUIRE(image.getHeight() == 8);
+
+    s4pkg::lib::ByteBuffer written = image.write();
+    REQUIRE(written.size() == encoded.size());
+    REQUIRE(memcmp(written.data(), encoded.data(), encoded.size()) == 0);
+    REQUIRE(!image.isDecoded());
+
+    REQUIRE(image.getPixelData().size() == pixels.size());
+    REQUIRE(image.isDecoded());
+
+    // Once modified, the image is encoded again
+    image.setImage(4, 4, s4pkg::lib::ByteBuffer(4 * 4 * 4));
+    REQUIRE(image.getWidth() == 4);
+    REQUIRE(image.write().size() < encoded.size());
+}
+
+TEST_CASE("Test parallel block compression", "imagecoder") {
+    // A height that leaves a partial strip and a partial block row at the end,
+    // and enough blocks to be split over threads
+    const uint32_t width = 260;
+    const uint32_t height = 266;
+
+    s4pkg::lib::ByteBuffer pixels(width * height * 4);
+    for (uint64_t i = 0; i < pixels.size(); i++) {
+        pixels[i] = (uint8_t)((i * 31) ^ (i >> 5));
+    }
+
+    namespace imagecoder = s4pkg::internal::imagecoder;
+
+    for (auto format :
+         {imagecoder::DXT1, imagecoder::DXT3, imagecoder::DXT5}) {
+        imagecoder::encode_options_t options{};
+
+        options.m_threadCount = 1;
+        s4pkg::lib::ByteBuffer serial = imagecoder::compressBlocks(
+            pixels.data(), width, height, format, options);
+
+        options.m_threadCount = 4;
+        s4pkg::lib::ByteBuffer parallel = imagecoder::compressBlocks(
+            pixels.data(), width, height, format, options);
+
+        uint32_t blockSize = format == imagecoder::DXT1 ? 8 : 16;
+        REQUIRE(serial.size() == 65 * 67 * blockSize);
+        REQUIRE(parallel.size() == serial.size());
+        REQUIRE(memcmp(parallel.data(), serial.data(), serial.size()) == 0);
+    }
+}
+
+TEST_CASE("Test encode quality presets", "imagecoder") {
+    namespace imagecoder = s4pkg::internal::imagecoder;
+
+    s4pkg::lib::ByteBuffer pixels(32 * 32 * 4);
+    for (uint64_t i = 0; i < pixels.size(); i++) {
+        pixels[i] = (uint8_t)(i * 13 + (i >> 7));
+    }
+
+    // Each preset reaches squish as its colour fit, and the weighting as its
+    // metric. How much better the slower fits are is up to squish.
+    const std::pair<imagecoder::encode_quality_t, int> fits[] = {
+        {imagecoder::FAST, squish::kColourRangeFit},
+        {imagecoder::BALANCED, squish::kColourClusterFit},
+        {imagecoder::BEST, squish::kColourIterativeClusterFit}};
+
+    auto squishBlocks = [&pixels](int flags) {
+        s4pkg::lib::ByteBuffer blocks(8 * 8 * 16);
+        squish::CompressImage(pixels.data(), 32, 32, blocks.data(),
+                              squish::kDxt5 | flags);
+        return blocks;
+    };
+
+    for (const auto& [quality, fit] : fits) {
+        for (bool perceptual : {true, false}) {
+            imagecoder::encode_options_t options{quality, perceptual};
+
+            s4pkg::lib::ByteBuffer blocks = imagecoder::compressBlocks(
+                pixels.data(), 32, 32, imagecoder::DXT5, options);
+            s4pkg::lib::ByteBuffer expected = squishBlocks(
+                fit | (perceptual ? squish::kColourMetricPerceptual
+                                  : squish::kColourMetricUniform));
+
+            REQUIRE(blocks.size() == expected.size());
+            REQUIRE(memcmp(blocks.data(), expected.data(), blocks.size()) == 0);
+        }
+    }
+
+    // Modified images are encoded with the options of the resource. Past the
+    // 128-byte header, the blocks of the full size image are the ones squish
+    // gives for the preset, the smaller mips follow.
+    for (const auto& [quality, fit] : fits) {
+        s4pkg::resources::ts4::DSTResource image(
+            s4pkg::ResourceType::DST_IMAGE, 0, 0, 0, s4pkg::lib::ByteBuffer());
+        image.setEncodeOptions({quality, false});
+        REQUIRE(image.getEncodeOptions().m_quality == quality);
+
+        image.setImage(32, 32, pixels);
+        s4pkg::lib::ByteBuffer blocks = imagecoder::transcode(
+            image.write(), imagecoder::DST5, imagecoder::DXT5);
+        s4pkg::lib::ByteBuffer expected =
+            squishBlocks(fit | squish::kColourMetricUniform);
+
+        REQUIRE(blocks.size() > 128 + expected.size());
+        REQUIRE(memcmp(blocks.data() + 128, expected.data(),
+                       expected.size()) == 0);
+    }
+}
+
+TEST_CASE("Test mip chain generation", "imagecoder") {
+    namespace mipmap = s4pkg::internal::mipmap;
+
+    // Sizes that leave odd rows and columns, and every kernel's scalar tail
+    const uint32_t sizes[][2] = {{37, 21}, {64, 64}, {1, 9}, {9, 1}, {2, 2}};
+
+    for (const auto& size : sizes) {
+        uint32_t width = size[0];
+        uint32_t height = size[1];
+
+        s4pkg::lib::ByteBuffer pixels(width * height * 4);
+        for (uint64_t i = 0; i < pixels.size(); i++) {
+            pixels[i] = (uint8_t)((i * 97) ^ (i >> 3));
+        }
+
+        uint32_t outputWidth = std::max<uint32_t>(1, width / 2);
+        uint32_t outputHeight = std::max<uint32_t>(1, height / 2);
+
+        s4pkg::lib::ByteBuffer scalar(outputWidth * outputHeight * 4);
+        mipmap::downsample(pixels.data(), width, height, scalar.data(),
+                           mipmap::SCALAR_KERNEL);
+
+        for (auto kernel : {mipmap::SSE2_KERNEL, mipmap::AVX2_KERNEL}) {
+            s4pkg::lib::ByteBuffer output(scalar.size());
+            mipmap::downsample(pixels.data(), width, height, output.data(),
+                               kernel);
+
+            REQUIRE(memcmp(output.data(), scalar.data(), scalar.size()) == 0);
+        }
+    }
+
+    // Every output pixel is the rounded average of its 2x2 block
+    uint8_t block[16] = {0, 10, 255, 1, 1, 10, 255, 2,
+                         0, 10, 255, 2, 1, 11, 0,   2};
+    uint8_t average[4];
+    mipmap::downsample(block, 2, 2, average);
+    REQUIRE(average[0] == 1);
+    REQUIRE(average[1] == 10);
+    REQUIRE(average[2] == 191);
+    REQUIRE(average[3] == 2);
+
+    s4pkg::lib::ByteBuffer image(40 * 10 * 4);
+    auto boxLevels = mipmap::generate(image.data(), 40, 10);
+    auto resampledLevels =
+        mipmap::generate(image.data(), 40, 10, mipmap::RESAMPLE_FILTER);
+
+    REQUIRE(boxLevels.size() == 5);
+    REQUIRE(resampledLevels.size() == boxLevels.size());
+    REQUIRE(boxLevels[0].m_width == 20);
+    REQUIRE(boxLevels[0].m_height == 5);
+    REQUIRE(boxLevels[2].m_height == 1);
+    REQUIRE(boxLevels.back().m_width == 1);
+    REQUIRE(boxLevels.back().m_pixels.size() == 4);
+}
+
+TEST_CASE("Test DST shuffles", "imagecoder") {
+    namespace dst = s4pkg::internal::dst;
+
+    for (uint64_t blockCount : {1, 7, 8, 9, 33, 100}) {
+        std::vector<uint8_t> blocks(blockCount * 16);
+        for (size_t i = 0; i < blocks.size(); i++) {
+            blocks[i] = (uint8_t)(i * 7 + i / 16);
+        }
+
+        // Every plane of the scalar output in the order of dst.h
+        std::vector<uint8_t> planes(blocks.size());
+        dst::shuffleDst5(blocks.data(), planes.data(), blockCount,
+                         dst::SCALAR_KERNEL);
+
+        for (uint64_t i = 0; i < blockCount; i++) {
+            const uint8_t* block = blocks.data() + i * 16;
+
+            REQUIRE(memcmp(planes.data() + i * 2, block, 2) == 0);
+            REQUIRE(memcmp(planes.data() + blockCount * 2 + i * 4, block + 8,
+                           4) == 0);
+            REQUIRE(memcmp(planes.data() + blockCount * 6 + i * 6, block + 2,
+                           6) == 0);
+            REQUIRE(memcmp(planes.data() + blockCount * 12 + i * 4,
+                           block + 12, 4) == 0);
+        }
+
+        for (dst::dst_kernel_t kernel :
+             {dst::SCALAR_KERNEL, dst::SSE2_KERNEL, dst::SSSE3_KERNEL}) {
+            std::vector<uint8_t> shuffled(blocks.size());
+            dst::shuffleDst5(blocks.data(), shuffled.data(), blockCount,
+                             kernel);
+            REQUIRE(shuffled == planes);
+
+            std::vector<uint8_t> unshuffled(blocks.size());
+            dst::unshuffleDst5(shuffled.data(), unshuffled.data(), blockCount,
+                               kernel);
+            REQUIRE(unshuffled == blocks);
+
+            // The same blocks as twice as many DXT1 blocks
+            std::vector<uint8_t> dst1(blocks.size());
+            dst::shuffleDst1(blocks.data(), dst1.data(), blockCount * 2,
+                             kernel);
+
+            for (uint64_t i = 0; i < blockCount * 2; i++) {
+                REQUIRE(memcmp(dst1.data() + i * 4, blocks.data() + i * 8,
+                               4) == 0);
+                REQUIRE(memcmp(dst1.data() + blockCount * 8 + i * 4,
+                               blocks.data() + i * 8 + 4, 4) == 0);
+            }
+
+            dst::unshuffleDst1(dst1.data(), unshuffled.data(), blockCount * 2,
+                               kernel);
+            REQUIRE(unshuffled == blocks);
+        }
+    }
+}
+
+TEST_CASE("Test DST transcoding", "imagecoder") {
+    namespace imagecoder = s4pkg::internal::imagecoder;
+
+    auto equal = [](const s4pkg::lib::ByteBuffer& a,
+                    const s4pkg::lib::ByteBuffer& b) {
+        return a.size() == b.size() &&
+               memcmp(a.data(), b.data(), a.size()) == 0;
+    };
+
+    // A mip chain whose block count isn't a multiple of any kernel's width
+    s4pkg::lib::ByteBuffer pixels(37 * 21 * 4);
+    for (uint64_t i = 0; i < pixels.size(); i++) {
+        pixels[i] = (uint8_t)(i * 29 + (i >> 5));
+    }
+
+    s4pkg::resources::ts4::DSTResource image(
+        s4pkg::ResourceType::DST_IMAGE, 0, 0, 0, s4pkg::lib::ByteBuffer());
+    image.setEncodeOptions({imagecoder::FAST});
+    image.setImage(37, 21, pixels);
+
+    s4pkg::lib::ByteBuffer dst5 = image.write();
+    std::shared_ptr<s4pkg::internal::Image> decoded =
+        imagecoder::decode(dst5, imagecoder::DST5);
+    REQUIRE(decoded != nullptr);
+
+    s4pkg::lib::ByteBuffer dxt5 =
+        imagecoder::transcode(dst5, imagecoder::DST5, imagecoder::DXT5);
+    REQUIRE(dxt5.size() == dst5.size());
+    REQUIRE(equal(imagecoder::decode(dxt5, imagecoder::DXT5)->getPixelData(),
+                  decoded->getPixelData()));
+    REQUIRE(equal(
+        imagecoder::transcode(dxt5, imagecoder::DXT5, imagecoder::DST5), dst5));
+
+    s4pkg::lib::ByteBuffer dxt1 = imagecoder::encode(
+        *decoded, imagecoder::DXT1, {imagecoder::FAST});
+    s4pkg::lib::ByteBuffer dst1 =
+        imagecoder::transcode(dxt1, imagecoder::DXT1, imagecoder::DST1);
+    REQUIRE(dst1.size() == dxt1.size());
+    REQUIRE(equal(imagecoder::decode(dst1, imagecoder::DST1)->getPixelData(),
+                  imagecoder::decode(dxt1, imagecoder::DXT1)->getPixelData()));
+    REQUIRE(equal(
+        imagecoder::transcode(dst1, imagecoder::DST1, imagecoder::DXT1), dxt1));
+
+    // The data has to be in the format it's said to be in, and complete
+    REQUIRE(imagecoder::transcode(dst5, imagecoder::DXT5, imagecoder::DST5)
+                .size() == 0);
+    REQUIRE(imagecoder::transcode(dst5, imagecoder::DST5, imagecoder::DXT1)
+                .size() == 0);
+    REQUIRE(imagecoder::transcode(s4pkg::lib::ByteBuffer(dst5.data(),
+                                                         dst5.size() - 1),
+                                  imagecoder::DST5, imagecoder::DXT5)
+                .size() == 0);
+}
+
+TEST_CASE("Test RLE decoding", "imagecoder") {
+    namespace rle = s4pkg::internal::rle;
+
+    for (bool specular : {false, true}) {
+        // An 8x8 image: a transparent block, two blocks with alpha, and a block
+        // which is opaque in RLE2, and has no specular mask in RLES
+        std::vector<uint8_t> colourEndpoints, colourIndices, alphaEndpoints,
+            alphaIndices, specularMask;
+        for (uint8_t i = 0; i < 12; i++) {
+            colourEndpoints.push_back(0x10 + i);
+            colourIndices.push_back(0x20 + i);
+        }
+        for (uint8_t i = 0; i < (specular ? 6 : 4); i++) {
+            alphaEndpoints.push_back(0x30 + i);
+        }
+        for (uint8_t i = 0; i < (specular ? 18 : 12); i++) {
+            alphaIndices.push_back(0x40 + i);
+        }
+        if (specular) {
+            specularMask.assign(32, 0x50);
+        }
+
+        std::vector<uint8_t> data;
+        auto put = [&data](uint32_t value, int size) {
+            for (int i = 0; i < size; i++) {
+                data.push_back((uint8_t)(value >> (i * 8)));
+            }
+        };
+
+        put(rle::fourcc_t::DXT5, 4);
+        put(specular ? rle::rle_version_t::RLES : rle::rle_version_t::RLE2, 4);
+        put(8, 2);
+        put(8, 2);
+        put(1, 2);
+        put(0, 2);
+
+        // The commands, then the planes in the order of the fields
+        uint32_t offset = 16 + (specular ? 24 : 20);
+        put(offset, 4);
+        offset += 6;
+        for (const std::vector<uint8_t>* plane :
+             {&colourEndpoints, &colourIndices, &alphaEndpoints,
+              &alphaIndices}) {
+            put(offset, 4);
+            offset += (uint32_t)plane->size();
+        }
+        if (specular) {
+            put(offset, 4);
+        }
+
+        put(1 << 2 | 0, 2);
+        put(2 << 2 | 1, 2);
+        put(1 << 2 | 2, 2);
+
+        for (const std::vector<uint8_t>* plane :
+             {&colourEndpoints, &colourIndices, &alphaEndpoints, &alphaIndices,
+              &specularMask}) {
+            data.insert(data.end(), plane->begin(), plane->end());
+        }
+
+        std::vector<uint8_t> expected;
+        const uint8_t transparent[] = {0x00, 0x05, 0, 0, 0, 0, 0, 0};
+        expected.insert(expected.end(), transparent, transparent + 8);
+        expected.insert(expected.end(), 8, 0);
+        if (!specular) {
+            expected[8] = expected[9] = 0xFF;
+        }
+
+        for (int j = 0; j < 3; j++) {
+            if (j == 2 && !specular) {
+                const uint8_t opaque[] = {0x00, 0x05, 0xFF, 0xFF,
+                                          0xFF, 0xFF, 0xFF, 0xFF};
+                expected.insert(expected.end(), opaque, opaque + 8);
+            } else {
+                expected.insert(expected.end(), &alphaEndpoints[j * 2],
+                                &alphaEndpoints[j * 2] + 2);
+                expected.insert(expected.end(), &alphaIndices[j * 6],
+                                &alphaIndices[j * 6] + 6);
+            }
+
+            expected.insert(expected.end(), &colourEndpoints[j * 4],
+                            &colourEndpoints[j * 4] + 4);
+            expected.insert(expected.end(), &colourIndices[j * 4],
+                            &colourIndices[j * 4] + 4);
+        }
+
+        s4pkg::internal::BinaryCursor cursor(data.data(), data.size());
+        rle::rle_file_t file = rle::readFile(cursor);
+
+        const s4pkg::lib::ByteBuffer& blocks = file.m_ddsFile.m_mainImage;
+        REQUIRE(blocks.size() == expected.size());
+        REQUIRE(memcmp(blocks.data(), expected.data(), blocks.size()) == 0);
+        REQUIRE(file.m_ddsFile.m_mipmaps.empty());
+
+        // A short plane, and more blocks than the image has
+        s4pkg::internal::BinaryCursor truncated(data.data(), data.size() - 1);
+        REQUIRE_THROWS_AS(rle::readFile(truncated), s4pkg::PackageException);
+
+        data[16 + (specular ? 24 : 20)] = 2 << 2 | 0;
+        s4pkg::internal::BinaryCursor overflowing(data.data(), data.size());
+        REQUIRE_THROWS_AS(rle::readFile(overflowing), s4pkg::PackageException);
+    }
+}
+
+TEST_CASE("Test RLE encoding", "imagecoder") {
+    namespace rle = s4pkg::internal::rle;
+    namespace imagecoder = s4pkg::internal::imagecoder;
+
+    const uint8_t transparent[16] = {0x00, 0x05, 0, 0, 0, 0, 0, 0,
+                                     0x12, 0x34, 0x56, 0x78, 1, 2, 3, 4};
+    const uint8_t opaque[16] = {0x00, 0x05, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+                                0x9A, 0xBC, 0xDE, 0xF0, 5, 6, 7, 8};
+
+    // Every index is 6 (alpha 0) with the endpoints in this order, or one of
+    // the equal endpoints
+    const uint8_t transparentToo[16] = {0x20, 0x40, 0xB6, 0x6D, 0xDB,
+                                        0xB6, 0x6D, 0xDB};
+    const uint8_t opaqueToo[16] = {0xFF, 0xFF, 0x92, 0x24, 0x49,
+                                   0x92, 0x24, 0x49};
+
+    // Interpolated values are never constant
+    const uint8_t interpolated[16] = {0x01, 0x00, 0xFF, 0xFF, 0xFF,
+                                      0xFF, 0xFF, 0xFF};
+
+    std::vector<uint8_t> blocks;
+    for (const uint8_t* block :
+         {transparent, opaque, transparentToo, opaqueToo, interpolated}) {
+        blocks.insert(blocks.end(), block, block + 16);
+    }
+
+    uint8_t classes[5];
+    rle::classifyBlocks(blocks.data(), 5, classes);
+    REQUIRE(classes[0] == rle::TRANSPARENT_BLOCK);
+    REQUIRE(classes[1] == rle::OPAQUE_BLOCK);
+    REQUIRE(classes[2] == rle::TRANSPARENT_BLOCK);
+    REQUIRE(classes[3] == rle::OPAQUE_BLOCK);
+    REQUIRE(classes[4] == rle::MIXED_BLOCK);
+
+    // A main image with a transparent run longer than a command can hold,
+    // and a mipmap mixing every kind of block
+    s4pkg::internal::dds::dds_file_t ddsFile{};
+    ddsFile.m_header.m_width = 512;
+    ddsFile.m_header.m_height = 640;
+    ddsFile.m_header.m_mipMapCount = 2;
+    ddsFile.m_header.m_pixelFormat.m_fourCC = rle::fourcc_t::DXT5;
+    ddsFile.m_mainImage = s4pkg::lib::ByteBuffer(128 * 160 * 16);
+    ddsFile.m_mipmaps.push_back(s4pkg::lib::ByteBuffer(64 * 80 * 16));
+
+    uint32_t seed = 1;
+    for (int i = 0; i < 2; i++) {
+        s4pkg::lib::ByteBuffer& surface =
+            i == 0 ? ddsFile.m_mainImage : ddsFile.m_mipmaps[0];
+
+        for (uint64_t j = 0; j < surface.size() / 16; j++) {
+            uint8_t* block = surface.data() + j * 16;
+
+            uint64_t kind = i == 0 && j < 17000 ? 0 : (j / 3 + j / 7) % 3;
+            if (kind == 2) {
+                for (int k = 0; k < 16; k++) {
+                    seed = seed * 1103515245 + 12345;
+                    block[k] = (uint8_t)(seed >> 16);
+                }
+
+                block[0] = 0x80;
+                block[1] = 0x20;
+                block[2] &= 0xF8;  // The first index is 0
+            } else {
+                memcpy(block, kind == 0 ? transparent : opaque, 16);
+                block[8] = (uint8_t)j;
+            }
+        }
+    }
+
+    s4pkg::internal::dds::dds_file_t specularMask = ddsFile;
+    for (uint64_t j = 0; j < specularMask.m_mipmaps[0].size(); j++) {
+        specularMask.m_mipmaps[0][j] = (uint8_t)(j * 3);
+    }
+
+    for (bool specular : {false, true}) {
+        for (bool withMask : {false, true}) {
+            s4pkg::lib::ByteBuffer data = rle::writeFile(
+                ddsFile,
+                specular ? rle::rle_version_t::RLES : rle::rle_version_t::RLE2,
+                withMask ? &specularMask : nullptr);
+
+            s4pkg::internal::BinaryCursor cursor(data.data(), data.size());
+            rle::rle_file_t file = rle::readFile(cursor);
+
+            REQUIRE(file.m_ddsFile.m_header.m_width == 512);
+            REQUIRE(file.m_ddsFile.m_mipmaps.size() == 1);
+
+            for (int i = 0; i < 2; i++) {
+                const s4pkg::lib::ByteBuffer& original =
+                    i == 0 ? ddsFile.m_mainImage : ddsFile.m_mipmaps[0];
+                const s4pkg::lib::ByteBuffer& decoded =
+                    i == 0 ? file.m_ddsFile.m_mainImage
+                           : file.m_ddsFile.m_mipmaps[0];
+                REQUIRE(decoded.size() == original.size());
+
+                std::vector<uint8_t> kinds(original.size() / 16);
+                rle::classifyBlocks(original.data(), kinds.size(),
+                                    kinds.data());
+
+                // Transparent blocks lose their colour, the rest is kept
+                bool kept = true;
+                for (uint64_t j = 0; j < kinds.size(); j++) {
+                    const uint8_t* a = original.data() + j * 16;
+                    const uint8_t* b = decoded.data() + j * 16;
+
+                    if (kinds[j] == rle::TRANSPARENT_BLOCK) {
+                        kept = kept && memcmp(a, b, 8) == 0 &&
+                               b[8] == (specular ? 0x00 : 0xFF);
+                    } else {
+                        kept = kept && memcmp(a, b, 16) == 0;
+                    }
+                }
+                REQUIRE(kept);
+            }
+        }
+    }
+
+    // Through the image coder, the pixels that aren't transparent are the
+    // ones DXT5 gives
+    s4pkg::lib::ByteBuffer pixels(40 * 24 * 4);
+    for (uint64_t i = 0; i < pixels.size(); i++) {
+        pixels[i] = (uint8_t)(i * 31 + (i >> 6));
+        if (i % 4 == 3) {
+            pixels[i] = i < pixels.size() / 3    ? 0x00
+                        : i < pixels.size() / 2 ? 0xFF
+                                                : pixels[i];
+        }
+    }
+
+    s4pkg::resources::ts4::DSTResource image(
+        s4pkg::ResourceType::DST_IMAGE, 0, 0, 0, s4pkg::lib::ByteBuffer());
+    image.setEncodeOptions({imagecoder::FAST});
+    image.setImage(40, 24, pixels);
+    std::shared_ptr<s4pkg::internal::Image> source =
+        imagecoder::decode(image.write(), imagecoder::DST5);
+    REQUIRE(source != nullptr);
+
+    std::shared_ptr<s4pkg::internal::Image> dxt5 = imagecoder::decode(
+        imagecoder::encode(*source, imagecoder::DXT5, {imagecoder::FAST}),
+        imagecoder::DXT5);
+
+    for (imagecoder::ImageFormat format :
+         {imagecoder::RLE2, imagecoder::RLES}) {
+        std::shared_ptr<s4pkg::internal::Image> decoded = imagecoder::decode(
+            imagecoder::encode(*source, format, {imagecoder::FAST}), format);
+        REQUIRE(decoded != nullptr);
+        REQUIRE(decoded->getWidth() == 40);
+        REQUIRE(decoded->getHeight() == 24);
+
+        const s4pkg::lib::ByteBuffer& a = decoded->getPixelData();
+        const s4pkg::lib::ByteBuffer& b = dxt5->getPixelData();
+        REQUIRE(a.size() == b.size());
+
+        bool same = true;
+        for (uint64_t i = 0; i < a.size(); i += 4) {
+            same = same && a[i + 3] == b[i + 3] &&
+                   (b[i + 3] == 0 || memcmp(&a[i], &b[i], 3) == 0);
+        }
+        REQUIRE(same);
+    }
+}
@@ -0,0 +1,190 @@
+/*
+ * Copyright (c) 2022- Gerber Lóránt Viktor
+ * Author: Gerber Lóránt Viktor <glorantv@student.elte.hu>
+ *
+ * This file is part of s4pkg.
+ *
+ * s4pkg is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#include <s4pkg/internal/mipmap.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <functional>
+#include <iostream>
+#include <vector>
+
+#include <fmt/core.h>
+
+// Compares making a mip chain level by level with the box filter kernels,
+// against resizing the full image to every level with stb_image_resize, both
+// in time, and in how far apart the levels they make are
+
+namespace mipmap = s4pkg::internal::mipmap;
+
+static int usage() {
+    std::cerr << "Usage: s4pkg_mipbench [size] [iterations]" << std::endl;
+    return 2;
+}
+
+// Something with both smooth areas and detail, like a texture
+static s4pkg::lib::ByteBuffer makeImage(uint32_t size) {
+    s4pkg::lib::ByteBuffer pixels((uint64_t)size * size * 4);
+    uint32_t noise = 0x9e3779b9;
+
+    for (uint32_t y = 0; y < size; y++) {
+        for (uint32_t x = 0; x < size; x++) {
+            noise ^= noise << 13;
+            noise ^= noise >> 17;
+            noise ^= noise << 5;
+
+            uint8_t* pixel = pixels.data() + ((uint64_t)y * size + x) * 4;
+            pixel[0] = (uint8_t)(x * 255 / size);
+            pixel[1] = (uint8_t)(y * 255 / size);
+            pixel[2] = (uint8_t)(((x / 16 + y / 16) % 2) * 200 + noise % 56);
+            pixel[3] = (uint8_t)(255 - (noise >> 24) % 32);
+        }
+    }
+
+    return pixels;
+}
+
+// Milliseconds per run, the best of the iterations
+static double measure(uint32_t iterations, const std::function<void()>& run) {
+    double best = 0;
+
+    for (uint32_t i = 0; i < iterations; i++) {
+        auto start = std::chrono::steady_clock::now();
+        run();
+        auto end = std::chrono::steady_clock::now();
+
+        double elapsed =
+            std::chrono::duration<double, std::milli>(end - start).count();
+        best = i == 0 ? elapsed : std::min(best, elapsed);
+    }
+
+    return best;
+}
+
+static std::vector<mipmap::mip_level_t> boxChain(const uint8_t* pixels,
+                                                 uint32_t size,
+                                                 mipmap::mip_kernel_t kernel) {
+    std::vector<mipmap::mip_level_t> levels;
+    levels.reserve(32);
+
+    const uint8_t* previous = pixels;
+    uint32_t previousSize = size;
+
+    while (previousSize > 1) {
+        uint32_t levelSize = previousSize / 2;
+        s4pkg::lib::ByteBuffer levelPixels((uint64_t)levelSize * levelSize * 4);
+
+        mipmap::downsample(previous, previousSize, previousSize,
+                           levelPixels.data(), kernel);
+        levels.push_back({levelSize, levelSize, levelPixels});
+
+        previous = levels.back().m_pixels.data();
+        previousSize = levelSize;
+    }
+
+    return levels;
+}
+
+static double psnr(const s4pkg::lib::ByteBuffer& a,
+                   const s4pkg::lib::ByteBuffer& b) {
+    double squaredError = 0;
+    for (uint64_t i = 0; i < a.size(); i++) {
+        double difference = (double)a[i] - (double)b[i];
+        squaredError += difference * difference;
+    }
+
+    if (squaredError == 0) {
+        return INFINITY;
+    }
+
+    return 10 * std::log10(255.0 * 255.0 * a.size() / squaredError);
+}
+
+int main(int argc, char** argv) {
+    if (argc > 3) {
+        return usage();
+    }
+
+    uint32_t size = argc > 1 ? (uint32_t)std::strtoul(argv[1], nullptr, 10)
+                             : 2048;
+    uint32_t iterations =
+        argc > 2 ? (uint32_t)std::strtoul(argv[2], nullptr, 10) : 5;
+
+    if (size < 2 || (size & (size - 1)) != 0 || iterations == 0) {
+        std::cerr << "The size has to be a power of two, at least 2"
+                  << std::endl;
+        return usage();
+    }
+
+    s4pkg::lib::ByteBuffer pixels = makeImage(size);
+
+    // Throughput is in pixels of the full image, made into a whole chain
+    double imagePixels = (double)size * size;
+
+    fmt::print("{}x{} RGBA, {} levels, best of {} runs\n\n", size, size,
+               (uint32_t)std::log2(size), iterations);
+    fmt::print("{:<24}{:>12}{:>16}{:>12}\n", "filter", "ms", "Mpixel/s",
+               "speedup");
+
+    double resampleTime = measure(iterations, [&]() {
+        mipmap::generate(pixels.data(), size, size, mipmap::RESAMPLE_FILTER);
+    });
+
+    fmt::print("{:<24}{:>12.2f}{:>16.1f}{:>12}\n", "stb_image_resize",
+               resampleTime, imagePixels / resampleTime / 1000,
+               "1.0x");
+
+    const std::pair<mipmap::mip_kernel_t, const char*> kernels[] = {
+        {mipmap::SCALAR_KERNEL, "box (scalar)"},
+        {mipmap::SSE2_KERNEL, "box (SSE2)"},
+        {mipmap::AVX2_KERNEL, "box (AVX2)"},
+    };
+
+    for (const auto& [kernel, name] : kernels) {
+        if (!mipmap::isKernelSupported(kernel)) {
+            fmt::print("{:<24}{:>12}\n", name, "unsupported");
+            continue;
+        }
+
+        double time = measure(
+            iterations, [&]() { boxChain(pixels.data(), size, kernel); });
+
+        fmt::print("{:<24}{:>12.2f}{:>16.1f}{:>11.1f}x\n", name, time,
+                   imagePixels / time / 1000, resampleTime / time);
+    }
+
+    // Quality: how close the box filter levels are to the resampled ones
+    std::vector<mipmap::mip_level_t> box =
+        mipmap::generate(pixels.data(), size, size, mipmap::BOX_FILTER);
+    std::vector<mipmap::mip_level_t> resampled =
+        mipmap::generate(pixels.data(), size, size, mipmap::RESAMPLE_FILTER);
+
+    fmt::print("\n{:<24}{:>12}\n", "level", "PSNR (dB)");
+    for (size_t i = 0; i < box.size() && i < 6; i++) {
+        fmt::print("{:<24}{:>12.2f}\n",
+                   fmt::format("{}x{}", box[i].m_width, box[i].m_height),
+                   psnr(box[i].m_pixels, resampled[i].m_pixels));
+    }
+
+    return 0;
+}
@@ -0,0 +1,96 @@
+/*
+ * Copyright (c) 2022- Gerber Lóránt Viktor
+ * Author: Gerber Lóránt Viktor <glorantv@student.elte.hu>
+ *
+ * This file is part of s4pkg.
+ *
+ * s4pkg is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <s4pkg/daemon/indexserver.h>
+#include <s4pkg/library/packagelibrary.h>
+#include <s4pkg/packageexception.h>
+
+#include <csignal>
+#include <cstdlib>
+#include <iostream>
+#include <string>
+
+// Keeps the catalogue of a mods folder in memory, and answers tools over a
+// Unix domain socket, see IndexServer and IndexClient
+
+static s4pkg::IndexServer* g_server = nullptr;
+
+static void stopServer(int) {
+    if (g_server != nullptr) {
+        g_server->stop();
+    }
+}
+
+static int usage() {
+    std::cerr << "Usage: s4pkgd <mods folder> <socket path> [--max-depth N] "
+                 "[--thumbnail-cache-mb N]"
+              << std::endl;
+
+    return 2;
+}
+
+int main(int argc, char** argv) {
+    if (argc < 3) {
+        return usage();
+    }
+
+    std::string rootPath = argv[1];
+    std::string socketPath = argv[2];
+    int32_t maxDepth = -1;
+    size_t thumbnailCacheMegabytes = 64;
+
+    for (int i = 3; i < argc; i++) {
+        std::string argument = argv[i];
+
+        if (i + 1 >= argc) {
+            return usage();
+        }
+
+        if (argument == "--max-depth") {
+            maxDepth = std::atoi(argv[++i]);
+        } else if (argument == "--thumbnail-cache-mb") {
+            thumbnailCacheMegabytes = std::strtoul(argv[++i], nullptr, 10);
+        } else {
+            return usage();
+        }
+    }
+
+    try {
+        s4pkg::PackageLibrary library(rootPath.c_str(),
+                                      s4pkg::LAST_LOADED_WINS, maxDepth);
+        s4pkg::IndexServer server(library, socketPath.c_str(),
+                                  thumbnailCacheMegabytes * 1024 * 1024);
+
+        std::cerr << "Serving " << library.getPackageCount()
+                  << " packages at " << socketPath << std::endl;
+
+        g_server = &server;
+        std::signal(SIGINT, stopServer);
+        std::signal(SIGTERM, stopServer);
+
+        server.run();
+        g_server = nullptr;
+    } catch (s4pkg::PackageException e) {
+        std::cerr << "s4pkgd: " << e.what() << std::endl;
+        return 1;
+    }
+
+    return 0;
+}